@@ -0,0 +1,165 @@
+#include "marantzuartbatch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace eu::tgcm::avrcommand;
+
+namespace
+{
+
+/**
+ * Stands for a device, with its own parser among the rest of its state
+ */
+struct Connection
+{
+	explicit Connection(std::uint32_t i) : parser(*this), id(i)
+	{
+	}
+
+	char otherState[512] = {};
+	MarantzUartParser<Connection> parser;
+	std::uint32_t id;
+	std::int64_t checksum = 0;
+
+	// same sums as Fleet
+	void powerChanged(bool power)
+	{
+		checksum += id + (power ? 1 : 0);
+	}
+	template <std::size_t N>
+	void volumeChanged(Zone<N>, int volume)
+	{
+		checksum += id + volume;
+	}
+};
+
+struct Fleet
+{
+	std::int64_t checksum = 0;
+
+	void powerChanged(std::uint32_t stream, bool power)
+	{
+		checksum += stream + (power ? 1 : 0);
+	}
+	template <std::size_t N>
+	void volumeChanged(std::uint32_t stream, Zone<N>, int volume)
+	{
+		checksum += stream + volume;
+	}
+};
+
+} // namespace
+
+/**
+ * Compares one parser per connection with a batch parser, when each wakeup delivers a few bytes for many
+ * connections, in random order
+ */
+int main(int argc, char** argv)
+{
+	std::uint32_t const nbStreams = argc > 1 ? static_cast<std::uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 5000;
+	std::uint32_t const perWakeup = argc > 2 ? static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 500;
+	int const nbWakeups = 20000;
+
+	std::string_view const replies[] = {"MV", "455\rZ2", "30\rPW", "ON\r", "SITUNER\r", "MUOFF\r"};
+	std::mt19937 random(42);
+	std::vector<std::vector<std::uint32_t>> wakeups(256);
+	for (auto& w : wakeups)
+		for (std::uint32_t i = 0; i < perWakeup; ++i)
+			w.push_back(random() % nbStreams);
+	// each stream goes through the replies in order, so that they are split across wakeups
+	std::vector<std::uint8_t> next(nbStreams, 0);
+	auto chunkOf = [&](std::uint32_t stream) {
+		auto& n = next[stream];
+		auto ret = replies[n];
+		n = static_cast<std::uint8_t>((n + 1) % (sizeof(replies) / sizeof(replies[0])));
+		return ret;
+	};
+
+	std::vector<std::unique_ptr<Connection>> connections;
+	for (std::uint32_t i = 0; i < nbStreams; ++i)
+		connections.push_back(std::make_unique<Connection>(i));
+	auto runSingle = [&] {
+		for (int i = 0; i < nbWakeups; ++i)
+		{
+			for (auto stream : wakeups[i % wakeups.size()])
+			{
+				auto data = chunkOf(stream);
+				auto& parser = connections[stream]->parser;
+				std::size_t res;
+				do
+				{
+					res = parser.parse(data, i);
+					data.remove_prefix(res);
+				} while (res > 0 && !data.empty());
+			}
+		}
+		std::int64_t checksum = 0;
+		for (auto& c : connections)
+		{
+			checksum += c->checksum;
+			c->checksum = 0;
+		}
+		return checksum;
+	};
+
+	Fleet fleet;
+	MarantzUartBatchParser<Fleet> batch(fleet);
+	for (std::uint32_t i = 0; i < nbStreams; ++i)
+		batch.addStream();
+	std::vector<MarantzUartBatchParser<Fleet>::Chunk> chunks;
+	auto runBatch = [&] {
+		for (int i = 0; i < nbWakeups; ++i)
+		{
+			chunks.clear();
+			for (auto stream : wakeups[i % wakeups.size()])
+				chunks.push_back({stream, chunkOf(stream), i});
+			batch.parse(chunks);
+		}
+		auto const checksum = fleet.checksum;
+		fleet.checksum = 0;
+		return checksum;
+	};
+
+	// alternated, best of 5 rounds, so that neither gets a warmer cache or a quieter machine. Each one
+	// carries on its streams where its previous round stopped, so both parse the same data.
+	auto time = [](auto&& run, std::int64_t& checksum) {
+		auto start = std::chrono::steady_clock::now();
+		checksum = run();
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	};
+	double single = 1e300;
+	double batched = 1e300;
+	std::int64_t singleChecksum = 0;
+	std::int64_t batchChecksum = 0;
+	std::vector<std::uint8_t> batchNext(nbStreams, 0);
+	for (int round = 0; round < 5; ++round)
+	{
+		std::int64_t checksum;
+		single = std::min(single, time(runSingle, checksum));
+		singleChecksum += checksum;
+		next.swap(batchNext);
+		batched = std::min(batched, time(runBatch, checksum));
+		batchChecksum += checksum;
+		next.swap(batchNext);
+	}
+
+	double const nbChunks = static_cast<double>(nbWakeups) * perWakeup;
+	std::printf("streams: %u, chunks per wakeup: %u\n", nbStreams, perWakeup);
+	std::printf("parser per connection: %.1f ns per chunk (checksum %lld)\n", single / nbChunks,
+	            static_cast<long long>(singleChecksum));
+	std::printf("batch parser: %.1f ns per chunk (checksum %lld)\n", batched / nbChunks,
+	            static_cast<long long>(batchChecksum));
+	if (singleChecksum != batchChecksum)
+	{
+		std::printf("checksums differ\n");
+		return 1;
+	}
+	return 0;
+}
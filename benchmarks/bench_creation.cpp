@@ -0,0 +1,129 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "AvrDevice.hpp"
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+/**
+ * Heap bytes in use, as reported by malloc_usable_size
+ */
+std::atomic<std::int64_t> heapBytes{0};
+std::atomic<std::size_t> allocationCount{0};
+
+void* allocated(void* p)
+{
+	if (p != nullptr)
+	{
+		heapBytes.fetch_add(static_cast<std::int64_t>(malloc_usable_size(p)), std::memory_order_relaxed);
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	return p;
+}
+
+void released(void* p)
+{
+	if (p != nullptr)
+		heapBytes.fetch_sub(static_cast<std::int64_t>(malloc_usable_size(p)), std::memory_order_relaxed);
+}
+} // namespace
+
+// Measured at the malloc level, as in test_allocations: Qt containers call malloc directly, and every form
+// of operator new ends up here too. Interposes glibc's allocator.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* p);
+
+void* malloc(std::size_t size)
+{
+	return allocated(__libc_malloc(size));
+}
+
+void* calloc(std::size_t n, std::size_t size)
+{
+	return allocated(__libc_calloc(n, size));
+}
+
+void* realloc(void* p, std::size_t size)
+{
+	auto const before = p == nullptr ? 0 : static_cast<std::int64_t>(malloc_usable_size(p));
+	void* ret = __libc_realloc(p, size);
+	if (ret == nullptr)
+	{
+		// p was freed by a realloc to size 0, and is left untouched by a failure
+		if (size == 0)
+			heapBytes.fetch_sub(before, std::memory_order_relaxed);
+		return ret;
+	}
+	heapBytes.fetch_add(static_cast<std::int64_t>(malloc_usable_size(ret)) - before, std::memory_order_relaxed);
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	return ret;
+}
+
+void* memalign(std::size_t alignment, std::size_t size)
+{
+	return allocated(__libc_memalign(alignment, size));
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+	return allocated(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void** ret, std::size_t alignment, std::size_t size)
+{
+	void* p = allocated(__libc_memalign(alignment, size));
+	if (p == nullptr)
+		return ENOMEM;
+	*ret = p;
+	return 0;
+}
+
+void free(void* p)
+{
+	released(p);
+	__libc_free(p);
+}
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	std::size_t const nbDevices = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+
+	std::vector<std::unique_ptr<eu::tgcm::avrremote::AvrDevice>> devices;
+	devices.reserve(nbDevices);
+	{
+		// warm up: builds the shared default source list and the meta object data
+		eu::tgcm::avrremote::AvrDevice d;
+	}
+
+	auto const bytesBefore = heapBytes.load();
+	auto const countBefore = allocationCount.load();
+	QElapsedTimer timer;
+	timer.start();
+	for (std::size_t i = 0; i < nbDevices; ++i)
+		devices.emplace_back(new eu::tgcm::avrremote::AvrDevice);
+	auto const elapsed = timer.nsecsElapsed();
+	auto const bytes = heapBytes.load() - bytesBefore;
+	auto const count = allocationCount.load() - countBefore;
+
+	std::printf("devices: %zu\n", nbDevices);
+	std::printf("construction time per device: %.1f ns\n", double(elapsed) / nbDevices);
+	std::printf("heap bytes per device, Qt containers included: %.1f\n", double(bytes) / nbDevices);
+	std::printf("allocations per device: %.2f\n", double(count) / nbDevices);
+	return 0;
+}
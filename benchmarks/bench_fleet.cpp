@@ -0,0 +1,63 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "Fleet.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using eu::tgcm::avrremote::Fleet;
+
+namespace
+{
+QByteArray configuration(int nbDevices, int renamed)
+{
+	QJsonArray devices;
+	for (int i = 0; i < nbDevices; ++i)
+	{
+		auto const address = QStringLiteral("10.%1.%2.%3").arg(i >> 16).arg((i >> 8) & 0xFF).arg(i & 0xFF);
+		auto const name = QString::fromLatin1(i == renamed ? "Renamed %1" : "Receiver %1").arg(i);
+		devices.push_back(QJsonObject{{"id", QStringLiteral("avr%1").arg(i)},
+		                              {"name", name},
+		                              {"address", address},
+		                              {"sources", QJsonArray{"Phono", "CD", "TV"}},
+		                              {"minVolume", 100}});
+	}
+	return QJsonDocument(QJsonObject{{"devices", devices}}).toJson();
+}
+
+double apply(Fleet& fleet, QByteArray const& json)
+{
+	QElapsedTimer timer;
+	timer.start();
+	std::vector<Fleet::DeviceConfig> configs;
+	if (!Fleet::parse(json, configs))
+		std::abort();
+	fleet.apply(std::move(configs));
+	return static_cast<double>(timer.nsecsElapsed()) / 1e6;
+}
+} // namespace
+
+/**
+ * Measures the initial load of a large fleet, and its reload after a single device changed
+ */
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	int const nbDevices = argc > 1 ? std::atoi(argv[1]) : 20000;
+	auto const initial = configuration(nbDevices, -1);
+	auto const changed = configuration(nbDevices, nbDevices / 2);
+
+	Fleet fleet;
+	fleet.setAutoConnect(false);
+	int touched = 0;
+	QObject::connect(&fleet, &Fleet::loaded,
+	                 [&touched](int added, int removed, int changed) { touched = added + removed + changed; });
+	std::printf("devices: %d, %d bytes\n", nbDevices, initial.size());
+	std::printf("initial load: %.1f ms\n", apply(fleet, initial));
+	std::printf("reload with one change: %.1f ms, %d device touched\n", apply(fleet, changed), touched);
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include "FleetState.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace eu::tgcm::avrremote;
+
+/**
+ * Measures the throughput of readers polling every slot of the region while a writer keeps updating it
+ */
+int main(int argc, char** argv)
+{
+	std::uint32_t const nbSlots = argc > 1 ? static_cast<std::uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1000;
+	int const nbReaders = argc > 2 ? std::atoi(argv[2]) : 4;
+	auto const duration = std::chrono::seconds(2);
+	auto const name = "/avrcontrol-bench-" + std::to_string(getpid());
+
+	fleetstate::Writer writer;
+	if (!writer.create(name.c_str(), nbSlots))
+	{
+		std::fprintf(stderr, "cannot create %s\n", name.c_str());
+		return 1;
+	}
+	fleetstate::DeviceRecord record{};
+	for (std::uint32_t i = 0; i < nbSlots; ++i)
+		writer.write(i, record);
+
+	std::atomic<bool> stop{false};
+	std::atomic<std::uint64_t> totalReads{0};
+	std::vector<std::thread> readers;
+	for (int r = 0; r < nbReaders; ++r)
+	{
+		readers.emplace_back([&]() {
+			fleetstate::Reader reader;
+			if (!reader.open(name.c_str()))
+				return;
+			std::uint64_t reads = 0;
+			fleetstate::DeviceRecord out;
+			std::int64_t checksum = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				for (std::uint32_t i = 0; i < nbSlots; ++i)
+				{
+					reader.read(i, out);
+					checksum += out.zones[0].volume.value;
+				}
+				reads += nbSlots;
+			}
+			totalReads += reads + (checksum == -1 ? 1 : 0);
+		});
+	}
+
+	std::uint64_t writes = 0;
+	auto const start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now() - start < duration)
+	{
+		for (std::uint32_t i = 0; i < nbSlots; ++i)
+		{
+			record.zones[0].volume.value = static_cast<std::int32_t>(writes % 980);
+			record.zones[0].volume.sequence += 1;
+			writer.write(i, record);
+			writes += 1;
+		}
+	}
+	stop = true;
+	for (auto& t : readers)
+		t.join();
+	auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf("slots: %u, readers: %d\n", nbSlots, nbReaders);
+	std::printf("writes: %.1f M/s\n", writes / seconds / 1e6);
+	std::printf("reads: %.1f M/s total, %.1f M/s per reader\n", totalReads / seconds / 1e6,
+	            totalReads / seconds / 1e6 / nbReaders);
+	return 0;
+}
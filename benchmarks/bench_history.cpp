@@ -0,0 +1,46 @@
+#include "PropertyHistory.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using eu::tgcm::avrremote::PropertyHistory;
+
+/**
+ * Measures the cost of recording a change and of decoding a day of changes, for volume steps about a
+ * second apart
+ */
+int main(int argc, char** argv)
+{
+	long const nbChanges = argc > 1 ? std::atol(argv[1]) : 10000000;
+	std::size_t const capacity = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+	PropertyHistory history(capacity);
+
+	std::int64_t timestamp = 0;
+	int volume = 300;
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < nbChanges; ++i)
+	{
+		timestamp += 900'000'000 + (i % 7) * 50'000'000;
+		volume += (i % 16) < 8 ? 5 : -5;
+		history.record(timestamp, volume);
+	}
+	auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	std::printf("changes: %ld, capacity: %zu bytes\n", nbChanges, history.capacity());
+	std::printf("cost per change: %.1f ns\n", elapsed / static_cast<double>(nbChanges));
+
+	long nbSamples = 0;
+	long long sum = 0;
+	start = std::chrono::steady_clock::now();
+	for (auto const& sample : history.samples(timestamp - 86'400'000'000'000, timestamp))
+	{
+		nbSamples += 1;
+		sum += sample.value;
+	}
+	elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	std::printf("changes kept: %ld (%.1f bytes per change, mean volume %.0f)\n", nbSamples,
+	            static_cast<double>(history.capacity()) / static_cast<double>(nbSamples),
+	            static_cast<double>(sum) / static_cast<double>(nbSamples));
+	std::printf("cost per change read: %.1f ns\n", elapsed / static_cast<double>(nbSamples));
+	return 0;
+}
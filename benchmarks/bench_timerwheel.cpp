@@ -0,0 +1,104 @@
+#include "TimerWheel.hpp"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+using eu::tgcm::avrremote::TimerWheel;
+
+namespace
+{
+
+struct Result
+{
+	long wakeups = 0;
+	long timeouts = 0;
+	double cpuSeconds = 0;
+};
+
+/**
+ * Runs the event loop for durationMs, counting its wakeups and the CPU time used. setup starts the timers.
+ */
+template <typename F>
+Result run(int durationMs, F&& setup)
+{
+	Result ret;
+	auto* dispatcher = QAbstractEventDispatcher::instance();
+	auto connection = QObject::connect(dispatcher, &QAbstractEventDispatcher::awake, [&ret] { ret.wakeups += 1; });
+	setup(ret.timeouts);
+	auto const start = std::clock();
+	QTimer::singleShot(durationMs, QCoreApplication::instance(), &QCoreApplication::quit);
+	QCoreApplication::exec();
+	ret.cpuSeconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+	QObject::disconnect(connection);
+	return ret;
+}
+
+void print(char const* name, Result const& r, int durationMs)
+{
+	double const seconds = durationMs / 1000.;
+	std::printf("%s: %.0f wakeups/s, %.0f timeouts/s, %.1f%% CPU\n", name, r.wakeups / seconds, r.timeouts / seconds,
+	            100. * r.cpuSeconds / seconds);
+}
+
+} // namespace
+
+/**
+ * Compares a QTimer per device with a shared TimerWheel, for a periodic timer per device (e.g. a keepalive)
+ * with random phases
+ */
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	int const nbDevices = argc > 1 ? std::atoi(argv[1]) : 5000;
+	int const periodMs = argc > 2 ? std::atoi(argv[2]) : 1000;
+	int const tickMs = argc > 3 ? std::atoi(argv[3]) : 10;
+	int const durationMs = 5000;
+
+	std::mt19937 random(42);
+	std::vector<int> phases;
+	for (int i = 0; i < nbDevices; ++i)
+		phases.push_back(static_cast<int>(random() % static_cast<unsigned>(periodMs)));
+
+	std::vector<std::unique_ptr<QTimer>> timers;
+	auto perDevice = run(durationMs, [&](long& timeouts) {
+		for (int i = 0; i < nbDevices; ++i)
+		{
+			auto* timer = new QTimer;
+			timers.emplace_back(timer);
+			QObject::connect(timer, &QTimer::timeout, [&timeouts, timer, periodMs] {
+				timeouts += 1;
+				timer->start(periodMs);
+			});
+			timer->start(phases[static_cast<std::size_t>(i)]);
+		}
+	});
+	timers.clear();
+
+	TimerWheel wheel(tickMs);
+	std::vector<std::function<void()>> heartbeats(static_cast<std::size_t>(nbDevices));
+	auto shared = run(durationMs, [&](long& timeouts) {
+		for (int i = 0; i < nbDevices; ++i)
+		{
+			auto& heartbeat = heartbeats[static_cast<std::size_t>(i)];
+			heartbeat = [&timeouts, &wheel, &heartbeat, periodMs] {
+				timeouts += 1;
+				wheel.start(periodMs, heartbeat);
+			};
+			wheel.start(phases[static_cast<std::size_t>(i)], heartbeat);
+		}
+	});
+
+	std::printf("devices: %d, period: %d ms, wheel tick: %d ms\n", nbDevices, periodMs, tickMs);
+	print("QTimer per device", perDevice, durationMs);
+	print("shared timer wheel", shared, durationMs);
+	return 0;
+}
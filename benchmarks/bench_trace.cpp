@@ -0,0 +1,55 @@
+// normally defined by the ENABLE_TRACING cmake option, the benchmark needs it either way
+#ifndef AVRCONTROL_ENABLE_TRACING
+#define AVRCONTROL_ENABLE_TRACING
+#endif
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace
+{
+constexpr int rounds = 5;
+
+/**
+ * Nanoseconds per iteration of f, run nbIterations times
+ */
+template <typename F>
+double measure(long nbIterations, F f)
+{
+	auto const start = std::chrono::steady_clock::now();
+	for (long i = 0; i < nbIterations; ++i)
+		f();
+	auto const elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	return elapsed / static_cast<double>(nbIterations);
+}
+} // namespace
+
+/**
+ * Measures the cost of a span when tracing is enabled, best of a few rounds, and the part of it spent reading
+ * the clock twice
+ */
+int main(int argc, char** argv)
+{
+	long const nbSpans = argc > 1 ? std::atol(argv[1]) : 10000000;
+	double span = std::numeric_limits<double>::max();
+	double clock = std::numeric_limits<double>::max();
+	for (int round = 0; round < rounds; ++round)
+	{
+		span = std::min(span, measure(nbSpans, [] { AVR_TRACE_SPAN("bench"); }));
+		clock = std::min(clock, measure(nbSpans, [] {
+			                 auto const start = eu::tgcm::avrremote::trace::now();
+			                 auto const end = eu::tgcm::avrremote::trace::now();
+			                 asm volatile("" : : "r"(end - start));
+		                 }));
+	}
+	std::printf("spans: %ld, best of %d rounds\n", nbSpans, rounds);
+	std::printf("cost per span: %.1f ns\n", span);
+	std::printf("of which reading the clock twice: %.1f ns\n", clock);
+	if (argc > 2)
+		eu::tgcm::avrremote::trace::writeChromeTrace(argv[2]);
+	return 0;
+}
@@ -1,11 +1,28 @@
 #include "AvrDevice.hpp"
 
+#include "AvrDeviceState.hpp"
+#include "CircuitBreaker.hpp"
+#include "Metrics.hpp"
+#include "RulesEngine.hpp"
+#include "Scene.hpp"
+#include "SeqLock.hpp"
+#include "TimerWheel.hpp"
+#include "Trace.hpp"
 #include "marantzuart.hpp"
 
 #include <QDebug>
+#include <QFutureInterface>
+#include <QLoggingCategory>
+#include <QPointer>
 #include <QTcpSocket>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <variant>
+#include <vector>
 
 namespace eu
 {
@@ -13,83 +30,355 @@ namespace tgcm
 {
 namespace avrremote
 {
+// debug output is disabled by default: building the logged QByteArrays would allocate on each read
+Q_LOGGING_CATEGORY(lcAvrDevice, "eu.tgcm.avrcontrol.device", QtInfoMsg)
+
+namespace
+{
+/**
+ * Progress of a volume ramp following curve (see AvrDevice::RampCurve), x being the elapsed fraction of
+ * the ramp duration
+ */
+double rampProgress(int curve, double x)
+{
+	switch (curve)
+	{
+		case AvrDevice::EaseIn:
+			return x * x;
+		case AvrDevice::EaseOut:
+			return 1. - (1. - x) * (1. - x);
+		case AvrDevice::EaseInOut:
+			return x * x * (3. - 2. * x);
+		default:
+			return x;
+	}
+}
+
+bool isValidZone(int zone)
+{
+	return zone >= 0 && zone < static_cast<int>(avrcommand::zoneCount);
+}
+
+/**
+ * Time for the device to reply to a command, reported to the circuit breaker if elapsed
+ */
+constexpr int replyTimeoutMs = 3000;
+} // namespace
+
 class AvrDevicePrivate
 {
 	Q_DISABLE_COPY(AvrDevicePrivate)
 	Q_DECLARE_PUBLIC(AvrDevice)
 	AvrDevice* q_ptr;
 
-	explicit AvrDevicePrivate(AvrDevice* q) : q_ptr{q}, parser_(*this)
-	{
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Phono)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::CD)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::DVD)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Bluray)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::TV)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Cable_Sat)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Multimedia)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Game)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Tuner)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::HdRadio)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux1)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux2)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux3)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux4)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux5)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux6)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Aux7)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Network)));
-		sources_.push_back(QString::fromUtf8(toCStr(avrcommand::Source::Bluetooth)));
+	explicit AvrDevicePrivate(AvrDevice* q) :
+	    q_ptr{q},
+	    sources_(defaultSources()),
+	    initPhase_{},
+	    closingSocket_{},
+	    parser_(std::in_place_type<Parser<avrcommand::MarantzDialect>>, *this)
+	{
+	}
+
+	~AvrDevicePrivate()
+	{
+		stopTimer_(rampTimer_);
+		stopTimer_(replyTimer_);
+		stopTimer_(breakerTimer_);
 	}
 
+	template <typename Dialect>
+	using Parser = avrcommand::MarantzUartParser<AvrDevicePrivate, Dialect>;
+
+	/**
+	 * Default list of sources, built once and shared (implicitly) by all devices. A device only gets its
+	 * own copy when setSources is called with a custom list.
+	 */
+	static QStringList const& defaultSources();
+
+	// members are ordered by decreasing alignment to avoid padding, there may be thousands of devices
+
+	QTcpSocket* socket_ = nullptr;
+
+	/**
+	 * Runs the timers of the device, shared with the other devices of the thread unless set by
+	 * AvrDevice::setTimerWheel. Null until the first timer.
+	 */
+	QPointer<TimerWheel> timers_;
+
 	QString name_;
 
 	QString address_;
 
-	int connectionStatus_{};
+	QStringList sources_;
 
-	RemoteIntProperty volume_{};
+	/**
+	 * Current state, only accessed from the thread of the device
+	 */
+	AvrDeviceState state_;
+
+	/**
+	 * Copy of state_, published after each change, for readers in other threads
+	 */
+	SeqLock<AvrDeviceState> published_;
+
+	/**
+	 * Where to record metrics, none if null
+	 */
+	metrics::DeviceMetrics* metrics_ = nullptr;
+
+	/**
+	 * Indexed by DeviceProperty, empty if the history is disabled
+	 */
+	std::vector<PropertyHistory> history_;
+
+	/**
+	 * Notified of the changes of properties, none if null
+	 */
+	RulesEngine* rules_ = nullptr;
+
+	/**
+	 * Commands for the zones and sources not supported are not sent
+	 */
+	Capabilities capabilities_;
+
+	/**
+	 * Time at which the last volume / mute command was sent, 0 if its echo was received since. Used to
+	 * measure round trip times.
+	 */
+	std::int64_t volumeCommandTime_ = 0;
+	std::int64_t muteCommandTime_ = 0;
+
+	/**
+	 * Smoothed round trip time of volume commands, in ns, used to pace volume ramps
+	 */
+	std::int64_t volumeLatency_ = 50'000'000;
+
+	/**
+	 * Volume ramp in progress, if active
+	 */
+	struct VolumeRamp
+	{
+		std::int64_t start = 0;    /**< monotonic time, ns */
+		std::int64_t duration = 0; /**< ns */
+		int from = 0;
+		int to = 0;
+		int sent = 0; /**< last step sent */
+		int stepIntervalMs = 0; /**< mean time between two half dB steps */
+		std::uint8_t curve = 0;
+		bool active = false;
+		bool waitingEcho = false;
+	} ramp_;
+
+	/**
+	 * Paces the steps of volume ramps, 0 if not running
+	 */
+	TimerWheel::TimerId rampTimer_ = 0;
+
+	/**
+	 * Runs from a command sent until data is received, 0 if not running
+	 */
+	TimerWheel::TimerId replyTimer_ = 0;
+
+	/**
+	 * Runs while the breaker is open, 0 if not running
+	 */
+	TimerWheel::TimerId breakerTimer_ = 0;
+
+	CircuitBreaker breaker_;
+
+	/**
+	 * Dropped frames count of the parser, when last reported to metrics_
+	 */
+	std::uint32_t reportedDroppedFrames_ = 0;
+
+	std::uint16_t port_ = 23;
+
+	bool initPhase_ : 1;
+
+	/**
+	 * Set while the device closes its own socket, which is not a connection failure
+	 */
+	bool closingSocket_ : 1;
+
+	/**
+	 * One parser type per dialect, the dialect is only checked once per chunk of data
+	 */
+	std::variant<Parser<avrcommand::MarantzDialect>, Parser<avrcommand::DenonDialect>> parser_;
 
-	RemoteStringProperty currentSource_;
-	avrcommand::Source currentSourceIndex_{};
+  public: // MarantzUartParser interface must be private
+	void maxVolumeChanged(int maxVolume);
+	void powerChanged(bool power);
+	template <std::size_t N>
+	void volumeChanged(avrcommand::Zone<N>, int volume);
+	template <std::size_t N>
+	void sourceChanged(avrcommand::Zone<N>, avrcommand::Source source);
+	template <std::size_t N>
+	void mutedChanged(avrcommand::Zone<N>, bool muted);
+	template <std::size_t N>
+	void zoneOnChanged(avrcommand::Zone<N>, bool on);
+
+	/**
+	 * Makes the current state visible to snapshot readers, must be called after each change of state_,
+	 * before notifying it
+	 */
+	void publish_()
+	{
+		published_.store(state_);
+		emit q_ptr->stateChanged();
+	}
 
-	QStringList sources_;
+  private:
+	avrcommand::Dialect dialect_() const
+	{
+		return std::visit([](auto const& parser) { return std::decay_t<decltype(parser)>::DialectType::id; },
+		                  parser_);
+	}
+
+	/**
+	 * Timestamp of the reply being dispatched
+	 */
+	std::int64_t replyTimestamp_() const
+	{
+		return std::visit([](auto const& parser) { return parser.timestamp(); }, parser_);
+	}
 
-	int minVolume_{};
+	std::uint32_t droppedFrames_() const
+	{
+		return std::visit([](auto const& parser) { return parser.droppedFrames(); }, parser_);
+	}
 
-	RemoteIntProperty maxVolume_{};
+	std::uint32_t malformedFrames_() const
+	{
+		return std::visit([](auto const& parser) { return parser.malformedFrames(); }, parser_);
+	}
 
-	QTcpSocket* socket_ = nullptr;
+	/**
+	 * Records the timestamp of the reply being dispatched, and the next sequence number, into p
+	 */
+	template <typename T>
+	void stamp_(BasicRemoteProperty<T>& p)
+	{
+		state_.sequence += 1;
+		p.setTimestamp(replyTimestamp_(), state_.sequence);
+		if (metrics_ != nullptr)
+			metrics_->framesParsed.add();
+	}
+
+	/**
+	 * Records value, set by the reply being dispatched, into the history of property, and has the rules
+	 * depending on property evaluated. Called once state_ is up to date.
+	 */
+	void propertyChanged_(DeviceProperty property, int value)
+	{
+		if (!history_.empty())
+			history_[static_cast<std::size_t>(property)].record(replyTimestamp_(), value);
+		if (rules_ != nullptr)
+			rules_->propertyChanged(q_ptr, property, state_);
+	}
+
+	/**
+	 * Sets p to value, up to date, and publishes the new state
+	 */
+	template <typename T>
+	void update_(BasicRemoteProperty<T>& p, T value)
+	{
+		p.setValue(value);
+		p.setState(RemoteProperty::UpToDate);
+		publish_();
+	}
+
+	/**
+	 * Records the round trip time of a command, if one was sent, and resets commandTime
+	 */
+	void recordRoundTrip_(std::int64_t& commandTime, metrics::Histogram metrics::DeviceMetrics::*histogram)
+	{
+		if (commandTime != 0 && metrics_ != nullptr)
+			(metrics_->*histogram).record(replyTimestamp_() - commandTime);
+		commandTime = 0;
+	}
 
-	bool standby_{};
+	/**
+	 * Writes command to the socket, which must be connected
+	 */
+	void send_(metrics::CommandType type, std::string_view command)
+	{
+		socket_->write(command.data(), static_cast<qint64>(command.size()));
+		if (metrics_ != nullptr)
+			metrics_->commandSent(type, command.size());
+		awaitReply_();
+	}
 
-	bool muted_{};
+	/**
+	 * Starts the reply timeout after a command, unless it is already running for an earlier one
+	 */
+	void awaitReply_()
+	{
+		if (replyTimer_ == 0)
+			startTimer_(replyTimer_, replyTimeoutMs, [this] { replyTimeout_(); });
+	}
 
-	bool initPhase_{};
+	/**
+	 * Closes the socket without reporting it as a failure
+	 */
+	void abortSocket_()
+	{
+		closingSocket_ = true;
+		socket_->abort();
+		closingSocket_ = false;
+	}
 
-	bool mainZoneOn_{};
+	/**
+	 * Sends the next step of the volume ramp if the curve moved by at least half a dB, schedules the next
+	 * check otherwise, or finishes the ramp once the target is reached
+	 */
+	void rampStep_();
+	void rampTimeout_();
+	void stopRamp_(bool completed);
+
+	/**
+	 * (Re)starts timer, calling callback in ms, which must reset timer. Callbacks only capture this, small
+	 * enough for std::function not to allocate.
+	 */
+	template <typename F>
+	void startTimer_(TimerWheel::TimerId& timer, int ms, F callback)
+	{
+		stopTimer_(timer);
+		if (timers_.isNull())
+			timers_ = TimerWheel::forCurrentThread();
+		timer = timers_->start(ms, std::move(callback));
+	}
 
-	bool zone2On_{};
+	void stopTimer_(TimerWheel::TimerId& timer);
 
-	avrcommand::MarantzUartParser<AvrDevicePrivate> parser_;
+	void replyTimeout_();
 
-  public: // MarantzUartParser interface must be private
-	void masterVolumeChanged(int volume);
-	void maxVolumeChanged(int maxVolume);
-	void powerChanged(bool power);
-	void sourceChanged(avrcommand::Source source);
-	void mutedChanged(bool muted);
-	void mainZoneOnChanged(bool on);
-	void zone2OnChanged(bool on);
+	/**
+	 * Reports event to the breaker, and applies the new state if it changed
+	 */
+	void breakerEvent_(CircuitBreaker::Event event);
+	void startBreakerTimer_();
+	void breakerTimeout_();
 
-  private:
-	void setVolume_(int volume);
 	void setStandby_(bool standby);
-	void setMuted_(bool mute);
-	void setMainZoneOn_(bool on);
-	void setZone2On_(bool on);
 };
 
+// a callback with a wrong signature would silently leave its replies undecoded
+static_assert(avrcommand::handledEvents<AvrDevicePrivate>() == avrcommand::allEvents,
+              "the device must handle every reply");
+
+QStringList const& AvrDevicePrivate::defaultSources()
+{
+	static QStringList const sources = [] {
+		QStringList ret;
+		ret.reserve(static_cast<int>(avrcommand::Source::Bluetooth) + 1);
+		for (int i = 0; i <= static_cast<int>(avrcommand::Source::Bluetooth); ++i)
+			ret.push_back(QString::fromUtf8(toCStr(static_cast<avrcommand::Source>(i))));
+		return ret;
+	}();
+	return sources;
+}
+
 AvrDevice::AvrDevice(QObject* parent) : QObject(parent), d_ptr(new AvrDevicePrivate(this))
 {
 }
@@ -122,66 +411,81 @@ void AvrDevice::setAddress(const QString &newAddress)
 	emit addressChanged();
 }
 
-int AvrDevice::connectionStatus() const
+int AvrDevice::port() const
 {
-	return d_ptr->connectionStatus_;
+	return d_ptr->port_;
 }
 
-void AvrDevice::setConnectionStatus(int newConnectionStatus)
+void AvrDevice::setPort(int newPort)
 {
-	if (d_ptr->connectionStatus_ == newConnectionStatus)
+	if (d_ptr->port_ == newPort || newPort <= 0 || newPort > 0xFFFF)
 		return;
-	d_ptr->connectionStatus_ = newConnectionStatus;
-	emit connectionStatusChanged();
+	d_ptr->port_ = static_cast<std::uint16_t>(newPort);
+	emit portChanged();
 }
 
-RemoteIntProperty AvrDevice::volume() const
+int AvrDevice::dialect() const
 {
-	return d_ptr->volume_;
+	return static_cast<int>(d_ptr->dialect_());
 }
 
-void AvrDevicePrivate::setMuted_(bool muted)
+void AvrDevice::setDialect(int newDialect)
 {
-	muted_ = muted;
-	emit q_ptr->mutedChanged();
+	static_assert(Denon == static_cast<int>(avrcommand::Dialect::Denon), "dialects must match");
+	if (newDialect == dialect() || newDialect < Marantz || newDialect > Denon)
+		return;
+	avrcommand::withDialect(static_cast<avrcommand::Dialect>(newDialect), [this](auto d) {
+		d_ptr->parser_.template emplace<AvrDevicePrivate::Parser<decltype(d)>>(*d_ptr);
+	});
+	d_ptr->reportedDroppedFrames_ = 0;
+	emit dialectChanged();
 }
 
-void AvrDevicePrivate::setVolume_(int newVolume)
+int AvrDevice::connectionStatus() const
 {
-	volume_.setValue(newVolume);
-	volume_.setState(RemoteProperty::UpToDate);
-	emit q_ptr->volumeChanged(newVolume);
+	return d_ptr->state_.connectionStatus;
 }
 
-void AvrDevicePrivate::setStandby_(bool newStandby)
+void AvrDevice::setConnectionStatus(int newConnectionStatus)
 {
-	standby_ = newStandby;
-	emit q_ptr->standbyChanged();
+	if (d_ptr->state_.connectionStatus == newConnectionStatus)
+		return;
+	d_ptr->state_.connectionStatus = static_cast<std::uint8_t>(newConnectionStatus);
+	d_ptr->publish_();
+	emit connectionStatusChanged();
 }
 
-void AvrDevicePrivate::setMainZoneOn_(bool newOn)
+RemoteIntProperty AvrDevice::volume() const
 {
-	mainZoneOn_ = newOn;
-	emit q_ptr->mainZoneOnChanged();
+	return d_ptr->state_.zones[0].volume;
 }
 
-void AvrDevicePrivate::setZone2On_(bool newOn)
+void AvrDevicePrivate::setStandby_(bool newStandby)
 {
-	zone2On_ = newOn;
-	emit q_ptr->zone2OnChanged();
+	state_.standby.setValue(newStandby);
+	state_.standby.setState(RemoteProperty::UpToDate);
+	publish_();
+	emit q_ptr->standbyChanged();
 }
 
-RemoteStringProperty AvrDevice::currentSource() const
+RemoteSourceProperty AvrDevice::currentSource() const
 {
-	return d_ptr->currentSource_;
+	return d_ptr->state_.zones[0].source;
 }
 
 void AvrDevice::setCurrentSource(const QString &newCurrentSource)
 {
-	d_ptr->currentSource_.setState(RemoteProperty::UpToDate);
-	d_ptr->currentSource_.setValue(newCurrentSource);
-	emit currentSourceChanged();
-	emit currentSourceIndexChanged();
+	for (std::size_t i = 0; i < avrcommand::sourceCount; ++i)
+	{
+		auto const source = static_cast<avrcommand::Source>(i);
+		if (newCurrentSource != QLatin1String(avrcommand::toCStr(source)))
+			continue;
+		d_ptr->update_(d_ptr->state_.zones[0].source, source);
+		emit currentSourceChanged();
+		emit currentSourceIndexChanged();
+		emit zoneChanged(0);
+		return;
+	}
 }
 
 const QStringList &AvrDevice::sources() const
@@ -189,6 +493,11 @@ const QStringList &AvrDevice::sources() const
 	return d_ptr->sources_;
 }
 
+const QStringList &AvrDevice::defaultSources()
+{
+	return AvrDevicePrivate::defaultSources();
+}
+
 void AvrDevice::setSources(const QStringList &newSources)
 {
 	if (d_ptr->sources_ == newSources)
@@ -199,236 +508,752 @@ void AvrDevice::setSources(const QStringList &newSources)
 
 int AvrDevice::minVolume() const
 {
-	return d_ptr->minVolume_;
+	return d_ptr->state_.minVolume;
 }
 
 void AvrDevice::setMinVolume(int newMinVolume)
 {
-	if (d_ptr->minVolume_ == newMinVolume)
+	if (d_ptr->state_.minVolume == newMinVolume)
 		return;
-	d_ptr->minVolume_ = newMinVolume;
+	d_ptr->state_.minVolume = newMinVolume;
+	d_ptr->publish_();
 	emit minVolumeChanged();
 }
 
 RemoteIntProperty AvrDevice::maxVolume() const
 {
-	return d_ptr->maxVolume_;
+	return d_ptr->state_.maxVolume;
 }
 
 void AvrDevice::setMaxVolume(int newMaxVolume)
 {
-	qDebug() << "Set max volume " << newMaxVolume;
-	d_ptr->maxVolume_.setState(RemoteProperty::UpToDate);
-	d_ptr->maxVolume_.setValue(newMaxVolume);
+	qCDebug(lcAvrDevice) << "Set max volume " << newMaxVolume;
+	d_ptr->state_.maxVolume.setState(RemoteProperty::UpToDate);
+	d_ptr->state_.maxVolume.setValue(newMaxVolume);
+	d_ptr->publish_();
 	emit maxVolumeChanged();
 }
 
 void AvrDevice::connectToDevice()
 {
+	if (d_ptr->breaker_.state() == CircuitBreaker::State::Open)
+		return; // see breakerState
 	if (d_ptr->socket_ == nullptr)
 	{
 		d_ptr->socket_ = new QTcpSocket(this);
 		d_ptr->socket_->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+		connect(d_ptr->socket_, &QTcpSocket::connected, this, &AvrDevice::handleConnected_);
+		connect(d_ptr->socket_, &QTcpSocket::readyRead, this, &AvrDevice::handleDataAvailable_);
+		connect(d_ptr->socket_, &QTcpSocket::stateChanged, this, &AvrDevice::handleSocketStateChanged_);
 	}
 	else
 	{
-		d_ptr->socket_->close();
+		d_ptr->abortSocket_();
+		if (d_ptr->metrics_ != nullptr)
+			d_ptr->metrics_->reconnects.add();
 	}
-	connect(d_ptr->socket_, &QTcpSocket::connected, this, &AvrDevice::handleConnected_);
-	connect(d_ptr->socket_, &QTcpSocket::readyRead, this, &AvrDevice::handleDataAvailable_);
-	d_ptr->socket_->connectToHost(address(), 23);
 	setConnectionStatus(Connecting);
+	d_ptr->socket_->connectToHost(address(), d_ptr->port_);
+}
+
+void AvrDevice::handleSocketStateChanged_(QAbstractSocket::SocketState state)
+{
+	// covers both a lost connection and a failed connection attempt
+	if (state == QAbstractSocket::UnconnectedState)
+	{
+		d_ptr->stopRamp_(false);
+		d_ptr->stopTimer_(d_ptr->replyTimer_);
+		auto previous = d_ptr->state_.connectionStatus;
+		if (!d_ptr->closingSocket_ && previous != Unconnected)
+			d_ptr->breakerEvent_(previous == Connected ? CircuitBreaker::Event::ConnectionLost
+			                                           : CircuitBreaker::Event::ConnectFailed);
+		setConnectionStatus(Unconnected);
+	}
 }
 
 void AvrDevice::handleConnected_()
 {
+	d_ptr->breakerEvent_(CircuitBreaker::Event::Connected);
 	setConnectionStatus(Connected);
 	d_ptr->initPhase_ = true;
-	d_ptr->volume_.setState(RemoteProperty::Reading);
-	d_ptr->socket_->write(avrcommand::queryPowerStatus);
+	d_ptr->state_.zones[0].volume.setState(RemoteProperty::Reading);
+	d_ptr->publish_();
+	d_ptr->send_(metrics::CommandType::Query, avrcommand::queryPowerStatus);
 }
 
 void AvrDevice::handleDataAvailable_()
 {
+	AVR_TRACE_SPAN("AvrDevice::handleDataAvailable_");
 	char data[1024];
-	auto nbRead = d_ptr->socket_->read(data, sizeof(data));
-	qDebug() << "Data read from socket: " << nbRead;
-	if (nbRead > 0)
+	qint64 nbRead;
+	while ((nbRead = d_ptr->socket_->read(data, sizeof(data))) > 0)
 	{
-		qDebug() << QByteArray(data, nbRead);
-		interpretResponse_(data, nbRead);
+		auto timestamp = monotonicTimestamp();
+		qCDebug(lcAvrDevice) << "Data read from socket: " << QByteArray::fromRawData(data, nbRead);
+		processResponse(data, static_cast<int>(nbRead), timestamp);
 	}
 }
 
 bool AvrDevice::standby() const
 {
-	return d_ptr->standby_;
+	return d_ptr->state_.standby.value();
 }
 
 bool AvrDevice::mainZoneOn() const
 {
-	return d_ptr->mainZoneOn_;
+	return d_ptr->state_.zones[0].on.value();
 }
 
 bool AvrDevice::zone2On() const
 {
-	return d_ptr->zone2On_;
+	return d_ptr->state_.zones[1].on.value();
 }
 
 bool AvrDevice::muted() const
 {
-	return d_ptr->muted_;
+	return d_ptr->state_.zones[0].muted.value();
 }
 
-void AvrDevice::interpretResponse_(char const* data, int len)
+int AvrDevice::zoneCount() const
 {
-	std::size_t res;
-	do
+	return static_cast<int>(avrcommand::zoneCount);
+}
+
+RemoteIntProperty AvrDevice::zoneVolume(int zone) const
+{
+	if (!isValidZone(zone))
+		return RemoteIntProperty();
+	return d_ptr->state_.zones[static_cast<std::size_t>(zone)].volume;
+}
+
+RemoteSourceProperty AvrDevice::zoneSource(int zone) const
+{
+	if (!isValidZone(zone))
+		return RemoteSourceProperty();
+	return d_ptr->state_.zones[static_cast<std::size_t>(zone)].source;
+}
+
+bool AvrDevice::zoneMuted(int zone) const
+{
+	return isValidZone(zone) && d_ptr->state_.zones[static_cast<std::size_t>(zone)].muted.value();
+}
+
+bool AvrDevice::zoneOn(int zone) const
+{
+	return isValidZone(zone) && d_ptr->state_.zones[static_cast<std::size_t>(zone)].on.value();
+}
+
+void AvrDevice::processResponse(char const* data, int len)
+{
+	processResponse(data, len, monotonicTimestamp());
+}
+
+void AvrDevice::processResponse(char const* data, int len, std::int64_t timestamp)
+{
+	AVR_TRACE_SPAN("MarantzUartParser::parse");
+	if (d_ptr->metrics_ != nullptr)
+		d_ptr->metrics_->bytesIn.add(static_cast<std::uint64_t>(len));
+	auto const malformedBefore = d_ptr->malformedFrames_();
+	auto const sequenceBefore = d_ptr->state_.sequence; // incremented by each reply parsed
+	std::visit(
+	    [&](auto& parser) {
+		    std::size_t res;
+		    do
+		    {
+			    res = parser.parse(std::string_view(data, len), timestamp);
+			    data += res;
+			    len -= res;
+		    } while (res > 0 && len > 0);
+	    },
+	    d_ptr->parser_);
+	d_ptr->stopTimer_(d_ptr->replyTimer_);
+	// the replies the parser does not decode are normal chatter, only garbage counts. A burst of it counts a
+	// few times at most, the reply timeout catches a device only sending garbage.
+	auto const parseErrors = std::min<std::uint32_t>(d_ptr->malformedFrames_() - malformedBefore, 4);
+	for (std::uint32_t i = 0; i < parseErrors; ++i)
+		d_ptr->breakerEvent_(CircuitBreaker::Event::ParseError);
+	if (d_ptr->state_.sequence != sequenceBefore)
+		d_ptr->breakerEvent_(CircuitBreaker::Event::Reply);
+	if (d_ptr->metrics_ != nullptr)
 	{
-		qDebug() << "Will parse " << QByteArray(data, len);
-		res = d_ptr->parser_.parse(std::string_view(data, len));
-		data += res;
-		len -= res;
-	} while (res > 0 && len > 0);
+		auto dropped = d_ptr->droppedFrames_();
+		d_ptr->metrics_->framesDropped.add(dropped - d_ptr->reportedDroppedFrames_);
+		d_ptr->reportedDroppedFrames_ = dropped;
+	}
 }
 
-void AvrDevicePrivate::masterVolumeChanged(int volume)
+void AvrDevice::setHistoryCapacity(int bytesPerProperty)
 {
-	setVolume_(volume);
+	d_ptr->history_.clear();
+	if (bytesPerProperty <= 0)
+		return;
+	d_ptr->history_.reserve(static_cast<std::size_t>(DeviceProperty::Count));
+	for (std::size_t i = 0; i < static_cast<std::size_t>(DeviceProperty::Count); ++i)
+		d_ptr->history_.emplace_back(static_cast<std::size_t>(bytesPerProperty));
 }
 
-void AvrDevicePrivate::mainZoneOnChanged(bool on)
+int AvrDevice::historyCapacity() const
 {
-	setMainZoneOn_(on);
+	return d_ptr->history_.empty() ? 0 : static_cast<int>(d_ptr->history_.front().capacity());
 }
 
-void AvrDevicePrivate::zone2OnChanged(bool on)
+PropertyHistory::Range AvrDevice::history(DeviceProperty property, std::int64_t from, std::int64_t to) const
 {
-	setZone2On_(on);
+	if (property >= DeviceProperty::Count || d_ptr->history_.empty())
+		return PropertyHistory::Range{};
+	return d_ptr->history_[static_cast<std::size_t>(property)].samples(from, to);
 }
 
-void AvrDevicePrivate::mutedChanged(bool muted)
+void AvrDevice::setRulesEngine(RulesEngine* rules)
 {
-	setMuted_(muted);
+	d_ptr->rules_ = rules;
 }
 
-void AvrDevice::volumeUp()
+RulesEngine* AvrDevice::rulesEngine() const
+{
+	return d_ptr->rules_;
+}
+
+void AvrDevice::setCapabilities(Capabilities const& capabilities)
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	if (d_ptr->capabilities_ == capabilities)
+		return;
+	d_ptr->capabilities_ = capabilities;
+	emit capabilitiesChanged();
+}
+
+Capabilities const& AvrDevice::capabilities() const
+{
+	return d_ptr->capabilities_;
+}
+
+bool AvrDevice::supports(DeviceProperty property, int value) const
+{
+	if (!isZoneProperty(property))
+		return property == DeviceProperty::Standby;
+	if (!d_ptr->capabilities_.hasZone(static_cast<int>(zoneOf(property))))
+		return false;
+	return zoneFieldOf(property) != ZoneField::Source || d_ptr->capabilities_.hasSource(value);
+}
+
+QList<int> AvrDevice::supportedSources() const
+{
+	QList<int> ret;
+	for (int i = 0; i < Capabilities::sourceCount; ++i)
 	{
-		d_ptr->socket_->write(avrcommand::masterVolumeUpCommand);
+		if (d_ptr->capabilities_.hasSource(i))
+			ret.push_back(i);
 	}
+	return ret;
 }
 
-void AvrDevice::volumeDown()
+void AvrDevice::setMetrics(metrics::DeviceMetrics* metrics)
+{
+	d_ptr->metrics_ = metrics;
+	d_ptr->reportedDroppedFrames_ = d_ptr->droppedFrames_();
+}
+
+void AvrDevice::setTimerWheel(TimerWheel* timers)
+{
+	d_ptr->stopRamp_(false);
+	d_ptr->stopTimer_(d_ptr->replyTimer_);
+	bool breakerTimer = d_ptr->breakerTimer_ != 0;
+	d_ptr->stopTimer_(d_ptr->breakerTimer_);
+	d_ptr->timers_ = timers;
+	if (breakerTimer)
+		d_ptr->startBreakerTimer_();
+}
+
+int AvrDevice::breakerState() const
+{
+	static_assert(BreakerHalfOpen == static_cast<int>(CircuitBreaker::State::HalfOpen), "states must match");
+	return static_cast<int>(d_ptr->breaker_.state());
+}
+
+double AvrDevice::health() const
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	return d_ptr->breaker_.health();
+}
+
+void AvrDevice::setBreakerOpenDuration(int minMs, int maxMs)
+{
+	d_ptr->breaker_.setOpenDuration(minMs * std::int64_t{1'000'000}, maxMs * std::int64_t{1'000'000});
+}
+
+template <std::size_t N>
+void AvrDevicePrivate::volumeChanged(avrcommand::Zone<N>, int volume)
+{
+	AVR_TRACE_SPAN("AvrDevicePrivate::volumeChanged");
+	stamp_(state_.zones[N].volume);
+	if constexpr (N == 0)
+	{
+		if (volumeCommandTime_ != 0)
+		{
+			// timestamps of replayed traffic may be anything
+			auto latency =
+			    std::clamp<std::int64_t>(replyTimestamp_() - volumeCommandTime_, 1'000'000, 2'000'000'000);
+			volumeLatency_ += (latency - volumeLatency_) / 4;
+		}
+		recordRoundTrip_(volumeCommandTime_, &metrics::DeviceMetrics::volumeRoundTrip);
+	}
+	update_(state_.zones[N].volume, volume);
+	propertyChanged_(zoneProperty(N, ZoneField::Volume), volume);
+	if constexpr (N == 0)
+		emit q_ptr->volumeChanged(volume);
+	emit q_ptr->zoneChanged(static_cast<int>(N));
+	if constexpr (N == 0)
 	{
-		d_ptr->socket_->write(avrcommand::masterVolumeDownCommand);
+		if (ramp_.active)
+		{
+			if (volume != ramp_.sent)
+				stopRamp_(false); // changed by someone else
+			else if (ramp_.waitingEcho)
+			{
+				ramp_.waitingEcho = false;
+				rampStep_();
+			}
+		}
 	}
 }
 
-void AvrDevice::setMainZoneOn(bool on)
+void AvrDevicePrivate::rampStep_()
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	auto now = monotonicTimestamp();
+	int volume = ramp_.to;
+	// aim at the value of the curve when the command will be applied
+	auto elapsed = now + volumeLatency_ - ramp_.start;
+	if (elapsed < ramp_.duration)
 	{
-		if (on)
-			d_ptr->socket_->write(avrcommand::mainZoneOnCommand);
-		else
-			d_ptr->socket_->write(avrcommand::mainZoneOffCommand);
+		double progress = rampProgress(ramp_.curve, static_cast<double>(elapsed) / ramp_.duration);
+		// volumes are set in half dB steps
+		volume = ramp_.from + static_cast<int>(std::lround((ramp_.to - ramp_.from) * progress / 5.)) * 5;
+	}
+	if (volume != ramp_.sent)
+	{
+		std::array<char, 6> d;
+		send_(metrics::CommandType::Volume, avrcommand::setMasterVolume(volume, d));
+		volumeCommandTime_ = now;
+		ramp_.sent = volume;
+		ramp_.waitingEcho = true;
+		// the device is considered unresponsive if the echo takes much longer than usual
+		startTimer_(rampTimer_, static_cast<int>(std::max<std::int64_t>(1000, 4 * volumeLatency_ / 1'000'000)),
+		            [this] { rampTimeout_(); });
 	}
+	else if (volume == ramp_.to)
+		stopRamp_(true);
+	else
+		startTimer_(rampTimer_, ramp_.stepIntervalMs, [this] { rampTimeout_(); });
 }
 
-void AvrDevice::setZone2On(bool on)
+void AvrDevicePrivate::rampTimeout_()
+{
+	rampTimer_ = 0;
+	if (ramp_.waitingEcho)
+		stopRamp_(false);
+	else
+		rampStep_();
+}
+
+void AvrDevicePrivate::stopRamp_(bool completed)
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	if (!ramp_.active)
+		return;
+	ramp_.active = false;
+	ramp_.waitingEcho = false;
+	stopTimer_(rampTimer_);
+	emit q_ptr->rampingVolumeChanged();
+	emit q_ptr->volumeRampFinished(completed);
+}
+
+void AvrDevicePrivate::stopTimer_(TimerWheel::TimerId& timer)
+{
+	if (timer != 0 && !timers_.isNull())
+		timers_->cancel(timer);
+	timer = 0;
+}
+
+void AvrDevicePrivate::replyTimeout_()
+{
+	replyTimer_ = 0;
+	if (state_.connectionStatus == AvrDevice::Connected)
+		breakerEvent_(CircuitBreaker::Event::ReplyTimeout);
+}
+
+void AvrDevicePrivate::breakerEvent_(CircuitBreaker::Event event)
+{
+	if (!breaker_.record(event))
+		return;
+	if (breaker_.state() == CircuitBreaker::State::Open)
 	{
-		if (on)
-			d_ptr->socket_->write(avrcommand::zone2OnCommand);
-		else
-			d_ptr->socket_->write(avrcommand::zone2OffCommand);
+		if (metrics_ != nullptr)
+			metrics_->breakerOpens.add();
+		stopTimer_(replyTimer_);
+		startBreakerTimer_();
+		// no traffic while open
+		if (socket_ != nullptr && socket_->state() != QAbstractSocket::UnconnectedState)
+		{
+			stopRamp_(false);
+			abortSocket_();
+			q_ptr->setConnectionStatus(AvrDevice::Unconnected);
+		}
+	}
+	emit q_ptr->breakerStateChanged();
+}
+
+void AvrDevicePrivate::startBreakerTimer_()
+{
+	startTimer_(breakerTimer_, static_cast<int>(breaker_.openDuration() / 1'000'000), [this] { breakerTimeout_(); });
+}
+
+void AvrDevicePrivate::breakerTimeout_()
+{
+	breakerTimer_ = 0;
+	if (!breaker_.halfOpen())
+		return;
+	emit q_ptr->breakerStateChanged();
+	q_ptr->connectToDevice(); // the probe
+}
+
+template <std::size_t N>
+void AvrDevicePrivate::zoneOnChanged(avrcommand::Zone<N>, bool on)
+{
+	AVR_TRACE_SPAN("AvrDevicePrivate::zoneOnChanged");
+	stamp_(state_.zones[N].on);
+	update_(state_.zones[N].on, on);
+	propertyChanged_(zoneProperty(N, ZoneField::On), on);
+	if constexpr (N == 0)
+		emit q_ptr->mainZoneOnChanged();
+	else if constexpr (N == 1)
+		emit q_ptr->zone2OnChanged();
+	emit q_ptr->zoneChanged(static_cast<int>(N));
+}
+
+template <std::size_t N>
+void AvrDevicePrivate::mutedChanged(avrcommand::Zone<N>, bool muted)
+{
+	AVR_TRACE_SPAN("AvrDevicePrivate::mutedChanged");
+	stamp_(state_.zones[N].muted);
+	if constexpr (N == 0)
+		recordRoundTrip_(muteCommandTime_, &metrics::DeviceMetrics::muteRoundTrip);
+	update_(state_.zones[N].muted, muted);
+	propertyChanged_(zoneProperty(N, ZoneField::Muted), muted);
+	if constexpr (N == 0)
+		emit q_ptr->mutedChanged();
+	emit q_ptr->zoneChanged(static_cast<int>(N));
+}
+
+void AvrDevice::rampVolume(int target, int durationMs, int curve)
+{
+	d_ptr->stopRamp_(false);
+	auto const volumeState = d_ptr->state_.zones[0].volume.state();
+	if (target >= 1000 || target < 0 || d_ptr->state_.connectionStatus != Connected ||
+	    (volumeState != RemoteProperty::UpToDate && volumeState != RemoteProperty::Refreshing))
+	{
+		emit volumeRampFinished(false);
+		return;
 	}
+	// the last step must be echoed back as sent, or the ramp would see it as a user intervention
+	target = avrcommand::encodedVolume(target);
+	auto& ramp = d_ptr->ramp_;
+	ramp.from = d_ptr->state_.zones[0].volume.value();
+	if (ramp.from == target)
+	{
+		emit volumeRampFinished(true);
+		return;
+	}
+	durationMs = std::max(durationMs, 0);
+	ramp.to = target;
+	ramp.start = monotonicTimestamp();
+	ramp.duration = durationMs * std::int64_t{1'000'000};
+	ramp.sent = ramp.from;
+	ramp.stepIntervalMs = std::max(10, durationMs * 5 / std::abs(target - ramp.from));
+	ramp.curve = static_cast<std::uint8_t>(curve);
+	ramp.active = true;
+	ramp.waitingEcho = false;
+	emit rampingVolumeChanged();
+	d_ptr->rampStep_();
+}
+
+void AvrDevice::cancelVolumeRamp()
+{
+	d_ptr->stopRamp_(false);
+}
+
+bool AvrDevice::rampingVolume() const
+{
+	return d_ptr->ramp_.active;
+}
+
+void AvrDevice::volumeUp()
+{
+	d_ptr->stopRamp_(false);
+	if (d_ptr->state_.connectionStatus == Connected)
+	{
+		d_ptr->send_(metrics::CommandType::Volume, avrcommand::masterVolumeUpCommand);
+	}
+}
+
+void AvrDevice::volumeDown()
+{
+	d_ptr->stopRamp_(false);
+	if (d_ptr->state_.connectionStatus == Connected)
+	{
+		d_ptr->send_(metrics::CommandType::Volume, avrcommand::masterVolumeDownCommand);
+	}
+}
+
+void AvrDevice::setMainZoneOn(bool on)
+{
+	setZoneOn(0, on);
+}
+
+void AvrDevice::setZone2On(bool on)
+{
+	setZoneOn(1, on);
+}
+
+void AvrDevice::setZoneOn(int zone, bool on)
+{
+	if (!d_ptr->capabilities_.hasZone(zone) || d_ptr->state_.connectionStatus != Connected)
+		return;
+	avrcommand::withZone(static_cast<std::size_t>(zone), [this, on](auto z) {
+		d_ptr->send_(metrics::CommandType::Zone, avrcommand::zoneOnCommand(z, on));
+	});
 }
 
 void AvrDevice::setVolume(int volume)
 {
-	if (volume >= 1000 || volume < 0)
-		return; // invalid volume
-	if (d_ptr->connectionStatus_ == Connected)
+	setZoneVolume(0, volume);
+}
+
+void AvrDevice::setZoneVolume(int zone, int volume)
+{
+	if (volume >= 1000 || volume < 0 || !d_ptr->capabilities_.hasZone(zone))
+		return; // invalid volume or zone
+	if (zone == 0)
+		d_ptr->stopRamp_(false);
+	if (d_ptr->state_.connectionStatus == Connected)
 	{
 		std::array<char, 6> d;
-		auto res = avrcommand::setMasterVolume(volume, d);
-		d_ptr->socket_->write(res.data(), res.size());
+		avrcommand::withZone(static_cast<std::size_t>(zone), [this, volume, &d](auto z) {
+			d_ptr->send_(metrics::CommandType::Volume, avrcommand::setVolume(z, volume, d));
+		});
+		// the latency used by ramps is measured on the main zone
+		if (zone == 0)
+			d_ptr->volumeCommandTime_ = monotonicTimestamp();
 	}
 }
 
 void AvrDevice::refreshVolume()
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	if (d_ptr->state_.connectionStatus == Connected)
 	{
-		d_ptr->socket_->write(avrcommand::queryMasterVolume);
-		d_ptr->socket_->write(avrcommand::queryMute);
+		d_ptr->send_(metrics::CommandType::Query, avrcommand::queryMasterVolume);
+		d_ptr->send_(metrics::CommandType::Query, avrcommand::queryMute);
 	}
 }
 
 void AvrDevice::refreshCurrentSource()
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	if (d_ptr->state_.connectionStatus == Connected)
 	{
-		d_ptr->socket_->write(avrcommand::querySourceInput);
+		d_ptr->send_(metrics::CommandType::Query, avrcommand::querySourceInput);
 	}
 }
 
 void AvrDevice::setMuted(bool muted)
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	setZoneMuted(0, muted);
+}
+
+void AvrDevice::setZoneMuted(int zone, bool muted)
+{
+	if (!d_ptr->capabilities_.hasZone(zone) || d_ptr->state_.connectionStatus != Connected)
+		return;
+	avrcommand::withZone(static_cast<std::size_t>(zone), [this, muted](auto z) {
+		d_ptr->send_(metrics::CommandType::Mute, avrcommand::muteCommand(z, muted));
+	});
+	if (zone == 0)
+		d_ptr->muteCommandTime_ = monotonicTimestamp();
+}
+
+void AvrDevice::refreshZone(int zone)
+{
+	if (!d_ptr->capabilities_.hasZone(zone) || d_ptr->state_.connectionStatus != Connected)
+		return;
+	if (zone == 0)
 	{
-		if (muted)
-			d_ptr->socket_->write(avrcommand::muteOnCommand);
-		else
-			d_ptr->socket_->write(avrcommand::muteOffCommand);
+		// the zone query of the main zone only reports its power
+		d_ptr->send_(metrics::CommandType::Query, avrcommand::queryMasterVolume);
+		d_ptr->send_(metrics::CommandType::Query, avrcommand::querySourceInput);
 	}
+	avrcommand::withZone(static_cast<std::size_t>(zone), [this](auto z) {
+		using Commands = avrcommand::ZoneCommands<decltype(z)::value>;
+		d_ptr->send_(metrics::CommandType::Query, Commands::query);
+		d_ptr->send_(metrics::CommandType::Query, Commands::queryMute);
+	});
 }
 
 void AvrDevice::setPowerStandby(bool standby)
 {
-	if (d_ptr->connectionStatus_ == Connected)
+	if (d_ptr->state_.connectionStatus == Connected)
 	{
 		if (standby)
-			d_ptr->socket_->write(avrcommand::powerOffCommand);
+			d_ptr->send_(metrics::CommandType::Power, avrcommand::powerOffCommand);
 		else
-			d_ptr->socket_->write(avrcommand::powerOnCommand);
+			d_ptr->send_(metrics::CommandType::Power, avrcommand::powerOnCommand);
 	}
 }
 
 void AvrDevice::setSource(int sourceIndex)
 {
+	setZoneSource(0, sourceIndex);
+}
+
+void AvrDevice::setZoneSource(int zone, int sourceIndex)
+{
+	if (!d_ptr->capabilities_.hasSource(sourceIndex) || !d_ptr->capabilities_.hasZone(zone))
+		return;
 	if (connectionStatus() == Connected)
 	{
-		auto cmd = avrcommand::setSource(static_cast<avrcommand::Source>(sourceIndex));
-		d_ptr->socket_->write(cmd.data(), cmd.size());
+		std::array<char, 12> d;
+		auto source = static_cast<avrcommand::Source>(sourceIndex);
+		auto cmd = avrcommand::withDialect(d_ptr->dialect_(), [zone, source, &d](auto dialect) {
+			return avrcommand::withZone(static_cast<std::size_t>(zone), [source, &d](auto z) {
+				return avrcommand::setSource<decltype(dialect)>(z, source, d);
+			});
+		});
+		if (!cmd.empty()) // not supported by the dialect
+			d_ptr->send_(metrics::CommandType::Source, cmd);
 	}
 }
 
 void AvrDevicePrivate::maxVolumeChanged(int maxVolume)
 {
+	AVR_TRACE_SPAN("AvrDevicePrivate::maxVolumeChanged");
+	stamp_(state_.maxVolume);
 	q_ptr->setMaxVolume(maxVolume);
+	propertyChanged_(DeviceProperty::MaxVolume, maxVolume);
 }
 
 void AvrDevicePrivate::powerChanged(bool power)
 {
+	AVR_TRACE_SPAN("AvrDevicePrivate::powerChanged");
+	stamp_(state_.standby);
 	setStandby_(!power);
+	propertyChanged_(DeviceProperty::Standby, !power);
 }
 
-void AvrDevicePrivate::sourceChanged(avrcommand::Source source)
+template <std::size_t N>
+void AvrDevicePrivate::sourceChanged(avrcommand::Zone<N>, avrcommand::Source source)
 {
-	currentSourceIndex_ = source;
-	q_ptr->setCurrentSource(toCStr(source));
+	AVR_TRACE_SPAN("AvrDevicePrivate::sourceChanged");
+	stamp_(state_.zones[N].source);
+	update_(state_.zones[N].source, source);
+	propertyChanged_(zoneProperty(N, ZoneField::Source), static_cast<int>(source));
+	if constexpr (N == 0)
+	{
+		emit q_ptr->currentSourceChanged();
+		emit q_ptr->currentSourceIndexChanged();
+	}
+	emit q_ptr->zoneChanged(static_cast<int>(N));
 }
 
 int AvrDevice::currentSourceIndex() const
 {
-	return static_cast<int>(d_ptr->currentSourceIndex_);
+	return static_cast<int>(d_ptr->state_.zones[0].source.value());
+}
+
+bool AvrDevice::sendCommands(std::string_view commands)
+{
+	if (d_ptr->state_.connectionStatus != Connected)
+		return false;
+	if (commands.empty())
+		return true;
+	d_ptr->socket_->write(commands.data(), static_cast<qint64>(commands.size()));
+	// handed to the system now rather than from the event loop, see DeviceGroup
+	d_ptr->socket_->flush();
+	d_ptr->awaitReply_();
+	if (d_ptr->metrics_ != nullptr)
+	{
+		while (!commands.empty())
+		{
+			auto end = commands.find('\n');
+			auto command = commands.substr(0, end == std::string_view::npos ? commands.size() : end + 1);
+			d_ptr->metrics_->commandSent(metrics::commandTypeOf(command), command.size());
+			commands.remove_prefix(command.size());
+		}
+	}
+	return true;
+}
+
+namespace
+{
+/**
+ * Applies scene to device, the returned future is resolved when the operation finishes
+ */
+QFuture<bool> applyAsync(AvrDevice* device, Scene const& scene, int timeoutMs)
+{
+	QFutureInterface<bool> promise;
+	promise.reportStarted();
+	auto* op = SceneOperation::apply(scene, {device}, timeoutMs, device);
+	QObject::connect(op, &SceneOperation::finished, [promise](bool success) mutable {
+		promise.reportResult(success);
+		promise.reportFinished();
+	});
+	// the operation is destroyed without finishing if the device is
+	QObject::connect(op, &QObject::destroyed, [promise]() mutable {
+		if (!promise.isFinished())
+		{
+			promise.reportResult(false);
+			promise.reportFinished();
+		}
+	});
+	return promise.future();
+}
+} // namespace
+
+QFuture<bool> AvrDevice::setVolumeAsync(int volume, int timeoutMs)
+{
+	return applyAsync(this, Scene().setVolume(volume), timeoutMs);
+}
+
+QFuture<bool> AvrDevice::setSourceAsync(int sourceIndex, int timeoutMs)
+{
+	return applyAsync(this, Scene().setSource(static_cast<avrcommand::Source>(sourceIndex)), timeoutMs);
+}
+
+QFuture<bool> AvrDevice::setMutedAsync(bool muted, int timeoutMs)
+{
+	return applyAsync(this, Scene().setMuted(muted), timeoutMs);
+}
+
+QFuture<bool> AvrDevice::setPowerStandbyAsync(bool standby, int timeoutMs)
+{
+	return applyAsync(this, Scene().setStandby(standby), timeoutMs);
+}
+
+QFuture<bool> AvrDevice::setMainZoneOnAsync(bool on, int timeoutMs)
+{
+	return applyAsync(this, Scene().setMainZoneOn(on), timeoutMs);
+}
+
+QFuture<bool> AvrDevice::setZone2OnAsync(bool on, int timeoutMs)
+{
+	return applyAsync(this, Scene().setZone2On(on), timeoutMs);
+}
+
+SceneOperation* AvrDevice::applyScene(QVariantList const& scene, int timeoutMs)
+{
+	Scene parsed;
+	if (!Scene::fromVariantList(scene, parsed))
+		return nullptr;
+	return SceneOperation::apply(parsed, {this}, timeoutMs, this);
+}
+
+AvrDeviceState AvrDevice::snapshot() const
+{
+	return d_ptr->published_.load();
 }
 
 } // namespace avrremote
@@ -1,11 +1,17 @@
 #ifndef AVRDEVICE_HPP
 #define AVRDEVICE_HPP
 
+#include <QFuture>
 #include <QObject>
 #include <QTcpSocket>
 
+#include "AvrDeviceState.hpp"
+#include "Capabilities.hpp"
+#include "PropertyHistory.hpp"
 #include "RemoteProperty.hpp"
 
+#include <string_view>
+
 namespace eu
 {
 namespace tgcm
@@ -14,6 +20,14 @@ namespace avrremote
 {
 
 class AvrDevicePrivate;
+class RulesEngine;
+class SceneOperation;
+class TimerWheel;
+
+namespace metrics
+{
+struct DeviceMetrics;
+}
 
 class AvrDevice : public QObject
 {
@@ -31,26 +45,66 @@ class AvrDevice : public QObject
 	};
 	Q_ENUM(ConnectionStatus)
 
+	/**
+	 * Shape of a volume ramp. Volumes are in dB, so Linear already sounds linear.
+	 */
+	enum RampCurve
+	{
+		Linear,
+		EaseIn,   /**< slow start */
+		EaseOut,  /**< slow end */
+		EaseInOut /**< slow start and end */
+	};
+	Q_ENUM(RampCurve)
+
+	/**
+	 * Protocol dialect of the device, same values as avrcommand::Dialect
+	 */
+	enum Dialect
+	{
+		Marantz,
+		Denon
+	};
+	Q_ENUM(Dialect)
+
+	/**
+	 * State of the circuit breaker of the device, same values as CircuitBreaker::State. While open, the
+	 * device does not connect, and the UI should show it as unavailable.
+	 */
+	enum BreakerState
+	{
+		BreakerClosed,
+		BreakerOpen,
+		BreakerHalfOpen /**< probing the device with a single connection */
+	};
+	Q_ENUM(BreakerState)
+
 	explicit AvrDevice(QObject *parent = nullptr);
 	~AvrDevice() override;
 
 	Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
 	Q_PROPERTY(QString address READ address WRITE setAddress NOTIFY addressChanged)
+	Q_PROPERTY(int port READ port WRITE setPort NOTIFY portChanged)
+	Q_PROPERTY(int dialect READ dialect WRITE setDialect NOTIFY dialectChanged)
 	Q_PROPERTY(int connectionStatus READ connectionStatus WRITE setConnectionStatus NOTIFY connectionStatusChanged)
+	Q_PROPERTY(int breakerState READ breakerState NOTIFY breakerStateChanged)
 
 	Q_PROPERTY(QStringList sources READ sources WRITE setSources NOTIFY sourcesChanged)
-	Q_PROPERTY(eu::tgcm::avrremote::RemoteStringProperty currentSource READ currentSource NOTIFY currentSourceChanged)
+	Q_PROPERTY(eu::tgcm::avrremote::RemoteSourceProperty currentSource READ currentSource NOTIFY currentSourceChanged)
 	Q_PROPERTY(int currentSourceIndex READ currentSourceIndex NOTIFY currentSourceIndexChanged)
 
 	Q_PROPERTY(eu::tgcm::avrremote::RemoteIntProperty volume READ volume NOTIFY volumeChanged)
 	Q_PROPERTY(int minVolume READ minVolume WRITE setMinVolume NOTIFY minVolumeChanged)
 	Q_PROPERTY(eu::tgcm::avrremote::RemoteIntProperty maxVolume READ maxVolume NOTIFY maxVolumeChanged)
+	Q_PROPERTY(bool rampingVolume READ rampingVolume NOTIFY rampingVolumeChanged)
 
 	Q_PROPERTY(bool standby READ standby NOTIFY standbyChanged)
 	Q_PROPERTY(bool muted READ muted NOTIFY mutedChanged)
 
 	Q_PROPERTY(bool mainZoneOn READ mainZoneOn NOTIFY mainZoneOnChanged)
 	Q_PROPERTY(bool zone2On READ zone2On NOTIFY zone2OnChanged)
+	Q_PROPERTY(int zoneCount READ zoneCount CONSTANT)
+	Q_PROPERTY(QList<int> supportedSources READ supportedSources NOTIFY capabilitiesChanged)
 
 	const QString &name() const;
 	void setName(const QString &newName);
@@ -58,25 +112,64 @@ class AvrDevice : public QObject
 	const QString &address() const;
 	void setAddress(const QString &newAddress);
 
+	/**
+	 * TCP port of the remote device, 23 (telnet) by default
+	 */
+	int port() const;
+	void setPort(int newPort);
+
+	/**
+	 * Protocol dialect of the remote device (see Dialect), Marantz by default. It selects the source codes
+	 * sent and recognized. Changing it drops the reply being parsed, if any.
+	 */
+	int dialect() const;
+	void setDialect(int newDialect);
+
 	int connectionStatus() const;
 	void setConnectionStatus(int newConnectionStatus);
 
+	/**
+	 * See BreakerState. The breaker opens when the health of the device gets too low, see CircuitBreaker.
+	 */
+	int breakerState() const;
+
+	/**
+	 * Health score of the device, from 0 (always failing) to 1, built from connection failures, reply
+	 * timeouts and replies not understood
+	 */
+	double health() const;
+
+	/**
+	 * Time the breaker stays open before probing the device, doubled after each failed probe up to maxMs.
+	 * 5 s and 5 min by default.
+	 */
+	void setBreakerOpenDuration(int minMs, int maxMs);
+
 	RemoteIntProperty volume() const;
 	/**
 	 * Reread the volume from the remote device
 	 */
 	Q_INVOKABLE void refreshVolume();
 
-	RemoteStringProperty currentSource() const;
+	RemoteSourceProperty currentSource() const;
 	/**
 	 * Reread the current source from the remote device
 	 */
 	Q_INVOKABLE void refreshCurrentSource();
+	/**
+	 * Sets the current source known locally, without sending any command. newCurrentSource is the name of a
+	 * source, as given by avrcommand::toCStr. Unknown names are ignored.
+	 */
 	void setCurrentSource(const QString &newCurrentSource);
 
 	const QStringList &sources() const;
 	void setSources(const QStringList &newSources);
 
+	/**
+	 * Sources of a new device: the names of the avrcommand::Source values, as given by avrcommand::toCStr
+	 */
+	static const QStringList &defaultSources();
+
 	int minVolume() const;
 	void setMinVolume(int newMinVolume);
 
@@ -90,6 +183,39 @@ class AvrDevice : public QObject
 	bool mainZoneOn() const;
 	bool zone2On() const;
 
+	/**
+	 * Zones are identified by their index, 0 for the main zone, 1 for zone 2 and 2 for zone 3. The
+	 * accessors return an unknown property for an invalid zone, the commands ignore it.
+	 */
+	int zoneCount() const;
+	Q_INVOKABLE eu::tgcm::avrremote::RemoteIntProperty zoneVolume(int zone) const;
+	Q_INVOKABLE eu::tgcm::avrremote::RemoteSourceProperty zoneSource(int zone) const;
+	Q_INVOKABLE bool zoneMuted(int zone) const;
+	Q_INVOKABLE bool zoneOn(int zone) const;
+
+	Q_INVOKABLE void setZoneOn(int zone, bool on);
+	Q_INVOKABLE void setZoneVolume(int zone, int volume);
+	Q_INVOKABLE void setZoneMuted(int zone, bool muted);
+	Q_INVOKABLE void setZoneSource(int zone, int sourceIndex);
+
+	/**
+	 * Rereads the state of zone from the remote device
+	 */
+	Q_INVOKABLE void refreshZone(int zone);
+
+	/**
+	 * Fades the volume from its current value to target in about durationMs milliseconds, following
+	 * curve (see RampCurve). Steps are sent one at a time, each one after the echo of the previous one,
+	 * and aim at the value the curve will have when the step is applied: the rate adapts to the latency
+	 * of the device, and a slow device gets fewer, larger steps. The ramp is cancelled by any other
+	 * volume command, by a volume change not caused by the ramp (e.g. the user turning the knob), or by a
+	 * disconnection. volumeRampFinished is emitted in all cases, with false right away if the current
+	 * volume has not been read yet. target is truncated the way setVolume truncates it.
+	 */
+	Q_INVOKABLE void rampVolume(int target, int durationMs, int curve = Linear);
+	Q_INVOKABLE void cancelVolumeRamp();
+	bool rampingVolume() const;
+
 	Q_INVOKABLE void volumeUp();
 	Q_INVOKABLE void volumeDown();
 	Q_INVOKABLE void setVolume(int volume);
@@ -104,8 +230,110 @@ class AvrDevice : public QObject
 	Q_INVOKABLE void setMainZoneOn(bool on);
 	Q_INVOKABLE void setZone2On(bool on);
 
+	/**
+	 * Same as the commands above, but return a future resolved to true once the device reports the
+	 * requested state, or to false if it does not within timeoutMs milliseconds, or gets disconnected. The
+	 * command is not sent if the device already is in the requested state. See also Awaitable.hpp.
+	 */
+	QFuture<bool> setVolumeAsync(int volume, int timeoutMs = 3000);
+	QFuture<bool> setSourceAsync(int sourceIndex, int timeoutMs = 3000);
+	QFuture<bool> setMutedAsync(bool muted, int timeoutMs = 3000);
+	QFuture<bool> setPowerStandbyAsync(bool standby, int timeoutMs = 3000);
+	QFuture<bool> setMainZoneOnAsync(bool on, int timeoutMs = 3000);
+	QFuture<bool> setZone2OnAsync(bool on, int timeoutMs = 3000);
+
 	int currentSourceIndex() const;
 
+	/**
+	 * Returns all the properties of the device, consistent with each other. Unlike the other accessors,
+	 * this can be called from any thread: it never blocks, and does not take any lock.
+	 */
+	AvrDeviceState snapshot() const;
+
+	/**
+	 * Feeds data received from the remote device to the parser, stamped with the current time. This is
+	 * public so that captured traffic can be replayed. Does not allocate once the device state has been
+	 * initialized.
+	 */
+	void processResponse(char const* data, int len);
+
+	/**
+	 * Same as processResponse, with the monotonic time (see monotonicTimestamp) at which data was
+	 * received. This timestamp is recorded in the properties updated by data.
+	 */
+	void processResponse(char const* data, int len, std::int64_t timestamp);
+
+	/**
+	 * Keeps the changes reported by the device for each property (see DeviceProperty) in a ring of
+	 * bytesPerProperty bytes, see PropertyHistory: the history of a device takes at most DeviceProperty::Count
+	 * times bytesPerProperty. 0, the default, disables it. Forgets the changes recorded so far.
+	 */
+	void setHistoryCapacity(int bytesPerProperty);
+	int historyCapacity() const;
+
+	/**
+	 * Changes of property with from <= timestamp <= to (monotonic times, see monotonicTimestamp), oldest
+	 * first. The range reads the history in place: it must be iterated in the thread of the device, before
+	 * the device processes more data.
+	 */
+	PropertyHistory::Range history(DeviceProperty property, std::int64_t from, std::int64_t to) const;
+
+	/**
+	 * Writes raw protocol commands, each one terminated by a new line, to the device in a single write, and
+	 * flushes the socket without waiting for the event loop. Returns false, without sending anything, if
+	 * the device is not connected. As for the commands of the setters, a device that does not reply in time
+	 * counts against the circuit breaker.
+	 */
+	bool sendCommands(std::string_view commands);
+
+	/**
+	 * Applies a scene, given as a list of maps with a single property each (e.g. [{"standby": false},
+	 * {"source": 3}, {"volume": 450}]), to this device, in the order of the list. See Scene::fromVariantList
+	 * and SceneOperation. The returned operation is owned by the device, and deletes itself once finished.
+	 * Returns null, without sending anything, if the scene is not valid.
+	 */
+	Q_INVOKABLE eu::tgcm::avrremote::SceneOperation* applyScene(QVariantList const& scene, int timeoutMs = 3000);
+
+	/**
+	 * Sets where the device records its metrics (traffic, parsed and dropped replies, commands sent, round
+	 * trip times). Null, the default, disables metrics. metrics must outlive the device, it is usually
+	 * obtained from a MetricsRegistry.
+	 */
+	void setMetrics(metrics::DeviceMetrics* metrics);
+
+	/**
+	 * Sets the wheel running the timers of the device (e.g. the steps of volume ramps), which must live in the
+	 * thread of the device. By default, the devices of a thread share TimerWheel::forCurrentThread. Cancels
+	 * a volume ramp in progress.
+	 */
+	void setTimerWheel(TimerWheel* timers);
+
+	/**
+	 * Sets the engine evaluating the rules depending on the properties of the device, which reports it each
+	 * change received from the receiver. Set by RulesEngine itself for the devices of its rules.
+	 */
+	void setRulesEngine(RulesEngine* rules);
+	RulesEngine* rulesEngine() const;
+
+	/**
+	 * What the model of the device supports, everything by default. Commands for the zones and sources it
+	 * does not support are not sent, see CapabilityCache.
+	 */
+	void setCapabilities(Capabilities const& capabilities);
+	Capabilities const& capabilities() const;
+
+	/**
+	 * Whether the device can set property to value (a source index for sources), according to its
+	 * capabilities
+	 */
+	bool supports(DeviceProperty property, int value) const;
+
+	/**
+	 * Indexes in sources of the sources the device supports. sources itself stays indexed by
+	 * avrcommand::Source.
+	 */
+	QList<int> supportedSources() const;
+
   public slots:
 	void connectToDevice();
 
@@ -113,12 +341,21 @@ class AvrDevice : public QObject
 
 	void nameChanged();
 	void addressChanged();
+	void portChanged();
+	void dialectChanged();
 	void connectionStatusChanged();
+	void breakerStateChanged();
 	void volumeChanged(int volume);
 	void currentSourceChanged();
 	void sourcesChanged();
 	void minVolumeChanged();
 	void maxVolumeChanged();
+	void rampingVolumeChanged();
+
+	/**
+	 * Emitted when a volume ramp ends, completed is false if it was cancelled
+	 */
+	void volumeRampFinished(bool completed);
 
 	void standbyChanged();
 
@@ -129,12 +366,23 @@ class AvrDevice : public QObject
 	void mainZoneOnChanged();
 	void zone2OnChanged();
 
-  private:
-	void interpretResponse_(char const* data, int len);
+	/**
+	 * Emitted after any change of the volume, source, mute or power of zone, including the main zone
+	 */
+	void zoneChanged(int zone);
+
+	/**
+	 * Emitted after any change of the state returned by snapshot, before the signal specific to the
+	 * property that changed
+	 */
+	void stateChanged();
+
+	void capabilitiesChanged();
 
   private slots:
 	void handleConnected_();
 	void handleDataAvailable_();
+	void handleSocketStateChanged_(QAbstractSocket::SocketState state);
 };
 
 } // namespace avrremote
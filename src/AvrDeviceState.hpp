@@ -0,0 +1,182 @@
+#ifndef EU_TGCM_AVRREMOTE_AVRDEVICESTATE_H
+#define EU_TGCM_AVRREMOTE_AVRDEVICESTATE_H
+
+#include "RemoteProperty.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * State of a zone of an AvrDevice. Only the volume of the main zone is reported with its max volume.
+ */
+struct ZoneState
+{
+	BasicRemoteProperty<int> volume;
+	BasicRemoteProperty<avrcommand::Source> source;
+	BasicRemoteProperty<bool> muted;
+	BasicRemoteProperty<bool> on;
+};
+
+/**
+ * State of an AvrDevice, as a trivially copyable value. Each remote property carries its own state,
+ * timestamp and sequence number.
+ */
+struct AvrDeviceState
+{
+	/**
+	 * Indexed by zone, zones[0] being the main zone
+	 */
+	std::array<ZoneState, avrcommand::zoneCount> zones;
+	BasicRemoteProperty<int> maxVolume;
+	BasicRemoteProperty<bool> standby;
+
+	/**
+	 * Sequence number of the last update of a remote property
+	 */
+	std::uint32_t sequence = 0;
+
+	std::int32_t minVolume = 0;
+
+	/**
+	 * AvrDevice::ConnectionStatus
+	 */
+	std::uint8_t connectionStatus = 0;
+};
+
+static_assert(std::is_trivially_copyable<AvrDeviceState>::value, "AvrDeviceState must be trivially copyable");
+
+/**
+ * Property of a zone, in the order of ZoneState
+ */
+enum class ZoneField : std::uint8_t
+{
+	Volume,
+	Source,
+	Muted,
+	On,
+	Count
+};
+
+constexpr std::size_t zoneFieldCount = static_cast<std::size_t>(ZoneField::Count);
+
+/**
+ * Identifies a remote property of AvrDeviceState. The properties of the zones come first, zoneFieldCount
+ * per zone, in the order of ZoneField.
+ */
+enum class DeviceProperty : std::uint8_t
+{
+	Volume,
+	Source,
+	Muted,
+	MainZoneOn,
+	Zone2Volume,
+	Zone2Source,
+	Zone2Muted,
+	Zone2On,
+	Zone3Volume,
+	Zone3Source,
+	Zone3Muted,
+	Zone3On,
+	MaxVolume,
+	Standby,
+	Count
+};
+
+static_assert(static_cast<std::size_t>(DeviceProperty::MaxVolume) == avrcommand::zoneCount * zoneFieldCount,
+              "DeviceProperty must list the properties of every zone");
+
+constexpr DeviceProperty zoneProperty(std::size_t zone, ZoneField field)
+{
+	return static_cast<DeviceProperty>(zone * zoneFieldCount + static_cast<std::size_t>(field));
+}
+
+constexpr bool isZoneProperty(DeviceProperty property)
+{
+	return property < DeviceProperty::MaxVolume;
+}
+
+/**
+ * Zone and field of property, which must be a zone property
+ */
+constexpr std::size_t zoneOf(DeviceProperty property)
+{
+	return static_cast<std::size_t>(property) / zoneFieldCount;
+}
+
+constexpr ZoneField zoneFieldOf(DeviceProperty property)
+{
+	return static_cast<ZoneField>(static_cast<std::size_t>(property) % zoneFieldCount);
+}
+
+/**
+ * Name of property, as used by Scene::fromVariantList: volume, source, muted and mainZoneOn for the main
+ * zone, zone2Volume... zone3On for the others, maxVolume and standby
+ */
+constexpr char const* toCStr(DeviceProperty property)
+{
+	constexpr char const* names[] = {"volume",      "source",      "muted",      "mainZoneOn",
+	                                 "zone2Volume", "zone2Source", "zone2Muted", "zone2On",
+	                                 "zone3Volume", "zone3Source", "zone3Muted", "zone3On",
+	                                 "maxVolume",   "standby"};
+	static_assert(sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(DeviceProperty::Count),
+	              "a name is needed for each property");
+	return property < DeviceProperty::Count ? names[static_cast<std::size_t>(property)] : "";
+}
+
+/**
+ * A remote property of any type, with its value converted to int (source index, 0/1 for booleans)
+ */
+struct PropertyValue
+{
+	RemoteProperty::State state;
+	int value;
+	std::uint32_t sequence;
+	std::int64_t timestamp;
+};
+
+template <typename T>
+constexpr PropertyValue toPropertyValue(BasicRemoteProperty<T> const& p)
+{
+	return PropertyValue{p.state(), static_cast<int>(p.value()), p.sequence(), p.timestamp()};
+}
+
+constexpr PropertyValue propertyValue(AvrDeviceState const& state, DeviceProperty property)
+{
+	if (isZoneProperty(property))
+	{
+		auto const& zone = state.zones[zoneOf(property)];
+		switch (zoneFieldOf(property))
+		{
+			case ZoneField::Volume:
+				return toPropertyValue(zone.volume);
+			case ZoneField::Source:
+				return toPropertyValue(zone.source);
+			case ZoneField::Muted:
+				return toPropertyValue(zone.muted);
+			case ZoneField::On:
+				return toPropertyValue(zone.on);
+			case ZoneField::Count:
+				break;
+		}
+	}
+	else if (property == DeviceProperty::MaxVolume)
+		return toPropertyValue(state.maxVolume);
+	else if (property == DeviceProperty::Standby)
+		return toPropertyValue(state.standby);
+	return PropertyValue{RemoteProperty::Unknown, 0, 0, 0};
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_AVRDEVICESTATE_H
@@ -0,0 +1,79 @@
+#ifndef AWAITABLE_HPP
+#define AWAITABLE_HPP
+
+#include <QFuture>
+#include <QFutureWatcher>
+
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define AVRCONTROL_HAS_COROUTINES 1
+#endif
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+#ifdef AVRCONTROL_HAS_COROUTINES
+
+/**
+ * Awaiter for a QFuture, resuming the awaiting coroutine from the event loop of the calling thread once
+ * the future is finished. Only available when compiling as C++20 or later, older code can use the QFuture
+ * directly (e.g. with a QFutureWatcher).
+ *
+ * Example, in a coroutine of any task type:
+ * @code
+ *   bool on = co_await awaitable(device.setPowerStandbyAsync(false));
+ *   if (on)
+ *       co_await awaitable(device.setVolumeAsync(450));
+ * @endcode
+ */
+template <typename T>
+class FutureAwaiter
+{
+  public:
+	explicit FutureAwaiter(QFuture<T> future) : future_(std::move(future))
+	{
+	}
+
+	bool await_ready() const
+	{
+		return future_.isFinished();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		auto* watcher = new QFutureWatcher<T>();
+		QObject::connect(watcher, &QFutureWatcherBase::finished, [watcher, handle] {
+			watcher->deleteLater();
+			handle.resume();
+		});
+		watcher->setFuture(future_);
+	}
+
+	T await_resume()
+	{
+		return future_.result();
+	}
+
+  private:
+	QFuture<T> future_;
+};
+
+template <typename T>
+FutureAwaiter<T> awaitable(QFuture<T> future)
+{
+	return FutureAwaiter<T>(std::move(future));
+}
+
+#endif
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // AWAITABLE_HPP
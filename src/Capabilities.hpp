@@ -0,0 +1,54 @@
+#ifndef EU_TGCM_AVRREMOTE_CAPABILITIES_H
+#define EU_TGCM_AVRREMOTE_CAPABILITIES_H
+
+#include "marantzuart.hpp"
+
+#include <cstdint>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * What a receiver model supports: the sources its main zone can select, and its zones. Everything is
+ * supported by default. Found by CapabilityProbe, and cached per model by CapabilityCache. The sources of
+ * the main zone are assumed to be available in the other zones.
+ */
+struct Capabilities
+{
+	static constexpr int sourceCount = static_cast<int>(avrcommand::Source::Bluetooth) + 1;
+	static constexpr std::uint32_t allSources = (std::uint32_t{1} << sourceCount) - 1;
+	static constexpr std::uint8_t allZones = (1u << avrcommand::zoneCount) - 1;
+
+	std::uint32_t sources = allSources; /**< one bit per avrcommand::Source */
+	std::uint8_t zones = allZones;      /**< one bit per zone, bit 0 being the main zone */
+
+	constexpr bool hasSource(int sourceIndex) const
+	{
+		return sourceIndex >= 0 && sourceIndex < sourceCount && (sources & (std::uint32_t{1} << sourceIndex)) != 0;
+	}
+
+	constexpr bool hasZone(int zone) const
+	{
+		return zone >= 0 && zone < static_cast<int>(avrcommand::zoneCount) && (zones & (1u << zone)) != 0;
+	}
+
+	constexpr bool operator==(Capabilities const& other) const
+	{
+		return sources == other.sources && zones == other.zones;
+	}
+
+	constexpr bool operator!=(Capabilities const& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_CAPABILITIES_H
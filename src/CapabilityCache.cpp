@@ -0,0 +1,366 @@
+#include "CapabilityCache.hpp"
+
+#include "AvrDevice.hpp"
+#include "Scene.hpp"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <string>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+/**
+ * Source named name (see toCStr(avrcommand::Source)), -1 if none
+ */
+int sourceNamed(QString const& name)
+{
+	for (int i = 0; i < Capabilities::sourceCount; ++i)
+	{
+		if (name == QLatin1String(toCStr(static_cast<avrcommand::Source>(i))))
+			return i;
+	}
+	return -1;
+}
+} // namespace
+
+CapabilityProbe::CapabilityProbe(AvrDevice* device, int timeoutMs, QObject* parent) :
+    QObject(parent), device_(device)
+{
+	capabilities_.sources = 0;
+	capabilities_.zones = 1; // the main zone
+	timeout_.setSingleShot(true);
+	timeout_.setInterval(timeoutMs);
+	connect(&timeout_, &QTimer::timeout, this, &CapabilityProbe::expire_);
+}
+
+CapabilityProbe* CapabilityProbe::start(AvrDevice* device, int timeoutMs, QObject* parent)
+{
+	auto* probe = new CapabilityProbe(device, timeoutMs, parent);
+	if (!canProbe(device))
+	{
+		QMetaObject::invokeMethod(probe, [probe] { probe->finish_(false); }, Qt::QueuedConnection);
+		return probe;
+	}
+	connect(device, &AvrDevice::stateChanged, probe, &CapabilityProbe::check_);
+	auto const state = device->snapshot();
+	std::string commands = avrcommand::ZoneCommands<1>::query;
+	commands += avrcommand::ZoneCommands<2>::query;
+	if (state.zones[0].source.state() == RemoteProperty::UpToDate)
+		probe->initialSource_ = static_cast<int>(state.zones[0].source.value());
+	else
+		commands += avrcommand::querySourceInput;
+	probe->sequence_ = state.sequence;
+	device->sendCommands(commands);
+	probe->timeout_.start();
+	return probe;
+}
+
+bool CapabilityProbe::canProbe(AvrDevice const* device)
+{
+	if (device == nullptr || device->connectionStatus() != AvrDevice::Connected)
+		return false;
+	auto const state = device->snapshot();
+	return state.standby.state() == RemoteProperty::UpToDate && !state.standby.value() &&
+	       state.zones[0].on.state() == RemoteProperty::UpToDate && state.zones[0].on.value();
+}
+
+AvrDevice* CapabilityProbe::device() const
+{
+	return device_.data();
+}
+
+Capabilities const& CapabilityProbe::capabilities() const
+{
+	return capabilities_;
+}
+
+void CapabilityProbe::next_()
+{
+	if (finished_)
+		return;
+	if (device_.isNull() || device_->connectionStatus() != AvrDevice::Connected)
+	{
+		finish_(false);
+		return;
+	}
+	auto const dialect = static_cast<avrcommand::Dialect>(device_->dialect());
+	std::string command;
+	while (++step_ < Capabilities::sourceCount)
+	{
+		command.clear();
+		// the sources the dialect cannot select are not supported
+		if (Scene::appendCommand(Scene::Target{DeviceProperty::Source, step_}, command, dialect))
+			break;
+	}
+	if (step_ >= Capabilities::sourceCount)
+	{
+		// nothing replied: the receiver was not listening, rather than supporting no source
+		finish_(capabilities_.sources != 0);
+		return;
+	}
+	sequence_ = device_->snapshot().sequence;
+	requeried_ = false;
+	device_->sendCommands(command);
+	timeout_.start();
+}
+
+void CapabilityProbe::expire_()
+{
+	if (finished_)
+		return;
+	// the zones that are not supported do not reply
+	if (step_ < 0 || device_.isNull() || device_->connectionStatus() != AvrDevice::Connected)
+	{
+		next_();
+		return;
+	}
+	if (!requeried_)
+	{
+		// some inputs (e.g. HDMI ones) take longer to switch: asks which one is selected before giving up
+		requeried_ = true;
+		querySequence_ = device_->snapshot().sequence;
+		device_->sendCommands(avrcommand::querySourceInput);
+		timeout_.start();
+		return;
+	}
+	// not even the query was answered: the other sources would not be known either
+	finish_(false);
+}
+
+void CapabilityProbe::check_()
+{
+	if (finished_)
+		return;
+	auto const state = device_->snapshot();
+	if (!canProbe(device_.data()))
+	{
+		finish_(false);
+		return;
+	}
+	auto const& source = state.zones[0].source;
+	if (step_ < 0)
+	{
+		for (std::size_t zone = 1; zone < avrcommand::zoneCount; ++zone)
+		{
+			if (state.zones[zone].on.sequence() > sequence_)
+				capabilities_.zones |= static_cast<std::uint8_t>(1u << zone);
+		}
+		if (initialSource_ < 0 && source.sequence() > sequence_)
+			initialSource_ = static_cast<int>(source.value());
+		// a zone that is not supported is only known once the timeout expires
+		if (capabilities_.zones == Capabilities::allZones && initialSource_ >= 0)
+			next_();
+		return;
+	}
+	if (source.sequence() > sequence_ && static_cast<int>(source.value()) == step_)
+	{
+		capabilities_.sources |= std::uint32_t{1} << step_;
+		next_();
+	}
+	else if (requeried_ && source.sequence() > querySequence_)
+		next_(); // another source is still selected: this one is not supported
+}
+
+void CapabilityProbe::finish_(bool success)
+{
+	if (finished_)
+		return;
+	finished_ = true;
+	timeout_.stop();
+	if (!device_.isNull())
+	{
+		disconnect(device_.data(), nullptr, this, nullptr);
+		// back to the source selected before, whether the probe went through or not
+		std::string command;
+		if (step_ >= 0 && initialSource_ >= 0 && device_->connectionStatus() == AvrDevice::Connected &&
+		    Scene::appendCommand(Scene::Target{DeviceProperty::Source, initialSource_}, command,
+		                         static_cast<avrcommand::Dialect>(device_->dialect())))
+			device_->sendCommands(command);
+	}
+	emit finished(success);
+	deleteLater();
+}
+
+CapabilityCache::CapabilityCache(QObject* parent) : QObject(parent)
+{
+}
+
+CapabilityCache::~CapabilityCache() = default;
+
+bool CapabilityCache::load(QString const& path)
+{
+	models_.clear();
+	path_ = path;
+	QFile file(path);
+	if (!file.exists())
+		return true;
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	auto const document = QJsonDocument::fromJson(file.readAll());
+	if (!document.isObject())
+		return false;
+	auto const models = document.object().value(QLatin1String("models")).toObject();
+	for (auto it = models.constBegin(); it != models.constEnd(); ++it)
+	{
+		auto const model = it.value().toObject();
+		Capabilities capabilities;
+		capabilities.sources = 0;
+		capabilities.zones = 1;
+		for (auto const& name : model.value(QLatin1String("sources")).toArray())
+		{
+			auto const source = sourceNamed(name.toString());
+			if (source >= 0)
+				capabilities.sources |= std::uint32_t{1} << source;
+		}
+		for (auto const& zone : model.value(QLatin1String("zones")).toArray())
+		{
+			if (zone.toInt() > 0 && zone.toInt() < static_cast<int>(avrcommand::zoneCount))
+				capabilities.zones |= static_cast<std::uint8_t>(1u << zone.toInt());
+		}
+		models_.insert(it.key(), capabilities);
+	}
+	return true;
+}
+
+bool CapabilityCache::contains(QString const& model) const
+{
+	return models_.contains(model);
+}
+
+Capabilities CapabilityCache::capabilities(QString const& model) const
+{
+	return models_.value(model);
+}
+
+void CapabilityCache::insert(QString const& model, Capabilities const& capabilities)
+{
+	models_.insert(model, capabilities);
+	save_();
+	// given once out of waiting_: capabilitiesChanged may apply another model
+	std::vector<AvrDevice*> devices;
+	for (auto it = waiting_.begin(); it != waiting_.end();)
+	{
+		if (it.value() != model)
+		{
+			++it;
+			continue;
+		}
+		devices.push_back(it.key());
+		disconnect(it.key(), nullptr, this, nullptr);
+		it = waiting_.erase(it);
+	}
+	for (auto* device : devices)
+		device->setCapabilities(capabilities);
+}
+
+int CapabilityCache::modelCount() const
+{
+	return models_.size();
+}
+
+void CapabilityCache::apply(AvrDevice* device, QString const& model)
+{
+	disconnect(device, nullptr, this, nullptr);
+	waiting_.remove(device);
+	if (model.isEmpty() || models_.contains(model))
+	{
+		device->setCapabilities(models_.value(model));
+		return;
+	}
+	waiting_.insert(device, model);
+	connect(device, &AvrDevice::connectionStatusChanged, this, [this, device] { probe_(waiting_.value(device)); });
+	connect(device, &AvrDevice::standbyChanged, this, [this, device] { waitingStateChanged_(device); });
+	connect(device, &AvrDevice::mainZoneOnChanged, this, [this, device] { probe_(waiting_.value(device)); });
+	connect(device, &QObject::destroyed, this, [this, device] { waiting_.remove(device); });
+	waitingStateChanged_(device);
+}
+
+int CapabilityCache::probeTimeout() const
+{
+	return probeTimeout_;
+}
+
+void CapabilityCache::setProbeTimeout(int timeoutMs)
+{
+	probeTimeout_ = timeoutMs;
+}
+
+bool CapabilityCache::save_() const
+{
+	if (path_.isEmpty())
+		return false;
+	QJsonObject models;
+	for (auto it = models_.cbegin(); it != models_.cend(); ++it)
+	{
+		QJsonArray sources;
+		for (int i = 0; i < Capabilities::sourceCount; ++i)
+		{
+			if (it->hasSource(i))
+				sources.push_back(QLatin1String(toCStr(static_cast<avrcommand::Source>(i))));
+		}
+		QJsonArray zones;
+		for (int zone = 0; zone < static_cast<int>(avrcommand::zoneCount); ++zone)
+		{
+			if (it->hasZone(zone))
+				zones.push_back(zone);
+		}
+		models.insert(it.key(), QJsonObject{{"sources", sources}, {"zones", zones}});
+	}
+	QSaveFile file(path_);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	file.write(QJsonDocument(QJsonObject{{"models", models}}).toJson());
+	return file.commit();
+}
+
+void CapabilityCache::probe_(QString const& model, AvrDevice* except)
+{
+	if (model.isEmpty() || probing_.contains(model) || models_.contains(model))
+		return;
+	for (auto it = waiting_.cbegin(); it != waiting_.cend(); ++it)
+	{
+		if (it.value() != model || it.key() == except || !CapabilityProbe::canProbe(it.key()))
+			continue;
+		probing_.insert(model);
+		auto* probe = CapabilityProbe::start(it.key(), probeTimeout_, this);
+		connect(probe, &CapabilityProbe::finished, this,
+		        [this, model, probe](bool success) { probeFinished_(model, probe, success); });
+		return;
+	}
+}
+
+void CapabilityCache::probeFinished_(QString const& model, CapabilityProbe* probe, bool success)
+{
+	probing_.remove(model);
+	if (success && probe->capabilities().sources != 0)
+		insert(model, probe->capabilities());
+	else
+		probe_(model, probe->device()); // with another device of the model, if one can be probed
+	emit probed(model, success);
+}
+
+void CapabilityCache::waitingStateChanged_(AvrDevice* device)
+{
+	auto const state = device->snapshot();
+	// the device only reads the power of the main zone when asked to
+	if (state.connectionStatus == AvrDevice::Connected && state.standby.state() == RemoteProperty::UpToDate &&
+	    !state.standby.value() && state.zones[0].on.state() != RemoteProperty::UpToDate)
+		device->sendCommands(avrcommand::queryMainZoneOn);
+	probe_(waiting_.value(device));
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,167 @@
+#ifndef EU_TGCM_AVRREMOTE_CAPABILITYCACHE_H
+#define EU_TGCM_AVRREMOTE_CAPABILITYCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+
+#include "Capabilities.hpp"
+
+#include <cstdint>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Finds the capabilities of a connected device: queries zones 2 and 3, then selects each source of its
+ * dialect in the main zone, one at a time, and finally selects the source that was selected before, also
+ * when the probe fails while the device is connected. A zone is supported if the device replies within
+ * timeoutMs. A source is supported if the device echoes its selection within timeoutMs or, when it does not,
+ * reports it selected when asked within another timeoutMs. This switches the inputs of the main zone for a
+ * few seconds: it is meant to be run once per model, see CapabilityCache.
+ *
+ * A receiver in standby, or whose main zone is off, does not reply to source selections: the probe needs
+ * the device to be on, with its main zone on (see canProbe), and fails if it is turned off meanwhile, if it
+ * does not answer which source is selected, or if no source replied.
+ */
+class CapabilityProbe : public QObject
+{
+	Q_OBJECT
+
+  public:
+	/**
+	 * Starts probing device. The probe is a child of parent, and deletes itself once finished has been
+	 * emitted, which is never done by start. It fails if the device cannot be probed, or gets disconnected.
+	 */
+	static CapabilityProbe* start(AvrDevice* device, int timeoutMs, QObject* parent = nullptr);
+
+	/**
+	 * Whether device can be probed: connected, known to be out of standby, and with its main zone known to
+	 * be on
+	 */
+	static bool canProbe(AvrDevice const* device);
+
+	AvrDevice* device() const;
+
+	/**
+	 * Capabilities found, valid once finished has been emitted with success
+	 */
+	Capabilities const& capabilities() const;
+
+  signals:
+	void finished(bool success);
+
+  private:
+	CapabilityProbe(AvrDevice* device, int timeoutMs, QObject* parent);
+
+	void next_();
+	void expire_();
+	void check_();
+	void finish_(bool success);
+
+	QPointer<AvrDevice> device_;
+	Capabilities capabilities_;
+	QTimer timeout_;
+
+	/**
+	 * -1 while probing the zones, then the source being probed
+	 */
+	int step_ = -1;
+
+	/**
+	 * Sequence of the device state when the commands of the step were sent
+	 */
+	std::uint32_t sequence_ = 0;
+
+	/**
+	 * Sequence of the device state when the selected source was asked for, valid if requeried_
+	 */
+	std::uint32_t querySequence_ = 0;
+	int initialSource_ = -1;
+	bool requeried_ = false; /**< the source of the step did not reply in time, and was asked for */
+	bool finished_ = false;
+};
+
+/**
+ * Capabilities of receiver models, saved in a JSON file such as {"models": {"SR6015": {"sources": ["CD",
+ * "TV"], "zones": [0, 1]}}}, sources being named as by toCStr(avrcommand::Source) and zones numbered from 0
+ * for the main zone. The protocol does not report the model of a receiver: it is given by the application,
+ * e.g. in the fleet configuration (see Fleet).
+ */
+class CapabilityCache : public QObject
+{
+	Q_OBJECT
+
+  public:
+	explicit CapabilityCache(QObject* parent = nullptr);
+	~CapabilityCache() override;
+
+	/**
+	 * Loads the cache saved at path, where it is saved from now on. A missing file is an empty cache.
+	 * Returns false, leaving the cache empty, if the file cannot be read or parsed.
+	 */
+	bool load(QString const& path);
+
+	bool contains(QString const& model) const;
+
+	/**
+	 * Capabilities of model, everything if it is not cached
+	 */
+	Capabilities capabilities(QString const& model) const;
+
+	/**
+	 * Caches the capabilities of model and saves the cache, then gives them to the devices waiting for them
+	 */
+	void insert(QString const& model, Capabilities const& capabilities);
+	int modelCount() const;
+
+	/**
+	 * Gives device the capabilities of model, or everything if model is empty. If model is not cached yet,
+	 * a device of this model is probed once connected and turned on (see CapabilityProbe), and the others
+	 * wait for the result. A probe that fails, or finds no source, is not cached: the model is probed
+	 * again once a device of the model connects or is turned on.
+	 */
+	void apply(AvrDevice* device, QString const& model);
+
+	/**
+	 * Time given to a device to reply to each command of a probe, 1 s by default
+	 */
+	int probeTimeout() const;
+	void setProbeTimeout(int timeoutMs);
+
+  signals:
+	void probed(QString const& model, bool success);
+
+  private:
+	bool save_() const;
+	/**
+	 * Probes model with one of its waiting devices that can be probed, other than except
+	 */
+	void probe_(QString const& model, AvrDevice* except = nullptr);
+	void waitingStateChanged_(AvrDevice* device);
+	void probeFinished_(QString const& model, CapabilityProbe* probe, bool success);
+
+	QHash<QString, Capabilities> models_;
+
+	/**
+	 * Devices waiting for the capabilities of their model
+	 */
+	QHash<AvrDevice*, QString> waiting_;
+	QSet<QString> probing_;
+	QString path_;
+	int probeTimeout_ = 1000;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_CAPABILITYCACHE_H
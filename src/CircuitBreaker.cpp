@@ -0,0 +1,98 @@
+#include "CircuitBreaker.hpp"
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+struct Outcome
+{
+	double value;  /**< 1 for a success, 0 for a failure */
+	double weight; /**< how far the health moves towards value */
+};
+
+/**
+ * A failed connection weighs much more than a reply: a device that cannot be reached at all must open the
+ * breaker after a couple of attempts, while a few garbled replies among many good ones must not
+ */
+Outcome outcome(CircuitBreaker::Event event)
+{
+	switch (event)
+	{
+		case CircuitBreaker::Event::Connected:
+			return {1., 0.3};
+		case CircuitBreaker::Event::ConnectFailed:
+			return {0., 0.5};
+		case CircuitBreaker::Event::ConnectionLost:
+			return {0., 0.3};
+		case CircuitBreaker::Event::Reply:
+			return {1., 0.05};
+		case CircuitBreaker::Event::ReplyTimeout:
+			return {0., 0.3};
+		case CircuitBreaker::Event::ParseError:
+			return {0., 0.05};
+	}
+	return {1., 0.};
+}
+
+bool isFailure(CircuitBreaker::Event event)
+{
+	return event == CircuitBreaker::Event::ConnectFailed || event == CircuitBreaker::Event::ConnectionLost ||
+	       event == CircuitBreaker::Event::ReplyTimeout;
+}
+} // namespace
+
+void CircuitBreaker::setOpenDuration(std::int64_t minimum, std::int64_t maximum) noexcept
+{
+	minOpenDuration_ = minimum;
+	maxOpenDuration_ = std::max(minimum, maximum);
+	// the backoff only grows while the breaker is not closed
+	openDuration_ = state_ == State::Closed ? minOpenDuration_
+	                                        : std::clamp(openDuration_, minOpenDuration_, maxOpenDuration_);
+}
+
+bool CircuitBreaker::record(Event event) noexcept
+{
+	if (state_ == State::Open)
+		return false;
+	auto o = outcome(event);
+	health_ += o.weight * (o.value - health_);
+	if (state_ == State::HalfOpen)
+	{
+		if (event == Event::Reply)
+		{
+			// the probe went through, give the device some slack
+			health_ = std::max(health_, (1. + threshold_) / 2.);
+			openDuration_ = minOpenDuration_;
+			state_ = State::Closed;
+			return true;
+		}
+		if (!isFailure(event))
+			return false;
+		openDuration_ = std::min(openDuration_ * 2, maxOpenDuration_);
+		state_ = State::Open;
+		return true;
+	}
+	if (health_ >= threshold_)
+		return false;
+	state_ = State::Open;
+	return true;
+}
+
+bool CircuitBreaker::halfOpen() noexcept
+{
+	if (state_ != State::Open)
+		return false;
+	state_ = State::HalfOpen;
+	return true;
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,99 @@
+#ifndef EU_TGCM_AVRREMOTE_CIRCUITBREAKER_H
+#define EU_TGCM_AVRREMOTE_CIRCUITBREAKER_H
+
+#include <cstdint>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * Decides whether a device may use the network, from a health score between 0 (always failing) and 1 (healthy).
+ * Each event moves the score towards 0 or 1, by a weight depending on the event: the score is an exponential
+ * moving average, where recent events count more.
+ *
+ * - Closed: normal traffic. Opens when the health falls below the threshold.
+ * - Open: no traffic at all, not even connection attempts, for the open duration.
+ * - HalfOpen: a single probe connection is allowed. The first reply closes the breaker, a failure opens it
+ *   again for twice as long (up to the maximum open duration).
+ *
+ * The breaker does not measure time: its owner calls halfOpen once openDuration has elapsed.
+ */
+class CircuitBreaker
+{
+  public:
+	enum class State : std::uint8_t
+	{
+		Closed,
+		Open,
+		HalfOpen
+	};
+
+	enum class Event : std::uint8_t
+	{
+		Connected,
+		ConnectFailed,
+		ConnectionLost,
+		Reply,        /**< data received from the device */
+		ReplyTimeout, /**< no data received in time after a command */
+		ParseError    /**< garbage received, see MarantzUartParser::malformedFrames */
+	};
+
+	State state() const noexcept
+	{
+		return state_;
+	}
+
+	double health() const noexcept
+	{
+		return health_;
+	}
+
+	/**
+	 * Open duration, ns. Grows with each failed probe, back to the minimum once closed.
+	 */
+	std::int64_t openDuration() const noexcept
+	{
+		return openDuration_;
+	}
+
+	/**
+	 * Open duration after the breaker was closed, and its maximum, ns
+	 */
+	void setOpenDuration(std::int64_t minimum, std::int64_t maximum) noexcept;
+
+	/**
+	 * Health below which the breaker opens
+	 */
+	void setThreshold(double threshold) noexcept
+	{
+		threshold_ = threshold;
+	}
+
+	/**
+	 * Updates the health with event, returns true if the state changed. Events are ignored while open.
+	 */
+	bool record(Event event) noexcept;
+
+	/**
+	 * Open to half open, returns false if not open
+	 */
+	bool halfOpen() noexcept;
+
+  private:
+	double health_ = 1.;
+	double threshold_ = 0.3;
+	std::int64_t minOpenDuration_ = 5'000'000'000;
+	std::int64_t maxOpenDuration_ = 300'000'000'000;
+	std::int64_t openDuration_ = minOpenDuration_;
+	State state_ = State::Closed;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_CIRCUITBREAKER_H
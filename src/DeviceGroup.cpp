@@ -0,0 +1,395 @@
+#include "DeviceGroup.hpp"
+
+#include "AvrDevice.hpp"
+#include "Scene.hpp"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+constexpr std::array<DeviceProperty, 4> groupProperties{DeviceProperty::Volume, DeviceProperty::Muted,
+                                                        DeviceProperty::Source, DeviceProperty::Standby};
+constexpr std::size_t volumeProperty = 0;
+constexpr std::size_t mutedProperty = 1;
+constexpr std::size_t sourceProperty = 2;
+constexpr std::size_t standbyProperty = 3;
+
+constexpr std::uint8_t bitOf(std::size_t property)
+{
+	return static_cast<std::uint8_t>(1u << property);
+}
+} // namespace
+
+DeviceGroup::DeviceGroup(QObject* parent) : QObject(parent)
+{
+	static_assert(groupProperties.size() == propertyCount, "one bit per property");
+}
+
+DeviceGroup::~DeviceGroup()
+{
+	if (expiryTimer_ != 0 && !timers_.isNull())
+		timers_->cancel(expiryTimer_);
+}
+
+void DeviceGroup::addMember(AvrDevice* device, int volumeOffset)
+{
+	if (device == nullptr || find_(device) != members_.end())
+		return;
+	Member member;
+	member.device = device;
+	member.volumeOffset = volumeOffset;
+	auto const state = device->snapshot();
+	for (std::size_t p = 0; p < propertyCount; ++p)
+		member.seen[p] = propertyValue(state, groupProperties[p]);
+	// brought to the state of the group at once
+	member.dirty = state.connectionStatus == AvrDevice::Connected ? hasTarget_ : 0;
+	members_.push_back(std::move(member));
+	connect(device, &AvrDevice::stateChanged, this, [this, device] { handleStateChanged_(device); });
+	connect(device, &QObject::destroyed, this, [this, device] { removeMember(device); });
+	if (members_.back().dirty != 0)
+		scheduleFlush_();
+}
+
+void DeviceGroup::removeMember(AvrDevice* device)
+{
+	auto member = find_(device);
+	if (member == members_.end())
+		return;
+	for (std::size_t p = 0; p < propertyCount; ++p)
+	{
+		if ((member->pending & bitOf(p)) != 0)
+			abandon_(*member, p);
+	}
+	members_.erase(member);
+	disconnect(device, nullptr, this, nullptr);
+}
+
+QList<AvrDevice*> DeviceGroup::members() const
+{
+	QList<AvrDevice*> ret;
+	ret.reserve(static_cast<int>(members_.size()));
+	for (auto const& m : members_)
+		ret.push_back(m.device);
+	return ret;
+}
+
+int DeviceGroup::volumeOffset(AvrDevice* device) const
+{
+	auto member = std::find_if(members_.cbegin(), members_.cend(), [device](Member const& m) {
+		return m.device == device;
+	});
+	return member == members_.cend() ? 0 : member->volumeOffset;
+}
+
+void DeviceGroup::setVolumeOffset(AvrDevice* device, int volumeOffset)
+{
+	auto member = find_(device);
+	if (member == members_.end() || member->volumeOffset == volumeOffset)
+		return;
+	member->volumeOffset = volumeOffset;
+	if ((hasTarget_ & bitOf(volumeProperty)) == 0)
+		return;
+	member->dirty |= bitOf(volumeProperty);
+	scheduleFlush_();
+}
+
+bool DeviceGroup::follow() const
+{
+	return follow_;
+}
+
+void DeviceGroup::setFollow(bool follow)
+{
+	follow_ = follow;
+}
+
+int DeviceGroup::echoTimeoutMs() const
+{
+	return echoTimeoutMs_;
+}
+
+void DeviceGroup::setEchoTimeoutMs(int echoTimeoutMs)
+{
+	echoTimeoutMs_ = std::max(echoTimeoutMs, 1);
+}
+
+int DeviceGroup::volume() const
+{
+	return (hasTarget_ & bitOf(volumeProperty)) != 0 ? target_[volumeProperty] : -1;
+}
+
+void DeviceGroup::setVolume(int volume)
+{
+	if (volume < 0 || volume >= 1000)
+		return; // invalid volume
+	set_(volumeProperty, volume, nullptr);
+}
+
+void DeviceGroup::setMuted(bool muted)
+{
+	set_(mutedProperty, muted ? 1 : 0, nullptr);
+}
+
+void DeviceGroup::setSource(int sourceIndex)
+{
+	if (sourceIndex < 0 || sourceIndex > static_cast<int>(avrcommand::Source::Bluetooth))
+		return;
+	set_(sourceProperty, sourceIndex, nullptr);
+}
+
+void DeviceGroup::setPowerStandby(bool standby)
+{
+	set_(standbyProperty, standby ? 1 : 0, nullptr);
+}
+
+metrics::Histogram const& DeviceGroup::writeSkew() const
+{
+	return writeSkew_;
+}
+
+metrics::Histogram const& DeviceGroup::replySkew() const
+{
+	return replySkew_;
+}
+
+std::uint64_t DeviceGroup::abandonedCommands() const
+{
+	return abandoned_;
+}
+
+std::vector<DeviceGroup::Member>::iterator DeviceGroup::find_(AvrDevice* device)
+{
+	return std::find_if(members_.begin(), members_.end(), [device](Member const& m) { return m.device == device; });
+}
+
+void DeviceGroup::set_(std::size_t property, int value, Member const* origin)
+{
+	target_[property] = value;
+	hasTarget_ |= bitOf(property);
+	for (auto& m : members_)
+	{
+		if (&m != origin)
+			m.dirty |= bitOf(property);
+	}
+	scheduleFlush_();
+}
+
+void DeviceGroup::scheduleFlush_()
+{
+	if (flushScheduled_)
+		return;
+	flushScheduled_ = true;
+	QMetaObject::invokeMethod(this, &DeviceGroup::flush_, Qt::QueuedConnection);
+}
+
+void DeviceGroup::flush_()
+{
+	flushScheduled_ = false;
+	// formats the commands of all the members before writing any, so that the writes follow each other closely
+	QVarLengthArray<std::uint8_t, 16> writing(static_cast<int>(members_.size()));
+	bool anyCommand = false;
+	for (std::size_t i = 0; i < members_.size(); ++i)
+	{
+		auto& m = members_[i];
+		m.commands.clear();
+		writing[static_cast<int>(i)] = 0;
+		if (m.dirty == 0)
+			continue;
+		auto const state = m.device->snapshot();
+		auto const dialect = static_cast<avrcommand::Dialect>(m.device->dialect());
+		for (std::size_t p = 0; p < propertyCount; ++p)
+		{
+			if ((m.dirty & bitOf(p)) == 0)
+				continue;
+			auto const value = memberValue_(m, p, state);
+			auto const current = propertyValue(state, groupProperties[p]);
+			if (current.state == RemoteProperty::UpToDate && current.value == value && m.inFlight[p] == 0)
+				continue; // already there
+			if (!m.device->supports(groupProperties[p], value) ||
+			    !Scene::appendCommand(Scene::Target{groupProperties[p], value}, m.commands, dialect))
+				continue;
+			m.sentValue[p] = value;
+			writing[static_cast<int>(i)] |= bitOf(p);
+			anyCommand = true;
+		}
+		// a member that is not connected is brought to the state of the group once connected
+		m.dirty = 0;
+	}
+	if (!anyCommand)
+		return;
+
+	// a new command: the previous one is no longer waited for
+	for (auto& m : members_)
+		m.pending = 0;
+	outstanding_ = 0;
+	commandFailed_ = false;
+	firstReply_ = 0;
+	lastReply_ = 0;
+	std::int64_t firstWrite = 0;
+	std::int64_t lastWrite = 0;
+	for (std::size_t i = 0; i < members_.size(); ++i)
+	{
+		auto& m = members_[i];
+		auto const bits = writing[static_cast<int>(i)];
+		if (bits == 0)
+			continue;
+		// sendCommands flushes the socket: the timestamp is when the commands were handed to the system
+		if (!m.device->sendCommands(m.commands))
+			continue;
+		auto const timestamp = monotonicTimestamp();
+		firstWrite = firstWrite == 0 ? timestamp : firstWrite;
+		lastWrite = timestamp;
+		for (std::size_t p = 0; p < propertyCount; ++p)
+		{
+			if ((bits & bitOf(p)) == 0)
+				continue;
+			m.inFlight[p] = static_cast<std::uint8_t>(std::min(m.inFlight[p] + 1, 255));
+			m.writtenAt[p] = timestamp;
+			m.pending |= bitOf(p);
+			outstanding_ += 1;
+		}
+	}
+	commandWriteSkew_ = lastWrite - firstWrite;
+	if (expiryTimer_ == 0 && lastWrite != 0)
+	{
+		if (timers_.isNull())
+			timers_ = TimerWheel::forCurrentThread();
+		expiryTimer_ = timers_->start(echoTimeoutMs_, [this] { expireEchoes_(); });
+	}
+}
+
+int DeviceGroup::memberValue_(Member const& member, std::size_t property, AvrDeviceState const& state) const
+{
+	auto value = target_[property];
+	if (property != volumeProperty)
+		return value;
+	auto const maxVolume = state.maxVolume.state() == RemoteProperty::UpToDate ? state.maxVolume.value() : 995;
+	value = std::min(std::max(value + member.volumeOffset, std::max(state.minVolume, 0)), std::min(maxVolume, 995));
+	return value - value % 5; // half dB steps
+}
+
+void DeviceGroup::handleStateChanged_(AvrDevice* device)
+{
+	auto member = find_(device);
+	if (member == members_.end())
+		return;
+	auto const state = device->snapshot();
+	if (state.connectionStatus != AvrDevice::Connected)
+	{
+		for (std::size_t p = 0; p < propertyCount; ++p)
+		{
+			member->inFlight[p] = 0;
+			// read again once connected, that is not a change to follow
+			member->seen[p].state = RemoteProperty::Unknown;
+			if ((member->pending & bitOf(p)) != 0)
+				abandon_(*member, p);
+		}
+		return;
+	}
+	bool confirmed = false;
+	for (std::size_t p = 0; p < propertyCount; ++p)
+	{
+		auto const current = propertyValue(state, groupProperties[p]);
+		auto const previous = member->seen[p];
+		if (current.sequence == previous.sequence && current.state == previous.state)
+			continue;
+		member->seen[p] = current;
+		if (current.state != RemoteProperty::UpToDate)
+			continue;
+		auto const bit = bitOf(p);
+		if (member->inFlight[p] > 0)
+		{
+			// the echo of the last command written, or of an older one
+			if (current.value == member->sentValue[p])
+			{
+				member->inFlight[p] = 0;
+				if ((member->pending & bit) != 0)
+					confirmed = confirm_(*member, p, current.timestamp) || confirmed;
+			}
+			else if (--member->inFlight[p] == 0 && (member->pending & bit) != 0)
+				abandon_(*member, p);
+			continue;
+		}
+		if ((hasTarget_ & bit) != 0 && current.value == memberValue_(*member, p, state))
+			continue; // already in the state of the group
+		if (previous.state != RemoteProperty::UpToDate)
+		{
+			if ((hasTarget_ & bit) != 0)
+			{
+				member->dirty |= bit;
+				scheduleFlush_();
+			}
+			continue;
+		}
+		if (current.value == previous.value || !follow_)
+			continue;
+		// changed outside the group, e.g. at the front panel
+		set_(p, p == volumeProperty ? current.value - member->volumeOffset : current.value, &*member);
+	}
+	// emitted last, its slots may change the members
+	if (confirmed)
+		emit commandConfirmed(commandWriteSkew_, lastReply_ - firstReply_);
+}
+
+bool DeviceGroup::confirm_(Member& member, std::size_t property, std::int64_t timestamp)
+{
+	member.pending &= static_cast<std::uint8_t>(~bitOf(property));
+	firstReply_ = firstReply_ == 0 ? timestamp : std::min(firstReply_, timestamp);
+	lastReply_ = std::max(lastReply_, timestamp);
+	if (--outstanding_ > 0 || commandFailed_)
+		return false;
+	writeSkew_.record(commandWriteSkew_);
+	replySkew_.record(lastReply_ - firstReply_);
+	return true;
+}
+
+void DeviceGroup::abandon_(Member& member, std::size_t property)
+{
+	member.pending &= static_cast<std::uint8_t>(~bitOf(property));
+	commandFailed_ = true;
+	outstanding_ -= 1;
+	abandoned_ += 1;
+}
+
+void DeviceGroup::expireEchoes_()
+{
+	expiryTimer_ = 0;
+	auto const now = monotonicTimestamp();
+	auto const timeout = echoTimeoutMs_ * std::int64_t{1'000'000};
+	std::int64_t oldest = 0; // write of the oldest command still waited for
+	for (auto& m : members_)
+	{
+		for (std::size_t p = 0; p < propertyCount; ++p)
+		{
+			if (m.inFlight[p] == 0)
+				continue;
+			if (now - m.writtenAt[p] < timeout)
+			{
+				oldest = oldest == 0 ? m.writtenAt[p] : std::min(oldest, m.writtenAt[p]);
+				continue;
+			}
+			// lost, or ignored by the member: whatever it reports next is its own change
+			m.inFlight[p] = 0;
+			if ((m.pending & bitOf(p)) != 0)
+				abandon_(m, p);
+		}
+	}
+	if (oldest != 0)
+	{
+		auto const delayMs = static_cast<int>((oldest + timeout - now + 999'999) / 1'000'000);
+		expiryTimer_ = timers_->start(delayMs, [this] { expireEchoes_(); });
+	}
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,168 @@
+#ifndef EU_TGCM_AVRREMOTE_DEVICEGROUP_H
+#define EU_TGCM_AVRREMOTE_DEVICEGROUP_H
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+
+#include "AvrDeviceState.hpp"
+#include "Metrics.hpp"
+#include "TimerWheel.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Devices controlled together, e.g. the receivers of a bar playing the same program. The group commands
+ * (volume, mute, source and power) of an event loop iteration are coalesced, then the commands of all the
+ * members are formatted, and written one member after the other, so that the members change together and
+ * step by step. Each member has an offset from the group volume.
+ *
+ * When the volume, mute, source or power of a member changes outside the group, e.g. at its front panel,
+ * the group takes the new value and the other members follow. A member connecting, or reconnecting, is
+ * brought to the state of the group once its state is read.
+ *
+ * The skew of each group command is measured between the first and the last write, each member's socket
+ * being flushed before the next member is written to, and between the first and the last echo of the
+ * members. It is recorded in writeSkew and replySkew, and reported by
+ * commandConfirmed once all the members written to have confirmed the command. A member whose echo does
+ * not come within echoTimeoutMs, e.g. a receiver in standby ignoring the command, is no longer waited for:
+ * the command is abandoned for it, and its next change is followed again.
+ *
+ * The group and its members must live in the same thread.
+ */
+class DeviceGroup : public QObject
+{
+	Q_OBJECT
+
+  public:
+	explicit DeviceGroup(QObject* parent = nullptr);
+	~DeviceGroup() override;
+
+	/**
+	 * Adds device to the group, its volume being the group volume plus volumeOffset (in tenths of dB, as
+	 * volumes), within its min and max volume. Members are removed when deleted.
+	 */
+	void addMember(AvrDevice* device, int volumeOffset = 0);
+	void removeMember(AvrDevice* device);
+	QList<AvrDevice*> members() const;
+	int volumeOffset(AvrDevice* device) const;
+	void setVolumeOffset(AvrDevice* device, int volumeOffset);
+
+	/**
+	 * Whether the members follow a change made to one of them outside the group, true by default
+	 */
+	bool follow() const;
+	void setFollow(bool follow);
+
+	/**
+	 * Time a member is given to echo a command, 3000 by default
+	 */
+	int echoTimeoutMs() const;
+	void setEchoTimeoutMs(int echoTimeoutMs);
+
+	/**
+	 * Group volume, -1 until set by setVolume or by a member
+	 */
+	int volume() const;
+
+	Q_INVOKABLE void setVolume(int volume);
+	Q_INVOKABLE void setMuted(bool muted);
+	Q_INVOKABLE void setSource(int sourceIndex);
+	Q_INVOKABLE void setPowerStandby(bool standby);
+
+	/**
+	 * Time between the first and the last write of each confirmed group command, in ns
+	 */
+	metrics::Histogram const& writeSkew() const;
+
+	/**
+	 * Time between the first and the last echo of each confirmed group command, in ns
+	 */
+	metrics::Histogram const& replySkew() const;
+
+	/**
+	 * Number of member commands given up on: not echoed in time, echoed with another value, or whose member
+	 * disconnected or left the group. A command abandoned by a member is not confirmed.
+	 */
+	std::uint64_t abandonedCommands() const;
+
+  signals:
+	void commandConfirmed(qint64 writeSkewNs, qint64 replySkewNs);
+
+  private:
+	/**
+	 * Volume, mute, source and power of the main zone, in this order
+	 */
+	static constexpr std::size_t propertyCount = 4;
+
+	struct Member
+	{
+		AvrDevice* device;
+		int volumeOffset;
+		std::array<PropertyValue, propertyCount> seen{}; /**< last values of the properties */
+		std::array<int, propertyCount> sentValue{};      /**< value of the last command written */
+		std::array<std::uint8_t, propertyCount> inFlight{};  /**< commands written and not echoed yet */
+		std::array<std::int64_t, propertyCount> writtenAt{}; /**< time of the last command written */
+		std::uint8_t dirty = 0;   /**< properties to write at the next flush, one bit each */
+		std::uint8_t pending = 0; /**< properties written by the current command and not confirmed yet */
+		std::string commands;     /**< formatted by flush_, kept to reuse its buffer */
+	};
+
+	std::vector<Member>::iterator find_(AvrDevice* device);
+	void set_(std::size_t property, int value, Member const* origin);
+	void scheduleFlush_();
+	void flush_();
+	int memberValue_(Member const& member, std::size_t property, AvrDeviceState const& state) const;
+	void handleStateChanged_(AvrDevice* device);
+
+	/**
+	 * Ends the wait for a property of the current command, confirmed by its echo received at timestamp.
+	 * Returns true if the whole command is now confirmed.
+	 */
+	bool confirm_(Member& member, std::size_t property, std::int64_t timestamp);
+	void abandon_(Member& member, std::size_t property);
+
+	/**
+	 * Stops waiting for the echoes older than echoTimeoutMs, and waits for the oldest remaining one
+	 */
+	void expireEchoes_();
+
+	std::vector<Member> members_;
+	std::array<int, propertyCount> target_{};
+	std::uint8_t hasTarget_ = 0;
+
+	// the current command, the last flush having written something
+	int outstanding_ = 0;
+	bool commandFailed_ = false;
+	std::int64_t commandWriteSkew_ = 0;
+	std::int64_t firstReply_ = 0;
+	std::int64_t lastReply_ = 0;
+
+	metrics::Histogram writeSkew_;
+	metrics::Histogram replySkew_;
+	std::uint64_t abandoned_ = 0;
+
+	QPointer<TimerWheel> timers_; /**< of the thread, null until the first command */
+	TimerWheel::TimerId expiryTimer_ = 0;
+	int echoTimeoutMs_ = 3000;
+	bool follow_ = true;
+	bool flushScheduled_ = false;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_DEVICEGROUP_H
@@ -0,0 +1,353 @@
+#include "DeviceProxy.hpp"
+
+#include "AvrDevice.hpp"
+#include "RemoteProperty.hpp"
+#include "Scene.hpp"
+#include "marantzuart.hpp"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+/**
+ * Time after which a command without reply is considered lost, and may be sent again
+ */
+constexpr std::int64_t pendingTimeout = 2'000'000'000;
+
+/**
+ * Longest line accepted from a client, longer ones are dropped whole
+ */
+constexpr int maxLineLength = 128;
+
+/**
+ * Commands setting a property have the same syntax as the replies reporting it, so they are decoded by
+ * the reply parser, with this handler
+ */
+struct CommandDecoder
+{
+	DeviceProperty property = DeviceProperty::Count;
+	int value = 0;
+
+	void maxVolumeChanged(int maxVolume)
+	{
+		property = DeviceProperty::MaxVolume;
+		value = maxVolume;
+	}
+	void powerChanged(bool power)
+	{
+		property = DeviceProperty::Standby;
+		value = power ? 0 : 1;
+	}
+	template <std::size_t N>
+	void volumeChanged(avrcommand::Zone<N>, int volume)
+	{
+		property = zoneProperty(N, ZoneField::Volume);
+		value = volume;
+	}
+	template <std::size_t N>
+	void sourceChanged(avrcommand::Zone<N>, avrcommand::Source source)
+	{
+		property = zoneProperty(N, ZoneField::Source);
+		value = static_cast<int>(source);
+	}
+	template <std::size_t N>
+	void mutedChanged(avrcommand::Zone<N>, bool muted)
+	{
+		property = zoneProperty(N, ZoneField::Muted);
+		value = muted ? 1 : 0;
+	}
+	template <std::size_t N>
+	void zoneOnChanged(avrcommand::Zone<N>, bool on)
+	{
+		property = zoneProperty(N, ZoneField::On);
+		value = on ? 1 : 0;
+	}
+};
+
+/**
+ * Properties reported by the replies to a status query
+ */
+struct QueriedProperties
+{
+	std::array<DeviceProperty, 3> properties;
+	std::size_t count = 0; /**< 0 if not a known query */
+};
+
+QueriedProperties queriedProperties(std::string_view query)
+{
+	if (query == "PW?")
+		return QueriedProperties{{DeviceProperty::Standby}, 1};
+	if (query == "MV?")
+		return QueriedProperties{{DeviceProperty::Volume}, 1};
+	if (query == "MU?")
+		return QueriedProperties{{DeviceProperty::Muted}, 1};
+	if (query == "SI?")
+		return QueriedProperties{{DeviceProperty::Source}, 1};
+	if (query == "ZM?")
+		return QueriedProperties{{DeviceProperty::MainZoneOn}, 1};
+	// zones other than the main one: Zn? is replied with the power, source and volume, ZnMU? with the mute
+	if (query.size() >= 3 && query[0] == 'Z' && query[1] >= '2' &&
+	    query[1] < static_cast<char>('1' + avrcommand::zoneCount))
+	{
+		auto zone = static_cast<std::size_t>(query[1] - '1');
+		auto rest = query.substr(2);
+		if (rest == "?")
+			return QueriedProperties{{zoneProperty(zone, ZoneField::On), zoneProperty(zone, ZoneField::Source),
+			                          zoneProperty(zone, ZoneField::Volume)},
+			                         3};
+		if (rest == "MU?")
+			return QueriedProperties{{zoneProperty(zone, ZoneField::Muted)}, 1};
+	}
+	return QueriedProperties{};
+}
+
+constexpr std::size_t index(DeviceProperty property)
+{
+	return static_cast<std::size_t>(property);
+}
+} // namespace
+
+DeviceProxy::DeviceProxy(AvrDevice* device, QObject* parent) : QObject(parent), device_(device)
+{
+	connect(device_, &AvrDevice::stateChanged, this, &DeviceProxy::handleStateChanged_);
+	connect(device_, &AvrDevice::connectionStatusChanged, this, &DeviceProxy::handleConnectionStatusChanged_);
+	auto state = device_->snapshot();
+	for (std::size_t i = 0; i < broadcastSequence_.size(); ++i)
+		broadcastSequence_[i] = propertyValue(state, static_cast<DeviceProperty>(i)).sequence;
+}
+
+DeviceProxy::~DeviceProxy() = default;
+
+bool DeviceProxy::listen(quint16 port, QHostAddress const& address)
+{
+	if (server_ == nullptr)
+	{
+		server_ = new QTcpServer(this);
+		connect(server_, &QTcpServer::newConnection, this, &DeviceProxy::handleNewConnection_);
+	}
+	return server_->listen(address, port);
+}
+
+quint16 DeviceProxy::serverPort() const
+{
+	return server_ != nullptr ? server_->serverPort() : 0;
+}
+
+int DeviceProxy::clientCount() const
+{
+	return clients_.size();
+}
+
+std::uint64_t DeviceProxy::commandsForwarded() const
+{
+	return commandsForwarded_;
+}
+
+std::uint64_t DeviceProxy::commandsAnswered() const
+{
+	return commandsAnswered_;
+}
+
+void DeviceProxy::handleNewConnection_()
+{
+	while (auto* client = server_->nextPendingConnection())
+	{
+		client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+		clients_.insert(client, Client{});
+		connect(client, &QTcpSocket::readyRead, this, [this, client] { handleClientData_(client); });
+		connect(client, &QTcpSocket::disconnected, this, [this, client] {
+			clients_.remove(client);
+			client->deleteLater();
+		});
+	}
+}
+
+void DeviceProxy::handleClientData_(QTcpSocket* client)
+{
+	auto it = clients_.find(client);
+	if (it == clients_.end())
+		return;
+	QByteArray& line = it->line;
+	char data[1024];
+	qint64 nbRead;
+	while ((nbRead = client->read(data, sizeof(data))) > 0)
+	{
+		for (qint64 i = 0; i < nbRead; ++i)
+		{
+			if (data[i] == '\r' || data[i] == '\n')
+			{
+				if (!line.isEmpty() && !it->discarding)
+					handleCommand_(client, std::string_view(line.constData(), static_cast<std::size_t>(line.size())));
+				line.clear();
+				it->discarding = false;
+			}
+			else if (it->discarding)
+				continue;
+			else if (line.size() < maxLineLength)
+				line.append(data[i]);
+			else
+			{
+				// not truncated: a prefix of the line could be a valid command
+				line.clear();
+				it->discarding = true;
+			}
+		}
+	}
+}
+
+void DeviceProxy::handleCommand_(QTcpSocket* client, std::string_view command)
+{
+	auto state = device_->snapshot();
+	auto now = monotonicTimestamp();
+	if (command.back() == '?')
+	{
+		auto queried = queriedProperties(command);
+		if (queried.count == 0)
+		{
+			forward_(command);
+			return;
+		}
+		auto begin = queried.properties.begin();
+		auto end = begin + queried.count;
+		if (std::all_of(begin, end, [&state](DeviceProperty p) {
+			    return propertyValue(state, p).state == RemoteProperty::UpToDate;
+		    }))
+		{
+			replies_.clear();
+			for (auto it = begin; it != end; ++it)
+				appendReply_(replies_, *it, state);
+			if (*begin == DeviceProperty::Volume && state.maxVolume.state() == RemoteProperty::UpToDate)
+				appendReply_(replies_, DeviceProperty::MaxVolume, state);
+			client->write(replies_.data(), static_cast<qint64>(replies_.size()));
+			commandsAnswered_ += 1;
+			return;
+		}
+		auto& pending = pending_[index(*begin)];
+		if (pending.queryTime != 0 && now - pending.queryTime < pendingTimeout)
+		{
+			commandsAnswered_ += 1; // the reply will be broadcast
+			return;
+		}
+		pending.queryTime = now;
+		forward_(command);
+		return;
+	}
+
+	CommandDecoder decoder;
+	avrcommand::withDialect(static_cast<avrcommand::Dialect>(device_->dialect()), [&decoder, command](auto d) {
+		avrcommand::MarantzUartParser<CommandDecoder, decltype(d)> parser(decoder);
+		parser.parse(command);
+		parser.parse("\r");
+	});
+	if (decoder.property == DeviceProperty::Count || decoder.property == DeviceProperty::MaxVolume)
+	{
+		forward_(command);
+		return;
+	}
+	auto current = propertyValue(state, decoder.property);
+	if (current.state == RemoteProperty::UpToDate && current.value == decoder.value)
+	{
+		// the device would only echo its current state
+		replies_.clear();
+		appendReply_(replies_, decoder.property, state);
+		client->write(replies_.data(), static_cast<qint64>(replies_.size()));
+		commandsAnswered_ += 1;
+		return;
+	}
+	auto& pending = pending_[index(decoder.property)];
+	if (pending.setTime != 0 && pending.value == decoder.value && now - pending.setTime < pendingTimeout)
+	{
+		commandsAnswered_ += 1; // already sent, the echo will be broadcast
+		return;
+	}
+	pending.setTime = now;
+	pending.value = decoder.value;
+	forward_(command);
+}
+
+void DeviceProxy::forward_(std::string_view command)
+{
+	if (upstream_.empty())
+		QMetaObject::invokeMethod(this, &DeviceProxy::flush_, Qt::QueuedConnection);
+	upstream_ += command;
+	upstream_ += '\n';
+	commandsForwarded_ += 1;
+}
+
+void DeviceProxy::flush_()
+{
+	if (upstream_.empty())
+		return;
+	device_->sendCommands(upstream_);
+	upstream_.clear();
+}
+
+void DeviceProxy::handleStateChanged_()
+{
+	auto state = device_->snapshot();
+	replies_.clear();
+	for (std::size_t i = 0; i < broadcastSequence_.size(); ++i)
+	{
+		auto property = static_cast<DeviceProperty>(i);
+		auto sequence = propertyValue(state, property).sequence;
+		if (sequence == broadcastSequence_[i])
+			continue;
+		broadcastSequence_[i] = sequence;
+		pending_[i] = Pending{};
+		appendReply_(replies_, property, state);
+	}
+	if (replies_.empty())
+		return;
+	for (auto it = clients_.cbegin(); it != clients_.cend(); ++it)
+		it.key()->write(replies_.data(), static_cast<qint64>(replies_.size()));
+}
+
+void DeviceProxy::handleConnectionStatusChanged_()
+{
+	pending_.fill(Pending{});
+	if (device_->connectionStatus() == AvrDevice::Connected)
+	{
+		// fill the state of the device, so that clients get their status queries answered immediately
+		std::string queries;
+		queries += avrcommand::queryMasterVolume;
+		queries += avrcommand::querySourceInput;
+		for (std::size_t zone = 0; zone < avrcommand::zoneCount; ++zone)
+		{
+			avrcommand::withZone(zone, [&queries](auto z) {
+				using Commands = avrcommand::ZoneCommands<decltype(z)::value>;
+				queries += Commands::query;
+				queries += Commands::queryMute;
+			});
+		}
+		device_->sendCommands(queries);
+	}
+}
+
+void DeviceProxy::appendReply_(std::string& out, DeviceProperty property, AvrDeviceState const& state) const
+{
+	auto value = propertyValue(state, property).value;
+	if (property == DeviceProperty::MaxVolume)
+	{
+		out += "MVMAX ";
+		out += std::to_string(value % 10 == 0 ? value / 10 : value);
+		out += '\r';
+		return;
+	}
+	auto dialect = static_cast<avrcommand::Dialect>(device_->dialect());
+	if (Scene::appendCommand(Scene::Target{property, value}, out, dialect))
+		out.back() = '\r'; // replies end with '\r', commands with '\n'
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
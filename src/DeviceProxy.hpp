@@ -0,0 +1,107 @@
+#ifndef EU_TGCM_AVRREMOTE_DEVICEPROXY_H
+#define EU_TGCM_AVRREMOTE_DEVICEPROXY_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+
+#include "AvrDeviceState.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class QTcpServer;
+class QTcpSocket;
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Shares the single control connection of a receiver between many local clients speaking the receiver
+ * protocol:
+ * - status queries (PW?, MV?, MU?, SI?, ZM?, and Z2?, Z2MU? and the same for the other zones) are answered
+ *   from the state of the device when it is up to date, and forwarded otherwise
+ * - commands setting a property to its current value are answered directly, commands already sent
+ *   upstream and waiting for their echo are not sent again
+ * - commands received during the same event loop iteration are merged into a single upstream write
+ * - state changes are broadcast to all clients, encoded like the replies of the receiver
+ * Other commands are forwarded as is, but their replies are not relayed: only the replies understood by
+ * MarantzUartParser are.
+ */
+class DeviceProxy : public QObject
+{
+	Q_OBJECT
+
+  public:
+	/**
+	 * device must outlive the proxy, and is usually connected by the caller
+	 */
+	explicit DeviceProxy(AvrDevice* device, QObject* parent = nullptr);
+	~DeviceProxy() override;
+
+	bool listen(quint16 port, QHostAddress const& address = QHostAddress::LocalHost);
+	quint16 serverPort() const;
+
+	int clientCount() const;
+
+	/**
+	 * Number of client commands sent upstream, and answered without sending anything upstream
+	 */
+	std::uint64_t commandsForwarded() const;
+	std::uint64_t commandsAnswered() const;
+
+  private:
+	/**
+	 * Command or query waiting for its reply from the device, per property
+	 */
+	struct Pending
+	{
+		std::int64_t setTime = 0;   /**< 0 if none */
+		std::int64_t queryTime = 0; /**< 0 if none */
+		int value = 0;
+	};
+
+	struct Client
+	{
+		QByteArray line;         /**< incomplete line */
+		bool discarding = false; /**< the line is too long, it is dropped up to its terminator */
+	};
+
+	void handleNewConnection_();
+	void handleClientData_(QTcpSocket* client);
+	void handleCommand_(QTcpSocket* client, std::string_view command);
+	void handleStateChanged_();
+	void handleConnectionStatusChanged_();
+	void forward_(std::string_view command);
+	void flush_();
+
+	/**
+	 * Appends the reply of the receiver reporting property in state to out
+	 */
+	void appendReply_(std::string& out, DeviceProperty property, AvrDeviceState const& state) const;
+
+	AvrDevice* device_;
+	QTcpServer* server_ = nullptr;
+	QHash<QTcpSocket*, Client> clients_;
+
+	std::string upstream_; /**< commands to send at the end of the event loop iteration */
+	std::string replies_;  /**< reused to encode replies */
+	std::array<Pending, static_cast<std::size_t>(DeviceProperty::Count)> pending_;
+	std::array<std::uint32_t, static_cast<std::size_t>(DeviceProperty::Count)> broadcastSequence_{};
+	std::uint64_t commandsForwarded_ = 0;
+	std::uint64_t commandsAnswered_ = 0;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_DEVICEPROXY_H
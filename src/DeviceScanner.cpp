@@ -0,0 +1,226 @@
+#include "DeviceScanner.hpp"
+
+#include "AvrDevice.hpp"
+#include "RemoteProperty.hpp"
+#include "marantzuart.hpp"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+
+#include <algorithm>
+#include <string_view>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * Probe of a single address. Also the handler of its parser: any power status reply confirms a receiver.
+ */
+struct DeviceScanner::Probe
+{
+	Probe() : parser(*this)
+	{
+	}
+
+	QTcpSocket* socket = nullptr;
+	std::int64_t deadline = 0;
+	bool confirmed = false;
+	avrcommand::MarantzUartParser<Probe> parser;
+
+	// the other replies are skipped by the parser
+	void powerChanged(bool)
+	{
+		confirmed = true;
+	}
+};
+
+DeviceScanner::DeviceScanner(QObject* parent) : QObject(parent)
+{
+	// a single timer expires all the probes, instead of one timer per probe
+	connect(&expiry_, &QTimer::timeout, this, &DeviceScanner::expireProbes_);
+}
+
+DeviceScanner::~DeviceScanner() = default;
+
+int DeviceScanner::port() const
+{
+	return port_;
+}
+
+void DeviceScanner::setPort(int port)
+{
+	port_ = port;
+}
+
+int DeviceScanner::maxConcurrent() const
+{
+	return maxConcurrent_;
+}
+
+void DeviceScanner::setMaxConcurrent(int maxConcurrent)
+{
+	maxConcurrent_ = std::max(maxConcurrent, 1);
+}
+
+int DeviceScanner::timeoutMs() const
+{
+	return timeoutMs_;
+}
+
+void DeviceScanner::setTimeoutMs(int timeoutMs)
+{
+	timeoutMs_ = std::max(timeoutMs, 1);
+}
+
+bool DeviceScanner::isRunning() const
+{
+	return running_;
+}
+
+bool DeviceScanner::start(QString const& range)
+{
+	if (running_)
+		return false;
+	auto subnet = QHostAddress::parseSubnet(range);
+	if (subnet.first.protocol() != QAbstractSocket::IPv4Protocol || subnet.second < 0 || subnet.second > 32)
+		return false;
+	std::uint32_t mask = subnet.second == 0 ? 0 : ~std::uint32_t{0} << (32 - subnet.second);
+	next_ = subnet.first.toIPv4Address() & mask;
+	last_ = next_ | ~mask;
+	if (subnet.second < 31)
+	{
+		next_ += 1;
+		last_ -= 1;
+	}
+	found_.clear();
+	running_ = true;
+	emit runningChanged();
+	expiry_.start(std::max(timeoutMs_ / 10, 10));
+	launchProbes_();
+	return true;
+}
+
+void DeviceScanner::stop()
+{
+	if (!running_)
+		return;
+	for (auto& probe : probes_)
+	{
+		probe->socket->disconnect(this);
+		probe->socket->abort();
+		probe->socket->deleteLater();
+	}
+	probes_.clear();
+	expiry_.stop();
+	running_ = false;
+	emit runningChanged();
+}
+
+QStringList const& DeviceScanner::foundAddresses() const
+{
+	return found_;
+}
+
+QList<AvrDevice*> DeviceScanner::createDevices(QObject* parent) const
+{
+	QList<AvrDevice*> ret;
+	for (auto const& address : found_)
+	{
+		auto* device = new AvrDevice(parent);
+		device->setName(address);
+		device->setAddress(address);
+		device->setPort(port_);
+		ret.push_back(device);
+	}
+	return ret;
+}
+
+void DeviceScanner::launchProbes_()
+{
+	// a connection failing synchronously ends its probe from inside connectToHost, the loop below
+	// replaces it
+	if (launching_)
+		return;
+	launching_ = true;
+	while (running_ && static_cast<int>(probes_.size()) < maxConcurrent_ && next_ <= last_ && next_ != 0)
+	{
+		QHostAddress const address(next_);
+		// wraps to 0 after 255.255.255.255, which ends the loop
+		next_ += 1;
+		auto probe = std::make_unique<Probe>();
+		auto* p = probe.get();
+		p->socket = new QTcpSocket(this);
+		p->deadline = monotonicTimestamp() + timeoutMs_ * std::int64_t{1'000'000};
+		connect(p->socket, &QTcpSocket::connected, this, [p] {
+			p->socket->write(avrcommand::queryPowerStatus);
+		});
+		connect(p->socket, &QTcpSocket::readyRead, this, [this, p] {
+			auto data = p->socket->readAll();
+			std::string_view remaining(data.constData(), static_cast<std::size_t>(data.size()));
+			while (!remaining.empty() && !p->confirmed)
+			{
+				auto consumed = p->parser.parse(remaining);
+				if (consumed == 0)
+					break;
+				remaining.remove_prefix(consumed);
+			}
+			if (p->confirmed)
+				endProbe_(p);
+		});
+		// refused, unreachable or closed without a reply
+		connect(p->socket, &QTcpSocket::stateChanged, this, [this, p](QAbstractSocket::SocketState state) {
+			if (state == QAbstractSocket::UnconnectedState)
+				endProbe_(p);
+		});
+		probes_.push_back(std::move(probe));
+		p->socket->connectToHost(address, static_cast<quint16>(port_));
+	}
+	launching_ = false;
+	if (probes_.empty() && running_)
+	{
+		expiry_.stop();
+		running_ = false;
+		emit runningChanged();
+		emit finished();
+	}
+}
+
+void DeviceScanner::endProbe_(Probe* probe)
+{
+	auto it = std::find_if(probes_.begin(), probes_.end(), [probe](auto const& p) { return p.get() == probe; });
+	if (it == probes_.end())
+		return; // already ended, aborting the socket signals its state change
+	auto owned = std::move(*it);
+	probes_.erase(it);
+	auto* socket = owned->socket;
+	socket->disconnect(this);
+	if (owned->confirmed)
+	{
+		found_.push_back(socket->peerAddress().toString());
+		emit deviceFound(found_.back());
+	}
+	socket->abort();
+	socket->deleteLater();
+	launchProbes_();
+}
+
+void DeviceScanner::expireProbes_()
+{
+	auto now = monotonicTimestamp();
+	std::vector<Probe*> expired;
+	for (auto const& probe : probes_)
+	{
+		if (probe->deadline <= now)
+			expired.push_back(probe.get());
+	}
+	for (auto* probe : expired)
+		endProbe_(probe);
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
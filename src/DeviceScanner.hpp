@@ -0,0 +1,101 @@
+#ifndef EU_TGCM_AVRREMOTE_DEVICESCANNER_H
+#define EU_TGCM_AVRREMOTE_DEVICESCANNER_H
+
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Discovers receivers in an IPv4 range. Each address is probed by connecting to the control port, sending a
+ * power status query and checking that the reply parses as a power status. Up to maxConcurrent probes
+ * are in flight at once, each one given timeoutMs to connect and reply.
+ */
+class DeviceScanner : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(int port READ port WRITE setPort)
+	Q_PROPERTY(int maxConcurrent READ maxConcurrent WRITE setMaxConcurrent)
+	Q_PROPERTY(int timeoutMs READ timeoutMs WRITE setTimeoutMs)
+	Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+	Q_PROPERTY(QStringList foundAddresses READ foundAddresses NOTIFY deviceFound)
+
+  public:
+	explicit DeviceScanner(QObject* parent = nullptr);
+	~DeviceScanner() override;
+
+	int port() const;
+	void setPort(int port);
+
+	int maxConcurrent() const;
+	void setMaxConcurrent(int maxConcurrent);
+
+	int timeoutMs() const;
+	void setTimeoutMs(int timeoutMs);
+
+	bool isRunning() const;
+
+	/**
+	 * Starts scanning range, in CIDR notation (e.g. "192.168.1.0/22"). The network and broadcast
+	 * addresses are skipped, except for /31 and /32. Returns false if range is not a valid IPv4 range or
+	 * a scan is running.
+	 */
+	Q_INVOKABLE bool start(QString const& range);
+
+	/**
+	 * Aborts the scan, finished is not emitted
+	 */
+	Q_INVOKABLE void stop();
+
+	/**
+	 * Addresses of the receivers found by the last scan, in the order they were found
+	 */
+	QStringList const& foundAddresses() const;
+
+	/**
+	 * Creates a device, not connected, for each address found, with the port used for the scan
+	 */
+	QList<AvrDevice*> createDevices(QObject* parent = nullptr) const;
+
+  signals:
+	void deviceFound(QString const& address);
+	void finished();
+	void runningChanged();
+
+  private:
+	struct Probe;
+
+	void launchProbes_();
+	void endProbe_(Probe* probe);
+	void expireProbes_();
+
+	std::vector<std::unique_ptr<Probe>> probes_;
+	QStringList found_;
+	QTimer expiry_;
+	std::uint32_t next_ = 0; /**< next address to probe */
+	std::uint32_t last_ = 0; /**< last address to probe */
+	int port_ = 23;
+	int maxConcurrent_ = 256;
+	int timeoutMs_ = 1000;
+	bool running_ = false;
+	bool launching_ = false; /**< launchProbes_ is running */
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_DEVICESCANNER_H
@@ -0,0 +1,260 @@
+#include "Fleet.hpp"
+
+#include "AvrDevice.hpp"
+#include "CapabilityCache.hpp"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+bool Fleet::DeviceConfig::operator==(DeviceConfig const& other) const
+{
+	return id == other.id && name == other.name && address == other.address && sources == other.sources &&
+	       model == other.model && port == other.port && dialect == other.dialect && minVolume == other.minVolume;
+}
+
+Fleet::Fleet(QObject* parent) : QObject(parent)
+{
+	reloadTimer_.setSingleShot(true);
+	reloadTimer_.setInterval(100);
+	connect(&reloadTimer_, &QTimer::timeout, this, &Fleet::reload);
+	connect(&watcher_, &QFileSystemWatcher::fileChanged, this, &Fleet::handleFileChanged_);
+	connect(&watcher_, &QFileSystemWatcher::directoryChanged, this, &Fleet::handleFileChanged_);
+}
+
+Fleet::~Fleet() = default;
+
+bool Fleet::parse(QByteArray const& json, std::vector<DeviceConfig>& configs, QString* error)
+{
+	auto fail = [error](QString const& message) {
+		if (error != nullptr)
+			*error = message;
+		return false;
+	};
+	QJsonParseError parseError;
+	auto const document = QJsonDocument::fromJson(json, &parseError);
+	if (document.isNull())
+		return fail(parseError.errorString());
+	auto const devices = document.object().value(QLatin1String("devices"));
+	if (!devices.isArray())
+		return fail(QStringLiteral("no devices array"));
+	auto const array = devices.toArray();
+	configs.clear();
+	configs.reserve(static_cast<std::size_t>(array.size()));
+	QSet<QString> ids;
+	ids.reserve(array.size());
+	for (int i = 0; i < array.size(); ++i)
+	{
+		if (!array.at(i).isObject())
+			return fail(QStringLiteral("device %1 is not an object").arg(i));
+		auto const object = array.at(i).toObject();
+		DeviceConfig config;
+		config.address = object.value(QLatin1String("address")).toString();
+		if (config.address.isEmpty())
+			return fail(QStringLiteral("device %1 has no address").arg(i));
+		config.id = object.value(QLatin1String("id")).toString(config.address);
+		config.name = object.value(QLatin1String("name")).toString(config.id);
+		config.port = object.value(QLatin1String("port")).toInt(config.port);
+		if (config.port <= 0 || config.port > 0xFFFF)
+			return fail(QStringLiteral("device %1 has an invalid port").arg(config.id));
+		auto const dialect = object.value(QLatin1String("dialect")).toString(QStringLiteral("marantz"));
+		if (dialect == QLatin1String("denon"))
+			config.dialect = AvrDevice::Denon;
+		else if (dialect == QLatin1String("marantz"))
+			config.dialect = AvrDevice::Marantz;
+		else
+			return fail(QStringLiteral("device %1 has an unknown dialect").arg(config.id));
+		auto const sources = object.value(QLatin1String("sources")).toArray();
+		config.sources.reserve(sources.size());
+		for (auto const& source : sources)
+			config.sources.push_back(source.toString());
+		config.minVolume = object.value(QLatin1String("minVolume")).toInt(config.minVolume);
+		config.model = object.value(QLatin1String("model")).toString();
+		if (ids.contains(config.id))
+			return fail(QStringLiteral("duplicate device id %1").arg(config.id));
+		ids.insert(config.id);
+		configs.push_back(std::move(config));
+	}
+	return true;
+}
+
+bool Fleet::load(QString const& path)
+{
+	auto const watched = watcher_.files() + watcher_.directories();
+	if (!watched.isEmpty())
+		watcher_.removePaths(watched);
+	path_ = path;
+	fileHash_.clear();
+	// the directory is watched too, to notice the file once an editor has replaced or recreated it
+	watcher_.addPath(QFileInfo(path).absolutePath());
+	return reload();
+}
+
+bool Fleet::reload()
+{
+	reloadTimer_.stop();
+	if (!watcher_.files().contains(path_) && QFile::exists(path_))
+		watcher_.addPath(path_);
+	QFile file(path_);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		emit loadFailed(file.errorString());
+		return false;
+	}
+	auto const json = file.readAll();
+	auto const hash = QCryptographicHash::hash(json, QCryptographicHash::Sha1);
+	if (hash == fileHash_)
+		return true;
+	std::vector<DeviceConfig> configs;
+	QString error;
+	if (!parse(json, configs, &error))
+	{
+		emit loadFailed(error);
+		return false;
+	}
+	fileHash_ = hash;
+	apply(std::move(configs));
+	return true;
+}
+
+void Fleet::apply(std::vector<DeviceConfig> configs)
+{
+	int added = 0;
+	int removed = 0;
+	int changed = 0;
+	QSet<QString> ids;
+	ids.reserve(static_cast<int>(configs.size()));
+	for (auto const& config : configs)
+		ids.insert(config.id);
+	for (auto it = entries_.begin(); it != entries_.end();)
+	{
+		if (ids.contains(it.key()))
+		{
+			++it;
+			continue;
+		}
+		auto* device = it->device;
+		auto const id = it.key();
+		it = entries_.erase(it);
+		removed += 1;
+		emit deviceRemoved(device, id);
+		device->deleteLater();
+	}
+	entries_.reserve(static_cast<int>(configs.size()));
+	for (auto& config : configs)
+	{
+		auto it = entries_.find(config.id);
+		if (it == entries_.end())
+		{
+			auto* device = create_(config);
+			auto const id = config.id;
+			entries_.insert(id, Entry{device, std::move(config)});
+			added += 1;
+			emit deviceAdded(device, id);
+			continue;
+		}
+		if (it->config == config)
+			continue; // its connection is left alone
+		auto* device = it->device;
+		update_(device, it->config, config);
+		it->config = std::move(config);
+		changed += 1;
+		emit deviceChanged(device, it.key());
+	}
+	emit loaded(added, removed, changed);
+}
+
+bool Fleet::autoConnect() const
+{
+	return autoConnect_;
+}
+
+void Fleet::setAutoConnect(bool autoConnect)
+{
+	autoConnect_ = autoConnect;
+}
+
+CapabilityCache* Fleet::capabilityCache() const
+{
+	return capabilityCache_;
+}
+
+void Fleet::setCapabilityCache(CapabilityCache* cache)
+{
+	capabilityCache_ = cache;
+}
+
+AvrDevice* Fleet::device(QString const& id) const
+{
+	auto it = entries_.constFind(id);
+	return it == entries_.cend() ? nullptr : it->device;
+}
+
+QStringList Fleet::ids() const
+{
+	return entries_.keys();
+}
+
+int Fleet::deviceCount() const
+{
+	return entries_.size();
+}
+
+void Fleet::handleFileChanged_()
+{
+	reloadTimer_.start();
+}
+
+AvrDevice* Fleet::create_(DeviceConfig const& config)
+{
+	auto* device = new AvrDevice(this);
+	device->setName(config.name);
+	device->setAddress(config.address);
+	device->setPort(config.port);
+	device->setDialect(config.dialect);
+	if (!config.sources.isEmpty())
+		device->setSources(config.sources);
+	device->setMinVolume(config.minVolume);
+	if (capabilityCache_ != nullptr)
+		capabilityCache_->apply(device, config.model);
+	if (autoConnect_)
+		device->connectToDevice();
+	return device;
+}
+
+void Fleet::update_(AvrDevice* device, DeviceConfig const& from, DeviceConfig const& to)
+{
+	device->setName(to.name);
+	if (to.sources != from.sources)
+	{
+		if (to.sources.isEmpty())
+			device->setSources(AvrDevice::defaultSources());
+		else
+			device->setSources(to.sources);
+	}
+	device->setMinVolume(to.minVolume);
+	if (capabilityCache_ != nullptr && to.model != from.model)
+		capabilityCache_->apply(device, to.model);
+	if (to.address == from.address && to.port == from.port && to.dialect == from.dialect)
+		return;
+	device->setAddress(to.address);
+	device->setPort(to.port);
+	device->setDialect(to.dialect);
+	if (device->connectionStatus() != AvrDevice::Unconnected)
+		device->connectToDevice();
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
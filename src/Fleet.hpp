@@ -0,0 +1,149 @@
+#ifndef EU_TGCM_AVRREMOTE_FLEET_H
+#define EU_TGCM_AVRREMOTE_FLEET_H
+
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+class CapabilityCache;
+
+/**
+ * Devices defined by a configuration file, which is watched: when it changes, the new configuration is
+ * compared with the current one, and only the devices added, removed or changed are touched. Unchanged
+ * devices keep their connection and their state.
+ *
+ * The file is a JSON object such as {"devices": [{"id": "living", "name": "Living room", "address":
+ * "192.168.1.10", "port": 23, "dialect": "denon", "sources": ["Phono", "CD"], "minVolume": 100, "model":
+ * "SR6015"}]}. Only address is required. id defaults to the address, and must be unique; name defaults to
+ * id; port, dialect (marantz or denon), sources and minVolume default to the AvrDevice defaults. model
+ * identifies the capabilities of the device in the capability cache, if any (see setCapabilityCache).
+ *
+ * A change of name, sources, minVolume or model is applied in place. A change of address, port or dialect makes
+ * the device reconnect, if it was connected or connecting. The devices are owned by the fleet.
+ */
+class Fleet : public QObject
+{
+	Q_OBJECT
+
+  public:
+	struct DeviceConfig
+	{
+		QString id;
+		QString name;
+		QString address;
+		QStringList sources; /**< empty for the default sources */
+		QString model;
+		int port = 23;
+		int dialect = 0; /**< AvrDevice::Dialect */
+		int minVolume = 0;
+
+		bool operator==(DeviceConfig const& other) const;
+		bool operator!=(DeviceConfig const& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	explicit Fleet(QObject* parent = nullptr);
+	~Fleet() override;
+
+	/**
+	 * Parses a configuration, returns false and sets error if it is not valid. Devices without address,
+	 * and duplicate ids, are invalid.
+	 */
+	static bool parse(QByteArray const& json, std::vector<DeviceConfig>& configs, QString* error = nullptr);
+
+	/**
+	 * Loads the configuration file path, and reloads it whenever it changes. Returns false if it cannot be
+	 * read or parsed, the path is watched anyway.
+	 */
+	bool load(QString const& path);
+
+	/**
+	 * Reloads the configuration file now
+	 */
+	bool reload();
+
+	/**
+	 * Reconciles the devices with configs, as done when the file changes
+	 */
+	void apply(std::vector<DeviceConfig> configs);
+
+	/**
+	 * Whether added devices are connected, true by default
+	 */
+	bool autoConnect() const;
+	void setAutoConnect(bool autoConnect);
+
+	/**
+	 * Cache giving the devices added from now on, and the devices whose model changes, the capabilities of
+	 * their model. Null by default: the devices keep their capabilities.
+	 */
+	CapabilityCache* capabilityCache() const;
+	void setCapabilityCache(CapabilityCache* cache);
+
+	AvrDevice* device(QString const& id) const;
+	QStringList ids() const;
+	int deviceCount() const;
+
+  signals:
+	void deviceAdded(eu::tgcm::avrremote::AvrDevice* device, QString const& id);
+
+	/**
+	 * Emitted before the device is deleted
+	 */
+	void deviceRemoved(eu::tgcm::avrremote::AvrDevice* device, QString const& id);
+	void deviceChanged(eu::tgcm::avrremote::AvrDevice* device, QString const& id);
+
+	/**
+	 * Emitted after each successful load, with the number of devices touched
+	 */
+	void loaded(int added, int removed, int changed);
+	void loadFailed(QString const& error);
+
+  private:
+	struct Entry
+	{
+		AvrDevice* device;
+		DeviceConfig config;
+	};
+
+	void handleFileChanged_();
+	AvrDevice* create_(DeviceConfig const& config);
+	void update_(AvrDevice* device, DeviceConfig const& from, DeviceConfig const& to);
+
+	QHash<QString, Entry> entries_;
+	QString path_;
+	QFileSystemWatcher watcher_;
+
+	/**
+	 * Waits for the writes of an editor to settle before reloading
+	 */
+	QTimer reloadTimer_;
+
+	/**
+	 * Hash of the file last loaded, to skip the reloads of an unchanged file
+	 */
+	QByteArray fileHash_;
+	CapabilityCache* capabilityCache_ = nullptr;
+	bool autoConnect_ = true;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_FLEET_H
@@ -0,0 +1,431 @@
+#include "FleetServer.hpp"
+
+#include "AvrDevice.hpp"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMetaMethod>
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+/**
+ * Longest request accepted from a client, longer ones are dropped
+ */
+constexpr int maxLineLength = 64 * 1024;
+
+/**
+ * Most arguments of a method called by a client
+ */
+constexpr int maxArgs = 4;
+
+/**
+ * Methods of AvrDevice a client may call: the commands sent to the receiver, and connectToDevice. Not the
+ * configuration of the device (address, port, sources, volume limits...), which belongs to its owner.
+ */
+constexpr char const* callableMethods[] = {
+    "connectToDevice", "refreshVolume",  "refreshCurrentSource", "refreshZone", "setZoneOn",
+    "setZoneVolume",   "setZoneMuted",   "setZoneSource",        "rampVolume",  "cancelVolumeRamp",
+    "volumeUp",        "volumeDown",     "setVolume",            "setSource",   "setMuted",
+    "setPowerStandby", "setMainZoneOn"};
+
+bool isCallable(QByteArray const& name)
+{
+	return std::any_of(std::begin(callableMethods), std::end(callableMethods),
+	                   [&name](char const* method) { return name == method; });
+}
+
+bool isBoolean(DeviceProperty property)
+{
+	if (property == DeviceProperty::Standby)
+		return true;
+	return isZoneProperty(property) &&
+	       (zoneFieldOf(property) == ZoneField::Muted || zoneFieldOf(property) == ZoneField::On);
+}
+
+QJsonValue toJson(DeviceProperty property, int value)
+{
+	if (isBoolean(property))
+		return QJsonValue(value != 0);
+	return QJsonValue(value);
+}
+
+QByteArray toLine(QJsonObject const& message)
+{
+	auto ret = QJsonDocument(message).toJson(QJsonDocument::Compact);
+	ret.append('\n');
+	return ret;
+}
+} // namespace
+
+FleetServer::FleetServer(QObject* parent) : QObject(parent)
+{
+}
+
+FleetServer::~FleetServer()
+{
+	close();
+}
+
+bool FleetServer::listen(QString const& name)
+{
+	if (server_ == nullptr)
+	{
+		server_ = new QLocalServer(this);
+		server_->setSocketOptions(QLocalServer::UserAccessOption);
+		connect(server_, &QLocalServer::newConnection, this, &FleetServer::handleNewConnection_);
+	}
+	QLocalServer::removeServer(name);
+	return server_->listen(name);
+}
+
+void FleetServer::close()
+{
+	if (server_ != nullptr)
+		server_->close();
+	auto clients = clients_.keys();
+	clients_.clear();
+	for (auto* socket : clients)
+	{
+		disconnect(socket, nullptr, this, nullptr);
+		socket->abort();
+		socket->deleteLater();
+	}
+}
+
+QString FleetServer::fullServerName() const
+{
+	return server_ != nullptr ? server_->fullServerName() : QString();
+}
+
+void FleetServer::addDevice(AvrDevice* device, QString const& id)
+{
+	if (devices_.contains(device) || ids_.contains(id))
+		return;
+	Device d;
+	d.id = id;
+	auto const state = device->snapshot();
+	for (std::size_t i = 0; i < d.sentSequence.size(); ++i)
+	{
+		auto const value = propertyValue(state, static_cast<DeviceProperty>(i));
+		d.sentSequence[i] = value.sequence;
+		d.sentUpToDate[i] = value.state == RemoteProperty::UpToDate;
+	}
+	d.connectionStatus = state.connectionStatus;
+	devices_.insert(device, d);
+	ids_.insert(id, device);
+	connect(device, &AvrDevice::stateChanged, this, [this, device] { handleStateChanged_(device); });
+	connect(device, &QObject::destroyed, this, [this, device] { removeDevice(device); });
+	snapshot_.clear();
+	QJsonObject message{{QStringLiteral("type"), QStringLiteral("added")},
+	                    {QStringLiteral("device"), deviceObject_(device, id)}};
+	broadcast_(toLine(message));
+}
+
+void FleetServer::removeDevice(AvrDevice* device)
+{
+	auto it = devices_.find(device);
+	if (it == devices_.end())
+		return;
+	QJsonObject message{{QStringLiteral("type"), QStringLiteral("removed")},
+	                    {QStringLiteral("device"), it->id}};
+	ids_.remove(it->id);
+	devices_.erase(it);
+	// may be called while device is being destroyed
+	disconnect(device, nullptr, this, nullptr);
+	dirty_.erase(std::remove(dirty_.begin(), dirty_.end(), device), dirty_.end());
+	snapshot_.clear();
+	broadcast_(toLine(message));
+}
+
+qint64 FleetServer::maxQueuedBytes() const
+{
+	return maxQueuedBytes_;
+}
+
+void FleetServer::setMaxQueuedBytes(qint64 maxQueuedBytes)
+{
+	maxQueuedBytes_ = maxQueuedBytes;
+}
+
+int FleetServer::clientCount() const
+{
+	return clients_.size();
+}
+
+void FleetServer::handleNewConnection_()
+{
+	while (auto* socket = server_->nextPendingConnection())
+	{
+		clients_.insert(socket, Client{});
+		connect(socket, &QLocalSocket::readyRead, this, [this, socket] { handleClientData_(socket); });
+		connect(socket, &QLocalSocket::bytesWritten, this, [this, socket] { handleBytesWritten_(socket); });
+		connect(socket, &QLocalSocket::disconnected, this, [this, socket] {
+			clients_.remove(socket);
+			socket->deleteLater();
+		});
+	}
+}
+
+void FleetServer::handleClientData_(QLocalSocket* socket)
+{
+	auto it = clients_.find(socket);
+	if (it == clients_.end())
+		return;
+	it->input += socket->readAll();
+	int end;
+	while ((end = it->input.indexOf('\n')) >= 0)
+	{
+		auto const line = it->input.left(end);
+		it->input.remove(0, end + 1);
+		if (!line.trimmed().isEmpty())
+			handleRequest_(socket, line);
+		// the request may have closed the server
+		it = clients_.find(socket);
+		if (it == clients_.end())
+			return;
+	}
+	if (it->input.size() > maxLineLength)
+	{
+		it->input.clear();
+		send_(socket, QJsonObject{{QStringLiteral("type"), QStringLiteral("error")},
+		                          {QStringLiteral("error"), QStringLiteral("request too long")}});
+	}
+}
+
+void FleetServer::handleBytesWritten_(QLocalSocket* socket)
+{
+	auto it = clients_.find(socket);
+	if (it == clients_.end() || !it->lagging || socket->bytesToWrite() > 0)
+		return;
+	// caught up, the deltas it missed are replaced by the current state
+	it->lagging = false;
+	sendSnapshot_(socket);
+}
+
+void FleetServer::handleRequest_(QLocalSocket* socket, QByteArray const& line)
+{
+	auto const request = QJsonDocument::fromJson(line).object();
+	auto const op = request.value(QStringLiteral("op")).toString();
+	if (op == QLatin1String("subscribe"))
+	{
+		auto& client = clients_[socket];
+		if (client.subscribed)
+			return;
+		client.subscribed = true;
+		sendSnapshot_(socket);
+	}
+	else if (op == QLatin1String("unsubscribe"))
+	{
+		auto& client = clients_[socket];
+		client.subscribed = false;
+		client.lagging = false;
+	}
+	else if (op == QLatin1String("call"))
+		send_(socket, call_(request));
+	else
+	{
+		send_(socket, QJsonObject{{QStringLiteral("type"), QStringLiteral("error")},
+		                          {QStringLiteral("error"), QStringLiteral("invalid request")}});
+	}
+}
+
+QJsonObject FleetServer::call_(QJsonObject const& request) const
+{
+	QJsonObject reply{{QStringLiteral("type"), QStringLiteral("reply")},
+	                  {QStringLiteral("id"), request.value(QStringLiteral("id"))}};
+	auto fail = [&reply](QString const& error) {
+		reply.insert(QStringLiteral("ok"), false);
+		reply.insert(QStringLiteral("error"), error);
+		return reply;
+	};
+	auto* device = ids_.value(request.value(QStringLiteral("device")).toString());
+	if (device == nullptr)
+		return fail(QStringLiteral("unknown device"));
+	auto const name = request.value(QStringLiteral("method")).toString().toLatin1();
+	auto const args = request.value(QStringLiteral("args")).toArray();
+	if (!isCallable(name))
+		return fail(QStringLiteral("unknown method"));
+	if (args.size() > maxArgs)
+		return fail(QStringLiteral("too many arguments"));
+	auto const* meta = device->metaObject();
+	for (int i = meta->methodOffset(); i < meta->methodCount(); ++i)
+	{
+		auto const method = meta->method(i);
+		if (method.name() != name || method.parameterCount() != args.size() ||
+		    method.access() != QMetaMethod::Public || method.methodType() == QMetaMethod::Signal ||
+		    method.returnType() != QMetaType::Void)
+			continue;
+		std::array<int, maxArgs> ints{};
+		std::array<bool, maxArgs> bools{};
+		std::array<QGenericArgument, maxArgs> generic;
+		for (int a = 0; a < args.size(); ++a)
+		{
+			auto const value = args.at(a);
+			auto const index = static_cast<std::size_t>(a);
+			if (method.parameterType(a) == QMetaType::Int && value.isDouble())
+			{
+				ints[index] = value.toInt();
+				generic[index] = Q_ARG(int, ints[index]);
+			}
+			else if (method.parameterType(a) == QMetaType::Bool && value.isBool())
+			{
+				bools[index] = value.toBool();
+				generic[index] = Q_ARG(bool, bools[index]);
+			}
+			else
+				return fail(QStringLiteral("invalid arguments"));
+		}
+		method.invoke(device, Qt::DirectConnection, generic[0], generic[1], generic[2], generic[3]);
+		reply.insert(QStringLiteral("ok"), true);
+		return reply;
+	}
+	return fail(QStringLiteral("unknown method"));
+}
+
+void FleetServer::handleStateChanged_(AvrDevice* device)
+{
+	snapshot_.clear();
+	auto it = devices_.find(device);
+	if (it == devices_.end() || it->dirty)
+		return;
+	it->dirty = true;
+	if (dirty_.empty())
+		QMetaObject::invokeMethod(this, &FleetServer::flush_, Qt::QueuedConnection);
+	dirty_.push_back(device);
+}
+
+void FleetServer::flush_()
+{
+	bool const subscribers = std::any_of(clients_.cbegin(), clients_.cend(), [](Client const& c) {
+		return c.subscribed && !c.lagging;
+	});
+	for (auto* device : dirty_)
+	{
+		auto it = devices_.find(device);
+		if (it == devices_.end())
+			continue;
+		it->dirty = false;
+		auto const state = device->snapshot();
+		QJsonObject changes;
+		for (std::size_t i = 0; i < it->sentSequence.size(); ++i)
+		{
+			auto const property = static_cast<DeviceProperty>(i);
+			auto const value = propertyValue(state, property);
+			bool const upToDate = value.state == RemoteProperty::UpToDate;
+			if (value.sequence == it->sentSequence[i] && upToDate == it->sentUpToDate[i])
+				continue;
+			bool const wasUpToDate = it->sentUpToDate[i];
+			it->sentSequence[i] = value.sequence;
+			it->sentUpToDate[i] = upToDate;
+			if (!subscribers)
+				continue;
+			if (upToDate)
+				changes.insert(QLatin1String(toCStr(property)), toJson(property, value.value));
+			else if (wasUpToDate)
+				changes.insert(QLatin1String(toCStr(property)), QJsonValue());
+		}
+		if (state.connectionStatus != it->connectionStatus)
+		{
+			it->connectionStatus = state.connectionStatus;
+			changes.insert(QStringLiteral("connectionStatus"), state.connectionStatus);
+		}
+		if (!subscribers || changes.isEmpty())
+			continue;
+		// serialized once for all the subscribers
+		QJsonObject message{{QStringLiteral("type"), QStringLiteral("delta")},
+		                    {QStringLiteral("device"), it->id},
+		                    {QStringLiteral("sequence"), static_cast<qint64>(state.sequence)},
+		                    {QStringLiteral("changes"), changes}};
+		broadcast_(toLine(message));
+	}
+	dirty_.clear();
+}
+
+void FleetServer::broadcast_(QByteArray const& line)
+{
+	for (auto it = clients_.begin(); it != clients_.end(); ++it)
+	{
+		if (!it->subscribed || it->lagging)
+			continue;
+		if (it.key()->bytesToWrite() > maxQueuedBytes_)
+		{
+			it->lagging = true;
+			continue;
+		}
+		it.key()->write(line);
+	}
+}
+
+void FleetServer::sendSnapshot_(QLocalSocket* socket)
+{
+	if (socket->bytesToWrite() > maxQueuedBytes_)
+	{
+		// sent once the client has caught up, see handleBytesWritten_
+		auto it = clients_.find(socket);
+		if (it != clients_.end())
+			it->lagging = true;
+		return;
+	}
+	if (snapshot_.isEmpty())
+	{
+		QJsonArray devices;
+		for (auto it = devices_.cbegin(); it != devices_.cend(); ++it)
+			devices.append(deviceObject_(it.key(), it->id));
+		snapshot_ = toLine(QJsonObject{{QStringLiteral("type"), QStringLiteral("snapshot")},
+		                               {QStringLiteral("devices"), devices}});
+	}
+	socket->write(snapshot_);
+}
+
+void FleetServer::send_(QLocalSocket* socket, QJsonObject const& message)
+{
+	// unlike deltas, replies cannot be skipped: a client that does not read them is dropped
+	if (socket->bytesToWrite() > maxQueuedBytes_)
+	{
+		drop_(socket);
+		return;
+	}
+	socket->write(toLine(message));
+}
+
+void FleetServer::drop_(QLocalSocket* socket)
+{
+	clients_.remove(socket);
+	disconnect(socket, nullptr, this, nullptr);
+	socket->abort();
+	socket->deleteLater();
+}
+
+QJsonObject FleetServer::deviceObject_(AvrDevice* device, QString const& id)
+{
+	auto const state = device->snapshot();
+	QJsonObject properties;
+	for (std::size_t i = 0; i < static_cast<std::size_t>(DeviceProperty::Count); ++i)
+	{
+		auto const property = static_cast<DeviceProperty>(i);
+		auto const value = propertyValue(state, property);
+		if (value.state == RemoteProperty::UpToDate)
+			properties.insert(QLatin1String(toCStr(property)), toJson(property, value.value));
+	}
+	return QJsonObject{{QStringLiteral("id"), id},
+	                   {QStringLiteral("name"), device->name()},
+	                   {QStringLiteral("address"), device->address()},
+	                   {QStringLiteral("connectionStatus"), device->connectionStatus()},
+	                   {QStringLiteral("sequence"), static_cast<qint64>(state.sequence)},
+	                   {QStringLiteral("properties"), properties}};
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
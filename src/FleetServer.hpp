@@ -0,0 +1,157 @@
+#ifndef EU_TGCM_AVRREMOTE_FLEETSERVER_H
+#define EU_TGCM_AVRREMOTE_FLEETSERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+
+#include "AvrDeviceState.hpp"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+class QLocalServer;
+class QLocalSocket;
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Exposes devices to other processes over a local socket (a Unix domain socket on unix), for tools that
+ * cannot link Qt. Messages are JSON objects, one per line, in both directions. Client requests:
+ * - {"op": "subscribe"}: the server replies with {"type": "snapshot", "devices": [...]}, each device being
+ *   {"id", "name", "address", "connectionStatus", "sequence", "properties": {...}}, then sends a
+ *   {"type": "delta", "device": id, "sequence", "changes": {...}} line when properties of a device change,
+ *   and {"type": "added", "device": {...}} / {"type": "removed", "device": id} when the fleet changes.
+ *   properties and changes map property names (see toCStr(DeviceProperty)) to their value: booleans for
+ *   mute, power and standby, the source index for sources, the volume in tenths of dB. changes may also
+ *   hold connectionStatus (see AvrDevice::ConnectionStatus). Only up to date properties are sent: a
+ *   property that is no longer up to date (e.g. once the device is disconnected) is sent as null.
+ * - {"op": "unsubscribe"}
+ * - {"op": "call", "device": id, "method": name, "args": [...], "id": any}: calls a command of the device,
+ *   taking ints and bools: connectToDevice, setVolume, volumeUp, volumeDown, setMuted, setSource,
+ *   setPowerStandby, setMainZoneOn, setZoneOn, setZoneVolume, setZoneMuted, setZoneSource, rampVolume,
+ *   cancelVolumeRamp, refreshVolume, refreshCurrentSource or refreshZone. The configuration of the device
+ *   cannot be changed. The server replies with {"type": "reply", "id": any, "ok": bool}, and "error" when
+ *   not ok.
+ * Invalid requests are answered with {"type": "error", "error": message}.
+ *
+ * Changes are coalesced per device during an event loop iteration, and each delta is serialized once for
+ * all the subscribers. A subscriber whose socket has more than maxQueuedBytes waiting to be written is
+ * skipped: once it has read everything, it gets a new snapshot instead of the deltas it missed. The
+ * snapshot it subscribes with is deferred the same way. A client sending requests while not reading the
+ * replies is disconnected once over maxQueuedBytes. A slow client never makes the server buffer more than
+ * about maxQueuedBytes for it.
+ */
+class FleetServer : public QObject
+{
+	Q_OBJECT
+
+  public:
+	explicit FleetServer(QObject* parent = nullptr);
+	~FleetServer() override;
+
+	/**
+	 * Listens on the local socket name (a path, or a name in the runtime directory), replacing a stale
+	 * socket left by a crashed server. Returns false on error.
+	 */
+	bool listen(QString const& name);
+	void close();
+	QString fullServerName() const;
+
+	/**
+	 * Exposes device as id, which must be unique. Devices are removed when deleted.
+	 */
+	void addDevice(AvrDevice* device, QString const& id);
+	void removeDevice(AvrDevice* device);
+
+	/**
+	 * Bytes waiting to be written to a subscriber above which it is considered slow, 1 MiB by default
+	 */
+	qint64 maxQueuedBytes() const;
+	void setMaxQueuedBytes(qint64 maxQueuedBytes);
+
+	int clientCount() const;
+
+  private:
+	struct Device
+	{
+		QString id;
+		/**
+		 * Sequence of each property when last sent to the subscribers
+		 */
+		std::array<std::uint32_t, static_cast<std::size_t>(DeviceProperty::Count)> sentSequence{};
+
+		/**
+		 * Whether each property was up to date when last sent, its state changes without a new sequence
+		 */
+		std::bitset<static_cast<std::size_t>(DeviceProperty::Count)> sentUpToDate;
+		std::uint8_t connectionStatus = 0;
+		bool dirty = false;
+	};
+
+	struct Client
+	{
+		QByteArray input; /**< incomplete line */
+		bool subscribed = false;
+		bool lagging = false; /**< missed deltas, gets a snapshot once its queue is empty */
+	};
+
+	void handleNewConnection_();
+	void handleClientData_(QLocalSocket* socket);
+	void handleBytesWritten_(QLocalSocket* socket);
+	void handleRequest_(QLocalSocket* socket, QByteArray const& line);
+	QJsonObject call_(QJsonObject const& request) const;
+	void handleStateChanged_(AvrDevice* device);
+	void flush_();
+
+	/**
+	 * Sends line to the subscribers, skipping and marking lagging the slow ones
+	 */
+	void broadcast_(QByteArray const& line);
+
+	/**
+	 * Sends the snapshot, or marks the client lagging if it is slow
+	 */
+	void sendSnapshot_(QLocalSocket* socket);
+
+	/**
+	 * Sends a reply or an error, or drops the client if it is slow
+	 */
+	void send_(QLocalSocket* socket, QJsonObject const& message);
+	void drop_(QLocalSocket* socket);
+	static QJsonObject deviceObject_(AvrDevice* device, QString const& id);
+
+	QLocalServer* server_ = nullptr;
+	QHash<QLocalSocket*, Client> clients_;
+	QHash<AvrDevice*, Device> devices_;
+	QHash<QString, AvrDevice*> ids_;
+
+	/**
+	 * Devices changed during this event loop iteration
+	 */
+	std::vector<AvrDevice*> dirty_;
+
+	/**
+	 * Serialized snapshot, shared by the clients subscribing until the next change. Empty if outdated.
+	 */
+	QByteArray snapshot_;
+
+	qint64 maxQueuedBytes_ = 1 << 20;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_FLEETSERVER_H
@@ -0,0 +1,148 @@
+#include "FleetState.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace fleetstate
+{
+
+static_assert(std::is_trivially_copyable<DeviceRecord>::value, "records are copied through a seqlock");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "slots are shared between processes");
+
+Writer::~Writer()
+{
+	close();
+}
+
+bool Writer::create(char const* name, std::uint32_t slotCount)
+{
+	close();
+	if (std::strlen(name) >= sizeof(name_))
+		return false;
+	shm_unlink(name); // discard a region left by a previous run
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+	auto size = regionSize(slotCount);
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		::close(fd);
+		shm_unlink(name);
+		return false;
+	}
+	void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+	{
+		shm_unlink(name);
+		return false;
+	}
+	std::strcpy(name_, name);
+	size_ = size;
+	slots_ = reinterpret_cast<DeviceSlot*>(static_cast<char*>(addr) + sizeof(Header));
+	for (std::uint32_t i = 0; i < slotCount; ++i)
+		new (slots_ + i) DeviceSlot();
+	header_ = new (addr) Header();
+	header_->layoutVersion = layoutVersion;
+	header_->slotCount = slotCount;
+	header_->slotSize = static_cast<std::uint32_t>(sizeof(DeviceSlot));
+	// readers check the magic before using anything else
+	header_->magic.store(magic, std::memory_order_release);
+	return true;
+}
+
+void Writer::close()
+{
+	if (header_ == nullptr)
+		return;
+	munmap(header_, size_);
+	shm_unlink(name_);
+	header_ = nullptr;
+	slots_ = nullptr;
+	size_ = 0;
+}
+
+void Writer::write(std::uint32_t slot, DeviceRecord const& record)
+{
+	slots_[slot].record.store(record);
+	slots_[slot].inUse.store(1, std::memory_order_release);
+}
+
+void Writer::release(std::uint32_t slot)
+{
+	slots_[slot].inUse.store(0, std::memory_order_release);
+}
+
+Reader::~Reader()
+{
+	close();
+}
+
+bool Reader::open(char const* name)
+{
+	close();
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header))
+	{
+		::close(fd);
+		return false;
+	}
+	auto size = static_cast<std::size_t>(st.st_size);
+	void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+	auto header = static_cast<Header const*>(addr);
+	if (header->magic.load(std::memory_order_acquire) != magic || header->layoutVersion != layoutVersion ||
+	    header->slotSize != sizeof(DeviceSlot) || regionSize(header->slotCount) > size)
+	{
+		munmap(addr, size);
+		return false;
+	}
+	header_ = header;
+	slots_ = reinterpret_cast<DeviceSlot const*>(static_cast<char const*>(addr) + sizeof(Header));
+	size_ = size;
+	return true;
+}
+
+void Reader::close()
+{
+	if (header_ == nullptr)
+		return;
+	munmap(const_cast<Header*>(header_), size_);
+	header_ = nullptr;
+	slots_ = nullptr;
+	size_ = 0;
+}
+
+bool Reader::read(std::uint32_t slot, DeviceRecord& out, int maxRetries) const
+{
+	if (!inUse(slot))
+		return false;
+	// not SeqLock::load, which would spin forever on a slot left odd by a crashed writer
+	for (int i = 0; i < maxRetries; ++i)
+	{
+		if (slots_[slot].record.tryLoad(out))
+			return true;
+	}
+	return false;
+}
+
+} // namespace fleetstate
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,194 @@
+#ifndef EU_TGCM_AVRREMOTE_FLEETSTATE_H
+#define EU_TGCM_AVRREMOTE_FLEETSTATE_H
+
+#include "SeqLock.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace fleetstate
+{
+
+/**
+ * Layout of the shared memory region in which a controlling process publishes the state of its devices. The
+ * region starts with a Header, followed by slotCount DeviceSlot. A device keeps the same slot as long as it
+ * is published. This file does not depend on Qt, so that readers do not need it.
+ */
+
+constexpr std::uint32_t magic = 0x46525641; // "AVRF"
+constexpr std::uint32_t layoutVersion = 2;
+constexpr std::size_t maxStringLength = 64; /**< including the terminating 0 */
+constexpr std::size_t zoneCount = 3;
+
+struct PropertyRecord
+{
+	std::int64_t timestamp; /**< monotonic time, in nanoseconds, of the reply that set the property */
+	std::uint32_t sequence; /**< per device sequence number of the reply that set the property */
+	std::int32_t value;     /**< value, source index, or 0/1 for booleans */
+	std::uint8_t state;     /**< RemoteProperty::State */
+};
+
+struct ZoneRecord
+{
+	PropertyRecord volume;
+	PropertyRecord source;
+	PropertyRecord muted;
+	PropertyRecord on;
+};
+
+struct DeviceRecord
+{
+	char name[maxStringLength];    /**< utf-8, truncated if too long */
+	char address[maxStringLength]; /**< utf-8, truncated if too long */
+	ZoneRecord zones[zoneCount];   /**< zones[0] is the main zone */
+	PropertyRecord maxVolume;
+	PropertyRecord standby;
+	std::uint32_t sequence;
+	std::int32_t minVolume;
+	std::uint8_t connectionStatus; /**< AvrDevice::ConnectionStatus */
+};
+
+struct alignas(64) Header
+{
+	std::atomic<std::uint32_t> magic{0}; /**< written last, once the region is initialized */
+	std::uint32_t layoutVersion = 0;
+	std::uint32_t slotCount = 0;
+	std::uint32_t slotSize = 0;
+};
+
+struct alignas(64) DeviceSlot
+{
+	std::atomic<std::uint32_t> inUse{0};
+	SeqLock<DeviceRecord> record;
+};
+
+/**
+ * Size of the region holding slotCount slots
+ */
+constexpr std::size_t regionSize(std::uint32_t slotCount)
+{
+	return sizeof(Header) + slotCount * sizeof(DeviceSlot);
+}
+
+/**
+ * Creates and writes the region. There must be a single writer per region.
+ */
+class Writer
+{
+  public:
+	Writer() = default;
+	~Writer();
+
+	Writer(Writer const&) = delete;
+	Writer& operator=(Writer const&) = delete;
+
+	/**
+	 * Creates (or recreates) the posix shared memory object name (must start with a '/'), sized for
+	 * slotCount devices. Returns false on error.
+	 */
+	bool create(char const* name, std::uint32_t slotCount);
+
+	/**
+	 * Unmaps and unlinks the region. Readers that have it open keep their mapping.
+	 */
+	void close();
+
+	bool isOpen() const
+	{
+		return header_ != nullptr;
+	}
+
+	std::uint32_t slotCount() const
+	{
+		return header_ != nullptr ? header_->slotCount : 0;
+	}
+
+	void write(std::uint32_t slot, DeviceRecord const& record);
+
+	/**
+	 * Marks the slot as unused
+	 */
+	void release(std::uint32_t slot);
+
+  private:
+	Header* header_ = nullptr;
+	DeviceSlot* slots_ = nullptr;
+	std::size_t size_ = 0;
+	char name_[256] = {};
+};
+
+/**
+ * Attempts of Reader::read before giving up on a slot being written. On a slot left by a writer that died
+ * in the middle of a write, this takes a few tens of microseconds.
+ */
+constexpr int defaultReadRetries = 10000;
+
+/**
+ * Read only access to a region created by a Writer, from any process. Reads never block the writer and
+ * never make a system call.
+ */
+class Reader
+{
+  public:
+	Reader() = default;
+	~Reader();
+
+	Reader(Reader const&) = delete;
+	Reader& operator=(Reader const&) = delete;
+
+	/**
+	 * Opens the region, returns false if it does not exist or has an incompatible layout
+	 */
+	bool open(char const* name);
+
+	void close();
+
+	bool isOpen() const
+	{
+		return header_ != nullptr;
+	}
+
+	std::uint32_t slotCount() const
+	{
+		return header_ != nullptr ? header_->slotCount : 0;
+	}
+
+	bool inUse(std::uint32_t slot) const
+	{
+		return slots_[slot].inUse.load(std::memory_order_acquire) != 0;
+	}
+
+	/**
+	 * Number of writes to the slot, allows polling for changes without copying the record
+	 */
+	std::uint32_t version(std::uint32_t slot) const
+	{
+		return slots_[slot].record.version();
+	}
+
+	/**
+	 * Reads a consistent record of the slot. Returns false if the slot is not in use, or if a write is
+	 * still in progress after maxRetries attempts: the writer may have died in the middle of a write, in
+	 * which case the slot stays unreadable until the region is recreated.
+	 */
+	bool read(std::uint32_t slot, DeviceRecord& out, int maxRetries = defaultReadRetries) const;
+
+  private:
+	Header const* header_ = nullptr;
+	DeviceSlot const* slots_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+} // namespace fleetstate
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_FLEETSTATE_H
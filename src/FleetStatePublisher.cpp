@@ -0,0 +1,130 @@
+#include "FleetStatePublisher.hpp"
+
+#include "AvrDevice.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+template <typename T>
+fleetstate::PropertyRecord toRecord_(BasicRemoteProperty<T> const& p)
+{
+	fleetstate::PropertyRecord ret{};
+	ret.timestamp = p.timestamp();
+	ret.sequence = p.sequence();
+	ret.value = static_cast<std::int32_t>(p.value());
+	ret.state = static_cast<std::uint8_t>(p.state());
+	return ret;
+}
+
+void copyString_(char (&dest)[fleetstate::maxStringLength], QString const& str)
+{
+	auto utf8 = str.toUtf8();
+	auto len = std::min<std::size_t>(static_cast<std::size_t>(utf8.size()), fleetstate::maxStringLength - 1);
+	std::memcpy(dest, utf8.constData(), len);
+	std::memset(dest + len, 0, fleetstate::maxStringLength - len);
+}
+} // namespace
+
+FleetStatePublisher::FleetStatePublisher(QObject* parent) : QObject(parent)
+{
+}
+
+FleetStatePublisher::~FleetStatePublisher()
+{
+	close();
+}
+
+bool FleetStatePublisher::open(QString const& name, int slotCount)
+{
+	close();
+	if (slotCount <= 0 || !writer_.create(name.toUtf8().constData(), static_cast<std::uint32_t>(slotCount)))
+		return false;
+	records_.assign(static_cast<std::size_t>(slotCount), fleetstate::DeviceRecord{});
+	freeSlots_.clear();
+	for (int i = slotCount - 1; i >= 0; --i)
+		freeSlots_.push_back(i);
+	return true;
+}
+
+void FleetStatePublisher::close()
+{
+	for (auto it = slots_.begin(); it != slots_.end(); ++it)
+		disconnect(it.key(), nullptr, this, nullptr);
+	slots_.clear();
+	freeSlots_.clear();
+	records_.clear();
+	writer_.close();
+}
+
+int FleetStatePublisher::addDevice(AvrDevice* device)
+{
+	auto it = slots_.constFind(device);
+	if (it != slots_.constEnd())
+		return it.value();
+	if (!writer_.isOpen() || freeSlots_.empty())
+		return -1;
+	int slot = freeSlots_.back();
+	freeSlots_.pop_back();
+	slots_.insert(device, slot);
+	connect(device, &AvrDevice::stateChanged, this, [this, device, slot]() { publishState_(device, slot); });
+	connect(device, &AvrDevice::nameChanged, this, [this, device, slot]() { publishStrings_(device, slot); });
+	connect(device, &AvrDevice::addressChanged, this, [this, device, slot]() { publishStrings_(device, slot); });
+	connect(device, &QObject::destroyed, this, [this, device]() { removeDevice(device); });
+	publishStrings_(device, slot);
+	return slot;
+}
+
+void FleetStatePublisher::removeDevice(AvrDevice* device)
+{
+	auto it = slots_.find(device);
+	if (it == slots_.end())
+		return;
+	int slot = it.value();
+	slots_.erase(it);
+	disconnect(device, nullptr, this, nullptr);
+	writer_.release(static_cast<std::uint32_t>(slot));
+	records_[static_cast<std::size_t>(slot)] = fleetstate::DeviceRecord{};
+	freeSlots_.push_back(slot);
+}
+
+void FleetStatePublisher::publishState_(AvrDevice* device, int slot)
+{
+	auto state = device->snapshot();
+	auto& record = records_[static_cast<std::size_t>(slot)];
+	static_assert(fleetstate::zoneCount == avrcommand::zoneCount, "the layout must hold every zone");
+	for (std::size_t i = 0; i < fleetstate::zoneCount; ++i)
+	{
+		auto const& zone = state.zones[i];
+		record.zones[i].volume = toRecord_(zone.volume);
+		record.zones[i].source = toRecord_(zone.source);
+		record.zones[i].muted = toRecord_(zone.muted);
+		record.zones[i].on = toRecord_(zone.on);
+	}
+	record.maxVolume = toRecord_(state.maxVolume);
+	record.standby = toRecord_(state.standby);
+	record.sequence = state.sequence;
+	record.minVolume = state.minVolume;
+	record.connectionStatus = state.connectionStatus;
+	writer_.write(static_cast<std::uint32_t>(slot), record);
+}
+
+void FleetStatePublisher::publishStrings_(AvrDevice* device, int slot)
+{
+	auto& record = records_[static_cast<std::size_t>(slot)];
+	copyString_(record.name, device->name());
+	copyString_(record.address, device->address());
+	publishState_(device, slot);
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,67 @@
+#ifndef EU_TGCM_AVRREMOTE_FLEETSTATEPUBLISHER_H
+#define EU_TGCM_AVRREMOTE_FLEETSTATEPUBLISHER_H
+
+#include <QHash>
+#include <QObject>
+
+#include "FleetState.hpp"
+
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Publishes the state of devices into a shared memory region (see FleetState.hpp), so that any number of
+ * local processes can read it with fleetstate::Reader, without connecting to the receivers themselves.
+ * Linux only.
+ */
+class FleetStatePublisher : public QObject
+{
+	Q_OBJECT
+
+  public:
+	explicit FleetStatePublisher(QObject* parent = nullptr);
+	~FleetStatePublisher() override;
+
+	/**
+	 * Creates the region name (e.g. "/avrcontrol"), with room for slotCount devices. Returns false on error.
+	 */
+	bool open(QString const& name, int slotCount);
+	void close();
+
+	/**
+	 * Starts publishing the state of device. Returns the slot of the device in the region, or -1 if the
+	 * region is not open or full.
+	 */
+	int addDevice(AvrDevice* device);
+	void removeDevice(AvrDevice* device);
+
+  private:
+	void publishState_(AvrDevice* device, int slot);
+	void publishStrings_(AvrDevice* device, int slot);
+
+	fleetstate::Writer writer_;
+
+	QHash<AvrDevice*, int> slots_;
+
+	/**
+	 * Last record written for each slot. Names and addresses are only converted when they change, so
+	 * publishing a state change does not allocate.
+	 */
+	std::vector<fleetstate::DeviceRecord> records_;
+
+	std::vector<int> freeSlots_;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_FLEETSTATEPUBLISHER_H
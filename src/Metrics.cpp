@@ -0,0 +1,308 @@
+#include "Metrics.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace metrics
+{
+
+namespace
+{
+int highestBit_(std::uint64_t v)
+{
+	return 63 - __builtin_clzll(v);
+}
+
+// buckets exported to prometheus: powers of two, from ~1us to ~68s. They fall on bucket boundaries, so the
+// cumulative counts are exact.
+constexpr int firstExportedExponent = 10;
+constexpr int lastExportedExponent = 36;
+
+std::string escapeLabel_(std::string const& value)
+{
+	std::string ret;
+	ret.reserve(value.size());
+	for (char c : value)
+	{
+		if (c == '\\' || c == '"')
+			ret += '\\';
+		if (c == '\n')
+		{
+			ret += "\\n";
+			continue;
+		}
+		ret += c;
+	}
+	return ret;
+}
+
+void appendf_(std::string& out, char const* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf_(std::string& out, char const* format, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	va_list again;
+	va_copy(again, args);
+	int len = std::vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (len > 0 && static_cast<std::size_t>(len) < sizeof(buffer))
+		out.append(buffer, static_cast<std::size_t>(len));
+	else if (len > 0)
+	{
+		// too long for the buffer (e.g. a long device label): formatted again, directly at the end of out
+		auto const size = out.size();
+		out.resize(size + static_cast<std::size_t>(len));
+		std::vsnprintf(&out[size], static_cast<std::size_t>(len) + 1, format, again);
+	}
+	va_end(again);
+}
+
+/**
+ * Cumulative bucket counts at the exported bounds, followed by the total count
+ */
+struct ExportedBuckets
+{
+	std::array<std::uint64_t, lastExportedExponent - firstExportedExponent + 1> cumulative{};
+	std::uint64_t count = 0;
+	std::uint64_t sum = 0;
+
+	void add(Histogram const& h)
+	{
+		std::uint64_t total = 0;
+		std::size_t e = 0;
+		for (std::size_t i = 0; i < Histogram::bucketCount; ++i)
+		{
+			while (e < cumulative.size() &&
+			       Histogram::bucketUpperBound(i) > (std::int64_t{1} << (firstExportedExponent + e)))
+			{
+				cumulative[e] += total;
+				e += 1;
+			}
+			total += h.bucketValue(i);
+		}
+		for (; e < cumulative.size(); ++e)
+			cumulative[e] += total;
+		count += total;
+		sum += h.sum();
+	}
+};
+
+void renderHistogram_(std::string& out, char const* name, std::string const& labels, ExportedBuckets const& b)
+{
+	auto separator = labels.empty() ? "" : ",";
+	for (std::size_t e = 0; e < b.cumulative.size(); ++e)
+	{
+		double bound = static_cast<double>(std::int64_t{1} << (firstExportedExponent + e)) / 1e9;
+		appendf_(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels.c_str(), separator, bound,
+		         static_cast<unsigned long long>(b.cumulative[e]));
+	}
+	appendf_(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels.c_str(), separator,
+	         static_cast<unsigned long long>(b.count));
+	appendf_(out, "%s_sum{%s} %.9g\n", name, labels.c_str(), static_cast<double>(b.sum) / 1e9);
+	appendf_(out, "%s_count{%s} %llu\n", name, labels.c_str(), static_cast<unsigned long long>(b.count));
+}
+} // namespace
+
+std::size_t Histogram::bucketIndex(std::int64_t value) noexcept
+{
+	if (value < subBucketCount)
+		return value < 0 ? 0 : static_cast<std::size_t>(value);
+	int e = highestBit_(static_cast<std::uint64_t>(value));
+	int shift = e - subBucketBits;
+	auto sub = static_cast<std::size_t>((value >> shift) - subBucketCount);
+	return static_cast<std::size_t>(subBucketCount) * static_cast<std::size_t>(shift + 1) + sub;
+}
+
+std::int64_t Histogram::bucketUpperBound(std::size_t bucket) noexcept
+{
+	if (bucket < static_cast<std::size_t>(subBucketCount))
+		return static_cast<std::int64_t>(bucket) + 1;
+	auto shift = bucket / static_cast<std::size_t>(subBucketCount) - 1;
+	auto sub = static_cast<std::int64_t>(bucket % static_cast<std::size_t>(subBucketCount));
+	if (shift + subBucketBits >= 62 && sub == subBucketCount - 1)
+		return INT64_MAX;
+	return (subBucketCount + sub + 1) << shift;
+}
+
+void Histogram::record(std::int64_t value) noexcept
+{
+	if (value < 0)
+		value = 0;
+	buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(static_cast<std::uint64_t>(value), std::memory_order_relaxed);
+}
+
+std::int64_t Histogram::quantile(double q) const noexcept
+{
+	std::uint64_t total = 0;
+	for (auto const& b : buckets_)
+		total += b.load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0;
+	auto rank = static_cast<std::uint64_t>(q * static_cast<double>(total));
+	if (rank >= total)
+		rank = total - 1;
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < bucketCount; ++i)
+	{
+		seen += buckets_[i].load(std::memory_order_relaxed);
+		if (seen > rank)
+			return bucketUpperBound(i) - 1;
+	}
+	return bucketUpperBound(bucketCount - 1);
+}
+
+char const* toCStr(CommandType type)
+{
+	switch (type)
+	{
+		case CommandType::Volume:
+			return "volume";
+		case CommandType::Mute:
+			return "mute";
+		case CommandType::Power:
+			return "power";
+		case CommandType::Source:
+			return "source";
+		case CommandType::Zone:
+			return "zone";
+		case CommandType::Query:
+			return "query";
+		case CommandType::Other:
+		case CommandType::Count:
+			break;
+	}
+	return "other";
+}
+
+CommandType commandTypeOf(std::string_view command)
+{
+	while (!command.empty() && (command.back() == '\n' || command.back() == '\r'))
+		command.remove_suffix(1);
+	if (command.size() < 2)
+		return CommandType::Other;
+	if (command.back() == '?')
+		return CommandType::Query;
+	auto prefix = command.substr(0, 2);
+	if (prefix == "MV")
+		return CommandType::Volume;
+	if (prefix == "MU")
+		return CommandType::Mute;
+	if (prefix == "PW")
+		return CommandType::Power;
+	if (prefix == "SI")
+		return CommandType::Source;
+	if (prefix[0] != 'Z')
+		return CommandType::Other;
+	// zone commands are labelled as AvrDevice labels them: Z2MUON is a mute, Z255 a volume, Z2CD a source
+	auto const rest = command.substr(2);
+	if (rest.substr(0, 2) == "MU")
+		return CommandType::Mute;
+	if (rest == "ON" || rest == "OFF")
+		return CommandType::Zone;
+	if (rest == "UP" || rest == "DOWN" || (!rest.empty() && rest[0] >= '0' && rest[0] <= '9'))
+		return CommandType::Volume;
+	return prefix == "ZM" ? CommandType::Other : CommandType::Source;
+}
+
+DeviceMetrics* MetricsRegistry::deviceMetrics(std::string const& name)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& d : devices_)
+	{
+		if (d.first == name)
+			return d.second.get();
+	}
+	devices_.emplace_back(name, std::make_unique<DeviceMetrics>());
+	return devices_.back().second.get();
+}
+
+std::string MetricsRegistry::renderPrometheus() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::string out;
+	out.reserve(1024 + devices_.size() * 4096);
+
+	struct CounterDesc
+	{
+		char const* name;
+		char const* help;
+		Counter DeviceMetrics::*counter;
+	};
+	static CounterDesc const counters[] = {
+	    {"avrcontrol_bytes_received_total", "Bytes read from the device", &DeviceMetrics::bytesIn},
+	    {"avrcontrol_bytes_sent_total", "Bytes written to the device", &DeviceMetrics::bytesOut},
+	    {"avrcontrol_frames_parsed_total", "Replies understood by the parser", &DeviceMetrics::framesParsed},
+	    {"avrcontrol_frames_dropped_total", "Replies skipped by the parser", &DeviceMetrics::framesDropped},
+	    {"avrcontrol_reconnects_total", "Connections to the device after the first one", &DeviceMetrics::reconnects},
+	    {"avrcontrol_breaker_opens_total", "Times the circuit breaker opened", &DeviceMetrics::breakerOpens},
+	};
+	for (auto const& c : counters)
+	{
+		appendf_(out, "# HELP %s %s\n# TYPE %s counter\n", c.name, c.help, c.name);
+		for (auto const& d : devices_)
+		{
+			appendf_(out, "%s{device=\"%s\"} %llu\n", c.name, escapeLabel_(d.first).c_str(),
+			         static_cast<unsigned long long>((d.second.get()->*c.counter).value()));
+		}
+	}
+
+	out += "# HELP avrcontrol_commands_sent_total Commands written to the device\n"
+	       "# TYPE avrcontrol_commands_sent_total counter\n";
+	for (auto const& d : devices_)
+	{
+		auto device = escapeLabel_(d.first);
+		for (std::size_t i = 0; i < d.second->commandsSent.size(); ++i)
+		{
+			appendf_(out, "avrcontrol_commands_sent_total{device=\"%s\",command=\"%s\"} %llu\n", device.c_str(),
+			         toCStr(static_cast<CommandType>(i)),
+			         static_cast<unsigned long long>(d.second->commandsSent[i].value()));
+		}
+	}
+
+	struct HistogramDesc
+	{
+		char const* command;
+		Histogram DeviceMetrics::*histogram;
+	};
+	static HistogramDesc const histograms[] = {{"volume", &DeviceMetrics::volumeRoundTrip},
+	                                           {"mute", &DeviceMetrics::muteRoundTrip}};
+	out += "# HELP avrcontrol_round_trip_seconds Time between a command and its echo\n"
+	       "# TYPE avrcontrol_round_trip_seconds histogram\n";
+	for (auto const& d : devices_)
+	{
+		auto device = escapeLabel_(d.first);
+		for (auto const& h : histograms)
+		{
+			ExportedBuckets b;
+			b.add(d.second.get()->*h.histogram);
+			renderHistogram_(out, "avrcontrol_round_trip_seconds",
+			                 "device=\"" + device + "\",command=\"" + h.command + "\"", b);
+		}
+	}
+	out += "# HELP avrcontrol_fleet_round_trip_seconds Time between a command and its echo, for all devices\n"
+	       "# TYPE avrcontrol_fleet_round_trip_seconds histogram\n";
+	for (auto const& h : histograms)
+	{
+		ExportedBuckets b;
+		for (auto const& d : devices_)
+			b.add(d.second.get()->*h.histogram);
+		renderHistogram_(out, "avrcontrol_fleet_round_trip_seconds", std::string("command=\"") + h.command + "\"",
+		                 b);
+	}
+	return out;
+}
+
+} // namespace metrics
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
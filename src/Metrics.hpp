@@ -0,0 +1,167 @@
+#ifndef EU_TGCM_AVRREMOTE_METRICS_H
+#define EU_TGCM_AVRREMOTE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace metrics
+{
+
+/**
+ * Monotonic counter. Updates are relaxed atomic additions, they can be done from any thread.
+ */
+class Counter
+{
+  public:
+	void add(std::uint64_t n = 1) noexcept
+	{
+		v_.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	std::uint64_t value() const noexcept
+	{
+		return v_.load(std::memory_order_relaxed);
+	}
+
+  private:
+	std::atomic<std::uint64_t> v_{0};
+};
+
+/**
+ * Latency histogram, in nanoseconds, with fixed log-linear buckets (as HdrHistogram does): each power of two
+ * range is split in subBucketCount linear buckets, so a recorded value is known with a relative error below
+ * 1 / subBucketCount. Recording is a few integer operations and relaxed atomic additions, without any
+ * allocation.
+ */
+class Histogram
+{
+  public:
+	static constexpr int subBucketBits = 3;
+	static constexpr std::int64_t subBucketCount = std::int64_t{1} << subBucketBits;
+	static constexpr std::size_t bucketCount = static_cast<std::size_t>(subBucketCount * (64 - subBucketBits));
+
+	void record(std::int64_t value) noexcept;
+
+	std::uint64_t count() const noexcept
+	{
+		return count_.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Sum of the recorded values, in nanoseconds
+	 */
+	std::uint64_t sum() const noexcept
+	{
+		return sum_.load(std::memory_order_relaxed);
+	}
+
+	std::uint64_t bucketValue(std::size_t bucket) const noexcept
+	{
+		return buckets_[bucket].load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Estimation of the given quantile (between 0 and 1), 0 if nothing was recorded
+	 */
+	std::int64_t quantile(double q) const noexcept;
+
+	static std::size_t bucketIndex(std::int64_t value) noexcept;
+
+	/**
+	 * Smallest value that does not fit in the bucket
+	 */
+	static std::int64_t bucketUpperBound(std::size_t bucket) noexcept;
+
+  private:
+	std::array<std::atomic<std::uint64_t>, bucketCount> buckets_{};
+	std::atomic<std::uint64_t> count_{0};
+	std::atomic<std::uint64_t> sum_{0};
+};
+
+/**
+ * Kind of command sent to a device, used as a label of the commands sent counter
+ */
+enum class CommandType
+{
+	Volume,
+	Mute,
+	Power,
+	Source,
+	Zone,
+	Query,
+	Other,
+	Count
+};
+
+char const* toCStr(CommandType type);
+
+/**
+ * Type of a raw protocol command, guessed from its prefix: the type AvrDevice gives the same command when
+ * it sends it
+ */
+CommandType commandTypeOf(std::string_view command);
+
+/**
+ * Metrics of a single device
+ */
+struct DeviceMetrics
+{
+	Counter bytesIn;
+	Counter bytesOut;
+	Counter framesParsed;
+	Counter framesDropped; /**< replies that were not understood by the parser */
+	Counter reconnects;
+	Counter breakerOpens; /**< times the circuit breaker of the device opened */
+	std::array<Counter, static_cast<std::size_t>(CommandType::Count)> commandsSent;
+	Histogram volumeRoundTrip; /**< from the write of a volume command to its echo */
+	Histogram muteRoundTrip;   /**< from the write of a mute command to its echo */
+
+	void commandSent(CommandType type, std::size_t bytes) noexcept
+	{
+		commandsSent[static_cast<std::size_t>(type)].add();
+		bytesOut.add(bytes);
+	}
+};
+
+/**
+ * Holds the metrics of a fleet of devices, and renders them in the prometheus text exposition format.
+ * Metrics are never removed, so that counters stay monotonic when a device is recreated with the same name.
+ */
+class MetricsRegistry
+{
+  public:
+	/**
+	 * Returns the metrics of the device with the given name, created if needed. The returned pointer stays
+	 * valid as long as the registry.
+	 */
+	DeviceMetrics* deviceMetrics(std::string const& name);
+
+	/**
+	 * Renders every device, plus round trip histograms merged over the whole fleet
+	 */
+	std::string renderPrometheus() const;
+
+  private:
+	mutable std::mutex mutex_;
+	std::vector<std::pair<std::string, std::unique_ptr<DeviceMetrics>>> devices_;
+};
+
+} // namespace metrics
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_METRICS_H
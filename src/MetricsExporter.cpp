@@ -0,0 +1,97 @@
+#include "MetricsExporter.hpp"
+
+#include "Metrics.hpp"
+
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+/**
+ * Limits of a request: a scraper sends a few hundred bytes at once, anything else is dropped
+ */
+constexpr qint64 maxRequestSize = 8192;
+constexpr int requestTimeoutMs = 5000;
+} // namespace
+
+MetricsExporter::MetricsExporter(metrics::MetricsRegistry& registry, QObject* parent) :
+    QObject(parent), registry_(registry)
+{
+}
+
+MetricsExporter::~MetricsExporter() = default;
+
+bool MetricsExporter::listen(quint16 port, QHostAddress const& address)
+{
+	if (server_ == nullptr)
+	{
+		server_ = new QTcpServer(this);
+		connect(server_, &QTcpServer::newConnection, this, &MetricsExporter::handleNewConnection_);
+	}
+	return server_->listen(address, port);
+}
+
+quint16 MetricsExporter::serverPort() const
+{
+	return server_ != nullptr ? server_->serverPort() : 0;
+}
+
+bool MetricsExporter::dumpToFile(QString const& path) const
+{
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	auto text = registry_.renderPrometheus();
+	if (file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size()))
+		return false;
+	return file.commit();
+}
+
+void MetricsExporter::handleNewConnection_()
+{
+	while (auto socket = server_->nextPendingConnection())
+	{
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		auto* deadline = new QTimer(socket);
+		deadline->setSingleShot(true);
+		connect(deadline, &QTimer::timeout, socket, [socket]() {
+			socket->abort();
+			socket->deleteLater();
+		});
+		deadline->start(requestTimeoutMs);
+		connect(socket, &QTcpSocket::readyRead, socket, [this, socket, deadline]() {
+			if (socket->bytesAvailable() > maxRequestSize)
+			{
+				socket->abort();
+				socket->deleteLater();
+				return;
+			}
+			// wait for the end of the request headers, the request itself does not matter
+			if (!socket->peek(socket->bytesAvailable()).contains("\r\n\r\n"))
+				return;
+			deadline->stop();
+			socket->readAll();
+			auto body = registry_.renderPrometheus();
+			QByteArray response = "HTTP/1.0 200 OK\r\n"
+			                      "Content-Type: text/plain; version=0.0.4\r\n"
+			                      "Content-Length: " +
+			                      QByteArray::number(static_cast<qulonglong>(body.size())) + "\r\n\r\n";
+			response.append(body.data(), static_cast<int>(body.size()));
+			socket->write(response);
+			socket->disconnectFromHost();
+		});
+	}
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,59 @@
+#ifndef EU_TGCM_AVRREMOTE_METRICSEXPORTER_H
+#define EU_TGCM_AVRREMOTE_METRICSEXPORTER_H
+
+#include <QHostAddress>
+#include <QObject>
+
+class QTcpServer;
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace metrics
+{
+class MetricsRegistry;
+}
+
+/**
+ * Exports the content of a MetricsRegistry in the prometheus text format, either over http (any request
+ * gets the metrics), or by dumping them into a file. Over http, a connection is closed without reply if its
+ * request headers exceed 8 KiB, or are not complete within 5 s.
+ */
+class MetricsExporter : public QObject
+{
+	Q_OBJECT
+
+  public:
+	explicit MetricsExporter(metrics::MetricsRegistry& registry, QObject* parent = nullptr);
+	~MetricsExporter() override;
+
+	/**
+	 * Starts serving the metrics over http. Port 0 selects a free port. Returns false on error.
+	 */
+	bool listen(quint16 port, QHostAddress const& address = QHostAddress::LocalHost);
+
+	quint16 serverPort() const;
+
+	/**
+	 * Writes the metrics to path, atomically. Returns false on error.
+	 */
+	bool dumpToFile(QString const& path) const;
+
+  private slots:
+	void handleNewConnection_();
+
+  private:
+	metrics::MetricsRegistry& registry_;
+
+	QTcpServer* server_ = nullptr;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_METRICSEXPORTER_H
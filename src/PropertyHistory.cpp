@@ -0,0 +1,184 @@
+#include "PropertyHistory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+constexpr std::int64_t nsPerMs = 1'000'000;
+
+/**
+ * Largest change: a value delta takes 5 bytes at most, a timestamp delta 10
+ */
+constexpr std::size_t maxChangeSize = 15;
+
+std::size_t writeVarint(std::uint8_t* out, std::uint64_t v) noexcept
+{
+	std::size_t n = 0;
+	while (v >= 0x80)
+	{
+		out[n++] = static_cast<std::uint8_t>(v | 0x80);
+		v >>= 7;
+	}
+	out[n++] = static_cast<std::uint8_t>(v);
+	return n;
+}
+
+std::uint64_t readVarint(std::uint8_t const* in, std::uint32_t& offset) noexcept
+{
+	std::uint64_t v = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7)
+	{
+		auto byte = in[offset++];
+		v |= std::uint64_t{byte & 0x7Fu} << shift;
+		if ((byte & 0x80) == 0)
+			break;
+	}
+	return v;
+}
+
+std::uint64_t zigzag(std::int64_t v) noexcept
+{
+	return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t v) noexcept
+{
+	return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+} // namespace
+
+PropertyHistory::PropertyHistory(std::size_t bytes)
+{
+	if (bytes == 0)
+		return;
+	blockCount_ = static_cast<std::uint32_t>(std::max<std::size_t>(2, bytes / blockSize));
+	data_.reset(new std::uint8_t[capacity()]);
+}
+
+void PropertyHistory::record(std::int64_t timestamp, int value) noexcept
+{
+	if (blockCount_ == 0 || (usedBlocks_ != 0 && value == lastValue_))
+		return;
+	auto const time = std::max(timestamp / nsPerMs, lastTime_);
+	if (usedBlocks_ == 0)
+	{
+		startBlock_(time, value);
+		return;
+	}
+	// the value delta comes first: it is never 0, so a 0 byte marks the end of the changes of a block
+	std::uint8_t change[maxChangeSize];
+	auto size = writeVarint(change, zigzag(std::int64_t{value} - lastValue_));
+	size += writeVarint(change + size, static_cast<std::uint64_t>(time - lastTime_));
+	if (writeOffset_ + size > blockSize)
+	{
+		startBlock_(time, value);
+		return;
+	}
+	auto* block = data_.get() + std::size_t{(firstBlock_ + usedBlocks_ - 1) % blockCount_} * blockSize;
+	std::memcpy(block + writeOffset_, change, size);
+	writeOffset_ += static_cast<std::uint32_t>(size);
+	lastTime_ = time;
+	lastValue_ = value;
+}
+
+void PropertyHistory::clear() noexcept
+{
+	firstBlock_ = 0;
+	usedBlocks_ = 0;
+	writeOffset_ = 0;
+	lastTime_ = 0;
+	lastValue_ = 0;
+}
+
+PropertyHistory::Range PropertyHistory::samples(std::int64_t from, std::int64_t to) const noexcept
+{
+	Range ret;
+	if (usedBlocks_ == 0 || from > to)
+		return ret;
+	// the last block starting before from, blocks starting at from may be preceded by changes at from
+	std::uint32_t low = 0;
+	std::uint32_t high = usedBlocks_;
+	while (low < high)
+	{
+		auto middle = low + (high - low) / 2;
+		if (blockTime_(middle) * nsPerMs < from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	auto& it = ret.begin_;
+	it.history_ = this;
+	it.to_ = to;
+	it.block_ = low == 0 ? 0 : low - 1;
+	auto const* block = block_(it.block_);
+	std::memcpy(&it.time_, block, sizeof(it.time_));
+	std::memcpy(&it.sample_.value, block + sizeof(it.time_), sizeof(it.sample_.value));
+	it.sample_.timestamp = it.time_ * nsPerMs;
+	it.offset_ = headerSize;
+	if (it.sample_.timestamp > to)
+		it = Iterator{};
+	while (it.block_ != Iterator::endBlock && it.sample_.timestamp < from)
+		it.advance_();
+	return ret;
+}
+
+std::int64_t PropertyHistory::blockTime_(std::uint32_t index) const noexcept
+{
+	std::int64_t time;
+	std::memcpy(&time, block_(index), sizeof(time));
+	return time;
+}
+
+void PropertyHistory::startBlock_(std::int64_t time, int value) noexcept
+{
+	if (usedBlocks_ == blockCount_)
+	{
+		firstBlock_ = (firstBlock_ + 1) % blockCount_;
+		usedBlocks_ -= 1;
+	}
+	auto* block = data_.get() + std::size_t{(firstBlock_ + usedBlocks_) % blockCount_} * blockSize;
+	usedBlocks_ += 1;
+	std::memset(block, 0, blockSize);
+	std::memcpy(block, &time, sizeof(time));
+	std::memcpy(block + sizeof(time), &value, sizeof(value));
+	writeOffset_ = headerSize;
+	lastTime_ = time;
+	lastValue_ = value;
+}
+
+void PropertyHistory::Iterator::advance_() noexcept
+{
+	auto const* block = history_->block_(block_);
+	if (offset_ < blockSize && block[offset_] != 0)
+	{
+		sample_.value = static_cast<int>(sample_.value + unzigzag(readVarint(block, offset_)));
+		time_ += static_cast<std::int64_t>(readVarint(block, offset_));
+	}
+	else if (block_ + 1 < history_->usedBlocks_)
+	{
+		block_ += 1;
+		time_ = history_->blockTime_(block_);
+		std::memcpy(&sample_.value, history_->block_(block_) + sizeof(time_), sizeof(sample_.value));
+		offset_ = headerSize;
+	}
+	else
+	{
+		*this = Iterator{};
+		return;
+	}
+	sample_.timestamp = time_ * nsPerMs;
+	if (sample_.timestamp > to_)
+		*this = Iterator{};
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
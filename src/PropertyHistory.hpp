@@ -0,0 +1,187 @@
+#ifndef EU_TGCM_AVRREMOTE_PROPERTYHISTORY_H
+#define EU_TGCM_AVRREMOTE_PROPERTYHISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * Changes of a property (e.g. the volume of a device), in a ring of fixed memory, for dashboards charting the
+ * last hours. Values are ints, as in PropertyValue.
+ *
+ * The ring is made of blocks of blockSize bytes. A block starts with the absolute timestamp and value of its
+ * first change, then each change is delta-encoded from the previous one, as two varints (zigzag value delta,
+ * then timestamp delta): a volume step usually takes 3 bytes. When the ring is full, the oldest block is
+ * dropped. Blocks are ordered by time, so a time range is found by a binary search, then decoded in place.
+ *
+ * Timestamps are monotonic times in ns (see monotonicTimestamp), kept with a ms resolution. A timestamp
+ * older than the previous change is recorded as the time of the previous change (e.g. replayed traffic).
+ */
+class PropertyHistory
+{
+  public:
+	static constexpr std::size_t blockSize = 64;
+
+	struct Sample
+	{
+		std::int64_t timestamp; /**< ns, rounded down to the ms */
+		int value;
+	};
+
+	/**
+	 * Forward iterator decoding the samples of a Range
+	 */
+	class Iterator
+	{
+	  public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Sample;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Sample const*;
+		using reference = Sample const&;
+
+		Sample const& operator*() const noexcept
+		{
+			return sample_;
+		}
+
+		Sample const* operator->() const noexcept
+		{
+			return &sample_;
+		}
+
+		Iterator& operator++() noexcept
+		{
+			advance_();
+			return *this;
+		}
+
+		Iterator operator++(int) noexcept
+		{
+			auto ret = *this;
+			advance_();
+			return ret;
+		}
+
+		bool operator==(Iterator const& other) const noexcept
+		{
+			return block_ == other.block_ && offset_ == other.offset_;
+		}
+
+		bool operator!=(Iterator const& other) const noexcept
+		{
+			return !(*this == other);
+		}
+
+	  private:
+		friend class PropertyHistory;
+
+		static constexpr std::uint32_t endBlock = ~std::uint32_t{0};
+
+		PropertyHistory const* history_ = nullptr;
+		std::int64_t to_ = 0;
+		std::int64_t time_ = 0; /**< ms */
+		std::uint32_t block_ = endBlock; /**< among the used blocks, oldest first */
+		std::uint32_t offset_ = 0;       /**< of the next change in the block */
+		Sample sample_{0, 0};
+
+		void advance_() noexcept;
+	};
+
+	/**
+	 * Changes between two timestamps, oldest first, decoded from the ring while iterating. A range is
+	 * invalidated by the next change recorded.
+	 */
+	class Range
+	{
+	  public:
+		Iterator begin() const noexcept
+		{
+			return begin_;
+		}
+
+		Iterator end() const noexcept
+		{
+			return Iterator{};
+		}
+
+		bool empty() const noexcept
+		{
+			return begin_ == end();
+		}
+
+	  private:
+		friend class PropertyHistory;
+		Iterator begin_;
+	};
+
+	/**
+	 * Disabled history, recording nothing
+	 */
+	PropertyHistory() = default;
+
+	/**
+	 * History in bytes, rounded down to blocks, two blocks at least. 0 disables it.
+	 */
+	explicit PropertyHistory(std::size_t bytes);
+
+	/**
+	 * Memory used by the changes, bytes
+	 */
+	std::size_t capacity() const noexcept
+	{
+		return std::size_t{blockCount_} * blockSize;
+	}
+
+	/**
+	 * Records that the property changed to value at timestamp. Does nothing if value is the last value
+	 * recorded, so that the echoes and query replies repeating the current value take no room.
+	 */
+	void record(std::int64_t timestamp, int value) noexcept;
+
+	/**
+	 * Forgets all the changes
+	 */
+	void clear() noexcept;
+
+	/**
+	 * Changes with from <= timestamp <= to
+	 */
+	Range samples(std::int64_t from, std::int64_t to) const noexcept;
+
+  private:
+	static constexpr std::uint32_t headerSize = sizeof(std::int64_t) + sizeof(int);
+
+	std::unique_ptr<std::uint8_t[]> data_;
+	std::int64_t lastTime_ = 0; /**< ms */
+	std::uint32_t blockCount_ = 0;
+	std::uint32_t firstBlock_ = 0; /**< oldest */
+	std::uint32_t usedBlocks_ = 0;
+	std::uint32_t writeOffset_ = 0; /**< in the newest block */
+	int lastValue_ = 0;
+
+	/**
+	 * index-th used block, oldest first
+	 */
+	std::uint8_t const* block_(std::uint32_t index) const noexcept
+	{
+		return data_.get() + std::size_t{(firstBlock_ + index) % blockCount_} * blockSize;
+	}
+
+	std::int64_t blockTime_(std::uint32_t index) const noexcept;
+	void startBlock_(std::int64_t time, int value) noexcept;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_PROPERTYHISTORY_H
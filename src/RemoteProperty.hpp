@@ -3,6 +3,12 @@
 
 #include <QObject>
 
+#include "marantzuart.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
 namespace eu
 {
 namespace tgcm
@@ -40,60 +46,219 @@ class RemoteProperty : public QObject
 	void refresh();
 };
 
-class RemoteIntProperty
+/**
+ * Current monotonic time, in nanoseconds. This is the clock used for all the timestamps of the remote
+ * properties, it is the same clock as QElapsedTimer uses on linux.
+ */
+inline std::int64_t monotonicTimestamp() noexcept
 {
-	Q_GADGET
-	Q_PROPERTY(eu::tgcm::avrremote::RemoteProperty::State state READ state)
-	Q_PROPERTY(int value READ value)
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+}
+
+/**
+ * Value read from the remote device, along with its state. The version is incremented each time the
+ * value or the state changes, so that consumers can skip work when nothing changed. The timestamp and
+ * sequence number identify the reply that last set the property: the timestamp is the monotonic time at
+ * which the reply was read from the socket, the sequence number orders the updates of a device.
+ *
+ * Only trivially copyable values are allowed, so that a property can be copied around (to QML, to another
+ * thread) without any allocation. This is named BasicRemoteProperty because RemoteProperty already holds
+ * the State enum exposed to QML.
+ */
+template <typename T>
+class BasicRemoteProperty
+{
+	static_assert(std::is_trivially_copyable<T>::value, "remote property values must be trivially copyable");
+
+  public:
+	using value_type = T;
+
+	constexpr BasicRemoteProperty() noexcept = default;
+
+	constexpr BasicRemoteProperty(RemoteProperty::State s, T v) noexcept : v_(v), s_(static_cast<std::uint8_t>(s))
+	{
+	}
+
+	constexpr RemoteProperty::State state() const noexcept
+	{
+		return static_cast<RemoteProperty::State>(s_);
+	}
+
+	constexpr T value() const noexcept
+	{
+		return v_;
+	}
 
-	RemoteProperty::State s_;
+	/**
+	 * Number of changes (of value or state) since construction. Wraps around.
+	 */
+	constexpr std::uint32_t version() const noexcept
+	{
+		return version_;
+	}
+
+	/**
+	 * Monotonic time (see monotonicTimestamp) of the reply that last set the property, 0 if never set
+	 */
+	constexpr std::int64_t timestamp() const noexcept
+	{
+		return timestamp_;
+	}
+
+	/**
+	 * Per device sequence number of the reply that last set the property, 0 if never set
+	 */
+	constexpr std::uint32_t sequence() const noexcept
+	{
+		return sequence_;
+	}
 
-	int v_;
+	constexpr void setTimestamp(std::int64_t timestamp, std::uint32_t sequence) noexcept
+	{
+		timestamp_ = timestamp;
+		sequence_ = sequence;
+	}
 
+	constexpr void setValue(T v) noexcept
+	{
+		if (v_ == v)
+			return;
+		v_ = v;
+		version_ += 1;
+	}
+
+	constexpr void setState(RemoteProperty::State s) noexcept
+	{
+		if (s_ == static_cast<std::uint8_t>(s))
+			return;
+		s_ = static_cast<std::uint8_t>(s);
+		version_ += 1;
+	}
+
+  private:
+	std::int64_t timestamp_ = 0;
+
+	std::uint32_t version_ = 0;
+
+	std::uint32_t sequence_ = 0;
+
+	T v_{};
+
+	std::uint8_t s_ = RemoteProperty::Unknown;
+};
+
+/**
+ * Accessors shared by the QML expositions of the remote properties below. This is not a gadget itself:
+ * moc does not handle templates, so each exposition declares its own Q_GADGET and Q_PROPERTY lines.
+ */
+template <typename T>
+class RemotePropertyGadget
+{
   public:
-	RemoteProperty::State state() const;
+	constexpr RemotePropertyGadget() noexcept = default;
+
+	constexpr RemotePropertyGadget(BasicRemoteProperty<T> p) noexcept : p_(p)
+	{
+	}
 
-	int value() const;
+	constexpr RemotePropertyGadget(RemoteProperty::State s, T v) noexcept : p_(s, v)
+	{
+	}
 
-	RemoteIntProperty();
+	RemoteProperty::State state() const
+	{
+		return p_.state();
+	}
 
-	RemoteIntProperty(RemoteProperty::State s, int v);
-	RemoteIntProperty(RemoteIntProperty&&) = default;
-	RemoteIntProperty(RemoteIntProperty const&) = default;
-	RemoteIntProperty& operator=(RemoteIntProperty&&) = default;
-	RemoteIntProperty& operator=(RemoteIntProperty const&) = default;
-	~RemoteIntProperty() noexcept = default;
+	T value() const
+	{
+		return p_.value();
+	}
 
-	void setValue(int v);
-	void setState(RemoteProperty::State s);
+	unsigned int version() const
+	{
+		return p_.version();
+	}
+
+	qint64 timestamp() const
+	{
+		return p_.timestamp();
+	}
+
+	unsigned int sequence() const
+	{
+		return p_.sequence();
+	}
+
+  protected:
+	BasicRemoteProperty<T> p_;
 };
 
-class RemoteStringProperty
+/**
+ * QML exposition of a BasicRemoteProperty<int>
+ */
+class RemoteIntProperty : public RemotePropertyGadget<int>
 {
 	Q_GADGET
 	Q_PROPERTY(eu::tgcm::avrremote::RemoteProperty::State state READ state)
-	Q_PROPERTY(QString value READ value)
+	Q_PROPERTY(int value READ value)
+	Q_PROPERTY(unsigned int version READ version)
+	Q_PROPERTY(qint64 timestamp READ timestamp)
+	Q_PROPERTY(unsigned int sequence READ sequence)
 
-	RemoteProperty::State s_;
+  public:
+	using RemotePropertyGadget::RemotePropertyGadget;
+};
 
-	QString v_;
+/**
+ * QML exposition of a BasicRemoteProperty<bool>
+ */
+class RemoteBoolProperty : public RemotePropertyGadget<bool>
+{
+	Q_GADGET
+	Q_PROPERTY(eu::tgcm::avrremote::RemoteProperty::State state READ state)
+	Q_PROPERTY(bool value READ value)
+	Q_PROPERTY(unsigned int version READ version)
+	Q_PROPERTY(qint64 timestamp READ timestamp)
+	Q_PROPERTY(unsigned int sequence READ sequence)
 
   public:
-	RemoteProperty::State state() const;
+	using RemotePropertyGadget::RemotePropertyGadget;
+};
 
-	QString value() const;
+/**
+ * QML exposition of a BasicRemoteProperty<avrcommand::Source>. As for the string property it replaces, the
+ * value is the name of the source (see avrcommand::toCStr), only built when read; index is its index.
+ */
+class RemoteSourceProperty : public RemotePropertyGadget<avrcommand::Source>
+{
+	Q_GADGET
+	Q_PROPERTY(eu::tgcm::avrremote::RemoteProperty::State state READ state)
+	Q_PROPERTY(QString value READ value)
+	Q_PROPERTY(int index READ index)
+	Q_PROPERTY(unsigned int version READ version)
+	Q_PROPERTY(qint64 timestamp READ timestamp)
+	Q_PROPERTY(unsigned int sequence READ sequence)
 
-	RemoteStringProperty();
+  public:
+	using RemotePropertyGadget::RemotePropertyGadget;
 
-	RemoteStringProperty(RemoteProperty::State s, QString v);
-	RemoteStringProperty(RemoteStringProperty&&) = default;
-	RemoteStringProperty(RemoteStringProperty const&) = default;
-	RemoteStringProperty& operator=(RemoteStringProperty&&) = default;
-	RemoteStringProperty& operator=(RemoteStringProperty const&) = default;
-	~RemoteStringProperty() noexcept = default;
+	QString value() const
+	{
+		return QString::fromUtf8(avrcommand::toCStr(p_.value()));
+	}
 
-	void setValue(QString v);
-	void setState(RemoteProperty::State s);
+	int index() const
+	{
+		return static_cast<int>(p_.value());
+	}
+
+	avrcommand::Source source() const
+	{
+		return p_.value();
+	}
 };
 
 } // namespace avrremote
@@ -101,6 +266,7 @@ class RemoteStringProperty
 } // namespace eu
 
 Q_DECLARE_METATYPE(eu::tgcm::avrremote::RemoteIntProperty)
-Q_DECLARE_METATYPE(eu::tgcm::avrremote::RemoteStringProperty)
+Q_DECLARE_METATYPE(eu::tgcm::avrremote::RemoteBoolProperty)
+Q_DECLARE_METATYPE(eu::tgcm::avrremote::RemoteSourceProperty)
 
 #endif // EU_TGCM_AVRREMOTE_REMOTEPROPERTY_H
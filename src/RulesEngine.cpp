@@ -0,0 +1,316 @@
+#include "RulesEngine.hpp"
+
+#include "AvrDevice.hpp"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+namespace
+{
+constexpr std::size_t propertyCount = static_cast<std::size_t>(DeviceProperty::Count);
+
+/**
+ * Property named name (see toCStr(DeviceProperty)), Count if none
+ */
+DeviceProperty propertyNamed(QString const& name)
+{
+	for (std::size_t i = 0; i < propertyCount; ++i)
+	{
+		if (name == QLatin1String(toCStr(static_cast<DeviceProperty>(i))))
+			return static_cast<DeviceProperty>(i);
+	}
+	return DeviceProperty::Count;
+}
+
+bool compare(RulesEngine::Comparison comparison, int value, int expected)
+{
+	switch (comparison)
+	{
+		case RulesEngine::Comparison::Equal:
+			return value == expected;
+		case RulesEngine::Comparison::NotEqual:
+			return value != expected;
+		case RulesEngine::Comparison::Less:
+			return value < expected;
+		case RulesEngine::Comparison::Greater:
+			return value > expected;
+	}
+	return false;
+}
+} // namespace
+
+bool RulesEngine::fromVariantMap(QVariantMap const& map, AvrDevice* device, AvrDevice* target, Rule& rule,
+                                 QString* error)
+{
+	auto fail = [error](QString const& message) {
+		if (error != nullptr)
+			*error = message;
+		return false;
+	};
+	Rule ret;
+	ret.device = device;
+	ret.target = target;
+	auto const when = map.value(QStringLiteral("when")).toMap();
+	if (when.isEmpty())
+		return fail(QStringLiteral("the rule has no condition"));
+	for (auto it = when.cbegin(); it != when.cend(); ++it)
+	{
+		auto property = propertyNamed(it.key());
+		if (property == DeviceProperty::Count)
+			return fail(QStringLiteral("condition on an unknown property %1").arg(it.key()));
+		bool ok = false;
+		if (it.value().type() != QVariant::Map)
+		{
+			// booleans convert to 0/1
+			auto const value = it.value().toInt(&ok);
+			if (!ok)
+				return fail(QStringLiteral("condition on %1 expects a value that is not a number").arg(it.key()));
+			ret.conditions.push_back(Condition{property, Comparison::Equal, value});
+			continue;
+		}
+		auto const comparison = it.value().toMap();
+		if (comparison.size() != 1)
+			return fail(QStringLiteral("condition on %1 does not have a single comparison").arg(it.key()));
+		auto const op = comparison.firstKey();
+		auto const value = comparison.first().toInt(&ok);
+		if (!ok)
+			return fail(QStringLiteral("condition on %1 compares with a value that is not a number").arg(it.key()));
+		if (op == QLatin1String("!="))
+			ret.conditions.push_back(Condition{property, Comparison::NotEqual, value});
+		else if (op == QLatin1String("<"))
+			ret.conditions.push_back(Condition{property, Comparison::Less, value});
+		else if (op == QLatin1String(">"))
+			ret.conditions.push_back(Condition{property, Comparison::Greater, value});
+		else
+			return fail(QStringLiteral("condition on %1 has an unknown comparison %2").arg(it.key(), op));
+	}
+	QString sceneError;
+	if (!Scene::fromVariantList(map.value(QStringLiteral("then")).toList(), ret.scene, &sceneError))
+		return fail(QStringLiteral("then: %1").arg(sceneError));
+	rule = std::move(ret);
+	return true;
+}
+
+RulesEngine::RulesEngine(QObject* parent) : QObject(parent)
+{
+}
+
+RulesEngine::~RulesEngine()
+{
+	for (auto it = devices_.cbegin(); it != devices_.cend(); ++it)
+	{
+		if (it.key()->rulesEngine() == this)
+			it.key()->setRulesEngine(nullptr);
+	}
+}
+
+int RulesEngine::addRule(Rule rule)
+{
+	if (rule.device == nullptr || rule.conditions.empty())
+		return -1;
+	if (rule.target == nullptr)
+		rule.target = rule.device;
+	attach_(rule.device);
+	attach_(rule.target);
+	bool const satisfied = holds_(rule, rule.device->snapshot());
+	rules_.push_back(Entry{nextId_, satisfied, std::move(rule)});
+	dirty_ = true;
+	return nextId_++;
+}
+
+void RulesEngine::removeRule(int id)
+{
+	auto it = std::find_if(rules_.begin(), rules_.end(), [id](Entry const& e) { return e.id == id; });
+	if (it == rules_.end())
+		return;
+	auto* device = it->rule.device;
+	auto* target = it->rule.target;
+	rules_.erase(it);
+	dirty_ = true;
+	detach_(device);
+	detach_(target);
+}
+
+int RulesEngine::ruleCount() const
+{
+	return static_cast<int>(rules_.size());
+}
+
+int RulesEngine::commandTimeout() const
+{
+	return commandTimeout_;
+}
+
+void RulesEngine::setCommandTimeout(int timeoutMs)
+{
+	commandTimeout_ = timeoutMs;
+}
+
+std::uint64_t RulesEngine::evaluations() const
+{
+	return evaluations_;
+}
+
+void RulesEngine::propertyChanged(AvrDevice* device, DeviceProperty property, AvrDeviceState const& state)
+{
+	if (dirty_)
+		compile_();
+	auto slot = slots_.constFind(device);
+	if (slot == slots_.cend() || property >= DeviceProperty::Count)
+		return;
+	auto const index = *slot * propertyCount + static_cast<std::size_t>(property);
+	// ruleFired is emitted once the index is no longer used: its slots may add or remove rules
+	QVarLengthArray<int, 8> fired;
+	for (auto i = offsets_[index]; i < offsets_[index + 1]; ++i)
+	{
+		auto& entry = rules_[dependents_[i]];
+		evaluations_ += 1;
+		bool const holds = holds_(entry.rule, state);
+		if (holds == entry.satisfied)
+			continue;
+		entry.satisfied = holds;
+		if (!holds)
+			continue;
+		fire_(entry);
+		fired.push_back(entry.id);
+	}
+	for (int id : fired)
+		emit ruleFired(id);
+}
+
+bool RulesEngine::holds_(Rule const& rule, AvrDeviceState const& state)
+{
+	return std::all_of(rule.conditions.cbegin(), rule.conditions.cend(), [&state](Condition const& c) {
+		auto const current = propertyValue(state, c.property);
+		return current.state == RemoteProperty::UpToDate && compare(c.comparison, current.value, c.value);
+	});
+}
+
+void RulesEngine::attach_(AvrDevice* device)
+{
+	auto& count = devices_[device];
+	count += 1;
+	if (count > 1)
+		return;
+	device->setRulesEngine(this);
+	connect(device, &QObject::destroyed, this, [this, device] { deviceDestroyed_(device); });
+}
+
+void RulesEngine::detach_(AvrDevice* device)
+{
+	auto it = devices_.find(device);
+	if (it == devices_.end() || --it.value() > 0)
+		return;
+	devices_.erase(it);
+	disconnect(device, &QObject::destroyed, this, nullptr);
+	if (device->rulesEngine() == this)
+		device->setRulesEngine(nullptr);
+}
+
+void RulesEngine::deviceDestroyed_(AvrDevice* device)
+{
+	devices_.remove(device); // not detached, it is being destroyed
+	for (auto it = rules_.begin(); it != rules_.end();)
+	{
+		if (it->rule.device != device && it->rule.target != device)
+		{
+			++it;
+			continue;
+		}
+		auto* other = it->rule.device == device ? it->rule.target : it->rule.device;
+		it = rules_.erase(it);
+		detach_(other);
+	}
+	dirty_ = true;
+}
+
+void RulesEngine::compile_()
+{
+	dirty_ = false;
+	slots_.clear();
+	for (auto const& e : rules_)
+	{
+		if (!slots_.contains(e.rule.device))
+			slots_.insert(e.rule.device, static_cast<std::uint32_t>(slots_.size()));
+	}
+	// counting sort of the (rule, property) pairs by slot and property, each rule counted once per property
+	offsets_.assign(static_cast<std::size_t>(slots_.size()) * propertyCount + 1, 0);
+	auto forEachDependency = [this](auto&& f) {
+		for (std::size_t r = 0; r < rules_.size(); ++r)
+		{
+			auto const& rule = rules_[r].rule;
+			std::uint32_t seen = 0; // properties of the rule already counted
+			for (auto const& c : rule.conditions)
+			{
+				if (c.property >= DeviceProperty::Count)
+					continue;
+				auto const bit = std::uint32_t{1} << static_cast<unsigned>(c.property);
+				if ((seen & bit) != 0)
+					continue;
+				seen |= bit;
+				f(slots_.value(rule.device) * propertyCount + static_cast<std::size_t>(c.property),
+				  static_cast<std::uint32_t>(r));
+			}
+		}
+	};
+	forEachDependency([this](std::size_t index, std::uint32_t) { offsets_[index + 1] += 1; });
+	for (std::size_t i = 1; i < offsets_.size(); ++i)
+		offsets_[i] += offsets_[i - 1];
+	dependents_.resize(offsets_.back());
+	std::vector<std::uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+	forEachDependency([this, &next](std::size_t index, std::uint32_t rule) { dependents_[next[index]++] = rule; });
+}
+
+void RulesEngine::fire_(Entry const& entry)
+{
+	auto* target = entry.rule.target;
+	auto batch =
+	    std::find_if(batches_.begin(), batches_.end(), [target](Batch const& b) { return b.device == target; });
+	if (batch == batches_.end())
+	{
+		batches_.push_back(Batch{target, {}});
+		batch = batches_.end() - 1;
+	}
+	for (auto const& t : entry.rule.scene.targets())
+	{
+		auto same = std::find_if(batch->targets.begin(), batch->targets.end(),
+		                         [&t](Scene::Target const& b) { return b.property == t.property; });
+		if (same != batch->targets.end())
+			same->value = t.value;
+		else
+			batch->targets.push_back(t);
+	}
+	if (!flushScheduled_)
+	{
+		flushScheduled_ = true;
+		QMetaObject::invokeMethod(this, &RulesEngine::flush_, Qt::QueuedConnection);
+	}
+}
+
+void RulesEngine::flush_()
+{
+	flushScheduled_ = false;
+	auto batches = std::move(batches_);
+	batches_.clear();
+	for (auto const& batch : batches)
+	{
+		if (batch.device.isNull() || batch.targets.empty())
+			continue;
+		Scene scene;
+		for (auto const& t : batch.targets)
+			scene.set(t.property, t.value);
+		SceneOperation::apply(scene, {batch.device.data()}, commandTimeout_, this);
+	}
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
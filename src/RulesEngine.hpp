@@ -0,0 +1,166 @@
+#ifndef EU_TGCM_AVRREMOTE_RULESENGINE_H
+#define EU_TGCM_AVRREMOTE_RULESENGINE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QVariantMap>
+
+#include "AvrDeviceState.hpp"
+#include "Scene.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * Runs automation rules such as "when the source becomes TV, set the volume to 35 dB and turn zone 2 on".
+ * A rule holds conditions on the properties of a device, and a scene applied to that device or to another
+ * one once all the conditions hold.
+ *
+ * Rules are compiled into an index keyed by (device, property): the devices report each change to the
+ * engine (see AvrDevice::setRulesEngine), which only evaluates the rules having a condition on that
+ * property, so the cost of a change does not grow with the number of rules of the fleet. A rule fires when
+ * its conditions become true, and not again until they have been false.
+ *
+ * The scenes of the rules fired during an event loop iteration are merged per device, a later rule
+ * overriding the targets of an earlier one, and applied by a single SceneOperation per device: the device
+ * gets all its commands in one write.
+ *
+ * The engine and the devices of its rules must live in the same thread.
+ */
+class RulesEngine : public QObject
+{
+	Q_OBJECT
+
+  public:
+	enum class Comparison : std::uint8_t
+	{
+		Equal,
+		NotEqual,
+		Less,
+		Greater
+	};
+
+	struct Condition
+	{
+		DeviceProperty property;
+		Comparison comparison;
+		int value; /**< source index, or 0/1 for booleans, as in PropertyValue */
+	};
+
+	struct Rule
+	{
+		AvrDevice* device = nullptr; /**< whose properties the conditions test */
+		AvrDevice* target = nullptr; /**< the scene is applied to device if null */
+		std::vector<Condition> conditions; /**< all must hold, on up to date properties */
+		Scene scene;
+	};
+
+	/**
+	 * Builds a rule from a map such as {"when": {"source": 4, "volume": {">": 600}}, "then": [{"volume":
+	 * 350}, {"zone2On": true}]}. "when" maps property names (see toCStr(DeviceProperty)) to the value
+	 * expected, or to a map with a single "!=", "<" or ">" key. "then" is a scene, see
+	 * Scene::fromVariantList. The scene is applied to target, or to device if target is null.
+	 *
+	 * Returns false and sets error, leaving rule unchanged, if there is no condition, if a condition is on
+	 * an unknown property, has an unknown comparison or a value that is not a number, or if the scene is
+	 * not valid.
+	 */
+	static bool fromVariantMap(QVariantMap const& map, AvrDevice* device, AvrDevice* target, Rule& rule,
+	                           QString* error = nullptr);
+
+	explicit RulesEngine(QObject* parent = nullptr);
+	~RulesEngine() override;
+
+	/**
+	 * Adds rule, returns its id, or -1 if it has no device or no condition. A rule whose conditions already
+	 * hold does not fire until they have been false. Rules of a deleted device, or targeting it, are
+	 * removed.
+	 */
+	int addRule(Rule rule);
+	void removeRule(int id);
+	int ruleCount() const;
+
+	/**
+	 * Timeout of the scene operations applying the rules, 3 s by default
+	 */
+	int commandTimeout() const;
+	void setCommandTimeout(int timeoutMs);
+
+	/**
+	 * Number of rule evaluations since the engine was created, to check that a change only evaluates the
+	 * rules depending on it
+	 */
+	std::uint64_t evaluations() const;
+
+	/**
+	 * Evaluates the rules depending on property of device, whose state is now state. Called by the devices
+	 * for each change reported by the receiver.
+	 */
+	void propertyChanged(AvrDevice* device, DeviceProperty property, AvrDeviceState const& state);
+
+  signals:
+	void ruleFired(int id);
+
+  private:
+	struct Entry
+	{
+		int id;
+		bool satisfied; /**< the conditions held at the last evaluation */
+		Rule rule;
+	};
+
+	/**
+	 * Targets to apply to a device at the end of the event loop iteration
+	 */
+	struct Batch
+	{
+		QPointer<AvrDevice> device;
+		std::vector<Scene::Target> targets;
+	};
+
+	static bool holds_(Rule const& rule, AvrDeviceState const& state);
+	void attach_(AvrDevice* device);
+	void detach_(AvrDevice* device);
+	void deviceDestroyed_(AvrDevice* device);
+	void compile_();
+	void fire_(Entry const& entry);
+	void flush_();
+
+	std::vector<Entry> rules_;
+
+	/**
+	 * Devices used by the rules, as device or target, with their number of rules
+	 */
+	QHash<AvrDevice*, int> devices_;
+
+	/**
+	 * The index: the rules depending on property of the device of slot s are
+	 * dependents_[offsets_[s * DeviceProperty::Count + property]] up to the next offset
+	 */
+	QHash<AvrDevice*, std::uint32_t> slots_;
+	std::vector<std::uint32_t> offsets_;
+	std::vector<std::uint32_t> dependents_; /**< indexes in rules_ */
+
+	std::vector<Batch> batches_;
+	std::uint64_t evaluations_ = 0;
+	int nextId_ = 1;
+	int commandTimeout_ = 3000;
+	bool dirty_ = false; /**< the index must be compiled again */
+	bool flushScheduled_ = false;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_RULESENGINE_H
@@ -0,0 +1,267 @@
+#include "Scene.hpp"
+
+#include "AvrDevice.hpp"
+
+#include <QVariantMap>
+
+#include <array>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+Scene& Scene::setStandby(bool standby)
+{
+	targets_.push_back(Target{DeviceProperty::Standby, standby ? 1 : 0});
+	return *this;
+}
+
+Scene& Scene::setMainZoneOn(bool on)
+{
+	targets_.push_back(Target{DeviceProperty::MainZoneOn, on ? 1 : 0});
+	return *this;
+}
+
+Scene& Scene::setZone2On(bool on)
+{
+	targets_.push_back(Target{DeviceProperty::Zone2On, on ? 1 : 0});
+	return *this;
+}
+
+Scene& Scene::setSource(avrcommand::Source source)
+{
+	targets_.push_back(Target{DeviceProperty::Source, static_cast<int>(source)});
+	return *this;
+}
+
+Scene& Scene::setVolume(int volume)
+{
+	targets_.push_back(Target{DeviceProperty::Volume, volume});
+	return *this;
+}
+
+Scene& Scene::setMuted(bool muted)
+{
+	targets_.push_back(Target{DeviceProperty::Muted, muted ? 1 : 0});
+	return *this;
+}
+
+Scene& Scene::set(DeviceProperty property, int value)
+{
+	targets_.push_back(Target{property, value});
+	return *this;
+}
+
+bool Scene::fromVariantList(QVariantList const& list, Scene& scene, QString* error)
+{
+	auto fail = [error](QString const& message) {
+		if (error != nullptr)
+			*error = message;
+		return false;
+	};
+	Scene ret;
+	for (int i = 0; i < list.size(); ++i)
+	{
+		auto const map = list.at(i).toMap();
+		// a map with several keys would be applied in the alphabetical order of its keys
+		if (map.size() != 1)
+			return fail(QStringLiteral("step %1 does not have a single property").arg(i));
+		auto property = DeviceProperty::Count;
+		for (std::size_t p = 0; p < static_cast<std::size_t>(DeviceProperty::Count); ++p)
+		{
+			if (map.firstKey() == QLatin1String(toCStr(static_cast<DeviceProperty>(p))))
+				property = static_cast<DeviceProperty>(p);
+		}
+		if (property == DeviceProperty::Count || property == DeviceProperty::MaxVolume)
+			return fail(QStringLiteral("step %1 sets an unknown property %2").arg(i).arg(map.firstKey()));
+		bool ok = false;
+		auto const value = map.first().toInt(&ok); // booleans convert to 0/1
+		if (!ok)
+			return fail(QStringLiteral("step %1 sets %2 to a value that is not a number").arg(i).arg(map.firstKey()));
+		ret.set(property, value);
+	}
+	scene = std::move(ret);
+	return true;
+}
+
+bool Scene::appendCommand(Target const& target, std::string& commands, avrcommand::Dialect dialect)
+{
+	if (target.property == DeviceProperty::Standby)
+	{
+		commands += target.value ? avrcommand::powerOffCommand : avrcommand::powerOnCommand;
+		return true;
+	}
+	if (!isZoneProperty(target.property))
+		return false;
+	return avrcommand::withZone(zoneOf(target.property), [&target, &commands, dialect](auto zone) {
+		switch (zoneFieldOf(target.property))
+		{
+			case ZoneField::Volume:
+			{
+				if (target.value < 0 || target.value >= 1000)
+					return false;
+				std::array<char, 6> d;
+				commands += avrcommand::setVolume(zone, target.value, d);
+				return true;
+			}
+			case ZoneField::Source:
+			{
+				if (target.value < 0 || target.value > static_cast<int>(avrcommand::Source::Bluetooth))
+					return false;
+				std::array<char, 12> d;
+				auto source = static_cast<avrcommand::Source>(target.value);
+				auto command = avrcommand::withDialect(dialect, [zone, source, &d](auto dialectPolicy) {
+					return avrcommand::setSource<decltype(dialectPolicy)>(zone, source, d);
+				});
+				commands += command;
+				return !command.empty(); // unsupported by the dialect
+			}
+			case ZoneField::Muted:
+				commands += avrcommand::muteCommand(zone, target.value != 0);
+				return true;
+			case ZoneField::On:
+				commands += avrcommand::zoneOnCommand(zone, target.value != 0);
+				return true;
+			case ZoneField::Count:
+				break;
+		}
+		return false;
+	});
+}
+
+SceneOperation::SceneOperation(QObject* parent) : QObject(parent)
+{
+	timeout_.setSingleShot(true);
+	connect(&timeout_, &QTimer::timeout, this, &SceneOperation::finish_);
+}
+
+SceneOperation* SceneOperation::apply(Scene const& scene, QList<AvrDevice*> const& devices, int timeoutMs,
+                                      QObject* parent)
+{
+	auto* op = new SceneOperation(parent);
+	op->start_(scene, devices, timeoutMs);
+	return op;
+}
+
+void SceneOperation::start_(Scene const& scene, QList<AvrDevice*> const& devices, int timeoutMs)
+{
+	std::string commands;
+	for (auto* device : devices)
+	{
+		auto state = device->snapshot();
+		bool connected = state.connectionStatus == AvrDevice::Connected;
+		commands.clear();
+		auto firstPending = pending_.size();
+		for (auto const& target : scene.targets())
+		{
+			auto current = propertyValue(state, target.property);
+			if (current.state == RemoteProperty::UpToDate && current.value == target.value)
+				continue; // already there
+			auto dialect = static_cast<avrcommand::Dialect>(device->dialect());
+			if (!connected || !device->supports(target.property, target.value) ||
+			    !Scene::appendCommand(target, commands, dialect))
+			{
+				failures_.push_back(Failure{device, target.property});
+				continue;
+			}
+			pending_.push_back(Pending{device, target.property, target.value, state.sequence});
+		}
+		if (commands.empty())
+			continue;
+		device->sendCommands(commands);
+		commandsSent_ += static_cast<int>(pending_.size() - firstPending);
+		connect(device, &AvrDevice::stateChanged, this, [this, device] { checkDevice_(device); });
+		connect(device, &AvrDevice::connectionStatusChanged, this, [this, device] {
+			if (device->connectionStatus() != AvrDevice::Connected)
+				failDevice_(device);
+		});
+	}
+	if (pending_.empty())
+		QMetaObject::invokeMethod(this, &SceneOperation::finish_, Qt::QueuedConnection);
+	else
+		timeout_.start(timeoutMs);
+}
+
+void SceneOperation::checkDevice_(AvrDevice* device)
+{
+	if (finished_)
+		return;
+	auto state = device->snapshot();
+	for (auto it = pending_.begin(); it != pending_.end();)
+	{
+		auto current = propertyValue(state, it->property);
+		// the echo must have been received after the command was sent, an older value does not count
+		if (it->device == device && current.value == it->value && current.sequence > it->sequence)
+			it = pending_.erase(it);
+		else
+			++it;
+	}
+	if (pending_.empty())
+		finish_();
+}
+
+void SceneOperation::failDevice_(AvrDevice* device)
+{
+	if (finished_)
+		return;
+	for (auto it = pending_.begin(); it != pending_.end();)
+	{
+		if (it->device == device)
+		{
+			failures_.push_back(Failure{device, it->property});
+			it = pending_.erase(it);
+		}
+		else
+			++it;
+	}
+	if (pending_.empty())
+		finish_();
+}
+
+void SceneOperation::finish_()
+{
+	if (finished_)
+		return;
+	for (auto const& p : pending_)
+		failures_.push_back(Failure{p.device, p.property});
+	pending_.clear();
+	timeout_.stop();
+	finished_ = true;
+	emit finished(failures_.empty());
+	deleteLater();
+}
+
+bool SceneOperation::isFinished() const
+{
+	return finished_;
+}
+
+bool SceneOperation::succeeded() const
+{
+	return finished_ && failures_.empty();
+}
+
+int SceneOperation::commandsSent() const
+{
+	return commandsSent_;
+}
+
+std::vector<SceneOperation::Failure> const& SceneOperation::failures() const
+{
+	return failures_;
+}
+
+QStringList SceneOperation::failedProperties() const
+{
+	QStringList ret;
+	for (auto const& f : failures_)
+		ret.push_back(QString::fromUtf8(toCStr(f.property)));
+	return ret;
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,152 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVariantList>
+
+#include "AvrDeviceState.hpp"
+#include "marantzuart.hpp"
+
+#include <string>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+class AvrDevice;
+
+/**
+ * An ordered list of target values for the properties of a device (e.g. power on, then select a source,
+ * then set the volume). Applied to one or more devices by SceneOperation.
+ */
+class Scene
+{
+  public:
+	struct Target
+	{
+		DeviceProperty property;
+		int value; /**< source index, or 0/1 for booleans */
+	};
+
+	Scene& setStandby(bool standby);
+	Scene& setMainZoneOn(bool on);
+	Scene& setZone2On(bool on);
+	Scene& setSource(avrcommand::Source source);
+	Scene& setVolume(int volume);
+	Scene& setMuted(bool muted);
+
+	/**
+	 * Appends a target for any property, e.g. zoneProperty(2, ZoneField::Volume) for the volume of zone 3
+	 */
+	Scene& set(DeviceProperty property, int value);
+
+	std::vector<Target> const& targets() const
+	{
+		return targets_;
+	}
+
+	/**
+	 * Builds a scene from a list of maps, each one holding a single property name (see
+	 * toCStr(DeviceProperty), e.g. standby, source (index), volume, muted, mainZoneOn, zone2Volume or
+	 * zone3On) and its value, e.g. [{"standby": false}, {"source": 3}, {"volume": 450}]. The targets are
+	 * applied in the order of the list. Returns false and sets error, leaving scene unchanged, if a map does
+	 * not hold exactly one key, if a key is unknown or maxVolume, or if a value is not a number or a boolean.
+	 */
+	static bool fromVariantList(QVariantList const& list, Scene& scene, QString* error = nullptr);
+
+	/**
+	 * Appends the command setting target to commands, in dialect, returns false if target cannot be set by
+	 * a command
+	 */
+	static bool appendCommand(Target const& target, std::string& commands,
+	                          avrcommand::Dialect dialect = avrcommand::Dialect::Marantz);
+
+  private:
+	std::vector<Target> targets_;
+};
+
+/**
+ * Applies a scene to a set of devices. For each device, targets already matching the known state of the
+ * device are skipped, and the commands for the other ones are pipelined in a single write. The operation
+ * then waits for the echo of each command, and finishes once all the targets are confirmed, or when the
+ * timeout expires. Devices that are not connected, or that get disconnected, fail all their remaining
+ * targets. Targets a device does not support (see AvrDevice::supports) fail without being sent.
+ */
+class SceneOperation : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(bool finished READ isFinished NOTIFY finished)
+	Q_PROPERTY(bool succeeded READ succeeded NOTIFY finished)
+	Q_PROPERTY(int commandsSent READ commandsSent CONSTANT)
+
+  public:
+	struct Failure
+	{
+		AvrDevice* device;
+		DeviceProperty property;
+	};
+
+	/**
+	 * Starts applying scene to devices. The operation is a child of parent, and deletes itself once
+	 * finished has been emitted. finished is always emitted asynchronously, even if there was nothing to
+	 * do.
+	 */
+	static SceneOperation* apply(Scene const& scene, QList<AvrDevice*> const& devices, int timeoutMs,
+	                             QObject* parent = nullptr);
+
+	bool isFinished() const;
+	bool succeeded() const;
+
+	/**
+	 * Number of commands written, across all devices
+	 */
+	int commandsSent() const;
+
+	/**
+	 * Targets that were not confirmed, valid when finished is emitted
+	 */
+	std::vector<Failure> const& failures() const;
+
+	/**
+	 * Names (see toCStr(DeviceProperty)) of the properties that failed, for QML
+	 */
+	Q_INVOKABLE QStringList failedProperties() const;
+
+  signals:
+	void finished(bool success);
+
+  private:
+	explicit SceneOperation(QObject* parent);
+
+	struct Pending
+	{
+		QPointer<AvrDevice> device;
+		DeviceProperty property;
+		int value;
+		std::uint32_t sequence; /**< sequence of the device state when the command was sent */
+	};
+
+	void start_(Scene const& scene, QList<AvrDevice*> const& devices, int timeoutMs);
+	void checkDevice_(AvrDevice* device);
+	void failDevice_(AvrDevice* device);
+	void finish_();
+
+	std::vector<Pending> pending_;
+	std::vector<Failure> failures_;
+	QTimer timeout_;
+	int commandsSent_ = 0;
+	bool finished_ = false;
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // SCENE_HPP
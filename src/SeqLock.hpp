@@ -0,0 +1,107 @@
+#ifndef EU_TGCM_AVRREMOTE_SEQLOCK_H
+#define EU_TGCM_AVRREMOTE_SEQLOCK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * Sequence lock protecting a trivially copyable value. There must be a single writer, readers never block
+ * the writer and never take a lock: they retry if the value was modified while they were reading it.
+ *
+ * The value is stored as an array of atomic words, so that concurrent reads and writes are not data races.
+ * All the atomics are lock free and address free, so a SeqLock can be placed in shared memory.
+ */
+template <typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "seqlock values must be trivially copyable");
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "seqlock requires lock free 64 bits atomics");
+
+  public:
+	SeqLock() noexcept : SeqLock(T{})
+	{
+	}
+
+	explicit SeqLock(T const& value) noexcept
+	{
+		store(value);
+	}
+
+	SeqLock(SeqLock const&) = delete;
+	SeqLock& operator=(SeqLock const&) = delete;
+
+	/**
+	 * Publishes a new value. Must only be called by the writer.
+	 */
+	void store(T const& value) noexcept
+	{
+		std::array<std::uint64_t, nbWords> buffer{};
+		std::memcpy(buffer.data(), &value, sizeof(T));
+		auto const seq = seq_.load(std::memory_order_relaxed);
+		seq_.store(seq + 1, std::memory_order_relaxed); // odd: write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		for (std::size_t i = 0; i < nbWords; ++i)
+			data_[i].store(buffer[i], std::memory_order_relaxed);
+		seq_.store(seq + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Tries to read the value, returns false if a write was in progress. out is only modified on success.
+	 */
+	bool tryLoad(T& out) const noexcept
+	{
+		std::array<std::uint64_t, nbWords> buffer;
+		auto const seq = seq_.load(std::memory_order_acquire);
+		if (seq & 1)
+			return false;
+		for (std::size_t i = 0; i < nbWords; ++i)
+			buffer[i] = data_[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq_.load(std::memory_order_relaxed) != seq)
+			return false;
+		std::memcpy(&out, buffer.data(), sizeof(T));
+		return true;
+	}
+
+	/**
+	 * Reads a consistent value, retrying as long as a write is in progress
+	 */
+	T load() const noexcept
+	{
+		T ret{};
+		while (!tryLoad(ret))
+			;
+		return ret;
+	}
+
+	/**
+	 * Number of writes since construction, can be used by readers to detect changes without copying the value
+	 */
+	std::uint32_t version() const noexcept
+	{
+		return seq_.load(std::memory_order_acquire) / 2;
+	}
+
+  private:
+	static constexpr std::size_t nbWords = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+	std::atomic<std::uint32_t> seq_{0};
+
+	std::array<std::atomic<std::uint64_t>, nbWords> data_{};
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_SEQLOCK_H
@@ -0,0 +1,241 @@
+#include "TimerWheel.hpp"
+
+#include "RemoteProperty.hpp"
+
+#include <QCoreApplication>
+#include <QPointer>
+#include <QThread>
+
+#include <algorithm>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+TimerWheel::TimerWheel(int tickMs, int slotCount, QObject* parent) :
+    QObject(parent),
+    tickNs_(std::max(tickMs, 1) * std::int64_t{1'000'000}),
+    slotMask_(0),
+    origin_(monotonicTimestamp())
+{
+	std::uint32_t count = 1;
+	while (count < static_cast<std::uint32_t>(std::max(slotCount, 64)))
+		count *= 2;
+	slotMask_ = count - 1;
+	slots_.assign(count, -1);
+	occupied_.assign(count / 64, 0);
+	timer_.setSingleShot(true);
+	// deadlines are already coalesced on ticks, a coarse timer would move them again
+	timer_.setTimerType(Qt::PreciseTimer);
+	connect(&timer_, &QTimer::timeout, this, &TimerWheel::wakeup_);
+}
+
+TimerWheel::~TimerWheel() = default;
+
+TimerWheel* TimerWheel::forCurrentThread()
+{
+	thread_local QPointer<TimerWheel> wheel;
+	if (wheel.isNull())
+	{
+		auto* app = QCoreApplication::instance();
+		if (app != nullptr && app->thread() == QThread::currentThread())
+			wheel = new TimerWheel(10, 512, app);
+		else
+		{
+			auto* w = new TimerWheel;
+			// finished is emitted from the thread itself, where the wheel lives
+			connect(QThread::currentThread(), &QThread::finished, w, [w] { delete w; }, Qt::DirectConnection);
+			wheel = w;
+		}
+	}
+	return wheel.data();
+}
+
+int TimerWheel::tickMs() const
+{
+	return static_cast<int>(tickNs_ / 1'000'000);
+}
+
+int TimerWheel::slotCount() const
+{
+	return static_cast<int>(slotMask_ + 1);
+}
+
+TimerWheel::TimerId TimerWheel::start(int delayMs, std::function<void()> callback)
+{
+	std::int32_t index = firstFree_;
+	if (index >= 0)
+		firstFree_ = entries_[static_cast<std::size_t>(index)].next;
+	else
+	{
+		index = static_cast<std::int32_t>(entries_.size());
+		entries_.emplace_back();
+	}
+	auto& entry = entries_[static_cast<std::size_t>(index)];
+	entry.callback = std::move(callback);
+	// rounded up, a timer never fires early
+	auto deadline = monotonicTimestamp() + std::max(delayMs, 0) * std::int64_t{1'000'000};
+	entry.deadline = std::max(tickOf_(deadline + tickNs_ - 1), currentTick_ + 1);
+	link_(index);
+	activeTimers_ += 1;
+	schedule_(entry.deadline);
+	return (std::uint64_t{entry.generation} << 32) | static_cast<std::uint32_t>(index + 1);
+}
+
+bool TimerWheel::cancel(TimerId timer)
+{
+	auto index = indexOf_(timer);
+	if (index < 0)
+		return false;
+	if (entries_[static_cast<std::size_t>(index)].state == EntryState::Linked)
+		unlink_(index);
+	release_(index);
+	if (activeTimers_ == 0)
+		timer_.stop();
+	// else the QTimer may wake up for nothing, which is cheaper than looking for the next deadline
+	return true;
+}
+
+bool TimerWheel::isActive(TimerId timer) const
+{
+	return indexOf_(timer) >= 0;
+}
+
+std::size_t TimerWheel::activeTimers() const
+{
+	return activeTimers_;
+}
+
+std::int64_t TimerWheel::tickOf_(std::int64_t timestamp) const
+{
+	return (timestamp - origin_) / tickNs_;
+}
+
+std::int32_t TimerWheel::indexOf_(TimerId timer) const
+{
+	auto index = static_cast<std::uint32_t>(timer & 0xffffffffu);
+	if (index == 0 || index > entries_.size())
+		return -1;
+	auto const& entry = entries_[index - 1];
+	if (entry.state == EntryState::Free || entry.generation != static_cast<std::uint32_t>(timer >> 32))
+		return -1;
+	return static_cast<std::int32_t>(index - 1);
+}
+
+void TimerWheel::link_(std::int32_t index)
+{
+	auto& entry = entries_[static_cast<std::size_t>(index)];
+	auto slot = static_cast<std::size_t>(entry.deadline) & slotMask_;
+	entry.prev = -1;
+	entry.next = slots_[slot];
+	if (entry.next >= 0)
+		entries_[static_cast<std::size_t>(entry.next)].prev = index;
+	slots_[slot] = index;
+	occupied_[slot / 64] |= std::uint64_t{1} << (slot % 64);
+	entry.state = EntryState::Linked;
+}
+
+void TimerWheel::unlink_(std::int32_t index)
+{
+	auto& entry = entries_[static_cast<std::size_t>(index)];
+	auto slot = static_cast<std::size_t>(entry.deadline) & slotMask_;
+	if (entry.prev >= 0)
+		entries_[static_cast<std::size_t>(entry.prev)].next = entry.next;
+	else
+		slots_[slot] = entry.next;
+	if (entry.next >= 0)
+		entries_[static_cast<std::size_t>(entry.next)].prev = entry.prev;
+	if (slots_[slot] < 0)
+		occupied_[slot / 64] &= ~(std::uint64_t{1} << (slot % 64));
+	entry.state = EntryState::Expired;
+}
+
+void TimerWheel::release_(std::int32_t index)
+{
+	auto& entry = entries_[static_cast<std::size_t>(index)];
+	entry.callback = nullptr;
+	entry.state = EntryState::Free;
+	entry.generation += 1; // invalidates the id
+	entry.next = firstFree_;
+	firstFree_ = index;
+	activeTimers_ -= 1;
+}
+
+void TimerWheel::schedule_(std::int64_t tick)
+{
+	if (timer_.isActive() && scheduledTick_ <= tick)
+		return;
+	scheduledTick_ = tick;
+	auto delay = origin_ + tick * tickNs_ - monotonicTimestamp();
+	timer_.start(static_cast<int>(std::max<std::int64_t>((delay + 999'999) / 1'000'000, 0)));
+}
+
+void TimerWheel::scheduleNext_()
+{
+	if (activeTimers_ == 0)
+		return;
+	// next occupied slot after the current tick, its timers may be for a later turn of the wheel
+	auto const slotCount = static_cast<std::size_t>(slotMask_) + 1;
+	auto const first = static_cast<std::size_t>(currentTick_ + 1) & slotMask_;
+	for (std::size_t distance = 0; distance < slotCount;)
+	{
+		auto slot = (first + distance) & slotMask_;
+		auto word = occupied_[slot / 64] >> (slot % 64);
+		if (word != 0)
+		{
+			for (; (word & 1) == 0; word >>= 1)
+				distance += 1;
+			schedule_(currentTick_ + 1 + static_cast<std::int64_t>(distance));
+			return;
+		}
+		distance += 64 - slot % 64;
+	}
+	// all the active timers are being fired, starting a new one will schedule the QTimer
+}
+
+void TimerWheel::wakeup_()
+{
+	auto const now = tickOf_(monotonicTimestamp());
+	// a late wakeup catches up with the ticks it missed, but goes through each slot at most once
+	auto const nbTicks = std::min<std::int64_t>(now - currentTick_, static_cast<std::int64_t>(slotMask_) + 1);
+	std::vector<std::int32_t> expired;
+	expired.swap(expired_);
+	for (std::int64_t tick = currentTick_ + 1; tick <= currentTick_ + nbTicks; ++tick)
+	{
+		auto const firstExpired = expired.size();
+		auto index = slots_[static_cast<std::size_t>(tick) & slotMask_];
+		while (index >= 0)
+		{
+			auto next = entries_[static_cast<std::size_t>(index)].next;
+			if (entries_[static_cast<std::size_t>(index)].deadline <= now)
+			{
+				unlink_(index);
+				expired.push_back(index);
+			}
+			index = next;
+		}
+		// timers are added at the head of their slot, fire them in the order they were started
+		std::reverse(expired.begin() + static_cast<std::ptrdiff_t>(firstExpired), expired.end());
+	}
+	currentTick_ = std::max(currentTick_, now);
+	for (auto index : expired)
+	{
+		auto& entry = entries_[static_cast<std::size_t>(index)];
+		if (entry.state != EntryState::Expired)
+			continue; // cancelled by a previous callback
+		auto callback = std::move(entry.callback);
+		release_(index);
+		callback(); // may start or cancel timers
+	}
+	expired.clear();
+	if (expired_.empty())
+		expired.swap(expired_);
+	scheduleNext_();
+}
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,143 @@
+#ifndef EU_TGCM_AVRREMOTE_TIMERWHEEL_H
+#define EU_TGCM_AVRREMOTE_TIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+
+/**
+ * Single shot timers of many objects (e.g. thousands of AvrDevice), driven by a single QTimer. Timers are kept
+ * in a hashed wheel: slot i holds the timers expiring at a tick t such that t % slotCount == i. Starting and
+ * cancelling a timer is O(1).
+ *
+ * Deadlines are rounded up to the next tick, so that all the timers expiring during a tick are fired by the same
+ * wakeup: a larger tick means fewer wakeups, and less precise timers. The QTimer only runs while there are
+ * timers, and wakes the event loop at the next tick having timers, not at every tick.
+ *
+ * Timers must be started and cancelled from the thread of the wheel.
+ */
+class TimerWheel : public QObject
+{
+	Q_OBJECT
+
+  public:
+	/**
+	 * Identifies a started timer, 0 is never a valid id
+	 */
+	using TimerId = std::uint64_t;
+
+	/**
+	 * slotCount is rounded up to a power of 2. The wheel is most efficient when most delays are shorter
+	 * than tickMs * slotCount, longer delays take several turns of the wheel.
+	 */
+	explicit TimerWheel(int tickMs = 10, int slotCount = 512, QObject* parent = nullptr);
+	~TimerWheel() override;
+
+	/**
+	 * Wheel of the current thread with the default settings, created on first use and deleted with the
+	 * application (main thread) or when the thread finishes
+	 */
+	static TimerWheel* forCurrentThread();
+
+	int tickMs() const;
+	int slotCount() const;
+
+	/**
+	 * Calls callback once, in delayMs or up to a tick later. Returns the id to cancel it.
+	 */
+	TimerId start(int delayMs, std::function<void()> callback);
+
+	/**
+	 * Cancels timer, false if it has already fired or been cancelled
+	 */
+	bool cancel(TimerId timer);
+
+	bool isActive(TimerId timer) const;
+
+	/**
+	 * Number of timers not yet fired nor cancelled
+	 */
+	std::size_t activeTimers() const;
+
+  private:
+	enum class EntryState : std::uint8_t
+	{
+		Free,
+		Linked, /**< in the list of its slot */
+		Expired /**< out of its slot, about to be fired */
+	};
+
+	struct Entry
+	{
+		std::function<void()> callback;
+		std::int64_t deadline = 0; /**< tick */
+		std::uint32_t generation = 1;
+		std::int32_t prev = -1;
+		std::int32_t next = -1; /**< next entry of the slot, or of the free list */
+		EntryState state = EntryState::Free;
+	};
+
+	std::int64_t tickNs_;
+	std::uint32_t slotMask_;
+
+	/**
+	 * Monotonic time of tick 0, ns
+	 */
+	std::int64_t origin_;
+
+	/**
+	 * Last tick whose timers have been fired
+	 */
+	std::int64_t currentTick_ = 0;
+
+	/**
+	 * Tick the QTimer is set to wake at, when active
+	 */
+	std::int64_t scheduledTick_ = 0;
+
+	std::vector<Entry> entries_;
+	std::int32_t firstFree_ = -1;
+	std::size_t activeTimers_ = 0;
+
+	/**
+	 * First entry of each slot, -1 if empty
+	 */
+	std::vector<std::int32_t> slots_;
+
+	/**
+	 * One bit per slot, set when it holds entries, to find the next tick to wake at
+	 */
+	std::vector<std::uint64_t> occupied_;
+
+	/**
+	 * Entries to fire during a wakeup, kept to avoid allocating at each wakeup
+	 */
+	std::vector<std::int32_t> expired_;
+
+	QTimer timer_;
+
+	std::int64_t tickOf_(std::int64_t timestamp) const;
+	std::int32_t indexOf_(TimerId timer) const; /**< -1 if not active */
+	void link_(std::int32_t index);
+	void unlink_(std::int32_t index);
+	void release_(std::int32_t index);
+	void schedule_(std::int64_t tick);
+	void scheduleNext_();
+	void wakeup_();
+};
+
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRREMOTE_TIMERWHEEL_H
@@ -0,0 +1,139 @@
+#include "Trace.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace trace
+{
+
+namespace
+{
+/**
+ * Conversion of ticks to the monotonic clock, in nanoseconds. The rate is measured between the creation of
+ * the registry and the export.
+ */
+struct Clock
+{
+	std::int64_t ticks;
+	std::int64_t ns;
+
+	static Clock current()
+	{
+		return Clock{now(), std::chrono::duration_cast<std::chrono::nanoseconds>(
+		                        std::chrono::steady_clock::now().time_since_epoch())
+		                        .count()};
+	}
+};
+
+struct Registry
+{
+	std::mutex mutex;
+	Clock reference = Clock::current();
+	// buffers are never freed: a thread may still be writing to its buffer while exporting
+	std::vector<std::unique_ptr<detail::ThreadBuffer>> buffers;
+};
+
+Registry& registry_()
+{
+	static Registry r;
+	return r;
+}
+
+void appendJsonString_(std::string& out, char const* str)
+{
+	out += '"';
+	for (; *str != 0; ++str)
+	{
+		if (*str == '"' || *str == '\\')
+			out += '\\';
+		out += *str;
+	}
+	out += '"';
+}
+} // namespace
+
+detail::ThreadBuffer* detail::createBuffer() noexcept
+{
+	auto& r = registry_();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.buffers.push_back(std::make_unique<ThreadBuffer>(static_cast<std::uint32_t>(r.buffers.size() + 1)));
+	return r.buffers.back().get();
+}
+
+std::string exportChromeTrace()
+{
+	auto& r = registry_();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	auto const current = Clock::current();
+	double nsPerTick = 1.;
+	if (current.ticks != r.reference.ticks)
+		nsPerTick = static_cast<double>(current.ns - r.reference.ns) /
+		            static_cast<double>(current.ticks - r.reference.ticks);
+	auto toNs = [&](std::int64_t ticks) {
+		auto elapsed = static_cast<double>(ticks - r.reference.ticks) * nsPerTick;
+		return r.reference.ns + static_cast<std::int64_t>(elapsed);
+	};
+	std::string out = "{\"traceEvents\":[";
+	bool first = true;
+	char buffer[128];
+	for (auto const& b : r.buffers)
+	{
+		auto head = b->head.load(std::memory_order_acquire);
+		auto begin = head > bufferCapacity ? head - bufferCapacity : 0;
+		for (auto i = begin; i < head; ++i)
+		{
+			auto const& e = b->events[i % bufferCapacity];
+			auto start = toNs(e.start);
+			auto duration = static_cast<std::int64_t>(static_cast<double>(e.duration) * nsPerTick);
+			if (!first)
+				out += ',';
+			first = false;
+			out += "{\"name\":";
+			appendJsonString_(out, e.name);
+			// chrome traces are in microseconds
+			std::snprintf(buffer, sizeof(buffer),
+			              ",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%" PRId64 ".%03d,\"dur\":%" PRId64
+			              ".%03d}",
+			              b->tid, start / 1000, static_cast<int>(start % 1000), duration / 1000,
+			              static_cast<int>(duration % 1000));
+			out += buffer;
+		}
+	}
+	out += "]}\n";
+	return out;
+}
+
+bool writeChromeTrace(char const* path)
+{
+	auto text = exportChromeTrace();
+	std::FILE* f = std::fopen(path, "wb");
+	if (f == nullptr)
+		return false;
+	bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+	return std::fclose(f) == 0 && ok;
+}
+
+void clear()
+{
+	auto& r = registry_();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (auto& b : r.buffers)
+		b->head.store(0, std::memory_order_release);
+}
+
+} // namespace trace
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
@@ -0,0 +1,153 @@
+#ifndef EU_TGCM_AVRREMOTE_TRACE_H
+#define EU_TGCM_AVRREMOTE_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrremote
+{
+namespace trace
+{
+
+/**
+ * Span tracing of the device pipeline. Spans are recorded into a fixed size ring buffer per thread, without
+ * lock nor allocation (except when a thread records its first span), and can be exported in the chrome
+ * trace event format, which perfetto and chrome://tracing can load.
+ *
+ * Instrumentation uses AVR_TRACE_SPAN, which compiles to nothing unless AVRCONTROL_ENABLE_TRACING is defined
+ * (ENABLE_TRACING cmake option).
+ */
+
+struct Event
+{
+	char const* name; /**< must be a string literal */
+	std::int64_t start;    /**< in ticks, see now() */
+	std::int64_t duration; /**< in ticks */
+};
+
+/**
+ * Number of events kept per thread, older events are overwritten
+ */
+constexpr std::size_t bufferCapacity = 1u << 16;
+
+/**
+ * Current time in ticks: the time stamp counter on x86, which is much cheaper to read than the monotonic
+ * clock, nanoseconds elsewhere. Ticks are converted to nanoseconds when exporting.
+ */
+inline std::int64_t now() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return static_cast<std::int64_t>(__rdtsc());
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+#endif
+}
+
+namespace detail
+{
+/**
+ * Events of a single thread. Only the owning thread writes, the exporter reads up to head.
+ */
+struct ThreadBuffer
+{
+	explicit ThreadBuffer(std::uint32_t threadId) : tid(threadId)
+	{
+	}
+
+	std::uint32_t const tid;
+	std::atomic<std::uint64_t> head{0}; /**< number of events ever recorded */
+	std::array<Event, bufferCapacity> events;
+};
+
+/**
+ * Creates and registers the buffer of the calling thread
+ */
+ThreadBuffer* createBuffer() noexcept;
+
+/**
+ * Buffer of the calling thread, null until it records its first span. Constant initialized, so that reading
+ * it does not check an initialization guard.
+ */
+inline thread_local ThreadBuffer* threadBuffer = nullptr;
+} // namespace detail
+
+/**
+ * Records a complete span in the buffer of the calling thread. Inline: a span costs little more than its two
+ * reads of the clock.
+ */
+inline void record(char const* name, std::int64_t start, std::int64_t duration) noexcept
+{
+	auto* buffer = detail::threadBuffer;
+	if (__builtin_expect(buffer == nullptr, 0))
+		detail::threadBuffer = buffer = detail::createBuffer();
+	auto const head = buffer->head.load(std::memory_order_relaxed);
+	buffer->events[head % bufferCapacity] = Event{name, start, duration};
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Returns all the recorded events, in the chrome trace event json format. Events being recorded while this
+ * runs may be missing or garbled, so it is best called when the traced threads are idle.
+ */
+std::string exportChromeTrace();
+
+/**
+ * Writes exportChromeTrace() to path, returns false on error
+ */
+bool writeChromeTrace(char const* path);
+
+/**
+ * Forgets all the recorded events
+ */
+void clear();
+
+/**
+ * Records the lifetime of a scope
+ */
+class Span
+{
+  public:
+	explicit Span(char const* name) noexcept : name_(name), start_(now())
+	{
+	}
+
+	~Span()
+	{
+		record(name_, start_, now() - start_);
+	}
+
+	Span(Span const&) = delete;
+	Span& operator=(Span const&) = delete;
+
+  private:
+	char const* name_;
+	std::int64_t start_;
+};
+
+} // namespace trace
+} // namespace avrremote
+} // namespace tgcm
+} // namespace eu
+
+#ifdef AVRCONTROL_ENABLE_TRACING
+#define AVR_TRACE_CONCAT_(a, b) a##b
+#define AVR_TRACE_CONCAT(a, b) AVR_TRACE_CONCAT_(a, b)
+#define AVR_TRACE_SPAN(name) ::eu::tgcm::avrremote::trace::Span AVR_TRACE_CONCAT(avrTraceSpan_, __LINE__)(name)
+#else
+#define AVR_TRACE_SPAN(name) static_cast<void>(0)
+#endif
+
+#endif // EU_TGCM_AVRREMOTE_TRACE_H
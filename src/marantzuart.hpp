@@ -1,11 +1,14 @@
 #ifndef EU_TGCM_AVRCOMMAND_MARANTZUART_H
 #define EU_TGCM_AVRCOMMAND_MARANTZUART_H
 
+#include <array>
 #include <cassert>
 #include <cctype>
 #include <cstdint>
 
 #include <string_view>
+#include <type_traits>
+#include <utility>
 
 namespace eu
 {
@@ -14,6 +17,37 @@ namespace tgcm
 namespace avrcommand
 {
 
+/**
+ * Number of zones handled: the main zone, zone 2 and zone 3
+ */
+constexpr std::size_t zoneCount = 3;
+
+/**
+ * Tag identifying a zone at compile time. Zone<0> is the main zone, controlled by the MV, MU, SI and ZM
+ * commands, Zone<1> and Zone<2> are zone 2 and 3, controlled by the Z2 and Z3 commands.
+ */
+template <std::size_t N>
+using Zone = std::integral_constant<std::size_t, N>;
+
+using MainZone = Zone<0>;
+using Zone2 = Zone<1>;
+using Zone3 = Zone<2>;
+
+/**
+ * Calls f(Zone<N>{}) with N equal to zone, which must be lower than zoneCount. Bridges the zone indexes
+ * used at runtime (e.g. by the QML API) with the commands, which are templated on the zone.
+ */
+template <std::size_t N = 0, typename F>
+constexpr decltype(auto) withZone(std::size_t zone, F&& f)
+{
+	if constexpr (N + 1 < zoneCount)
+	{
+		if (zone != N)
+			return withZone<N + 1>(zone, std::forward<F>(f));
+	}
+	return f(Zone<N>{});
+}
+
 enum class Source
 {
 	Phono,
@@ -83,14 +117,235 @@ constexpr char const* toCStr(Source source)
 	return "";
 }
 
+constexpr std::size_t sourceCount = static_cast<std::size_t>(Source::Bluetooth) + 1;
+
 /**
- * This class handles the parsing of marantz uart replies, and generate proper events
- * accordingly
+ * Longest source code, so that a zone source command fits in 12 chars
+ */
+constexpr std::size_t maxSourceCodeLength = 9;
+
+/**
+ * Code of a source in the SI, Z2 and Z3 commands and replies
+ */
+struct SourceCode
+{
+	std::string_view code;
+	Source source;
+	bool replyOnly; /**< only recognized in replies (e.g. spelling of older models), never sent */
+};
+
+/**
+ * Protocol dialects. Each one is described by a policy class, given as template parameter to
+ * MarantzUartParser and to the source commands, which provides:
+ * - id, its Dialect value
+ * - sources, its table of source codes, sorted by code. Sources without a code that is not replyOnly are
+ *   not supported by the dialect.
+ */
+enum class Dialect : std::uint8_t
+{
+	Marantz,
+	Denon
+};
+
+struct MarantzDialect
+{
+	static constexpr Dialect id = Dialect::Marantz;
+	static constexpr SourceCode sources[] = {
+	    {"AUX1", Source::Aux1, false},
+	    {"AUX2", Source::Aux2, false},
+	    {"AUX3", Source::Aux3, false},
+	    {"AUX4", Source::Aux4, false},
+	    {"AUX5", Source::Aux5, false},
+	    {"AUX6", Source::Aux6, false},
+	    {"AUX7", Source::Aux7, false},
+	    {"BD", Source::Bluray, false},
+	    {"BT", Source::Bluetooth, false},
+	    {"CD", Source::CD, false},
+	    {"DVD", Source::DVD, false},
+	    {"GAME", Source::Game, false},
+	    {"HDRADIO", Source::HdRadio, false},
+	    {"M-XPORT", Source::Bluetooth, true}, // bluetooth adapter of the models before 2013
+	    {"MPLAY", Source::Multimedia, false},
+	    {"NET", Source::Network, false},
+	    {"PHONO", Source::Phono, false},
+	    {"SAT/CBL", Source::Cable_Sat, false},
+	    {"TUNER", Source::Tuner, false},
+	    {"TV", Source::TV, false},
+	};
+};
+
+struct DenonDialect
+{
+	static constexpr Dialect id = Dialect::Denon;
+	static constexpr SourceCode sources[] = {
+	    {"AUX1", Source::Aux1, false},
+	    {"AUX2", Source::Aux2, false},
+	    {"AUX3", Source::Aux3, false},
+	    {"AUX4", Source::Aux4, false},
+	    {"AUX5", Source::Aux5, false},
+	    {"AUX6", Source::Aux6, false},
+	    {"AUX7", Source::Aux7, false},
+	    {"BD", Source::Bluray, false},
+	    {"BT", Source::Bluetooth, false},
+	    {"CD", Source::CD, false},
+	    {"DVD", Source::DVD, false},
+	    {"GAME", Source::Game, false},
+	    {"HDRADIO", Source::HdRadio, false},
+	    {"MPLAY", Source::Multimedia, false},
+	    {"NET", Source::Network, false},
+	    {"NET/USB", Source::Network, true}, // models before 2012
+	    {"PHONO", Source::Phono, false},
+	    {"SAT", Source::Cable_Sat, true}, // models before 2012
+	    {"SAT/CBL", Source::Cable_Sat, false},
+	    {"TUNER", Source::Tuner, false},
+	    {"TV", Source::TV, false},
+	    {"USB/IPOD", Source::Multimedia, true}, // models before 2012
+	};
+};
+
+/**
+ * Calls f(MarantzDialect{}) or f(DenonDialect{}), according to dialect
+ */
+template <typename F>
+constexpr decltype(auto) withDialect(Dialect dialect, F&& f)
+{
+	if (dialect == Dialect::Denon)
+		return f(DenonDialect{});
+	return f(MarantzDialect{});
+}
+
+/**
+ * Checks the source table of Dialect: sorted by code, codes not empty and not too long, and not starting
+ * like the other replies of a zone (a digit for the volume, O for ON / OFF, MU for the mute)
+ */
+template <typename Dialect>
+constexpr bool isValidSourceTable()
+{
+	std::string_view previous;
+	for (auto const& s : Dialect::sources)
+	{
+		if (s.code.empty() || s.code.size() > maxSourceCodeLength || s.code <= previous)
+			return false;
+		if ((s.code[0] >= '0' && s.code[0] <= '9') || s.code[0] == 'O' || s.code.substr(0, 2) == "MU")
+			return false;
+		previous = s.code;
+	}
+	return true;
+}
+
+/**
+ * Replies the parser notifies a handler of. The zone replies are notified per zone, see eventMask.
+ */
+enum class ParserEvent : std::uint8_t
+{
+	Power,     /**< powerChanged */
+	MaxVolume, /**< maxVolumeChanged */
+	Volume,    /**< volumeChanged */
+	Muted,     /**< mutedChanged */
+	Source,    /**< sourceChanged */
+	ZoneOn     /**< zoneOnChanged */
+};
+
+/**
+ * Bit of event in an event mask, for zone if event is a zone reply. Power and MaxVolume are not per zone.
+ */
+constexpr std::uint32_t eventMask(ParserEvent event, std::size_t zone = 0)
+{
+	if (event < ParserEvent::Volume)
+		return 1u << static_cast<unsigned>(event);
+	constexpr auto firstZoneEvent = static_cast<unsigned>(ParserEvent::Volume);
+	constexpr auto zoneEvents = static_cast<unsigned>(ParserEvent::ZoneOn) - firstZoneEvent + 1;
+	return 1u << (firstZoneEvent + zone * zoneEvents + static_cast<unsigned>(event) - firstZoneEvent);
+}
+
+/**
+ * Bits of event for all the zones
+ */
+constexpr std::uint32_t eventMaskAllZones(ParserEvent event)
+{
+	std::uint32_t ret = 0;
+	for (std::size_t zone = 0; zone < zoneCount; ++zone)
+		ret |= eventMask(event, zone);
+	return ret;
+}
+
+constexpr std::uint32_t allEvents = eventMask(ParserEvent::Power) | eventMask(ParserEvent::MaxVolume) |
+                                    eventMaskAllZones(ParserEvent::Volume) | eventMaskAllZones(ParserEvent::Muted) |
+                                    eventMaskAllZones(ParserEvent::Source) | eventMaskAllZones(ParserEvent::ZoneOn);
+
+namespace detail
+{
+
+// each callback is detected by a pair of overloads, the first one being removed by SFINAE when Handler does not
+// provide the callback
+#define AVRCOMMAND_DETECT_CALLBACK(name, ...)                                                                          \
+	template <typename Handler, std::size_t N>                                                                         \
+	constexpr auto has_##name(int) -> decltype(std::declval<Handler&>().name(__VA_ARGS__), true)                      \
+	{                                                                                                                  \
+		return true;                                                                                                   \
+	}                                                                                                                  \
+	template <typename Handler, std::size_t N>                                                                         \
+	constexpr bool has_##name(...)                                                                                     \
+	{                                                                                                                  \
+		return false;                                                                                                  \
+	}
+
+AVRCOMMAND_DETECT_CALLBACK(powerChanged, true)
+AVRCOMMAND_DETECT_CALLBACK(maxVolumeChanged, 0)
+AVRCOMMAND_DETECT_CALLBACK(volumeChanged, Zone<N>{}, 0)
+AVRCOMMAND_DETECT_CALLBACK(mutedChanged, Zone<N>{}, true)
+AVRCOMMAND_DETECT_CALLBACK(sourceChanged, Zone<N>{}, Source::Phono)
+AVRCOMMAND_DETECT_CALLBACK(zoneOnChanged, Zone<N>{}, true)
+
+#undef AVRCOMMAND_DETECT_CALLBACK
+
+template <typename Handler, std::size_t N>
+constexpr std::uint32_t handledZoneEvents()
+{
+	std::uint32_t ret = (has_volumeChanged<Handler, N>(0) ? eventMask(ParserEvent::Volume, N) : 0) |
+	                    (has_mutedChanged<Handler, N>(0) ? eventMask(ParserEvent::Muted, N) : 0) |
+	                    (has_sourceChanged<Handler, N>(0) ? eventMask(ParserEvent::Source, N) : 0) |
+	                    (has_zoneOnChanged<Handler, N>(0) ? eventMask(ParserEvent::ZoneOn, N) : 0);
+	if constexpr (N + 1 < zoneCount)
+		ret |= handledZoneEvents<Handler, N + 1>();
+	return ret;
+}
+
+} // namespace detail
+
+/**
+ * Mask of the events for which Handler provides a callback
  */
 template <typename Handler>
+constexpr std::uint32_t handledEvents()
+{
+	return (detail::has_powerChanged<Handler, 0>(0) ? eventMask(ParserEvent::Power) : 0) |
+	       (detail::has_maxVolumeChanged<Handler, 0>(0) ? eventMask(ParserEvent::MaxVolume) : 0) |
+	       detail::handledZoneEvents<Handler, 0>();
+}
+
+/**
+ * This class handles the parsing of marantz uart replies, and generate proper events
+ * accordingly. Handler may provide:
+ * - powerChanged(bool), for the power of the whole device (PWON / PWSTANDBY)
+ * - maxVolumeChanged(int)
+ * - for each zone N, which can be done with member templates:
+ *   - volumeChanged(Zone<N>, int)
+ *   - mutedChanged(Zone<N>, bool)
+ *   - sourceChanged(Zone<N>, Source)
+ *   - zoneOnChanged(Zone<N>, bool)
+ * Only the replies in Events for which Handler provides a callback are decoded, which is detected at compile time.
+ * The other ones are skipped up to their '\r' without being decoded, and are not counted as dropped frames.
+ * Sources are recognized according to Dialect, see MarantzDialect.
+ */
+template <typename Handler, typename Dialect = MarantzDialect, std::uint32_t Events = allEvents>
 class MarantzUartParser
 {
+	static_assert(isValidSourceTable<Dialect>(), "invalid source table");
+
   public:
+	using DialectType = Dialect;
+
 	explicit MarantzUartParser(Handler& h) : h_(h)
 	{
 	}
@@ -111,6 +366,10 @@ class MarantzUartParser
 			case InternalState::Invalid: {
 				return parseInvalid_(data);
 			}
+			case InternalState::Skip:
+				return parseSkip_(data);
+			case InternalState::Malformed:
+				return skipReply_(data, InternalState::Malformed);
 			case InternalState::Parse_M:
 				return parseM_(data);
 			case InternalState::Parse_MV:
@@ -123,16 +382,6 @@ class MarantzUartParser
 				return parseMVMAX_(data);
 			case InternalState::Parse_MVMAX2:
 				return parseMVMAX2_(data);
-			case InternalState::Parse_MU:
-				return parseMU_(data);
-			case InternalState::Parse_MUO:
-				return parseMUO_(data);
-			case InternalState::Parse_MUON:
-				return parseMUON_(data);
-			case InternalState::Parse_MUOF:
-				return parseMUOF_(data);
-			case InternalState::Parse_MUOFF:
-				return parseMUOFF_(data);
 			case InternalState::Parse_P:
 				return parseP_(data);
 			case InternalState::Parse_PW:
@@ -145,46 +394,86 @@ class MarantzUartParser
 				return parsePWS_(data);
 			case InternalState::Parse_S:
 				return parseS_(data);
-			case InternalState::Parse_SI:
-				return parseSI_(data);
 			case InternalState::Parse_Z:
 				return parseZ_(data);
-			case InternalState::Parse_ZM:
-				return parseZM_(data);
-			case InternalState::Parse_ZMO:
-				return parseZMO_(data);
-			case InternalState::Parse_ZMON:
-				return parseZMON_(data);
-			case InternalState::Parse_ZMOF:
-				return parseZMOF_(data);
-			case InternalState::Parse_ZMOFF:
-				return parseZMOFF_(data);
-			case InternalState::Parse_Z2:
-				return parseZ2_(data);
-			case InternalState::Parse_Z2O:
-				return parseZ2O_(data);
-			case InternalState::Parse_Z2ON:
-				return parseZ2ON_(data);
-			case InternalState::Parse_Z2OF:
-				return parseZ2OF_(data);
-			case InternalState::Parse_Z2OFF:
-				return parseZ2OFF_(data);
+			default:
+				if (s_ >= InternalState::Zones)
+					return resumeZone_<0>(data);
+				break;
 		}
 		assert(false && "parser in a very bad state");
 		return data.size(); // should not happen !!!
 	}
 
+	/**
+	 * Same as parse, but stamps data with the time at which it was received. The handler can read the
+	 * timestamp of the reply it is being notified of with timestamp(). A reply split over several chunks
+	 * gets the timestamp of the chunk that completes it.
+	 */
+	std::size_t parse(std::string_view data, std::int64_t timestamp)
+	{
+		timestamp_ = timestamp;
+		return parse(data);
+	}
+
+	/**
+	 * Timestamp given with the data being parsed
+	 */
+	std::int64_t timestamp() const noexcept
+	{
+		return timestamp_;
+	}
+
+	/**
+	 * Number of replies that were skipped because they were not understood, since construction. Wraps around.
+	 */
+	std::uint32_t droppedFrames() const noexcept
+	{
+		return droppedFrames_;
+	}
+
+	/**
+	 * Number of the dropped frames that were not even shaped like a reply, i.e. did not start with an
+	 * uppercase letter (line noise, the end of a reply whose beginning was lost). The others are replies this
+	 * parser does not decode (e.g. MSSTEREO, PSFRONT A, NSE lines). Wraps around.
+	 */
+	std::uint32_t malformedFrames() const noexcept
+	{
+		return malformedFrames_;
+	}
+
+	/**
+	 * Where the parser is within a reply, see saveState
+	 */
+	struct ResumeState
+	{
+		std::uint8_t state = 0; /**< 0 between replies */
+		int lastValue = 0;
+	};
+
+	/**
+	 * State to give to restoreState to resume parsing where it stopped, lets a single parser take turns on
+	 * several streams (see MarantzUartBatchParser)
+	 */
+	ResumeState saveState() const noexcept
+	{
+		return ResumeState{static_cast<std::uint8_t>(s_), lastValue_};
+	}
+
+	void restoreState(ResumeState state) noexcept
+	{
+		s_ = static_cast<InternalState>(state.state);
+		lastValue_ = state.lastValue;
+	}
+
   private:
-	enum class InternalState
+	enum class InternalState : std::uint8_t
 	{
-		Begin,   /**< Initial state, wait for a reply */
-		Invalid, /**< Invalid state, wait for a '\r' to go back to begin */
+		Begin,     /**< Initial state, wait for a reply */
+		Invalid,   /**< Invalid state, wait for a '\r' to go back to begin */
+		Skip,      /**< Reply nobody subscribed to, wait for a '\r' to go back to begin */
+		Malformed, /**< Same as Invalid, for a frame not starting with an uppercase letter */
 		Parse_M,
-		Parse_MU,
-		Parse_MUO,
-		Parse_MUON,
-		Parse_MUOF,
-		Parse_MUOFF,
 		Parse_MV,
 		Parse_MVM,
 		Parse_MVMA,
@@ -196,20 +485,70 @@ class MarantzUartParser
 		Parse_PWON,
 		Parse_PWS,
 		Parse_S,
-		Parse_SI,
 		Parse_Z,
-		Parse_ZM,
-		Parse_ZMO,
-		Parse_ZMON,
-		Parse_ZMOF,
-		Parse_ZMOFF,
-		Parse_Z2,
-		Parse_Z2O,
-		Parse_Z2ON,
-		Parse_Z2OF,
-		Parse_Z2OFF,
+		Zones /**< first of the zone states, see zoneState_ */
+	};
+
+	/**
+	 * Steps of the replies of a zone, the same for all zones. The main zone only goes through some of them,
+	 * its replies having different prefixes (MV, MU, SI, ZM instead of Z2 or Z3).
+	 */
+	enum class ZoneStep : std::uint8_t
+	{
+		Prefix, /**< after Z2 / Z3: volume, ON / OFF, MU or source follows */
+		M,      /**< after Z2M: MU or MPLAY */
+		MuteStart,
+		MuteO,
+		MuteON,
+		MuteOF,
+		MuteOFF,
+		PowerStart,
+		PowerO,
+		PowerON,
+		PowerOF,
+		PowerOFF,
+		Volume,
+		Source,
+		Count
 	};
 
+	static constexpr InternalState zoneState_(std::size_t zone, ZoneStep step)
+	{
+		return static_cast<InternalState>(static_cast<std::size_t>(InternalState::Zones) +
+		                                  zone * static_cast<std::size_t>(ZoneStep::Count) +
+		                                  static_cast<std::size_t>(step));
+	}
+
+	static_assert(static_cast<std::size_t>(InternalState::Zones) +
+	                      zoneCount * static_cast<std::size_t>(ZoneStep::Count) <= 256,
+	              "zone states must fit in InternalState");
+
+	/**
+	 * Step of the ON / OFF replies: zone power, or mute if Mute
+	 */
+	static constexpr ZoneStep onOffStep_(bool mute, int offset)
+	{
+		return static_cast<ZoneStep>(static_cast<int>(mute ? ZoneStep::MuteStart : ZoneStep::PowerStart) + offset);
+	}
+
+	/**
+	 * Whether the replies of event are decoded, for zone if event is a zone reply. Only to be called from the
+	 * member functions, where Handler is complete: handlers often hold their parser.
+	 */
+	static constexpr bool subscribed_(ParserEvent event, std::size_t zone = 0)
+	{
+		return (Events & handledEvents<Handler>() & eventMask(event, zone)) != 0;
+	}
+
+	/**
+	 * Whether any reply of zone is decoded
+	 */
+	static constexpr bool zoneSubscribed_(std::size_t zone)
+	{
+		return subscribed_(ParserEvent::Volume, zone) || subscribed_(ParserEvent::Muted, zone) ||
+		       subscribed_(ParserEvent::Source, zone) || subscribed_(ParserEvent::ZoneOn, zone);
+	}
+
 	Handler& h_;
 
 	InternalState s_ = InternalState::Begin;
@@ -219,19 +558,40 @@ class MarantzUartParser
 	 */
 	int lastValue_ = 0;
 
+	std::int64_t timestamp_ = 0;
+
+	std::uint32_t droppedFrames_ = 0;
+	std::uint32_t malformedFrames_ = 0;
+
 	std::size_t parseBegin_(std::string_view data)
 	{
 		lastValue_ = 0; // always reinitialize last value at begin
 		if (data.empty())
 			return 0;
+		// the families of replies nobody subscribed to are skipped right away
 		if (data[0] == 'M')
-			return parseM_(data.substr(1)) + 1;
+		{
+			if constexpr (subscribed_(ParserEvent::MaxVolume) || subscribed_(ParserEvent::Volume) ||
+			              subscribed_(ParserEvent::Muted))
+				return parseM_(data.substr(1)) + 1;
+			return parseSkip_(data);
+		}
 		if (data[0] == 'P')
-			return parseP_(data.substr(1)) + 1;
+		{
+			if constexpr (subscribed_(ParserEvent::Power))
+				return parseP_(data.substr(1)) + 1;
+			return parseSkip_(data);
+		}
 		if (data[0] == 'S')
-			return parseS_(data.substr(1)) + 1;
+		{
+			if constexpr (subscribed_(ParserEvent::Source))
+				return parseS_(data.substr(1)) + 1;
+			return parseSkip_(data);
+		}
 		if (data[0] == 'Z')
 			return parseZ_(data.substr(1)) + 1;
+		if (data[0] < 'A' || data[0] > 'Z')
+			return skipReply_(data, InternalState::Malformed);
 		// else need to implement
 		return parseInvalid_(data);
 	}
@@ -240,17 +600,29 @@ class MarantzUartParser
 	// unknown status responses
 	std::size_t parseInvalid_(std::string_view data)
 	{
-		std::size_t i = 0;
-		while (i < data.size() && data[i] != '\r')
-			i += 1;
-		if (i < data.size()) // '\r' found
+		return skipReply_(data, InternalState::Invalid);
+	}
+
+	// same as parseInvalid_, for replies that are understood but not subscribed to
+	std::size_t parseSkip_(std::string_view data)
+	{
+		return skipReply_(data, InternalState::Skip);
+	}
+
+	std::size_t skipReply_(std::string_view data, InternalState state)
+	{
+		auto i = data.find('\r');
+		if (i == std::string_view::npos)
 		{
-			s_ = InternalState::Begin;
-			i += 1; // consume the '\r'
+			s_ = state;
+			return data.size();
 		}
-		else
-			s_ = InternalState::Invalid;
-		return i; // in all cases, we consumed i chars
+		s_ = InternalState::Begin;
+		if (state != InternalState::Skip)
+			droppedFrames_ += 1;
+		if (state == InternalState::Malformed)
+			malformedFrames_ += 1;
+		return i + 1; // consume the '\r'
 	}
 
 #define IF_EMPTY_RETURN_0(data, state)                                                                                 \
@@ -294,23 +666,18 @@ class MarantzUartParser
 		return parseInvalid_(data);                                                                                    \
 	}
 
-	PARSE_BINARY_BRANCH(parseM_, InternalState::Parse_M, 'V', parseMV_, 'U', parseMU_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseMU_, InternalState::Parse_MU, 'O', parseMUO_);
-	PARSE_BINARY_BRANCH(parseMUO_, InternalState::Parse_MUO, 'F', parseMUOF_, 'N', parseMUON_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseMUOF_, InternalState::Parse_MUOFF, 'F', parseMUOFF_);
-	PARSE_TERMINAL(parseMUON_, InternalState::Parse_MUON, h_.mutedChanged(true));
-	PARSE_TERMINAL(parseMUOFF_, InternalState::Parse_MUOFF, h_.mutedChanged(false));
+	PARSE_BINARY_BRANCH(parseM_, InternalState::Parse_M, 'V', parseMV_, 'U', (parseSubscribedOnOff_<0, true>))
 
-	PARSE_SINGLE_EXPECTED_CHAR(parseMVM_, InternalState::Parse_MVM, 'A', parseMVMA_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseMVMA_, InternalState::Parse_MVMA, 'X', parseMVMAX_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseMVMAX_, InternalState::Parse_MVMAX, ' ', parseMVMAX2_);
+	PARSE_SINGLE_EXPECTED_CHAR(parseMVM_, InternalState::Parse_MVM, 'A', parseMVMA_)
+	PARSE_SINGLE_EXPECTED_CHAR(parseMVMA_, InternalState::Parse_MVMA, 'X', parseMVMAX_)
+	PARSE_SINGLE_EXPECTED_CHAR(parseMVMAX_, InternalState::Parse_MVMAX, ' ', parseMVMAX2_)
 
-	PARSE_SINGLE_EXPECTED_CHAR(parseP_, InternalState::Parse_P, 'W', parsePW_);
+	PARSE_SINGLE_EXPECTED_CHAR(parseP_, InternalState::Parse_P, 'W', parsePW_)
 
 	PARSE_SINGLE_EXPECTED_CHAR(parsePWO_, InternalState::Parse_PWO, 'N', parsePWON_)
-	PARSE_TERMINAL(parsePWON_, InternalState::Parse_PWON, h_.powerChanged(true))
+	PARSE_TERMINAL(parsePWON_, InternalState::Parse_PWON, powerChanged_(true))
 
-	PARSE_SINGLE_EXPECTED_CHAR(parseS_, InternalState::Parse_S, 'I', parseSI_);
+	PARSE_SINGLE_EXPECTED_CHAR(parseS_, InternalState::Parse_S, 'I', parseSource_<0>)
 
 	std::size_t parsePW_(std::string_view data)
 	{
@@ -324,55 +691,94 @@ class MarantzUartParser
 		return parseInvalid_(data);
 	}
 
+	/**
+	 * While parsing a volume, lastValue_ holds the digits parsed so far in its low bits, and their count
+	 * from volumeDigitsShift_: leading zeros matter, "MV05" is 5 dB while "MV055" is 5.5 dB
+	 */
+	static constexpr int volumeDigitsShift_ = 16;
+
+	void appendVolumeDigit_(char c)
+	{
+		auto const digits = lastValue_ >> volumeDigitsShift_;
+		if (digits > 3)
+			return; // not a volume anyway
+		auto const value = lastValue_ & ((1 << volumeDigitsShift_) - 1);
+		lastValue_ = ((digits + 1) << volumeDigitsShift_) | (value * 10 + (c - '0'));
+	}
+
+	/**
+	 * Volume in tenths of dB of the digits held by lastValue_, -1 if they are not a volume. Two digits are
+	 * whole dB ("MV45" is 450), three digits already are tenths ("MV455" is 455, "MV095" is 95).
+	 */
+	int decodeVolume_() const
+	{
+		auto const digits = lastValue_ >> volumeDigitsShift_;
+		auto const value = lastValue_ & ((1 << volumeDigitsShift_) - 1);
+		if (digits == 1 || digits == 2)
+			return value * 10;
+		return digits == 3 ? value : -1;
+	}
+
 	std::size_t parseMVMAX2_(std::string_view data)
 	{
-		if (data.empty())
-		{
-			s_ = InternalState::Parse_MVMAX;
-			return 0;
-		}
+		IF_EMPTY_RETURN_0(data, InternalState::Parse_MVMAX2)
 		std::size_t i = 0;
 		while (i < data.size() && std::isdigit(data[i]))
 		{
-			lastValue_ = lastValue_ * 10;
-			lastValue_ += data[i] - '0';
+			appendVolumeDigit_(data[i]);
 			i += 1;
 		}
 		if (i < data.size())
 		{
 			if (data[i] == '\r') // found the '\r'
 			{
+				auto const volume = decodeVolume_();
+				if (volume < 0)
+					return parseInvalid_(data.substr(i)) + i;
 				s_ = InternalState::Begin;
-				if (lastValue_ < 100)
-					lastValue_ *= 10;
-				h_.maxVolumeChanged(lastValue_);
+				if constexpr (subscribed_(ParserEvent::MaxVolume))
+					h_.maxVolumeChanged(volume);
 				return i + 1;
 			}
-			return parseInvalid_(data.substr(1)) + 1;
+			return parseInvalid_(data.substr(i + 1)) + i + 1;
 		}
-		s_ = InternalState::Parse_MVMAX;
+		s_ = InternalState::Parse_MVMAX2;
 		return i;
 	}
 
 	std::size_t parseMV_(std::string_view data)
 	{
-		std::size_t i = 0;
 		IF_EMPTY_RETURN_0(data, InternalState::Parse_MV)
-		if (lastValue_ == 0 && data[i] == 'M')
-			return parseMVM_(data.substr(1)) + 1;
+		if (data[0] == 'M')
+		{
+			if constexpr (subscribed_(ParserEvent::MaxVolume))
+				return parseMVM_(data.substr(1)) + 1;
+			return parseSkip_(data);
+		}
+		return parseVolume_<0>(data);
+	}
+
+	template <std::size_t N>
+	std::size_t parseVolume_(std::string_view data)
+	{
+		if constexpr (!subscribed_(ParserEvent::Volume, N))
+			return parseSkip_(data);
+		std::size_t i = 0;
+		IF_EMPTY_RETURN_0(data, zoneState_(N, ZoneStep::Volume))
 		while (i < data.size() && std::isdigit(data[i]))
 		{
-			lastValue_ = lastValue_ * 10;
-			lastValue_ += (data[i] - '0');
+			appendVolumeDigit_(data[i]);
 			i += 1;
 		}
 		if (i < data.size())
 		{
 			if (data[i] == '\r') // found the '\r'
 			{
-				if (lastValue_ < 100)
-					lastValue_ *= 10;
-				h_.masterVolumeChanged(lastValue_);
+				auto const volume = decodeVolume_();
+				if (volume < 0)
+					return parseInvalid_(data.substr(i)) + i;
+				if constexpr (subscribed_(ParserEvent::Volume, N))
+					h_.volumeChanged(Zone<N>{}, volume);
 				s_ = InternalState::Begin;
 				return i + 1;
 			}
@@ -381,7 +787,7 @@ class MarantzUartParser
 			return parseInvalid_(data.substr(i + 1)) + i + 1;
 		}
 		// else needs more data
-		s_ = InternalState::Parse_MV;
+		s_ = zoneState_(N, ZoneStep::Volume);
 		return i;
 	}
 
@@ -410,10 +816,14 @@ class MarantzUartParser
 			CASE(5, 'Y')
 			case 6: // terminal state
 				if (nbConsumed == data.size())
+				{
+					s_ = InternalState::Parse_PWS;
+					lastValue_ += nbConsumed;
 					return nbConsumed;
+				}
 				if (data[nbConsumed] != '\r')
 					return parseInvalid_(data.substr(nbConsumed)) + nbConsumed;
-				h_.powerChanged(false);
+				powerChanged_(false);
 				s_ = InternalState::Begin;
 				return nbConsumed + 1;
 		}
@@ -421,258 +831,356 @@ class MarantzUartParser
 #undef CASE
 	}
 
-	PARSE_BINARY_BRANCH(parseZ_, InternalState::Parse_Z, 'M', parseZM_, '2', parseZ2_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseZM_, InternalState::Parse_ZM, 'O', parseZMO_);
-	PARSE_BINARY_BRANCH(parseZMO_, InternalState::Parse_ZMO, 'F', parseZMOF_, 'N', parseZMON_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseZMOF_, InternalState::Parse_ZMOF, 'F', parseZMOFF_);
-	PARSE_TERMINAL(parseZMON_, InternalState::Parse_ZMON, h_.mainZoneOnChanged(true));
-	PARSE_TERMINAL(parseZMOFF_, InternalState::Parse_ZMOFF, h_.mainZoneOnChanged(false));
-	PARSE_SINGLE_EXPECTED_CHAR(parseZ2_, InternalState::Parse_Z2, 'O', parseZ2O_);
-	PARSE_BINARY_BRANCH(parseZ2O_, InternalState::Parse_Z2O, 'F', parseZ2OF_, 'N', parseZ2ON_);
-	PARSE_SINGLE_EXPECTED_CHAR(parseZ2OF_, InternalState::Parse_Z2OF, 'F', parseZ2OFF_);
-	PARSE_TERMINAL(parseZ2ON_, InternalState::Parse_Z2ON, h_.zone2OnChanged(true));
-	PARSE_TERMINAL(parseZ2OFF_, InternalState::Parse_Z2OFF, h_.zone2OnChanged(false));
+	std::size_t parseZ_(std::string_view data)
+	{
+		IF_EMPTY_RETURN_0(data, InternalState::Parse_Z)
+		if (data[0] == 'M')
+			return parseSubscribedOnOff_<0, false>(data.substr(1)) + 1;
+		if (data[0] >= '2' && data[0] < static_cast<char>('1' + zoneCount))
+			return dispatchZonePrefix_<1>(static_cast<std::size_t>(data[0] - '1'), data.substr(1)) + 1;
+		return parseInvalid_(data);
+	}
 
-	static constexpr int value_of_char_(char c)
+	/**
+	 * Dispatches to the prefix parser of zone, N being the first zone to test
+	 */
+	template <std::size_t N>
+	std::size_t dispatchZonePrefix_(std::size_t zone, std::string_view data)
 	{
-		if (c >= 'A' && c <= 'Z')
-			return c - 'A' + 1;
-		if (c == '/')
-			return 25;
-		if (c >= '0' && c <= '9')
-			return 26 + c - '0';
-		return 0;
+		if constexpr (N + 1 < zoneCount)
+		{
+			if (zone != N)
+				return dispatchZonePrefix_<N + 1>(zone, data);
+		}
+		if constexpr (zoneSubscribed_(N))
+			return parseZonePrefix_<N>(data);
+		return parseSkip_(data);
 	}
 
-	static constexpr int value_of_str(char const* str)
+	/**
+	 * After Z2 / Z3: volume, ON / OFF, mute (MU) or source
+	 */
+	template <std::size_t N>
+	std::size_t parseZonePrefix_(std::string_view data)
 	{
-		if (*str == 0)
-			return 0;
-		return value_of_char_(*str) + (36 * (value_of_str(str + 1) % 59652323)); // this constant ensures no overflow
+		IF_EMPTY_RETURN_0(data, zoneState_(N, ZoneStep::Prefix))
+		if (std::isdigit(data[0]))
+		{
+			lastValue_ = 0;
+			return parseVolume_<N>(data);
+		}
+		if (data[0] == 'O')
+		{
+			if constexpr (subscribed_(ParserEvent::ZoneOn, N))
+				return parseOnOffO_<N, false>(data.substr(1)) + 1;
+			return parseSkip_(data);
+		}
+		if (data[0] == 'M')
+			return parseZoneM_<N>(data.substr(1)) + 1;
+		if (data[0] >= 'A' && data[0] <= 'Z')
+		{
+			lastValue_ = 0;
+			return parseSource_<N>(data);
+		}
+		return parseInvalid_(data);
+	}
+
+	/**
+	 * After Z2M / Z3M: mute, or a source starting with M (e.g. MPLAY)
+	 */
+	template <std::size_t N>
+	std::size_t parseZoneM_(std::string_view data)
+	{
+		IF_EMPTY_RETURN_0(data, zoneState_(N, ZoneStep::M))
+		if (data[0] == 'U')
+			return parseSubscribedOnOff_<N, true>(data.substr(1)) + 1;
+		constexpr int afterM = sourcePrefixState_("M");
+		if constexpr (afterM >= 0)
+		{
+			lastValue_ = afterM;
+			return parseSource_<N>(data);
+		}
+		return parseInvalid_(data);
 	}
 
-	std::size_t parseSI_(std::string_view data)
+	/**
+	 * ON / OFF replies, for the power of a zone, or its mute if Mute
+	 */
+	template <std::size_t N, bool Mute>
+	void onOffChanged_(bool on)
+	{
+		if constexpr (!subscribed_(onOffEvent_(Mute), N))
+			return;
+		else if constexpr (Mute)
+			h_.mutedChanged(Zone<N>{}, on);
+		else
+			h_.zoneOnChanged(Zone<N>{}, on);
+	}
+
+	static constexpr ParserEvent onOffEvent_(bool mute)
 	{
-		IF_EMPTY_RETURN_0(data, InternalState::Parse_SI)
-#define CASE(value, expected, nextvalue)                                                                               \
-	case value_of_str(value):                                                                                          \
-		if (data[i] != expected)                                                                                       \
-			return parseInvalid_(data.substr(i)) + i;                                                                  \
-		lastValue_ = value_of_str(nextvalue);                                                                          \
-		break
+		return mute ? ParserEvent::Muted : ParserEvent::ZoneOn;
+	}
+
+	template <std::size_t N, bool Mute>
+	std::size_t parseSubscribedOnOff_(std::string_view data)
+	{
+		if constexpr (subscribed_(onOffEvent_(Mute), N))
+			return parseOnOff_<N, Mute>(data);
+		return parseSkip_(data);
+	}
+
+	void powerChanged_(bool power)
+	{
+		if constexpr (subscribed_(ParserEvent::Power))
+			h_.powerChanged(power);
+	}
+
+	template <std::size_t N, bool Mute>
+	PARSE_SINGLE_EXPECTED_CHAR(parseOnOff_, zoneState_(N, onOffStep_(Mute, 0)), 'O', (parseOnOffO_<N, Mute>))
+	template <std::size_t N, bool Mute>
+	PARSE_BINARY_BRANCH(parseOnOffO_, zoneState_(N, onOffStep_(Mute, 1)), 'N', (parseOnOffON_<N, Mute>), 'F',
+	                    (parseOnOffOF_<N, Mute>))
+	template <std::size_t N, bool Mute>
+	PARSE_TERMINAL(parseOnOffON_, zoneState_(N, onOffStep_(Mute, 2)), (onOffChanged_<N, Mute>(true)))
+	template <std::size_t N, bool Mute>
+	PARSE_SINGLE_EXPECTED_CHAR(parseOnOffOF_, zoneState_(N, onOffStep_(Mute, 3)), 'F', (parseOnOffOFF_<N, Mute>))
+	template <std::size_t N, bool Mute>
+	PARSE_TERMINAL(parseOnOffOFF_, zoneState_(N, onOffStep_(Mute, 4)), (onOffChanged_<N, Mute>(false)))
+
+	/**
+	 * Resumes parsing in a zone state, N being the first zone to test
+	 */
+	template <std::size_t N>
+	std::size_t resumeZone_(std::string_view data)
+	{
+		constexpr auto first = static_cast<std::size_t>(zoneState_(N, ZoneStep::Prefix));
+		auto step = static_cast<ZoneStep>(static_cast<std::size_t>(s_) - first);
+		if constexpr (N + 1 < zoneCount)
+		{
+			if (step >= ZoneStep::Count)
+				return resumeZone_<N + 1>(data);
+		}
+		switch (step)
+		{
+			case ZoneStep::Prefix:
+				return parseZonePrefix_<N>(data);
+			case ZoneStep::M:
+				return parseZoneM_<N>(data);
+			case ZoneStep::MuteStart:
+				return parseOnOff_<N, true>(data);
+			case ZoneStep::MuteO:
+				return parseOnOffO_<N, true>(data);
+			case ZoneStep::MuteON:
+				return parseOnOffON_<N, true>(data);
+			case ZoneStep::MuteOF:
+				return parseOnOffOF_<N, true>(data);
+			case ZoneStep::MuteOFF:
+				return parseOnOffOFF_<N, true>(data);
+			case ZoneStep::PowerStart:
+				return parseOnOff_<N, false>(data);
+			case ZoneStep::PowerO:
+				return parseOnOffO_<N, false>(data);
+			case ZoneStep::PowerON:
+				return parseOnOffON_<N, false>(data);
+			case ZoneStep::PowerOF:
+				return parseOnOffOF_<N, false>(data);
+			case ZoneStep::PowerOFF:
+				return parseOnOffOFF_<N, false>(data);
+			case ZoneStep::Volume:
+				return parseVolume_<N>(data);
+			case ZoneStep::Source:
+				return parseSource_<N>(data);
+			case ZoneStep::Count:
+				break;
+		}
+		return parseInvalid_(data);
+	}
 
-#define CASE_TERM(value, source)                                                                                       \
-	case value_of_str(value):                                                                                          \
-		if (data[i] != '\r')                                                                                           \
-			return parseInvalid_(data.substr(i)) + i;                                                                  \
-		h_.sourceChanged(source);                                                                                      \
-		return i + 1
+	/**
+	 * While parsing a source, lastValue_ holds the index of the first entry of the source table starting
+	 * with the code parsed so far, and the length of this code in its low bits
+	 */
+	static constexpr int sourceLengthBits_ = 4;
+	static_assert(maxSourceCodeLength < (1 << sourceLengthBits_), "source code length must fit");
+
+	/**
+	 * Value of lastValue_ once prefix has been parsed, -1 if no source starts with prefix
+	 */
+	static constexpr int sourcePrefixState_(std::string_view prefix)
+	{
+		int index = 0;
+		for (auto const& s : Dialect::sources)
+		{
+			if (s.code.substr(0, prefix.size()) == prefix)
+				return (index << sourceLengthBits_) | static_cast<int>(prefix.size());
+			index += 1;
+		}
+		return -1;
+	}
 
+	/**
+	 * Source code, after SI for the main zone, or Z2 / Z3. As the table is sorted, the codes starting with
+	 * the same prefix follow each other, and the shortest one comes first.
+	 */
+	template <std::size_t N>
+	std::size_t parseSource_(std::string_view data)
+	{
+		if constexpr (!subscribed_(ParserEvent::Source, N))
+			return parseSkip_(data);
+		IF_EMPTY_RETURN_0(data, zoneState_(N, ZoneStep::Source))
+		constexpr auto& table = Dialect::sources;
+		constexpr std::size_t tableSize = sizeof(table) / sizeof(table[0]);
+		auto entry = static_cast<std::size_t>(lastValue_ >> sourceLengthBits_);
+		auto length = static_cast<std::size_t>(lastValue_ & ((1 << sourceLengthBits_) - 1));
 		for (std::size_t i = 0u; i < data.size(); ++i)
 		{
-			switch (lastValue_)
+			if (data[i] == '\r')
 			{
-				case 0: // use lastValue_ to store state of parser
-					if (data[i] != '\r')
-						lastValue_ = value_of_char_(data[i]);
-					else
-						return parseInvalid_(data);
-					break;
-
-					CASE("A", 'U', "AU");
-					CASE("AU", 'X', "AUX");
-				case value_of_str("AUX"):
-					if (data[i] == '1')
-						lastValue_ = value_of_str("AUX1");
-					else if (data[i] == '2')
-						lastValue_ = value_of_str("AUX2");
-					else if (data[i] == '3')
-						lastValue_ = value_of_str("AUX3");
-					else if (data[i] == '4')
-						lastValue_ = value_of_str("AUX4");
-					else if (data[i] == '5')
-						lastValue_ = value_of_str("AUX5");
-					else if (data[i] == '6')
-						lastValue_ = value_of_str("AUX6");
-					else if (data[i] == '7')
-						lastValue_ = value_of_str("AUX7");
-					else
-						return parseInvalid_(data.substr(i)) + i;
-					break;
-				case value_of_str("AUX1"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux1);
-					return i + 1;
-				case value_of_str("AUX2"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux2);
-					return i + 1;
-				case value_of_str("AUX3"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux3);
-					return i + 1;
-				case value_of_str("AUX4"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux4);
-					return i + 1;
-				case value_of_str("AUX5"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux5);
-					return i + 1;
-				case value_of_str("AUX6"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux6);
-					return i + 1;
-				case value_of_str("AUX7"):
-					if (data[i] != '\r')
-						return parseInvalid_(data.substr(i)) + i;
-					h_.sourceChanged(Source::Aux7);
-					return i + 1;
-				case value_of_str("B"): // BD/BT
-					if (data[i] == 'D')
-					{
-						lastValue_ = value_of_str("BD");
-						break;
-					}
-					if (data[i] == 'T')
-					{
-						lastValue_ = value_of_str("BT");
-						break;
-					}
-					return parseInvalid_(data.substr(i)) + i;
-					CASE_TERM("BD", Source::Bluray);
-					CASE_TERM("BT", Source::Bluetooth);
-
-					CASE("C", 'D', "CD"); // CD
-					CASE_TERM("CD", Source::CD);
-
-					CASE("D", 'V', "DV"); // DVD
-					CASE("DV", 'D', "DVD");
-					CASE_TERM("DVD", Source::DVD);
-
-					CASE("G", 'A', "GA"); // GAME
-					CASE("GA", 'M', "GAM");
-					CASE("GAM", 'E', "GAME");
-					CASE_TERM("GAME", Source::Game);
-
-					CASE("H", 'D', "HD"); // HDRADIO
-					CASE("HD", 'R', "HDR");
-					CASE("HDR", 'A', "HDRA");
-					CASE("HDRA", 'D', "HDRAD");
-					CASE("HDRAD", 'I', "HDRADI");
-					CASE("HDRADI", 'O', "HDRADIO");
-					CASE_TERM("HDRADIO", Source::HdRadio);
-
-					CASE("M", 'P', "MP"); // MPLAY
-					CASE("MP", 'L', "MPL");
-					CASE("MPL", 'A', "MPLA");
-					CASE("MPLA", 'Y', "MPLAY");
-					CASE_TERM("MPLAY", Source::Multimedia);
-
-					CASE("N", 'E', "NE"); // NET
-					CASE("NE", 'T', "NET");
-					CASE_TERM("NET", Source::Network);
-
-					CASE("P", 'H', "PH"); // PHONO
-					CASE("PH", 'O', "PHO");
-					CASE("PHO", 'N', "PHON");
-					CASE("PHON", 'O', "PHONO");
-					CASE_TERM("PHONO", Source::Phono);
-
-					CASE("S", 'A', "SA"); // SAT/CBL
-					CASE("SA", 'T', "SAT");
-					CASE("SAT", '/', "SAT/");
-					CASE("SAT/", 'C', "SAT/C");
-					CASE("SAT/C", 'B', "SAT/CB");
-					CASE("SAT/CB", 'L', "SAT/CBL");
-					CASE_TERM("SAT/CBL", Source::Cable_Sat);
-
-				case value_of_str("T"):
-					if (data[i] == 'V') // TV
-					{
-						lastValue_ = value_of_str("TV");
-						break;
-					}
-					if (data[i] == 'U') // TUNER
-					{
-						lastValue_ = value_of_str("TU");
-						break;
-					}
+				if (length == 0 || table[entry].code.size() != length)
 					return parseInvalid_(data.substr(i)) + i;
-
-					CASE_TERM("TV", Source::TV);
-
-					CASE("TU", 'N', "TUN");
-					CASE("TUN", 'E', "TUNE");
-					CASE("TUNE", 'R', "TUNER");
-					CASE_TERM("TUNER", Source::Tuner);
-				default:
-					return parseInvalid_(data.substr(i)) + 1;
+				if constexpr (subscribed_(ParserEvent::Source, N))
+					h_.sourceChanged(Zone<N>{}, table[entry].source);
+				s_ = InternalState::Begin;
+				return i + 1;
 			}
+			auto const prefix = table[entry].code.substr(0, length);
+			while (entry < tableSize && table[entry].code.substr(0, length) == prefix &&
+			       (table[entry].code.size() == length || table[entry].code[length] != data[i]))
+				entry += 1;
+			if (entry == tableSize || table[entry].code.substr(0, length) != prefix)
+				return parseInvalid_(data.substr(i)) + i;
+			length += 1;
 		}
-		s_ = InternalState::Parse_SI;
+		lastValue_ = static_cast<int>((entry << sourceLengthBits_) | length);
+		s_ = zoneState_(N, ZoneStep::Source);
 		return data.size();
-#undef CASE
-#undef CASE_TERM
 	}
 };
 
-constexpr std::string_view setSource(Source source)
+/**
+ * Code of source in the SI (main zone) and Z2 / Z3 commands, empty if Dialect does not support source
+ */
+template <typename Dialect = MarantzDialect>
+constexpr std::string_view sourceCode(Source source)
 {
-	switch (source)
+	for (auto const& s : Dialect::sources)
 	{
-		case eu::tgcm::avrcommand::Source::Phono:
-			return "SIPHONO\n";
-		case eu::tgcm::avrcommand::Source::CD:
-			return "SICD\n";
-		case eu::tgcm::avrcommand::Source::DVD:
-			return "SIDVD\n";
-		case eu::tgcm::avrcommand::Source::Bluray:
-			return "SIBD\n";
-		case eu::tgcm::avrcommand::Source::TV:
-			return "SITV\n";
-		case eu::tgcm::avrcommand::Source::Cable_Sat:
-			return "SISAT/CBL\n";
-		case eu::tgcm::avrcommand::Source::Multimedia:
-			return "SIMPLAY\n";
-		case eu::tgcm::avrcommand::Source::Game:
-			return "SIGAME\n";
-		case eu::tgcm::avrcommand::Source::Tuner:
-			return "SITUNER\n";
-		case eu::tgcm::avrcommand::Source::HdRadio:
-			return "SIHDRADIO\n";
-		case eu::tgcm::avrcommand::Source::Aux1:
-			return "SIAUX1\n";
-		case eu::tgcm::avrcommand::Source::Aux2:
-			return "SIAUX2\n";
-		case eu::tgcm::avrcommand::Source::Aux3:
-			return "SIAUX3\n";
-		case eu::tgcm::avrcommand::Source::Aux4:
-			return "SIAUX4\n";
-		case eu::tgcm::avrcommand::Source::Aux5:
-			return "SIAUX5\n";
-		case eu::tgcm::avrcommand::Source::Aux6:
-			return "SIAUX6\n";
-		case eu::tgcm::avrcommand::Source::Aux7:
-			return "SIAUX7\n";
-		case eu::tgcm::avrcommand::Source::Network:
-			return "SINET\n";
-		case eu::tgcm::avrcommand::Source::Bluetooth:
-			return "SIBT\n";
+		if (s.source == source && !s.replyOnly)
+			return s.code;
 	}
-	return "";
+	return std::string_view();
 }
 
-constexpr std::string_view setMasterVolume(int volume, std::array<char, 6>& data)
+/**
+ * Main zone source commands of Dialect, built at compile time from its source table
+ */
+template <typename Dialect>
+struct SourceCommands
 {
-	data[0] = 'M';
-	data[1] = 'V';
+	struct Command
+	{
+		char data[maxSourceCodeLength + 3];
+		std::size_t size;
+	};
+
+	static constexpr std::array<Command, sourceCount> commands = [] {
+		std::array<Command, sourceCount> ret{};
+		for (std::size_t i = 0; i < sourceCount; ++i)
+		{
+			auto code = sourceCode<Dialect>(static_cast<Source>(i));
+			if (code.empty())
+				continue;
+			auto& command = ret[i];
+			command.data[0] = 'S';
+			command.data[1] = 'I';
+			for (std::size_t j = 0; j < code.size(); ++j)
+				command.data[2 + j] = code[j];
+			command.data[2 + code.size()] = '\n';
+			command.size = code.size() + 3;
+		}
+		return ret;
+	}();
+};
+
+/**
+ * Command selecting the source of the main zone, empty if Dialect does not support source
+ */
+template <typename Dialect = MarantzDialect>
+constexpr std::string_view setSource(Source source)
+{
+	auto const& command = SourceCommands<Dialect>::commands[static_cast<std::size_t>(source)];
+	return std::string_view(command.data, command.size);
+}
+
+/**
+ * Fixed commands of zone N, see ZoneCommands<0> for the main zone
+ */
+template <std::size_t N>
+struct ZoneCommands
+{
+	static_assert(N > 0 && N < zoneCount, "invalid zone");
+	static constexpr char id = static_cast<char>('1' + N);
+	static constexpr char prefix[] = {'Z', id, '\0'};
+	static constexpr char on[] = {'Z', id, 'O', 'N', '\n', '\0'};
+	static constexpr char off[] = {'Z', id, 'O', 'F', 'F', '\n', '\0'};
+	static constexpr char muteOn[] = {'Z', id, 'M', 'U', 'O', 'N', '\n', '\0'};
+	static constexpr char muteOff[] = {'Z', id, 'M', 'U', 'O', 'F', 'F', '\n', '\0'};
+	static constexpr char volumeUp[] = {'Z', id, 'U', 'P', '\n', '\0'};
+	static constexpr char volumeDown[] = {'Z', id, 'D', 'O', 'W', 'N', '\n', '\0'};
+	/** replied with the source, volume and power of the zone */
+	static constexpr char query[] = {'Z', id, '?', '\n', '\0'};
+	static constexpr char queryMute[] = {'Z', id, 'M', 'U', '?', '\n', '\0'};
+	static constexpr char const* volumePrefix = prefix;
+	static constexpr char const* sourcePrefix = prefix;
+};
+
+template <>
+struct ZoneCommands<0>
+{
+	static constexpr char on[] = "ZMON\n";
+	static constexpr char off[] = "ZMOFF\n";
+	static constexpr char muteOn[] = "MUON\n";
+	static constexpr char muteOff[] = "MUOFF\n";
+	static constexpr char volumeUp[] = "MVUP\n";
+	static constexpr char volumeDown[] = "MVDOWN\n";
+	/** replied with the power of the zone only */
+	static constexpr char query[] = "ZM?\n";
+	static constexpr char queryMute[] = "MU?\n";
+	static constexpr char volumePrefix[] = "MV";
+	static constexpr char sourcePrefix[] = "SI";
+};
+
+template <std::size_t N>
+constexpr std::string_view zoneOnCommand(Zone<N>, bool on)
+{
+	return on ? ZoneCommands<N>::on : ZoneCommands<N>::off;
+}
+
+template <std::size_t N>
+constexpr std::string_view muteCommand(Zone<N>, bool muted)
+{
+	return muted ? ZoneCommands<N>::muteOn : ZoneCommands<N>::muteOff;
+}
+
+/**
+ * Volume actually set by setVolume(zone, volume, data): the units digit is only sent when it is 5, so any
+ * other volume is truncated to the tenth of dB below.
+ */
+constexpr int encodedVolume(int volume)
+{
+	return volume - volume % 10 + (volume % 10 == 5 ? 5 : 0);
+}
+
+/**
+ * Command setting the volume of zone N, volume being in tenth of dB, in half dB steps. Returns a view on
+ * data.
+ */
+template <std::size_t N>
+constexpr std::string_view setVolume(Zone<N>, int volume, std::array<char, 6>& data)
+{
+	data[0] = ZoneCommands<N>::volumePrefix[0];
+	data[1] = ZoneCommands<N>::volumePrefix[1];
 	std::size_t i = 2;
 	data[i] = (volume / 100) + '0';
 	i += 1;
@@ -689,24 +1197,48 @@ constexpr std::string_view setMasterVolume(int volume, std::array<char, 6>& data
 	return std::string_view(data.data(), i);
 }
 
+/**
+ * Command selecting the source of zone N. Returns a view on data, empty if Dialect does not support source.
+ */
+template <typename Dialect = MarantzDialect, std::size_t N>
+constexpr std::string_view setSource(Zone<N>, Source source, std::array<char, 12>& data)
+{
+	static_assert(maxSourceCodeLength + 3 <= 12, "source commands must fit in data");
+	auto code = sourceCode<Dialect>(source);
+	if (code.empty())
+		return std::string_view();
+	data[0] = ZoneCommands<N>::sourcePrefix[0];
+	data[1] = ZoneCommands<N>::sourcePrefix[1];
+	std::size_t i = 2;
+	for (auto c : code)
+		data[i++] = c;
+	data[i++] = '\n';
+	return std::string_view(data.data(), i);
+}
+
+constexpr std::string_view setMasterVolume(int volume, std::array<char, 6>& data)
+{
+	return setVolume(MainZone{}, volume, data);
+}
+
 constexpr char const* queryMasterVolume = "MV?\n";
-constexpr char const* masterVolumeUpCommand = "MVUP\n";
-constexpr char const* masterVolumeDownCommand = "MVDOWN\n";
+constexpr char const* masterVolumeUpCommand = ZoneCommands<0>::volumeUp;
+constexpr char const* masterVolumeDownCommand = ZoneCommands<0>::volumeDown;
 
-constexpr char const* queryMute = "MU?\n";
-constexpr char const* muteOnCommand = "MUON\n";
-constexpr char const* muteOffCommand = "MUOFF\n";
+constexpr char const* queryMute = ZoneCommands<0>::queryMute;
+constexpr char const* muteOnCommand = ZoneCommands<0>::muteOn;
+constexpr char const* muteOffCommand = ZoneCommands<0>::muteOff;
 
 constexpr char const* queryPowerStatus = "PW?\n";
 constexpr char const* powerOnCommand = "PWON\n";
 constexpr char const* powerOffCommand = "PWSTANDBY\n";
 
-constexpr char const* queryMainZoneOn = "ZM?\n";
-constexpr char const* mainZoneOnCommand = "ZMON\n";
-constexpr char const* mainZoneOffCommand = "ZMOFF\n";
-constexpr char const* queryZone2On = "Z2?\n";
-constexpr char const* zone2OnCommand = "Z2ON\n";
-constexpr char const* zone2OffCommand = "Z2OFF\n";
+constexpr char const* queryMainZoneOn = ZoneCommands<0>::query;
+constexpr char const* mainZoneOnCommand = ZoneCommands<0>::on;
+constexpr char const* mainZoneOffCommand = ZoneCommands<0>::off;
+constexpr char const* queryZone2On = ZoneCommands<1>::query;
+constexpr char const* zone2OnCommand = ZoneCommands<1>::on;
+constexpr char const* zone2OffCommand = ZoneCommands<1>::off;
 constexpr char const* querySourceInput = "SI?\n";
 
 } // namespace avrcommand
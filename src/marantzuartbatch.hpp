@@ -0,0 +1,192 @@
+#ifndef EU_TGCM_AVRCOMMAND_MARANTZUARTBATCH_H
+#define EU_TGCM_AVRCOMMAND_MARANTZUARTBATCH_H
+
+#include "marantzuart.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace eu
+{
+namespace tgcm
+{
+namespace avrcommand
+{
+
+/**
+ * Parses the replies of many streams (one per receiver connection) with a single MarantzUartParser. The state
+ * of each stream is kept in contiguous arrays, indexed by stream id, instead of one parser per connection, and
+ * the data received for many streams is parsed in a single call.
+ *
+ * The parser holds the state of the last stream parsed, which is only parked in the arrays when a chunk of
+ * another stream comes: the chunks a stream receives in a row are parsed as if by a parser of its own.
+ *
+ * The callbacks of Handler are the ones of MarantzUartParser, taking the id of the stream as first argument,
+ * e.g. powerChanged(StreamId, bool) or volumeChanged(StreamId, Zone<N>, int). As for MarantzUartParser, the
+ * replies for which Handler provides no callback are skipped.
+ */
+template <typename Handler, typename Dialect = MarantzDialect, std::uint32_t Events = allEvents>
+class MarantzUartBatchParser
+{
+  public:
+	using StreamId = std::uint32_t;
+
+	/**
+	 * Data received on a stream
+	 */
+	struct Chunk
+	{
+		StreamId stream;
+		std::string_view data;
+		std::int64_t timestamp = 0;
+	};
+
+	explicit MarantzUartBatchParser(Handler& h) : tagged_{h, 0}, parser_(tagged_)
+	{
+	}
+
+	// the parser refers to tagged_
+	MarantzUartBatchParser(MarantzUartBatchParser const&) = delete;
+	MarantzUartBatchParser& operator=(MarantzUartBatchParser const&) = delete;
+
+	/**
+	 * Adds a stream, waiting for a reply, and returns its id. Ids are given in sequence from 0.
+	 */
+	StreamId addStream()
+	{
+		states_.push_back(0);
+		lastValues_.push_back(0);
+		droppedFrames_.push_back(0);
+		return static_cast<StreamId>(states_.size() - 1);
+	}
+
+	/**
+	 * Forgets the partial reply of stream, e.g. when its connection is reopened. Lets the caller reuse the id.
+	 */
+	void resetStream(StreamId stream)
+	{
+		assert(stream < states_.size());
+		states_[stream] = 0;
+		lastValues_[stream] = 0;
+		droppedFrames_[stream] = 0;
+		if (stream == tagged_.stream)
+		{
+			parser_.restoreState(typename Parser::ResumeState{});
+			droppedBase_ = parser_.droppedFrames();
+		}
+	}
+
+	std::size_t streamCount() const noexcept
+	{
+		return states_.size();
+	}
+
+	/**
+	 * Parses count chunks, in order. The chunks of a stream must come in the order they were received, but the
+	 * chunks of different streams can be interleaved. Each chunk is parsed entirely.
+	 */
+	void parse(Chunk const* chunks, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto const& chunk = chunks[i];
+			assert(chunk.stream < states_.size());
+			if (chunk.stream != tagged_.stream)
+				load_(chunk.stream);
+			auto data = chunk.data;
+			std::size_t res;
+			do
+			{
+				res = parser_.parse(data, chunk.timestamp);
+				data.remove_prefix(res);
+			} while (res > 0 && !data.empty());
+		}
+	}
+
+	void parse(std::vector<Chunk> const& chunks)
+	{
+		parse(chunks.data(), chunks.size());
+	}
+
+	/**
+	 * Timestamp of the chunk being parsed, for the handler
+	 */
+	std::int64_t timestamp() const noexcept
+	{
+		return parser_.timestamp();
+	}
+
+	/**
+	 * Number of replies of stream that were skipped because they were not understood. Wraps around.
+	 */
+	std::uint32_t droppedFrames(StreamId stream) const
+	{
+		assert(stream < states_.size());
+		if (stream == tagged_.stream)
+			return droppedFrames_[stream] + (parser_.droppedFrames() - droppedBase_);
+		return droppedFrames_[stream];
+	}
+
+  private:
+	/**
+	 * Handler of the parser, forwards the callbacks with the id of the stream being parsed. Only provides the
+	 * callbacks Handler provides, so that the parser skips the same replies.
+	 */
+	struct Tagged
+	{
+		Handler& h;
+		StreamId stream;
+
+		// H makes the return types depend on the template arguments, so that a missing callback is not an error
+#define AVRCOMMAND_FORWARD_CALLBACK(name)                                                                              \
+	template <typename H = Handler, typename... Args>                                                                  \
+	auto name(Args... args)->decltype(std::declval<H&>().name(stream, args...))                                        \
+	{                                                                                                                  \
+		return h.name(stream, args...);                                                                                \
+	}
+
+		AVRCOMMAND_FORWARD_CALLBACK(powerChanged)
+		AVRCOMMAND_FORWARD_CALLBACK(maxVolumeChanged)
+		AVRCOMMAND_FORWARD_CALLBACK(volumeChanged)
+		AVRCOMMAND_FORWARD_CALLBACK(mutedChanged)
+		AVRCOMMAND_FORWARD_CALLBACK(sourceChanged)
+		AVRCOMMAND_FORWARD_CALLBACK(zoneOnChanged)
+
+#undef AVRCOMMAND_FORWARD_CALLBACK
+	};
+
+	using Parser = MarantzUartParser<Tagged, Dialect, Events>;
+
+	/**
+	 * Parks the state of the stream held by the parser, and resumes stream
+	 */
+	void load_(StreamId stream)
+	{
+		auto const parked = tagged_.stream;
+		auto const state = parser_.saveState();
+		states_[parked] = state.state;
+		lastValues_[parked] = state.lastValue;
+		droppedFrames_[parked] += parser_.droppedFrames() - droppedBase_;
+		tagged_.stream = stream;
+		parser_.restoreState(typename Parser::ResumeState{states_[stream], lastValues_[stream]});
+		droppedBase_ = parser_.droppedFrames();
+	}
+
+	Tagged tagged_; /**< tagged_.stream is the stream whose state is in the parser, stale in the arrays */
+	Parser parser_;
+	std::uint32_t droppedBase_ = 0; /**< frames the parser had dropped when it resumed tagged_.stream */
+
+	/** State of each stream, see MarantzUartParser::ResumeState */
+	std::vector<std::uint8_t> states_;
+	std::vector<int> lastValues_;
+	std::vector<std::uint32_t> droppedFrames_;
+};
+
+} // namespace avrcommand
+} // namespace tgcm
+} // namespace eu
+
+#endif // EU_TGCM_AVRCOMMAND_MARANTZUARTBATCH_H
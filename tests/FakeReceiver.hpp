@@ -0,0 +1,206 @@
+#ifndef FAKERECEIVER_HPP
+#define FAKERECEIVER_HPP
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <algorithm>
+
+/**
+ * Emulates a receiver on a local TCP port, for the tests: keeps a power / volume / mute / source state, for
+ * the main zone and zones 2 and 3, changes it according to the commands received, and echoes the new state,
+ * the way a real device does. Queries are answered with the current state.
+ */
+class FakeReceiver
+{
+  public:
+	FakeReceiver()
+	{
+		QObject::connect(&server_, &QTcpServer::newConnection, [this] {
+			while (auto* socket = server_.nextPendingConnection())
+			{
+				clients_.push_back(socket);
+				QObject::connect(socket, &QTcpSocket::readyRead, [this, socket] { handleData(socket); });
+			}
+		});
+	}
+
+	bool listen(QHostAddress const& address = QHostAddress::LocalHost, quint16 port = 0)
+	{
+		return server_.listen(address, port);
+	}
+
+	quint16 port() const
+	{
+		return server_.serverPort();
+	}
+
+	/**
+	 * Disconnects all the clients
+	 */
+	void disconnectClients()
+	{
+		for (auto* c : clients_)
+			c->disconnectFromHost();
+		clients_.clear();
+	}
+
+	/**
+	 * Sends data to all the clients, e.g. to emulate a change made on the device itself
+	 */
+	void send(QByteArray const& data)
+	{
+		for (auto* c : clients_)
+			c->write(data);
+	}
+
+	/**
+	 * Every command line received, in order, without its terminator
+	 */
+	QList<QByteArray> received;
+
+	/**
+	 * Whether commands changing the state are echoed, queries are always answered
+	 */
+	bool echo = true;
+
+	/**
+	 * Commands starting with one of these are not answered, as by a model without the feature (e.g. "Z3"
+	 * for a receiver without zone 3, "SIPHONO" for one without phono input)
+	 */
+	QList<QByteArray> unsupported;
+
+	bool power = true;
+	int volume = 300;
+	bool muted = false;
+	QByteArray source = "CD";
+	bool mainZone = true;
+
+	struct Zone
+	{
+		bool on = false;
+		int volume = 200;
+		bool muted = false;
+		QByteArray source = "TUNER";
+	};
+	/**
+	 * Zone 2 and zone 3
+	 */
+	Zone zones[2];
+
+  private:
+	static QByteArray volumeReply(QByteArray const& prefix, int volume)
+	{
+		if (volume % 10 == 0)
+			return prefix + QByteArray::number(volume / 10).rightJustified(2, '0') + "\r";
+		return prefix + QByteArray::number(volume).rightJustified(3, '0') + "\r";
+	}
+
+	static void setVolume(QByteArray const& value, int& volume)
+	{
+		if (value == "UP")
+			volume += 5;
+		else if (value == "DOWN")
+			volume -= 5;
+		else
+			volume = value.size() == 2 ? value.toInt() * 10 : value.toInt();
+	}
+
+	QByteArray zoneReply(QByteArray const& command, bool query)
+	{
+		QByteArray const prefix = command.left(2);
+		Zone& zone = zones[command[1] - '2'];
+		QByteArray const arg = command.mid(2);
+		if (arg == "?")
+			return prefix + (zone.on ? "ON\r" : "OFF\r") + prefix + zone.source + "\r" +
+			       volumeReply(prefix, zone.volume);
+		if (arg.startsWith("MU"))
+		{
+			if (!query)
+				zone.muted = arg == "MUON";
+			return prefix + (zone.muted ? "MUON\r" : "MUOFF\r");
+		}
+		if (arg == "ON" || arg == "OFF")
+		{
+			zone.on = arg == "ON";
+			return command + "\r";
+		}
+		if (arg == "UP" || arg == "DOWN" || (!arg.isEmpty() && arg[0] >= '0' && arg[0] <= '9'))
+		{
+			setVolume(arg, zone.volume);
+			return volumeReply(prefix, zone.volume);
+		}
+		zone.source = arg;
+		return command + "\r";
+	}
+
+	QByteArray reply(QByteArray const& command)
+	{
+		QByteArray ret;
+		bool const query = command.endsWith('?');
+		if (command.startsWith("PW"))
+		{
+			if (!query)
+				power = command == "PWON";
+			ret = power ? "PWON\r" : "PWSTANDBY\r";
+		}
+		else if (command.startsWith("MU"))
+		{
+			if (!query)
+				muted = command == "MUON";
+			ret = muted ? "MUON\r" : "MUOFF\r";
+		}
+		else if (command.startsWith("MV"))
+		{
+			if (!query)
+				setVolume(command.mid(2), volume);
+			ret = volumeReply("MV", volume);
+		}
+		else if (command.startsWith("SI"))
+		{
+			if (!query)
+				source = command.mid(2);
+			ret = "SI" + source + "\r";
+		}
+		else if (command.startsWith("ZM"))
+		{
+			if (!query)
+				mainZone = command == "ZMON";
+			ret = mainZone ? "ZMON\r" : "ZMOFF\r";
+		}
+		else if (command.size() > 2 && command[0] == 'Z' && (command[1] == '2' || command[1] == '3'))
+			ret = zoneReply(command, query);
+		if (!query && !echo)
+			return QByteArray();
+		return ret;
+	}
+
+	void handleData(QTcpSocket* socket)
+	{
+		buffer_ += socket->readAll();
+		int end;
+		while ((end = buffer_.indexOf('\n')) >= 0 || (end = buffer_.indexOf('\r')) >= 0)
+		{
+			QByteArray command = buffer_.left(end);
+			buffer_.remove(0, end + 1);
+			if (command.isEmpty())
+				continue;
+			received.push_back(command);
+			if (std::any_of(unsupported.cbegin(), unsupported.cend(),
+			                [&command](QByteArray const& prefix) { return command.startsWith(prefix); }))
+				continue;
+			auto r = reply(command);
+			if (!r.isEmpty())
+				socket->write(r);
+		}
+	}
+
+	QTcpServer server_;
+	QList<QTcpSocket*> clients_;
+	QByteArray buffer_;
+};
+
+#endif // FAKERECEIVER_HPP
@@ -0,0 +1,156 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+
+#include <QHash>
+#include <QList>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace
+{
+std::atomic<bool> countAllocations{false};
+std::atomic<std::size_t> allocationCount{0};
+
+void count()
+{
+	if (countAllocations.load(std::memory_order_relaxed))
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Defeats the elision of a new / delete pair
+ */
+void* volatile sink = nullptr;
+} // namespace
+
+// Counted at the malloc level: Qt containers (QArrayData, QListData, QHashData) call malloc directly, and
+// every form of operator new (arrays, aligned, nothrow) ends up here too. Interposes glibc's allocator.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+void* malloc(std::size_t size)
+{
+	count();
+	return __libc_malloc(size);
+}
+
+void* calloc(std::size_t n, std::size_t size)
+{
+	count();
+	return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, std::size_t size)
+{
+	count();
+	return __libc_realloc(p, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size)
+{
+	count();
+	return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+	count();
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ret, std::size_t alignment, std::size_t size)
+{
+	count();
+	void* p = __libc_memalign(alignment, size);
+	if (p == nullptr)
+		return ENOMEM;
+	*ret = p;
+	return 0;
+}
+}
+
+class TestAllocations : public QObject
+{
+	Q_OBJECT
+	/**
+	 * Number of allocations made by f
+	 */
+	template <typename F>
+	static std::size_t allocations(F f)
+	{
+		allocationCount = 0;
+		countAllocations = true;
+		f();
+		countAllocations = false;
+		return allocationCount.load();
+	}
+
+  private slots:
+	void testCounter()
+	{
+		struct alignas(64) Aligned
+		{
+			char data[64];
+		};
+		QCOMPARE(allocations([] { sink = new int(1); }), std::size_t{1});
+		delete static_cast<int*>(sink);
+		QCOMPARE(allocations([] { sink = new int[4]; }), std::size_t{1});
+		delete[] static_cast<int*>(sink);
+		QCOMPARE(allocations([] { sink = new (std::nothrow) int(1); }), std::size_t{1});
+		delete static_cast<int*>(sink);
+		QCOMPARE(allocations([] { sink = new Aligned; }), std::size_t{1});
+		delete static_cast<Aligned*>(sink);
+		QCOMPARE(allocations([] { sink = new (std::nothrow) Aligned[2]; }), std::size_t{1});
+		delete[] static_cast<Aligned*>(sink);
+		// the allocations of the Qt containers do not go through operator new
+		QVERIFY(allocations([] { QString s(100, QLatin1Char('x')); }) > 0);
+		QVERIFY(allocations([] { QByteArray b(100, 'x'); }) > 0);
+		QVERIFY(allocations([] { QList<int> l{1, 2, 3}; }) > 0);
+		QVERIFY(allocations([] { QHash<int, int> h{{1, 2}}; }) > 0);
+	}
+
+	void testSteadyStateReplay()
+	{
+		char const traffic[] = "PWON\rZMON\rZ2OFF\rMV30\rMVMAX 655\rSIBD\rMUOFF\rMV305\rSICD\rMUON\r"
+		                       "XX12\rMV31\rSISAT/CBL\rMUOFF\rPWSTANDBY\rPWON\r";
+		std::size_t const len = std::strlen(traffic);
+
+		eu::tgcm::avrremote::AvrDevice d;
+		int volumeSignals = 0;
+		QObject::connect(&d, &eu::tgcm::avrremote::AvrDevice::volumeChanged, [&volumeSignals](int) {
+			volumeSignals += 1;
+		});
+
+		// warm-up
+		d.processResponse(traffic, static_cast<int>(len));
+
+		auto const count = allocations([&d, &traffic, len] {
+			for (std::size_t chunk = 1; chunk <= len; ++chunk)
+			{
+				// replay the traffic, split in chunks of every possible size
+				for (std::size_t offset = 0; offset < len; offset += chunk)
+				{
+					auto size = std::min(chunk, len - offset);
+					d.processResponse(traffic + offset, static_cast<int>(size));
+				}
+			}
+		});
+
+		// QString and QByteArray included, e.g. the current source or debug output
+		QCOMPARE(count, std::size_t{0});
+		QVERIFY(volumeSignals == 3 * static_cast<int>(len + 1));
+		QVERIFY(d.volume().value() == 310);
+		QVERIFY(!d.standby());
+	}
+};
+
+QTEST_MAIN(TestAllocations)
+#include "test_allocations.moc"
@@ -0,0 +1,70 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+#include "marantzuart.hpp"
+
+using namespace eu::tgcm::avrremote;
+using eu::tgcm::avrcommand::Source;
+
+class TestAsync : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+	}
+
+  private slots:
+	void testResolved()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		auto volume = device.setVolumeAsync(455);
+		auto source = device.setSourceAsync(static_cast<int>(Source::Tuner));
+		QVERIFY(!volume.isFinished());
+		QTRY_VERIFY(volume.isFinished() && source.isFinished());
+		QVERIFY(volume.result());
+		QVERIFY(source.result());
+		QCOMPARE(device.volume().value(), 455);
+		QVERIFY(device.currentSource().source() == Source::Tuner);
+
+		// already in the requested state: nothing sent
+		auto power = device.setPowerStandbyAsync(false);
+		QTRY_VERIFY(power.isFinished());
+		QVERIFY(power.result());
+		QCOMPARE(receiver.received, (QList<QByteArray>{"PW?", "MV455", "SITUNER"}));
+	}
+
+	void testTimeout()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		receiver.echo = false;
+
+		auto muted = device.setMutedAsync(true, 100);
+		QTRY_VERIFY(muted.isFinished());
+		QVERIFY(!muted.result());
+	}
+
+	void testDeviceDestroyed()
+	{
+		auto* device = new AvrDevice();
+		auto zone = device->setZone2OnAsync(true);
+		delete device;
+		QVERIFY(zone.isFinished());
+		QVERIFY(!zone.result());
+	}
+};
+
+QTEST_MAIN(TestAsync)
+#include "test_async.moc"
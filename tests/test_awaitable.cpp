@@ -0,0 +1,105 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "Awaitable.hpp"
+#include "FakeReceiver.hpp"
+
+#include <exception>
+#include <vector>
+
+#ifndef AVRCONTROL_HAS_COROUTINES
+#error "test_awaitable must be compiled as C++20"
+#endif
+
+using namespace eu::tgcm::avrremote;
+
+namespace
+{
+/**
+ * Coroutine type running until its first suspension when called, and destroyed once finished
+ */
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object()
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+Task muteThenSetVolume(AvrDevice& device, std::vector<bool>& results)
+{
+	results.push_back(co_await awaitable(device.setMutedAsync(true, 1000)));
+	results.push_back(co_await awaitable(device.setVolumeAsync(455, 1000)));
+}
+} // namespace
+
+class TestAwaitable : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+	}
+
+  private slots:
+	void testResumed()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		std::vector<bool> results;
+		muteThenSetVolume(device, results);
+		QVERIFY(results.empty()); // suspended until the echo is received
+		QTRY_COMPARE(results.size(), std::size_t(2));
+		QVERIFY(results[0]);
+		QVERIFY(results[1]);
+		QVERIFY(device.muted());
+		QCOMPARE(device.volume().value(), 455);
+	}
+
+	void testTimeout()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		receiver.echo = false;
+
+		std::vector<bool> results;
+		muteThenSetVolume(device, results);
+		QTRY_COMPARE(results.size(), std::size_t(2));
+		QVERIFY(!results[0]);
+		QVERIFY(!results[1]);
+	}
+};
+
+QTEST_MAIN(TestAwaitable)
+#include "test_awaitable.moc"
@@ -0,0 +1,118 @@
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "CircuitBreaker.hpp"
+#include "FakeReceiver.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+class TestBreaker : public QObject
+{
+	Q_OBJECT
+
+  private slots:
+	void testStates()
+	{
+		CircuitBreaker breaker;
+		breaker.setOpenDuration(100, 350);
+		QCOMPARE(breaker.state(), CircuitBreaker::State::Closed);
+		QCOMPARE(breaker.health(), 1.);
+
+		// a few garbled replies among good ones do not open it
+		for (int i = 0; i < 100; ++i)
+			QVERIFY(!breaker.record(i % 5 == 0 ? CircuitBreaker::Event::ParseError : CircuitBreaker::Event::Reply));
+		QCOMPARE(breaker.state(), CircuitBreaker::State::Closed);
+
+		// an unreachable device does
+		QVERIFY(!breaker.record(CircuitBreaker::Event::ConnectFailed));
+		QVERIFY(breaker.record(CircuitBreaker::Event::ConnectFailed));
+		QCOMPARE(breaker.state(), CircuitBreaker::State::Open);
+		QVERIFY(breaker.health() < 0.3);
+		QCOMPARE(breaker.openDuration(), std::int64_t{100});
+		QVERIFY(!breaker.record(CircuitBreaker::Event::Reply));
+		QCOMPARE(breaker.state(), CircuitBreaker::State::Open);
+
+		// failed probes back off, up to the maximum
+		for (std::int64_t expected : {200, 350, 350})
+		{
+			QVERIFY(breaker.halfOpen());
+			QVERIFY(!breaker.halfOpen());
+			QCOMPARE(breaker.state(), CircuitBreaker::State::HalfOpen);
+			QVERIFY(breaker.record(CircuitBreaker::Event::ConnectFailed));
+			QCOMPARE(breaker.state(), CircuitBreaker::State::Open);
+			QCOMPARE(breaker.openDuration(), expected);
+		}
+
+		// connecting is not enough, the device must reply
+		QVERIFY(breaker.halfOpen());
+		QVERIFY(!breaker.record(CircuitBreaker::Event::Connected));
+		QVERIFY(breaker.record(CircuitBreaker::Event::Reply));
+		QCOMPARE(breaker.state(), CircuitBreaker::State::Closed);
+		QCOMPARE(breaker.openDuration(), std::int64_t{100});
+		QVERIFY(breaker.health() >= 0.3);
+		// not opened again by the next failure
+		QVERIFY(!breaker.record(CircuitBreaker::Event::ReplyTimeout));
+	}
+
+	void testDevice()
+	{
+		// a port nothing listens on
+		QTcpServer server;
+		QVERIFY(server.listen(QHostAddress::LocalHost));
+		auto const port = server.serverPort();
+		server.close();
+
+		AvrDevice device;
+		device.setBreakerOpenDuration(200, 200);
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(port);
+		QSignalSpy breakerChanged(&device, &AvrDevice::breakerStateChanged);
+		for (int i = 0; i < 2; ++i)
+		{
+			device.connectToDevice();
+			QTRY_COMPARE(device.connectionStatus(), int(AvrDevice::Unconnected));
+		}
+		QCOMPARE(device.breakerState(), int(AvrDevice::BreakerOpen));
+		QCOMPARE(breakerChanged.count(), 1);
+
+		// no traffic while open
+		device.connectToDevice();
+		QCOMPARE(device.connectionStatus(), int(AvrDevice::Unconnected));
+
+		// the receiver comes back, the probe closes the breaker
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen(QHostAddress::LocalHost, port));
+		QTRY_COMPARE(device.breakerState(), int(AvrDevice::BreakerClosed));
+		QCOMPARE(device.connectionStatus(), int(AvrDevice::Connected));
+		QCOMPARE(breakerChanged.count(), 3);
+	}
+
+	void testChatter()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_COMPARE(device.connectionStatus(), int(AvrDevice::Connected));
+
+		// well formed replies the device does not decode, with no decoded reply to make up for them
+		QByteArray const chatter("MSSTEREO\rPSFRONT A\rSVOFF\rCVFL 50\rCVEND\rNSE1Artist\rZ2CVFL 50\rZ2SLPOFF\r");
+		for (int i = 0; i < 100; ++i)
+			device.processResponse(chatter.constData(), chatter.size());
+		QCOMPARE(device.breakerState(), int(AvrDevice::BreakerClosed));
+		QCOMPARE(device.connectionStatus(), int(AvrDevice::Connected));
+
+		// garbage still counts
+		QByteArray const garbage("55\r\x01\x02\r#?\r0\r");
+		for (int i = 0; i < 10; ++i)
+			device.processResponse(garbage.constData(), garbage.size());
+		QCOMPARE(device.breakerState(), int(AvrDevice::BreakerOpen));
+	}
+};
+
+QTEST_MAIN(TestBreaker)
+#include "test_breaker.moc"
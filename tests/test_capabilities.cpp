@@ -0,0 +1,220 @@
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "CapabilityCache.hpp"
+#include "FakeReceiver.hpp"
+#include "Scene.hpp"
+
+using namespace eu::tgcm::avrremote;
+using eu::tgcm::avrcommand::Source;
+
+class TestCapabilities : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+		receiver.received.clear();
+	}
+
+	static int index(Source source)
+	{
+		return static_cast<int>(source);
+	}
+
+  private slots:
+	void testSuppression()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		QCOMPARE(device.supportedSources().size(), Capabilities::sourceCount);
+
+		QSignalSpy changed(&device, &AvrDevice::capabilitiesChanged);
+		Capabilities capabilities;
+		capabilities.zones = 0b011;
+		capabilities.sources &= ~(std::uint32_t{1} << index(Source::Phono));
+		device.setCapabilities(capabilities);
+		QCOMPARE(changed.count(), 1);
+		QVERIFY(!device.supportedSources().contains(index(Source::Phono)));
+		QVERIFY(device.supportedSources().contains(index(Source::CD)));
+		QVERIFY(!device.supports(zoneProperty(2, ZoneField::On), 1));
+		QVERIFY(device.supports(zoneProperty(1, ZoneField::On), 1));
+
+		device.setZoneOn(2, true);
+		device.setZoneVolume(2, 300);
+		device.setSource(index(Source::Phono));
+		device.setSource(index(Source::CD));
+		device.setZoneOn(1, true);
+		QTRY_COMPARE(receiver.received, (QList<QByteArray>{"SICD", "Z2ON"}));
+
+		// scene targets the device does not support fail without being sent
+		receiver.received.clear();
+		auto* op = SceneOperation::apply(Scene().set(zoneProperty(2, ZoneField::On), 1).setMuted(true), {&device},
+		                                 1000);
+		QStringList failed;
+		bool finished = false;
+		connect(op, &SceneOperation::finished, this, [&failed, &finished, op] {
+			failed = op->failedProperties();
+			finished = true;
+		});
+		QTRY_VERIFY(finished);
+		QCOMPARE(failed, QStringList{toCStr(zoneProperty(2, ZoneField::On))});
+		QCOMPARE(receiver.received, QList<QByteArray>{"MUON"});
+	}
+
+	void testProbe()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		receiver.unsupported = {"Z3", "SIPHONO", "SIDVD"};
+		AvrDevice device;
+		connectTo(device, receiver);
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		auto const path = dir.filePath(QStringLiteral("capabilities.json"));
+
+		CapabilityCache cache;
+		QVERIFY(cache.load(path));
+		QCOMPARE(cache.modelCount(), 0);
+		cache.setProbeTimeout(200);
+		QSignalSpy probed(&cache, &CapabilityCache::probed);
+		cache.apply(&device, QStringLiteral("SR6015"));
+		QTRY_COMPARE_WITH_TIMEOUT(probed.count(), 1, 10000);
+		QCOMPARE(probed.first().at(1).toBool(), true);
+		auto const capabilities = device.capabilities();
+		QVERIFY(capabilities.hasZone(1));
+		QVERIFY(!capabilities.hasZone(2));
+		QVERIFY(!capabilities.hasSource(index(Source::Phono)));
+		QVERIFY(!capabilities.hasSource(index(Source::DVD)));
+		QVERIFY(capabilities.hasSource(index(Source::CD)));
+		QVERIFY(capabilities.hasSource(index(Source::Bluetooth)));
+		// back to the source selected before the probe
+		QTRY_COMPARE(receiver.received.last(), QByteArray("SICD"));
+		QCOMPARE(receiver.source, QByteArray("CD"));
+
+		// another session finds the model in the cache, and does not probe
+		FakeReceiver other;
+		QVERIFY(other.listen());
+		AvrDevice otherDevice;
+		connectTo(otherDevice, other);
+		CapabilityCache saved;
+		QVERIFY(saved.load(path));
+		QVERIFY(saved.contains(QStringLiteral("SR6015")));
+		QVERIFY(saved.capabilities(QStringLiteral("SR6015")) == capabilities);
+		saved.apply(&otherDevice, QStringLiteral("SR6015"));
+		QVERIFY(otherDevice.capabilities() == capabilities);
+		QTest::qWait(50);
+		QVERIFY(other.received.isEmpty());
+	}
+
+	void testStandby()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		receiver.power = false;
+		receiver.mainZone = false;
+		AvrDevice device;
+		connectTo(device, receiver);
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		auto const path = dir.filePath(QStringLiteral("capabilities.json"));
+
+		// a receiver in standby does not select sources: it is not probed, and nothing is cached
+		CapabilityCache cache;
+		QVERIFY(cache.load(path));
+		cache.setProbeTimeout(200);
+		QSignalSpy probed(&cache, &CapabilityCache::probed);
+		cache.apply(&device, QStringLiteral("SR6015"));
+		QTest::qWait(300);
+		QCOMPARE(probed.count(), 0);
+		QVERIFY(!receiver.received.contains("Z2?"));
+
+		// nor once on, while its main zone is off
+		device.setPowerStandby(false);
+		QTRY_VERIFY(device.snapshot().zones[0].on.state() == RemoteProperty::UpToDate);
+		QTest::qWait(300);
+		QCOMPARE(probed.count(), 0);
+		QCOMPARE(cache.modelCount(), 0);
+		QVERIFY(!QFile::exists(path));
+		QVERIFY(!receiver.received.contains("Z2?"));
+
+		device.setMainZoneOn(true);
+		QTRY_COMPARE_WITH_TIMEOUT(probed.count(), 1, 10000);
+		QCOMPARE(probed.first().at(1).toBool(), true);
+		QVERIFY(device.capabilities().hasSource(index(Source::CD)));
+		QVERIFY(device.capabilities().hasSource(index(Source::Bluetooth)));
+		CapabilityCache saved;
+		QVERIFY(saved.load(path));
+		QVERIFY(saved.capabilities(QStringLiteral("SR6015")) == device.capabilities());
+	}
+
+	void testLateEcho()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		receiver.unsupported = {"SIPHONO"};
+		AvrDevice device;
+		connectTo(device, receiver);
+		// switches without echoing in time, only answers when asked
+		receiver.echo = false;
+
+		CapabilityCache cache;
+		cache.setProbeTimeout(100);
+		QSignalSpy probed(&cache, &CapabilityCache::probed);
+		cache.apply(&device, QStringLiteral("SR6015"));
+		QTRY_COMPARE_WITH_TIMEOUT(probed.count(), 1, 20000);
+		QCOMPARE(probed.first().at(1).toBool(), true);
+		QVERIFY(device.capabilities().hasSource(index(Source::CD)));
+		QVERIFY(device.capabilities().hasSource(index(Source::Bluetooth)));
+		QVERIFY(!device.capabilities().hasSource(index(Source::Phono)));
+		QVERIFY(receiver.received.count("SI?") > 1); // the first one reads the source to go back to
+		QTRY_COMPARE(receiver.source, QByteArray("CD"));
+	}
+
+	void testAborted()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		auto const path = dir.filePath(QStringLiteral("capabilities.json"));
+
+		// the main zone turned off during the probe: back to the source selected before, nothing cached
+		receiver.echo = false; // each source takes a timeout
+		CapabilityCache cache;
+		QVERIFY(cache.load(path));
+		cache.setProbeTimeout(200);
+		QSignalSpy probed(&cache, &CapabilityCache::probed);
+		cache.apply(&device, QStringLiteral("SR6015"));
+		QTRY_VERIFY(receiver.source != "CD");
+		receiver.mainZone = false;
+		receiver.send("ZMOFF\r");
+		QTRY_COMPARE(probed.count(), 1);
+		QCOMPARE(probed.first().at(1).toBool(), false);
+		QTRY_COMPARE(receiver.source, QByteArray("CD"));
+		QCOMPARE(cache.modelCount(), 0);
+
+		// a receiver that stops answering leaves a partial result, which is not cached either
+		receiver.send("ZMON\r");
+		receiver.mainZone = true;
+		receiver.unsupported = {"SI"};
+		QTRY_COMPARE_WITH_TIMEOUT(probed.count(), 2, 10000);
+		QCOMPARE(probed.last().at(1).toBool(), false);
+		QCOMPARE(cache.modelCount(), 0);
+		QVERIFY(!QFile::exists(path));
+	}
+};
+
+QTEST_GUILESS_MAIN(TestCapabilities)
+#include "test_capabilities.moc"
@@ -55,6 +55,33 @@ class TestCommands : public QObject
 		testSourceHelper_("SIBT\n", Source::Bluetooth);
 	}
 
+	void testZones()
+	{
+		std::array<char, 6> volume{0};
+		QVERIFY(setVolume(Zone2{}, 455, volume) == "Z2455\n");
+		QVERIFY(setVolume(Zone3{}, 300, volume) == "Z330\n");
+		QVERIFY(setVolume(MainZone{}, 50, volume) == "MV05\n");
+		std::array<char, 12> source{0};
+		QVERIFY(setSource(Zone2{}, Source::Cable_Sat, source) == "Z2SAT/CBL\n");
+		QVERIFY(setSource(MainZone{}, Source::Tuner, source) == "SITUNER\n");
+		QVERIFY(zoneOnCommand(Zone3{}, false) == "Z3OFF\n");
+		QVERIFY(zoneOnCommand(MainZone{}, true) == "ZMON\n");
+		QVERIFY(muteCommand(Zone2{}, true) == "Z2MUON\n");
+		QVERIFY(muteCommand(MainZone{}, false) == "MUOFF\n");
+		QVERIFY(std::string_view(ZoneCommands<1>::query) == "Z2?\n");
+		QVERIFY(std::string_view(ZoneCommands<2>::queryMute) == "Z3MU?\n");
+	}
+
+	void testDialects()
+	{
+		// reply only codes are never sent
+		QVERIFY(setSource<DenonDialect>(Source::Cable_Sat) == "SISAT/CBL\n");
+		QVERIFY(setSource<DenonDialect>(Source::Multimedia) == "SIMPLAY\n");
+		QVERIFY(sourceCode<MarantzDialect>(Source::Bluetooth) == "BT");
+		std::array<char, 12> data{0};
+		QVERIFY(setSource<DenonDialect>(Zone3{}, Source::Network, data) == "Z3NET\n");
+	}
+
   private:
 	void testSourceHelper_(std::string_view s, Source c)
 	{
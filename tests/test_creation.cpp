@@ -14,6 +14,38 @@ class TestCreation : public QObject
 		eu::tgcm::avrremote::AvrDevice d;
 		(void)d;
 	}
+
+	void testSnapshot()
+	{
+		eu::tgcm::avrremote::AvrDevice d;
+		auto s = d.snapshot();
+		QVERIFY(s.zones[0].volume.state() == eu::tgcm::avrremote::RemoteProperty::Unknown);
+		QVERIFY(s.sequence == 0u);
+		char const data[] = "MV45\rSIBD\rPWON\rMUON\r";
+		d.processResponse(data, sizeof(data) - 1, 1000);
+		s = d.snapshot();
+		QVERIFY(s.zones[0].volume.value() == 450);
+		QVERIFY(s.zones[0].volume.state() == eu::tgcm::avrremote::RemoteProperty::UpToDate);
+		QVERIFY(s.zones[0].volume.timestamp() == 1000);
+		QVERIFY(s.zones[0].source.value() == Source::Bluray);
+		QVERIFY(!s.standby.value());
+		QVERIFY(s.zones[0].muted.value());
+		QVERIFY(s.sequence == 4u);
+		QVERIFY(s.zones[0].muted.sequence() == 4u);
+	}
+
+	void testDialect()
+	{
+		eu::tgcm::avrremote::AvrDevice d;
+		QVERIFY(d.dialect() == eu::tgcm::avrremote::AvrDevice::Marantz);
+		char const data[] = "SISAT\r";
+		d.processResponse(data, sizeof(data) - 1);
+		QVERIFY(d.currentSource().state() == eu::tgcm::avrremote::RemoteProperty::Unknown);
+		d.setDialect(eu::tgcm::avrremote::AvrDevice::Denon);
+		QVERIFY(d.dialect() == eu::tgcm::avrremote::AvrDevice::Denon);
+		d.processResponse(data, sizeof(data) - 1);
+		QVERIFY(d.currentSource().source() == Source::Cable_Sat);
+	}
 };
 
 QTEST_MAIN(TestCreation)
@@ -0,0 +1,159 @@
+#include <QSignalSpy>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "DeviceGroup.hpp"
+#include "FakeReceiver.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+class TestDeviceGroup : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+		receiver.received.clear();
+	}
+
+  private slots:
+	void testFanOut()
+	{
+		FakeReceiver bar;
+		QVERIFY(bar.listen());
+		FakeReceiver terrace;
+		QVERIFY(terrace.listen());
+		AvrDevice barDevice;
+		connectTo(barDevice, bar);
+		AvrDevice terraceDevice;
+		connectTo(terraceDevice, terrace);
+
+		DeviceGroup group;
+		group.addMember(&barDevice);
+		group.addMember(&terraceDevice, -50);
+		QCOMPARE(group.volume(), -1);
+		QSignalSpy confirmed(&group, &DeviceGroup::commandConfirmed);
+
+		// the commands of an event loop iteration are coalesced, and the offsets applied
+		group.setVolume(300);
+		group.setVolume(400);
+		group.setMuted(true);
+		QTRY_COMPARE(confirmed.count(), 1);
+		QCOMPARE(bar.received, (QList<QByteArray>{"MV40", "MUON"}));
+		QCOMPARE(terrace.received, (QList<QByteArray>{"MV35", "MUON"}));
+		QCOMPARE(terraceDevice.volume().value(), 350);
+		QCOMPARE(group.writeSkew().count(), std::uint64_t{1});
+		QCOMPARE(group.replySkew().count(), std::uint64_t{1});
+		// the writes of the members follow each other within the same event loop iteration
+		auto const writeSkew = confirmed.first().at(0).toLongLong();
+		QVERIFY(writeSkew >= 0);
+		QVERIFY2(writeSkew < 50'000'000, qPrintable(QStringLiteral("write skew %1 ns").arg(writeSkew)));
+		QVERIFY(confirmed.first().at(1).toLongLong() >= 0);
+
+		// members already in the requested state are not written to
+		bar.received.clear();
+		terrace.received.clear();
+		group.setMuted(true);
+		QTest::qWait(50);
+		QVERIFY(bar.received.isEmpty());
+		QVERIFY(terrace.received.isEmpty());
+		QCOMPARE(confirmed.count(), 1);
+
+		// offsets stay within the volume range of the member
+		group.setVolumeOffset(&terraceDevice, -500);
+		QTRY_COMPARE(terrace.received, (QList<QByteArray>{"MV00"}));
+		QVERIFY(bar.received.isEmpty());
+
+		auto* other = new AvrDevice;
+		group.addMember(other);
+		QCOMPARE(group.members().size(), 3);
+		delete other;
+		QCOMPARE(group.members(), (QList<AvrDevice*>{&barDevice, &terraceDevice}));
+	}
+
+	void testFollow()
+	{
+		FakeReceiver bar;
+		QVERIFY(bar.listen());
+		FakeReceiver terrace;
+		QVERIFY(terrace.listen());
+		AvrDevice barDevice;
+		connectTo(barDevice, bar);
+		AvrDevice terraceDevice;
+		connectTo(terraceDevice, terrace);
+
+		DeviceGroup group;
+		group.addMember(&barDevice);
+		group.addMember(&terraceDevice, -50);
+		QSignalSpy confirmed(&group, &DeviceGroup::commandConfirmed);
+		group.setVolume(400);
+		group.setMuted(false);
+		QTRY_COMPARE(confirmed.count(), 1);
+		bar.received.clear();
+		terrace.received.clear();
+
+		// turned at the front panel of the bar receiver, its echo does not come back to it
+		bar.send("MV50\r");
+		QTRY_COMPARE(terrace.received, (QList<QByteArray>{"MV45"}));
+		QCOMPARE(group.volume(), 500);
+		QTRY_COMPARE(terraceDevice.volume().value(), 450);
+		QVERIFY(bar.received.isEmpty());
+
+		terrace.send("MUON\r");
+		QTRY_COMPARE(bar.received, (QList<QByteArray>{"MUON"}));
+
+		group.setFollow(false);
+		bar.received.clear();
+		terrace.received.clear();
+		bar.send("MV55\r");
+		QTRY_COMPARE(barDevice.volume().value(), 550);
+		QTest::qWait(50);
+		QVERIFY(terrace.received.isEmpty());
+		QCOMPARE(group.volume(), 500);
+	}
+
+	void testLostEcho()
+	{
+		FakeReceiver bar;
+		QVERIFY(bar.listen());
+		FakeReceiver terrace;
+		QVERIFY(terrace.listen());
+		AvrDevice barDevice;
+		connectTo(barDevice, bar);
+		AvrDevice terraceDevice;
+		connectTo(terraceDevice, terrace);
+		terraceDevice.refreshVolume();
+		QTRY_VERIFY(terraceDevice.volume().state() == RemoteProperty::UpToDate);
+
+		DeviceGroup group;
+		group.setEchoTimeoutMs(100);
+		group.addMember(&barDevice);
+		group.addMember(&terraceDevice, -50);
+		QSignalSpy confirmed(&group, &DeviceGroup::commandConfirmed);
+
+		// ignored, as by a receiver in standby
+		terrace.echo = false;
+		group.setVolume(400);
+		QTRY_COMPARE(terrace.received, (QList<QByteArray>{"MV35"}));
+		QTRY_COMPARE(group.abandonedCommands(), std::uint64_t{1});
+		QCOMPARE(confirmed.count(), 0);
+
+		// no longer mistaken for the echo
+		bar.received.clear();
+		terrace.send("MV20\r");
+		QTRY_COMPARE(bar.received, (QList<QByteArray>{"MV25"}));
+		QCOMPARE(group.volume(), 250);
+
+		terrace.echo = true;
+		group.setVolume(300);
+		QTRY_COMPARE(confirmed.count(), 1);
+		QCOMPARE(group.abandonedCommands(), std::uint64_t{1});
+	}
+};
+
+QTEST_GUILESS_MAIN(TestDeviceGroup)
+#include "test_devicegroup.moc"
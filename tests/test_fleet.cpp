@@ -0,0 +1,153 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSaveFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+#include "Fleet.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+class TestFleet : public QObject
+{
+	Q_OBJECT
+
+	/**
+	 * Replaces the file at path, as most editors do
+	 */
+	static void write(QString const& path, QJsonArray const& devices)
+	{
+		QSaveFile file(path);
+		QVERIFY(file.open(QIODevice::WriteOnly));
+		file.write(QJsonDocument(QJsonObject{{"devices", devices}}).toJson());
+		QVERIFY(file.commit());
+	}
+
+	static QJsonObject receiverConfig(QString const& id, FakeReceiver const& receiver)
+	{
+		return QJsonObject{{"id", id}, {"address", "127.0.0.1"}, {"port", receiver.port()}};
+	}
+
+  private slots:
+	void testParse()
+	{
+		std::vector<Fleet::DeviceConfig> configs;
+		QVERIFY(Fleet::parse(R"({"devices": [{"address": "10.0.0.1"}, {"id": "kitchen", "name": "Kitchen",
+			"address": "10.0.0.2", "port": 2323, "dialect": "denon", "sources": ["Phono", "CD"],
+			"minVolume": 100}]})",
+		                     configs));
+		QCOMPARE(configs.size(), std::size_t{2});
+		QCOMPARE(configs[0].id, QStringLiteral("10.0.0.1"));
+		QCOMPARE(configs[0].name, QStringLiteral("10.0.0.1"));
+		QCOMPARE(configs[0].port, 23);
+		QCOMPARE(configs[0].dialect, static_cast<int>(AvrDevice::Marantz));
+		QVERIFY(configs[0].sources.isEmpty());
+		QCOMPARE(configs[1].id, QStringLiteral("kitchen"));
+		QCOMPARE(configs[1].name, QStringLiteral("Kitchen"));
+		QCOMPARE(configs[1].port, 2323);
+		QCOMPARE(configs[1].dialect, static_cast<int>(AvrDevice::Denon));
+		QCOMPARE(configs[1].sources, (QStringList{"Phono", "CD"}));
+		QCOMPARE(configs[1].minVolume, 100);
+
+		QString error;
+		QVERIFY(!Fleet::parse("{", configs, &error));
+		QVERIFY(!error.isEmpty());
+		QVERIFY(!Fleet::parse(R"({"devices": [{"id": "a"}]})", configs));
+		QVERIFY(!Fleet::parse(R"({"devices": [{"address": "a"}, {"address": "a"}]})", configs));
+		QVERIFY(!Fleet::parse(R"({"devices": [{"address": "a", "dialect": "onkyo"}]})", configs));
+		QVERIFY(!Fleet::parse(R"({"devices": [{"address": "a", "port": 70000}]})", configs));
+	}
+
+	void testApply()
+	{
+		Fleet fleet;
+		fleet.setAutoConnect(false);
+		QSignalSpy added(&fleet, &Fleet::deviceAdded);
+		QSignalSpy changed(&fleet, &Fleet::deviceChanged);
+		std::vector<Fleet::DeviceConfig> configs(2);
+		configs[0].id = configs[0].name = configs[0].address = QStringLiteral("living");
+		configs[1].id = configs[1].name = configs[1].address = QStringLiteral("kitchen");
+		configs[1].sources = QStringList{"Phono", "CD"};
+		configs[1].minVolume = 100;
+		fleet.apply(configs);
+		QCOMPARE(fleet.deviceCount(), 2);
+		QCOMPARE(added.count(), 2);
+		auto* kitchen = fleet.device(QStringLiteral("kitchen"));
+		QVERIFY(kitchen != nullptr);
+		QCOMPARE(kitchen->sources(), (QStringList{"Phono", "CD"}));
+		QCOMPARE(kitchen->minVolume(), 100);
+		QCOMPARE(fleet.device(QStringLiteral("living"))->sources(), AvrDevice::defaultSources());
+
+		// the same configuration changes nothing, back to the default sources changes them in place
+		fleet.apply(configs);
+		QCOMPARE(changed.count(), 0);
+		configs[1].sources.clear();
+		fleet.apply(configs);
+		QCOMPARE(changed.count(), 1);
+		QCOMPARE(fleet.device(QStringLiteral("kitchen")), kitchen);
+		QCOMPARE(kitchen->sources(), AvrDevice::defaultSources());
+		QCOMPARE(added.count(), 2);
+	}
+
+	void testReload()
+	{
+		FakeReceiver first;
+		QVERIFY(first.listen());
+		FakeReceiver second;
+		QVERIFY(second.listen());
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		auto const path = dir.filePath(QStringLiteral("fleet.json"));
+		auto living = receiverConfig(QStringLiteral("living"), first);
+		auto kitchen = receiverConfig(QStringLiteral("kitchen"), first);
+		auto garage = receiverConfig(QStringLiteral("garage"), first);
+		write(path, QJsonArray{living, kitchen, garage});
+
+		Fleet fleet;
+		QSignalSpy loaded(&fleet, &Fleet::loaded);
+		QVERIFY(fleet.load(path));
+		QCOMPARE(fleet.deviceCount(), 3);
+		QPointer<AvrDevice> livingDevice = fleet.device(QStringLiteral("living"));
+		QPointer<AvrDevice> kitchenDevice = fleet.device(QStringLiteral("kitchen"));
+		QPointer<AvrDevice> garageDevice = fleet.device(QStringLiteral("garage"));
+		for (auto* device : {livingDevice.data(), kitchenDevice.data(), garageDevice.data()})
+			QTRY_VERIFY(device->snapshot().standby.state() == RemoteProperty::UpToDate);
+		QCOMPARE(first.received.count("PW?"), 3);
+
+		// renames living, moves kitchen to the second receiver, removes garage, adds office
+		living.insert("name", "Living room");
+		kitchen.insert("port", second.port());
+		write(path, QJsonArray{living, kitchen, receiverConfig(QStringLiteral("office"), second)});
+		QTRY_COMPARE(loaded.count(), 2);
+		QCOMPARE(loaded.last(), (QVariantList{1, 1, 2}));
+		QCOMPARE(fleet.device(QStringLiteral("living")), livingDevice.data());
+		QCOMPARE(livingDevice->name(), QStringLiteral("Living room"));
+		QCOMPARE(fleet.device(QStringLiteral("kitchen")), kitchenDevice.data());
+		QTRY_VERIFY(garageDevice.isNull());
+		QVERIFY(fleet.device(QStringLiteral("office")) != nullptr);
+		QTRY_COMPARE(second.received.count("PW?"), 2);
+		QTRY_COMPARE(kitchenDevice->connectionStatus(), static_cast<int>(AvrDevice::Connected));
+
+		// living kept its connection
+		QCOMPARE(first.received.count("PW?"), 3);
+		QCOMPARE(livingDevice->connectionStatus(), static_cast<int>(AvrDevice::Connected));
+
+		// an invalid file leaves the fleet as it is
+		QSignalSpy failed(&fleet, &Fleet::loadFailed);
+		QSaveFile file(path);
+		QVERIFY(file.open(QIODevice::WriteOnly));
+		file.write("{\"devices\": [");
+		QVERIFY(file.commit());
+		QTRY_COMPARE(failed.count(), 1);
+		QCOMPARE(fleet.deviceCount(), 3);
+		QCOMPARE(loaded.count(), 2);
+	}
+};
+
+QTEST_GUILESS_MAIN(TestFleet)
+#include "test_fleet.moc"
@@ -0,0 +1,236 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+#include "FleetServer.hpp"
+
+#include <cstring>
+
+using namespace eu::tgcm::avrremote;
+
+class TestFleetServer : public QObject
+{
+	Q_OBJECT
+
+	/**
+	 * Next message received by client, an empty object if none within 5 s
+	 */
+	static QJsonObject receive(QLocalSocket& client)
+	{
+		if (!client.canReadLine())
+			QTRY_VERIFY_WITH_TIMEOUT(client.canReadLine(), 5000);
+		if (!client.canReadLine())
+			return QJsonObject();
+		return QJsonDocument::fromJson(client.readLine()).object();
+	}
+
+	static void request(QLocalSocket& client, QJsonObject const& message)
+	{
+		client.write(QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
+	}
+
+	static void process(AvrDevice& device, char const* data)
+	{
+		device.processResponse(data, static_cast<int>(std::strlen(data)));
+	}
+
+	static QString serverName()
+	{
+		return QStringLiteral("avrcontrol-test-%1").arg(QCoreApplication::applicationPid());
+	}
+
+  private slots:
+	void testSubscribe()
+	{
+		AvrDevice living;
+		living.setName(QStringLiteral("Living room"));
+		process(living, "MV45\rMUON\rPWON\r");
+		AvrDevice kitchen;
+		FleetServer server;
+		QVERIFY(server.listen(serverName()));
+		server.addDevice(&living, QStringLiteral("living"));
+		server.addDevice(&kitchen, QStringLiteral("kitchen"));
+
+		QLocalSocket client;
+		client.connectToServer(server.fullServerName());
+		QVERIFY(client.waitForConnected(5000));
+		request(client, QJsonObject{{"op", "subscribe"}});
+		auto snapshot = receive(client);
+		QCOMPARE(snapshot.value("type").toString(), QStringLiteral("snapshot"));
+		auto devices = snapshot.value("devices").toArray();
+		QCOMPARE(devices.size(), 2);
+		auto device = devices[0].toObject().value("id") == "living" ? devices[0].toObject() : devices[1].toObject();
+		QCOMPARE(device.value("name").toString(), QStringLiteral("Living room"));
+		auto properties = device.value("properties").toObject();
+		QCOMPARE(properties.value("volume").toInt(), 450);
+		QCOMPARE(properties.value("muted").toBool(), true);
+		QCOMPARE(properties.value("standby").toBool(), false);
+		QVERIFY(!properties.contains("zone2Volume"));
+
+		// changes of an event loop iteration come as a single delta, with the changed properties only
+		process(living, "MV50\rMV55\rMUOFF\r");
+		auto delta = receive(client);
+		QCOMPARE(delta.value("type").toString(), QStringLiteral("delta"));
+		QCOMPARE(delta.value("device").toString(), QStringLiteral("living"));
+		QCOMPARE(delta.value("changes").toObject(), (QJsonObject{{"volume", 550}, {"muted", false}}));
+		QVERIFY(!client.canReadLine());
+
+		server.removeDevice(&kitchen);
+		QCOMPARE(receive(client), (QJsonObject{{"type", "removed"}, {"device", "kitchen"}}));
+
+		request(client, QJsonObject{{"op", "unsubscribe"}});
+		request(client, QJsonObject{{"op", "bogus"}});
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("error"));
+		process(living, "MV40\r");
+		QTest::qWait(50);
+		QVERIFY(!client.canReadLine());
+	}
+
+	void testOutOfDate()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		receiver.unsupported = {"PW"}; // the volume is read once the power status is known
+		AvrDevice device;
+		process(device, "MV45\r");
+		FleetServer server;
+		QVERIFY(server.listen(serverName()));
+		server.addDevice(&device, QStringLiteral("living"));
+
+		QLocalSocket client;
+		client.connectToServer(server.fullServerName());
+		QVERIFY(client.waitForConnected(5000));
+		request(client, QJsonObject{{"op", "subscribe"}});
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("snapshot"));
+
+		// the volume being read again is no longer up to date, and is sent as null
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QJsonObject changes;
+		while (!changes.contains("volume"))
+		{
+			auto delta = receive(client);
+			QCOMPARE(delta.value("type").toString(), QStringLiteral("delta"));
+			changes = delta.value("changes").toObject();
+		}
+		QVERIFY(changes.value("volume").isNull());
+	}
+
+	void testCall()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		FleetServer server;
+		QVERIFY(server.listen(serverName()));
+		server.addDevice(&device, QStringLiteral("living"));
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+
+		QLocalSocket client;
+		client.connectToServer(server.fullServerName());
+		QVERIFY(client.waitForConnected(5000));
+		request(client, QJsonObject{{"op", "call"}, {"device", "living"}, {"method", "connectToDevice"}, {"id", 1}});
+		QCOMPARE(receive(client), (QJsonObject{{"type", "reply"}, {"id", 1}, {"ok", true}}));
+		QTRY_COMPARE(device.connectionStatus(), int(AvrDevice::Connected));
+
+		request(client, QJsonObject{{"op", "call"},
+		                            {"device", "living"},
+		                            {"method", "setVolume"},
+		                            {"args", QJsonArray{405}},
+		                            {"id", "v"}});
+		QCOMPARE(receive(client).value("ok").toBool(), true);
+		request(client, QJsonObject{{"op", "call"},
+		                            {"device", "living"},
+		                            {"method", "setZoneOn"},
+		                            {"args", QJsonArray{1, true}}});
+		QCOMPARE(receive(client).value("ok").toBool(), true);
+		QTRY_VERIFY(receiver.received.contains("MV405"));
+		QTRY_VERIFY(receiver.received.contains("Z2ON"));
+
+		// wrong arguments, unknown methods and devices, methods of QObject and configuration are refused
+		for (auto const& call : {QJsonObject{{"device", "living"}, {"method", "setVolume"}, {"args", QJsonArray{"a"}}},
+		                         QJsonObject{{"device", "living"}, {"method", "setVolume"}},
+		                         QJsonObject{{"device", "living"}, {"method", "deleteLater"}},
+		                         QJsonObject{{"device", "living"}, {"method", "setPort"}, {"args", QJsonArray{24}}},
+		                         QJsonObject{{"device", "living"}, {"method", "setMaxVolume"}, {"args", QJsonArray{0}}},
+		                         QJsonObject{{"device", "living"}, {"method", "nope"}},
+		                         QJsonObject{{"device", "kitchen"}, {"method", "volumeUp"}}})
+		{
+			auto message = call;
+			message.insert("op", "call");
+			request(client, message);
+			auto reply = receive(client);
+			QCOMPARE(reply.value("type").toString(), QStringLiteral("reply"));
+			QCOMPARE(reply.value("ok").toBool(), false);
+			QVERIFY(!reply.value("error").toString().isEmpty());
+		}
+	}
+
+	void testSlowClient()
+	{
+		AvrDevice first, second;
+		FleetServer server;
+		QVERIFY(server.listen(serverName()));
+		server.addDevice(&first, QStringLiteral("first"));
+		server.addDevice(&second, QStringLiteral("second"));
+		server.setMaxQueuedBytes(1);
+
+		QLocalSocket client;
+		client.connectToServer(server.fullServerName());
+		QVERIFY(client.waitForConnected(5000));
+		request(client, QJsonObject{{"op", "subscribe"}});
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("snapshot"));
+
+		// the second delta finds the first one still queued: it is replaced by a snapshot
+		process(first, "MV45\r");
+		process(second, "MV50\r");
+		auto delta = receive(client);
+		QCOMPARE(delta.value("type").toString(), QStringLiteral("delta"));
+		auto snapshot = receive(client);
+		QCOMPARE(snapshot.value("type").toString(), QStringLiteral("snapshot"));
+		for (auto const& device : snapshot.value("devices").toArray())
+		{
+			auto volume = device.toObject().value("properties").toObject().value("volume").toInt();
+			QCOMPARE(volume, device.toObject().value("id") == "first" ? 450 : 500);
+		}
+
+		// back to deltas
+		process(first, "MV40\r");
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("delta"));
+	}
+
+	void testClientNotReading()
+	{
+		AvrDevice device;
+		FleetServer server;
+		QVERIFY(server.listen(serverName()));
+		server.addDevice(&device, QStringLiteral("living"));
+		server.setMaxQueuedBytes(1);
+
+		QLocalSocket client;
+		client.connectToServer(server.fullServerName());
+		QVERIFY(client.waitForConnected(5000));
+		QTRY_COMPARE(server.clientCount(), 1);
+
+		// the snapshot finds the reply still queued, it comes once the reply is written
+		client.write("{\"op\": \"call\", \"id\": 1, \"device\": \"living\", \"method\": \"refreshVolume\"}\n"
+		             "{\"op\": \"subscribe\"}\n");
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("reply"));
+		QCOMPARE(receive(client).value("type").toString(), QStringLiteral("snapshot"));
+
+		// the second reply cannot be queued behind the first one
+		client.write("{\"op\": \"call\", \"id\": 2, \"device\": \"living\", \"method\": \"refreshVolume\"}\n"
+		             "{\"op\": \"call\", \"id\": 3, \"device\": \"living\", \"method\": \"refreshVolume\"}\n");
+		QTRY_COMPARE(server.clientCount(), 0);
+		QTRY_COMPARE(client.state(), QLocalSocket::UnconnectedState);
+	}
+};
+
+QTEST_MAIN(TestFleetServer)
+#include "test_fleetserver.moc"
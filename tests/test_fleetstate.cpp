@@ -0,0 +1,79 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FleetStatePublisher.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace eu::tgcm::avrremote;
+
+class TestFleetState : public QObject
+{
+	Q_OBJECT
+  private slots:
+	void testPublish()
+	{
+		auto name = QStringLiteral("/avrcontrol-test-%1").arg(getpid());
+		FleetStatePublisher publisher;
+		QVERIFY(publisher.open(name, 4));
+
+		AvrDevice d;
+		d.setName(QStringLiteral("living room"));
+		QVERIFY(publisher.addDevice(&d) == 0);
+
+		fleetstate::Reader reader;
+		QVERIFY(reader.open(name.toUtf8().constData()));
+		QVERIFY(reader.slotCount() == 4u);
+		QVERIFY(reader.inUse(0));
+		QVERIFY(!reader.inUse(1));
+
+		auto version = reader.version(0);
+		char const data[] = "MV45\rSIBD\r";
+		d.processResponse(data, sizeof(data) - 1, 1234);
+		QVERIFY(reader.version(0) != version);
+
+		fleetstate::DeviceRecord record;
+		QVERIFY(reader.read(0, record));
+		QVERIFY(QString::fromUtf8(record.name) == QStringLiteral("living room"));
+		QVERIFY(record.zones[0].volume.value == 450);
+		QVERIFY(record.zones[0].volume.timestamp == 1234);
+		QVERIFY(record.zones[0].volume.state == RemoteProperty::UpToDate);
+		QVERIFY(record.zones[0].source.value == static_cast<int>(eu::tgcm::avrcommand::Source::Bluray));
+		QVERIFY(record.zones[1].volume.state == RemoteProperty::Unknown);
+
+		publisher.removeDevice(&d);
+		QVERIFY(!reader.inUse(0));
+		QVERIFY(!reader.read(0, record));
+	}
+
+	void testCrashedWriter()
+	{
+		auto const name = QStringLiteral("/avrcontrol-test-crash-%1").arg(getpid()).toUtf8();
+		fleetstate::Writer writer;
+		QVERIFY(writer.create(name.constData(), 1));
+		fleetstate::DeviceRecord record{};
+		writer.write(0, record);
+
+		// a writer dying in the middle of a write leaves the sequence of the slot odd
+		int fd = shm_open(name.constData(), O_RDWR, 0);
+		QVERIFY(fd >= 0);
+		auto const size = fleetstate::regionSize(1);
+		void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		QVERIFY(addr != MAP_FAILED);
+		auto* slot = reinterpret_cast<fleetstate::DeviceSlot*>(static_cast<char*>(addr) + sizeof(fleetstate::Header));
+		// the sequence is the first member of the seqlock
+		reinterpret_cast<std::atomic<std::uint32_t>*>(&slot->record)->fetch_add(1);
+
+		fleetstate::Reader reader;
+		QVERIFY(reader.open(name.constData()));
+		QVERIFY(reader.inUse(0));
+		QVERIFY(!reader.read(0, record));
+		munmap(addr, size);
+	}
+};
+
+QTEST_MAIN(TestFleetState)
+#include "test_fleetstate.moc"
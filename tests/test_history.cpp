@@ -0,0 +1,121 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "PropertyHistory.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace eu::tgcm::avrremote;
+
+namespace
+{
+constexpr std::int64_t ms = 1'000'000;
+
+std::vector<std::pair<std::int64_t, int>> samples(PropertyHistory::Range const& range)
+{
+	std::vector<std::pair<std::int64_t, int>> ret;
+	for (auto const& sample : range)
+		ret.emplace_back(sample.timestamp, sample.value);
+	return ret;
+}
+} // namespace
+
+class TestHistory : public QObject
+{
+	Q_OBJECT
+
+	using Samples = std::vector<std::pair<std::int64_t, int>>;
+
+  private slots:
+	void testRecord()
+	{
+		PropertyHistory disabled;
+		disabled.record(10 * ms, 1);
+		QVERIFY(disabled.samples(0, 100 * ms).empty());
+
+		PropertyHistory history(256);
+		QCOMPARE(history.capacity(), std::size_t{256});
+		history.record(10 * ms + 5, 300);
+		history.record(11 * ms, 300); // same value
+		history.record(12 * ms, 305);
+		history.record(20 * ms, -7);
+		QCOMPARE(samples(history.samples(0, 100 * ms)), (Samples{{10 * ms, 300}, {12 * ms, 305}, {20 * ms, -7}}));
+		QCOMPARE(samples(history.samples(11 * ms, 19 * ms)), (Samples{{12 * ms, 305}}));
+		QVERIFY(history.samples(21 * ms, 30 * ms).empty());
+		QVERIFY(history.samples(0, 9 * ms).empty());
+
+		// older than the previous change
+		history.record(15 * ms, 8);
+		QCOMPARE(samples(history.samples(20 * ms, 20 * ms)), (Samples{{20 * ms, -7}, {20 * ms, 8}}));
+
+		history.clear();
+		QVERIFY(history.samples(0, 100 * ms).empty());
+	}
+
+	void testWrap()
+	{
+		PropertyHistory history(512);
+		Samples recorded;
+		std::int64_t timestamp = 0;
+		for (int i = 1; i <= 10000; ++i)
+		{
+			// some large steps and delays, up to a new block per change
+			timestamp += (i % 100 == 0 ? 100'000 : i % 7) * ms;
+			int value = i % 50 == 0 ? -i * 1000 : i;
+			history.record(timestamp, value);
+			recorded.emplace_back(timestamp, value);
+		}
+		auto kept = samples(history.samples(0, timestamp));
+		QVERIFY(kept.size() > 50);
+		QVERIFY(kept.size() < recorded.size());
+		QVERIFY(std::equal(kept.begin(), kept.end(), recorded.end() - static_cast<std::ptrdiff_t>(kept.size())));
+
+		// every range of the changes kept
+		for (std::size_t first = 0; first < kept.size(); first += 7)
+		{
+			for (std::size_t last = first; last < kept.size(); last += 13)
+			{
+				Samples expected;
+				for (auto const& s : kept)
+				{
+					if (s.first >= kept[first].first && s.first <= kept[last].first)
+						expected.push_back(s);
+				}
+				QCOMPARE(samples(history.samples(kept[first].first, kept[last].first)), expected);
+			}
+		}
+	}
+
+	void testDevice()
+	{
+		AvrDevice device;
+		QCOMPARE(device.historyCapacity(), 0);
+		char const volume[] = "MV45\r";
+		device.processResponse(volume, sizeof(volume) - 1, 1000 * ms);
+		QVERIFY(device.history(DeviceProperty::Volume, 0, 10000 * ms).empty());
+
+		device.setHistoryCapacity(1024);
+		QCOMPARE(device.historyCapacity(), 1024);
+		char const data[] = "MV45\rSIBD\rZ230\r";
+		device.processResponse(data, sizeof(data) - 1, 2000 * ms);
+		char const echo[] = "MV455\rMV455\rPWSTANDBY\r";
+		device.processResponse(echo, sizeof(echo) - 1, 3000 * ms);
+
+		QCOMPARE(samples(device.history(DeviceProperty::Volume, 0, 10000 * ms)),
+		         (Samples{{2000 * ms, 450}, {3000 * ms, 455}}));
+		QCOMPARE(samples(device.history(DeviceProperty::Volume, 2500 * ms, 10000 * ms)), (Samples{{3000 * ms, 455}}));
+		QCOMPARE(samples(device.history(DeviceProperty::Source, 0, 10000 * ms)),
+		         (Samples{{2000 * ms, static_cast<int>(eu::tgcm::avrcommand::Source::Bluray)}}));
+		QCOMPARE(samples(device.history(DeviceProperty::Zone2Volume, 0, 10000 * ms)), (Samples{{2000 * ms, 300}}));
+		QCOMPARE(samples(device.history(DeviceProperty::Standby, 0, 10000 * ms)), (Samples{{3000 * ms, 1}}));
+		QVERIFY(device.history(DeviceProperty::Muted, 0, 10000 * ms).empty());
+		QVERIFY(device.history(DeviceProperty::Count, 0, 10000 * ms).empty());
+
+		device.setHistoryCapacity(0);
+		QVERIFY(device.history(DeviceProperty::Volume, 0, 10000 * ms).empty());
+	}
+};
+
+QTEST_MAIN(TestHistory)
+#include "test_history.moc"
@@ -0,0 +1,109 @@
+#include <QTcpSocket>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "Metrics.hpp"
+#include "MetricsExporter.hpp"
+#include "marantzuart.hpp"
+
+#include <array>
+
+using namespace eu::tgcm::avrremote;
+
+class TestMetrics : public QObject
+{
+	Q_OBJECT
+  private slots:
+	void testHistogramBuckets()
+	{
+		using metrics::Histogram;
+		for (std::int64_t v : {std::int64_t{0}, std::int64_t{7}, std::int64_t{8}, std::int64_t{1000},
+		                       std::int64_t{123456789}})
+		{
+			auto i = Histogram::bucketIndex(v);
+			QVERIFY(i < Histogram::bucketCount);
+			QVERIFY(Histogram::bucketUpperBound(i) > v);
+			if (i > 0)
+				QVERIFY(Histogram::bucketUpperBound(i - 1) <= v);
+		}
+	}
+
+	void testHistogramQuantile()
+	{
+		metrics::Histogram h;
+		QVERIFY(h.quantile(0.5) == 0);
+		for (int i = 1; i <= 100; ++i)
+			h.record(i * 1000000);
+		QVERIFY(h.count() == 100u);
+		auto p50 = h.quantile(0.5);
+		// relative error is below 1/8
+		QVERIFY(p50 >= 50000000 && p50 <= 50000000 * 9 / 8 + 1000000);
+	}
+
+	void testDeviceMetrics()
+	{
+		metrics::MetricsRegistry registry;
+		auto m = registry.deviceMetrics("living");
+		QVERIFY(registry.deviceMetrics("living") == m);
+
+		AvrDevice d;
+		d.setMetrics(m);
+		char const data[] = "MV45\rXX12\rPWON\rSIFOO\r";
+		d.processResponse(data, sizeof(data) - 1);
+		QVERIFY(m->bytesIn.value() == sizeof(data) - 1);
+		QVERIFY(m->framesParsed.value() == 2u);
+		QVERIFY(m->framesDropped.value() == 2u);
+
+		auto text = registry.renderPrometheus();
+		QVERIFY(text.find("avrcontrol_frames_dropped_total{device=\"living\"} 2\n") != std::string::npos);
+		QVERIFY(text.find("# TYPE avrcontrol_round_trip_seconds histogram") != std::string::npos);
+	}
+
+	void testCommandTypes()
+	{
+		using metrics::CommandType;
+		using metrics::commandTypeOf;
+		namespace cmd = eu::tgcm::avrcommand;
+		// the labels AvrDevice gives the commands it sends
+		std::array<char, 6> data{};
+		QVERIFY(commandTypeOf(cmd::muteCommand(cmd::Zone<0>{}, true)) == CommandType::Mute);
+		QVERIFY(commandTypeOf(cmd::muteCommand(cmd::Zone<1>{}, true)) == CommandType::Mute);
+		QVERIFY(commandTypeOf(cmd::muteCommand(cmd::Zone<2>{}, false)) == CommandType::Mute);
+		QVERIFY(commandTypeOf(cmd::setVolume(cmd::Zone<0>{}, 355, data)) == CommandType::Volume);
+		QVERIFY(commandTypeOf(cmd::setVolume(cmd::Zone<1>{}, 355, data)) == CommandType::Volume);
+		QVERIFY(commandTypeOf(cmd::ZoneCommands<1>::volumeUp) == CommandType::Volume);
+		QVERIFY(commandTypeOf(cmd::ZoneCommands<2>::volumeDown) == CommandType::Volume);
+		QVERIFY(commandTypeOf(cmd::zoneOnCommand(cmd::Zone<0>{}, true)) == CommandType::Zone);
+		QVERIFY(commandTypeOf(cmd::zoneOnCommand(cmd::Zone<1>{}, false)) == CommandType::Zone);
+		QVERIFY(commandTypeOf("Z2CD\n") == CommandType::Source);
+		QVERIFY(commandTypeOf("SICD\n") == CommandType::Source);
+		QVERIFY(commandTypeOf(cmd::powerOnCommand) == CommandType::Power);
+		QVERIFY(commandTypeOf(cmd::ZoneCommands<1>::queryMute) == CommandType::Query);
+	}
+
+	void testLongLabel()
+	{
+		metrics::MetricsRegistry registry;
+		std::string const name(700, 'x');
+		registry.deviceMetrics(name)->bytesIn.add(3);
+		auto text = registry.renderPrometheus();
+		QVERIFY(text.find("avrcontrol_bytes_received_total{device=\"" + name + "\"} 3\n") != std::string::npos);
+	}
+
+	void testExporterRequestLimit()
+	{
+		metrics::MetricsRegistry registry;
+		MetricsExporter exporter(registry);
+		QVERIFY(exporter.listen(0));
+		QTcpSocket client;
+		client.connectToHost(QHostAddress::LocalHost, exporter.serverPort());
+		QVERIFY(client.waitForConnected(1000));
+		// request headers that never end
+		client.write(QByteArray(16384, 'x'));
+		QTRY_COMPARE(client.state(), QAbstractSocket::UnconnectedState);
+		QVERIFY(!client.readAll().startsWith("HTTP"));
+	}
+};
+
+QTEST_MAIN(TestMetrics)
+#include "test_metrics.moc"
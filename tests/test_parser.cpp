@@ -1,24 +1,23 @@
 #include <QTest>
 
 #include "marantzuart.hpp"
+#include "marantzuartbatch.hpp"
 
 using namespace eu::tgcm::avrcommand;
 
 class ParserCallbacks
 {
   public:
-	int masterVolume = -1;
+	MarantzUartParser<ParserCallbacks>* parser = nullptr;
+	std::int64_t lastTimestamp = 0;
+
 	int maxVolume = -1;
 	bool powerStatus = false;
-	Source source;
-	bool muted = false;
-	bool zmon = false;
-	bool z2on = false;
-
-	void masterVolumeChanged(int newMasterVolume)
-	{
-		masterVolume = newMasterVolume;
-	}
+	/** indexed by zone */
+	std::array<int, zoneCount> volume{-1, -1, -1};
+	std::array<Source, zoneCount> source{};
+	std::array<bool, zoneCount> muted{};
+	std::array<bool, zoneCount> zoneOn{};
 
 	void maxVolumeChanged(int newMaxVolume)
 	{
@@ -27,27 +26,69 @@ class ParserCallbacks
 
 	void powerChanged(bool newPower)
 	{
+		if (parser != nullptr)
+			lastTimestamp = parser->timestamp();
 		powerStatus = newPower;
 	}
 
-	void sourceChanged(Source newSource)
+	template <std::size_t N>
+	void volumeChanged(Zone<N>, int newVolume)
 	{
-		source = newSource;
+		volume[N] = newVolume;
 	}
 
-	void mutedChanged(bool newMuted)
+	template <std::size_t N>
+	void sourceChanged(Zone<N>, Source newSource)
+	{
+		source[N] = newSource;
+	}
+
+	template <std::size_t N>
+	void mutedChanged(Zone<N>, bool newMuted)
+	{
+		muted[N] = newMuted;
+	}
+
+	template <std::size_t N>
+	void zoneOnChanged(Zone<N>, bool on)
+	{
+		zoneOn[N] = on;
+	}
+};
+
+/**
+ * Only interested in the power: the other replies are skipped
+ */
+struct PowerCallbacks
+{
+	int powerChanges = 0;
+	bool powerStatus = false;
+
+	void powerChanged(bool newPower)
 	{
-		muted = newMuted;
+		powerChanges += 1;
+		powerStatus = newPower;
 	}
+};
+
+/**
+ * Callbacks of a batch parser, tagged with the stream
+ */
+struct StreamCallbacks
+{
+	std::vector<int> zone2Volume;
+	std::vector<bool> powerStatus;
 
-	void mainZoneOnChanged(bool on)
+	void powerChanged(std::uint32_t stream, bool newPower)
 	{
-		zmon = on;
+		powerStatus[stream] = newPower;
 	}
 
-	void zone2OnChanged(bool on)
+	template <std::size_t N>
+	void volumeChanged(std::uint32_t stream, Zone<N>, int newVolume)
 	{
-		z2on = on;
+		if (N == 1)
+			zone2Volume[stream] = newVolume;
 	}
 };
 
@@ -72,7 +113,7 @@ class TestParser : public QObject
 			cur = cur.substr(res);
 		} while (res > 0);
 
-		QVERIFY(c.masterVolume == 300);
+		QVERIFY(c.volume[0] == 300);
 		QVERIFY(c.maxVolume == 655);
 		QVERIFY(total == strlen(line));
 	}
@@ -92,11 +133,59 @@ class TestParser : public QObject
 		cur = cur.substr(res);
 		res = p.parse(cur);
 		total += res;
-		QVERIFY(c.masterVolume == 300);
+		QVERIFY(c.volume[0] == 300);
 		QVERIFY(c.maxVolume == 650);
 		QVERIFY(total == strlen(line));
 	}
 
+	void testLowVolume()
+	{
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks> p(c);
+
+		// the number of digits tells whole dB from tenths, leading zeros included
+		QVERIFY(p.parse("MV095\r") == 6);
+		QVERIFY(c.volume[0] == 95);
+		QVERIFY(p.parse("MV05\r") == 5);
+		QVERIFY(c.volume[0] == 50);
+		QVERIFY(p.parse("MV00\r") == 5);
+		QVERIFY(c.volume[0] == 0);
+		QVERIFY(p.parse("Z2005\r") == 6);
+		QVERIFY(c.volume[1] == 5);
+		// split in the middle of the digits
+		QVERIFY(p.parse("MV0") == 3);
+		QVERIFY(p.parse("55\r") == 3);
+		QVERIFY(c.volume[0] == 55);
+		QVERIFY(p.parse("MVMAX 095\r") == 10);
+		QVERIFY(c.maxVolume == 95);
+		QVERIFY(p.droppedFrames() == 0u);
+
+		// too many digits: not a volume
+		QVERIFY(p.parse("MV0550\r") == 7);
+		QVERIFY(c.volume[0] == 55);
+		QVERIFY(p.droppedFrames() == 1u);
+		QVERIFY(p.malformedFrames() == 0u);
+	}
+
+	void testMalformed()
+	{
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks> p(c);
+		// replies this parser does not decode
+		for (auto line : {"MSSTEREO\r", "PSFRONT A\r", "SVOFF\r", "CVFL 50\r", "NSE1Artist\r", "Z2CVFL 50\r"})
+			QVERIFY(p.parse(line) == strlen(line));
+		QVERIFY(p.droppedFrames() == 6u);
+		QVERIFY(p.malformedFrames() == 0u);
+		// the end of a reply whose beginning was lost, noise, split over two chunks
+		QVERIFY(p.parse("55\r") == 3);
+		QVERIFY(p.parse("\x01\xff") == 2);
+		QVERIFY(p.parse("\r") == 1);
+		QVERIFY(p.droppedFrames() == 8u);
+		QVERIFY(p.malformedFrames() == 2u);
+		QVERIFY(p.parse("PWON\r") == 5);
+		QVERIFY(c.powerStatus);
+	}
+
 	void testPower()
 	{
 		ParserCallbacks c;
@@ -148,7 +237,7 @@ class TestParser : public QObject
 		char const* line = "SISAT/CBL\r";
 		ParserCallbacks c;
 		MarantzUartParser<ParserCallbacks> p(c);
-		c.source = Source::Aux1;
+		c.source[0] = Source::Aux1;
 		testSourceHelper_(c, p, line, Source::Cable_Sat);
 		testSourceHelper_(c, p, "SIPHONO\r", Source::Phono);
 		testSourceHelper_(c, p, "SICD\r", Source::CD);
@@ -178,11 +267,11 @@ class TestParser : public QObject
 		MarantzUartParser<ParserCallbacks> p(c);
 		auto res = p.parse(line);
 		QVERIFY(res == strlen(line));
-		QVERIFY(c.muted);
+		QVERIFY(c.muted[0]);
 		char const* line2 = "MUOFF\r";
 		res = p.parse(line2);
 		QVERIFY(res == strlen(line2));
-		QVERIFY(!c.muted);
+		QVERIFY(!c.muted[0]);
 	}
 
 	void testZM()
@@ -192,26 +281,161 @@ class TestParser : public QObject
 		MarantzUartParser<ParserCallbacks> p(c);
 		auto res = p.parse(line);
 		QVERIFY(res == strlen(line));
-		QVERIFY(c.zmon);
-		c.zmon = false;
-		QVERIFY(!c.zmon);
+		QVERIFY(c.zoneOn[0]);
+		c.zoneOn[0] = false;
+		QVERIFY(!c.zoneOn[0]);
 		for (int i = 0; i < strlen(line); ++i)
 		{
 			auto l = std::string_view(line + i, 1);
 			p.parse(l);
 		}
-		QVERIFY(c.zmon);
+		QVERIFY(c.zoneOn[0]);
 		char const* line2 = "ZMOFF\r";
 		res = p.parse(line2);
 		QVERIFY(res == strlen(line2));
-		QVERIFY(!c.zmon);
-		c.zmon = true;
+		QVERIFY(!c.zoneOn[0]);
+		c.zoneOn[0] = true;
 		for (int i = 0; i < strlen(line2); ++i)
 		{
 			auto l = std::string_view(line2 + i, 1);
 			p.parse(l);
 		}
-		QVERIFY(!c.zmon);
+		QVERIFY(!c.zoneOn[0]);
+	}
+
+	void testZones()
+	{
+		std::string_view const lines = "Z2ON\rZ255\rZ2MUON\rZ2TUNER\rZ3ON\rZ3455\rZ3MUOFF\rZ3MPLAY\rZ2OFF\r";
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks> p(c);
+		QVERIFY(p.parse(lines.substr(0, 5)) == 5u);
+		QVERIFY(c.zoneOn[1]);
+		// split at every byte, so that each state of the zone parsers is resumed
+		for (auto ch : lines.substr(5))
+			p.parse(std::string_view(&ch, 1));
+		QVERIFY(!c.zoneOn[1]);
+		QVERIFY(c.volume[1] == 550);
+		QVERIFY(c.muted[1]);
+		QVERIFY(c.source[1] == Source::Tuner);
+		QVERIFY(c.zoneOn[2]);
+		QVERIFY(c.volume[2] == 455);
+		QVERIFY(!c.muted[2]);
+		QVERIFY(c.source[2] == Source::Multimedia);
+		// the main zone is left untouched
+		QVERIFY(c.volume[0] == -1);
+		QVERIFY(!c.zoneOn[0]);
+		QVERIFY(p.droppedFrames() == 0u);
+	}
+
+	void testUnknownZone()
+	{
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks> p(c);
+		std::string_view const line = "Z4ON\rZ2SOURCE\rZ3ON\r";
+		std::size_t total = 0;
+		std::size_t res;
+		while ((res = p.parse(line.substr(total))) > 0)
+			total += res;
+		QVERIFY(total == line.size());
+		QVERIFY(p.droppedFrames() == 2u);
+		QVERIFY(c.zoneOn[2]);
+	}
+
+	void testDialects()
+	{
+		// spellings of older models
+		std::string_view const lines = "SISAT\rZ2USB/IPOD\rZ3M-XPORT\rSINET/USB\r";
+		ParserCallbacks marantz;
+		MarantzUartParser<ParserCallbacks, MarantzDialect> pm(marantz);
+		ParserCallbacks denon;
+		MarantzUartParser<ParserCallbacks, DenonDialect> pd(denon);
+		for (auto ch : lines)
+		{
+			pm.parse(std::string_view(&ch, 1));
+			pd.parse(std::string_view(&ch, 1));
+		}
+		QVERIFY(pm.droppedFrames() == 3u);
+		QVERIFY(marantz.source[2] == Source::Bluetooth);
+		QVERIFY(pd.droppedFrames() == 1u);
+		QVERIFY(denon.source[0] == Source::Network);
+		QVERIFY(denon.source[1] == Source::Multimedia);
+	}
+
+	void testSubscription()
+	{
+		static_assert(handledEvents<PowerCallbacks>() == eventMask(ParserEvent::Power));
+		static_assert(handledEvents<ParserCallbacks>() == allEvents);
+		std::string_view const lines = "MV30\rMVMAX 655\rSITUNER\rZ2ON\rZ3MUON\rPWON\rAB45\rPWSTANDBY\r";
+		PowerCallbacks power;
+		MarantzUartParser<PowerCallbacks> pp(power);
+		// explicit mask, narrower than the callbacks
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks, MarantzDialect, eventMask(ParserEvent::Volume, 1)> pc(c);
+		for (auto ch : lines)
+		{
+			pp.parse(std::string_view(&ch, 1));
+			pc.parse(std::string_view(&ch, 1));
+		}
+		QVERIFY(power.powerChanges == 2);
+		QVERIFY(!power.powerStatus);
+		// skipped replies are not dropped frames, unknown ones still are
+		QVERIFY(pp.droppedFrames() == 1u);
+		QVERIFY(pc.droppedFrames() == 1u);
+		QVERIFY(c.volume[0] == -1);
+		QVERIFY(c.maxVolume == -1);
+		QVERIFY(!c.zoneOn[1]);
+		pc.parse("Z2455\r");
+		QVERIFY(c.volume[1] == 455);
+	}
+
+	void testBatch()
+	{
+		StreamCallbacks c;
+		c.zone2Volume.assign(3, -1);
+		c.powerStatus.assign(3, false);
+		MarantzUartBatchParser<StreamCallbacks> p(c);
+		for (int i = 0; i < 3; ++i)
+			QVERIFY(p.addStream() == static_cast<std::uint32_t>(i));
+		// replies split across chunks, interleaved with the other streams
+		std::vector<MarantzUartBatchParser<StreamCallbacks>::Chunk> chunks{
+		    {0, "PWO"}, {1, "Z24"}, {2, "AB\rPWSTAN"}, {0, "N\rZ2"}, {1, "55\rSITV\r"}, {2, "DBY\r"}, {0, "30\r"}};
+		p.parse(chunks);
+		QVERIFY(c.powerStatus[0]);
+		QVERIFY(c.zone2Volume[0] == 300);
+		QVERIFY(c.zone2Volume[1] == 455);
+		QVERIFY(!c.powerStatus[2]);
+		QVERIFY(p.droppedFrames(0) == 0u);
+		QVERIFY(p.droppedFrames(2) == 1u);
+		// a reset stream forgets its partial reply
+		MarantzUartBatchParser<StreamCallbacks>::Chunk chunk{1, "Z2"};
+		p.parse(&chunk, 1);
+		p.resetStream(1);
+		chunk.data = "50\r";
+		p.parse(&chunk, 1);
+		QVERIFY(c.zone2Volume[1] == 455);
+		QVERIFY(p.droppedFrames(1) == 1u);
+		// the counts survive parking the stream
+		chunk = {0, "PWON\r"};
+		p.parse(&chunk, 1);
+		QVERIFY(p.droppedFrames(1) == 1u);
+		QVERIFY(p.droppedFrames(0) == 0u);
+	}
+
+	void testTimestamp()
+	{
+		ParserCallbacks c;
+		MarantzUartParser<ParserCallbacks> p(c);
+		c.parser = &p;
+		auto res = p.parse("PWSTAND", 10);
+		QVERIFY(res == 7);
+		QVERIFY(c.lastTimestamp == 0); // not complete yet
+		res = p.parse("BY\r", 20);
+		QVERIFY(res == 3);
+		QVERIFY(!c.powerStatus);
+		QVERIFY(c.lastTimestamp == 20); // stamped by the chunk completing the reply
+		res = p.parse("PWON\r", 30);
+		QVERIFY(c.powerStatus);
+		QVERIFY(c.lastTimestamp == 30);
 	}
 
   private:
@@ -222,7 +446,7 @@ class TestParser : public QObject
 	{
 		auto res = p.parse(line);
 		QVERIFY(res == strlen(line));
-		QVERIFY(c.source == expectedResult);
+		QVERIFY(c.source[0] == expectedResult);
 	}
 };
 
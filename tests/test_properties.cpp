@@ -0,0 +1,80 @@
+#include <QMetaProperty>
+#include <QTest>
+
+#include "RemoteProperty.hpp"
+
+using namespace eu::tgcm::avrremote;
+using eu::tgcm::avrcommand::Source;
+
+class TestProperties : public QObject
+{
+	Q_OBJECT
+  private slots:
+	void testDefault()
+	{
+		BasicRemoteProperty<int> p;
+		QVERIFY(p.state() == RemoteProperty::Unknown);
+		QVERIFY(p.value() == 0);
+		QVERIFY(p.version() == 0u);
+	}
+
+	void testVersion()
+	{
+		BasicRemoteProperty<int> p;
+		p.setValue(300);
+		QVERIFY(p.version() == 1u);
+		p.setState(RemoteProperty::UpToDate);
+		QVERIFY(p.version() == 2u);
+		p.setValue(300); // same value, no change
+		p.setState(RemoteProperty::UpToDate);
+		QVERIFY(p.version() == 2u);
+		p.setValue(305);
+		QVERIFY(p.version() == 3u);
+		QVERIFY(p.value() == 305);
+	}
+
+	void testTimestamp()
+	{
+		BasicRemoteProperty<int> p;
+		QVERIFY(p.timestamp() == 0);
+		QVERIFY(p.sequence() == 0u);
+		auto now = monotonicTimestamp();
+		p.setTimestamp(now, 12);
+		p.setValue(300);
+		QVERIFY(p.timestamp() == now);
+		QVERIFY(p.sequence() == 12u);
+		QVERIFY(monotonicTimestamp() >= now);
+		RemoteIntProperty g(p);
+		QVERIFY(g.timestamp() == now);
+		QVERIFY(g.sequence() == 12u);
+	}
+
+	void testGadgets()
+	{
+		BasicRemoteProperty<Source> s(RemoteProperty::UpToDate, Source::Bluray);
+		RemoteSourceProperty g(s);
+		QVERIFY(g.value() == QStringLiteral("Bluray"));
+		QVERIFY(g.index() == static_cast<int>(Source::Bluray));
+		QVERIFY(g.state() == RemoteProperty::UpToDate);
+		QVERIFY(g.source() == Source::Bluray);
+		RemoteIntProperty i(RemoteProperty::Reading, 300);
+		QVERIFY(i.value() == 300);
+		QVERIFY(i.state() == RemoteProperty::Reading);
+		RemoteBoolProperty b(RemoteProperty::Reading, true);
+		QVERIFY(b.value());
+		QVERIFY(b.state() == RemoteProperty::Reading);
+
+		// as seen from QML: the value of a source is still its name
+		auto const& meta = RemoteSourceProperty::staticMetaObject;
+		auto const value = meta.property(meta.indexOfProperty("value")).readOnGadget(&g);
+		QCOMPARE(value.type(), QVariant::String);
+		QCOMPARE(value.toString(), QStringLiteral("Bluray"));
+		QCOMPARE(meta.property(meta.indexOfProperty("index")).readOnGadget(&g).toInt(),
+		         static_cast<int>(Source::Bluray));
+		auto const& boolMeta = RemoteBoolProperty::staticMetaObject;
+		QCOMPARE(boolMeta.property(boolMeta.indexOfProperty("value")).readOnGadget(&b), QVariant(true));
+	}
+};
+
+QTEST_MAIN(TestProperties)
+#include "test_properties.moc"
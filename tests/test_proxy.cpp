@@ -0,0 +1,139 @@
+#include <QTcpSocket>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "DeviceProxy.hpp"
+#include "FakeReceiver.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+class TestProxy : public QObject
+{
+	Q_OBJECT
+
+	/**
+	 * Connects a client to the proxy, and collects what it receives
+	 */
+	struct Client
+	{
+		QTcpSocket socket;
+		QByteArray received;
+
+		bool connectTo(quint16 port)
+		{
+			QObject::connect(&socket, &QTcpSocket::readyRead, [this] { received += socket.readAll(); });
+			socket.connectToHost(QHostAddress::LocalHost, port);
+			return socket.waitForConnected(5000);
+		}
+	};
+
+	FakeReceiver* receiver_ = nullptr;
+	AvrDevice* device_ = nullptr;
+	DeviceProxy* proxy_ = nullptr;
+
+  private slots:
+	void init()
+	{
+		receiver_ = new FakeReceiver();
+		QVERIFY(receiver_->listen());
+		device_ = new AvrDevice();
+		proxy_ = new DeviceProxy(device_);
+		QVERIFY(proxy_->listen(0));
+		device_->setAddress(QStringLiteral("127.0.0.1"));
+		device_->setPort(receiver_->port());
+		device_->connectToDevice();
+		// the proxy queries the whole state once connected
+		QTRY_VERIFY(device_->snapshot().zones[1].on.state() == RemoteProperty::UpToDate);
+		QTRY_VERIFY(device_->snapshot().standby.state() == RemoteProperty::UpToDate);
+		receiver_->received.clear();
+	}
+
+	void cleanup()
+	{
+		delete proxy_;
+		delete device_;
+		delete receiver_;
+	}
+
+	void testQueriesFromCache()
+	{
+		Client client;
+		QVERIFY(client.connectTo(proxy_->serverPort()));
+		client.socket.write("MV?\rSI?\rPW?\rMU?\r");
+		QTRY_COMPARE(client.received, QByteArray("MV30\rSICD\rPWON\rMUOFF\r"));
+		QVERIFY(receiver_->received.isEmpty());
+		QCOMPARE(proxy_->commandsAnswered(), std::uint64_t(4));
+	}
+
+	void testDedupe()
+	{
+		Client c1, c2;
+		QVERIFY(c1.connectTo(proxy_->serverPort()));
+		QVERIFY(c2.connectTo(proxy_->serverPort()));
+		QTRY_COMPARE(proxy_->clientCount(), 2);
+		c1.socket.write("MV45\r");
+		c2.socket.write("MV45\r");
+		// every client sees the echo, the device gets the command once. c2 may get it twice, if its command
+		// arrives after the echo
+		QTRY_COMPARE(c1.received, QByteArray("MV45\r"));
+		QTRY_VERIFY(c2.received.startsWith("MV45\r"));
+		QCOMPARE(receiver_->received, QList<QByteArray>{"MV45"});
+
+		// the device already is at this volume
+		c1.socket.write("MV45\r");
+		QTRY_COMPARE(c1.received, QByteArray("MV45\rMV45\r"));
+		QCOMPARE(receiver_->received, QList<QByteArray>{"MV45"});
+	}
+
+	void testMerged()
+	{
+		Client client;
+		QVERIFY(client.connectTo(proxy_->serverPort()));
+		client.socket.write("SIBD\rMUON\rPSBAS UP\r");
+		QTRY_COMPARE(receiver_->received.size(), 3);
+		QCOMPARE(receiver_->received, (QList<QByteArray>{"SIBD", "MUON", "PSBAS UP"}));
+		QTRY_COMPARE(client.received, QByteArray("SIBD\rMUON\r"));
+		QCOMPARE(proxy_->commandsForwarded(), std::uint64_t(3));
+	}
+
+	void testLongLineDropped()
+	{
+		Client client;
+		QVERIFY(client.connectTo(proxy_->serverPort()));
+		// nothing of the long line is forwarded, not even its beginning, until its terminator
+		client.socket.write(QByteArray("PSBAS UP") + QByteArray(200, 'X'));
+		client.socket.write(QByteArray(200, 'Y') + "\rMUON\r");
+		QTRY_COMPARE(receiver_->received, QList<QByteArray>{"MUON"});
+		QCOMPARE(proxy_->commandsForwarded(), std::uint64_t(1));
+	}
+
+	void testZones()
+	{
+		Client client;
+		QVERIFY(client.connectTo(proxy_->serverPort()));
+		client.socket.write("Z2?\rZ3MU?\r");
+		QTRY_COMPARE(client.received, QByteArray("Z2OFF\rZ2TUNER\rZ220\rZ3MUOFF\r"));
+		QVERIFY(receiver_->received.isEmpty());
+
+		client.received.clear();
+		client.socket.write("Z3455\rZ2MUON\r");
+		QTRY_COMPARE(client.received, QByteArray("Z3455\rZ2MUON\r"));
+		QCOMPARE(receiver_->received, (QList<QByteArray>{"Z3455", "Z2MUON"}));
+		QCOMPARE(device_->zoneVolume(2).value(), 455);
+		QVERIFY(device_->zoneMuted(1));
+		QVERIFY(!device_->muted());
+	}
+
+	void testChangesBroadcast()
+	{
+		Client client;
+		QVERIFY(client.connectTo(proxy_->serverPort()));
+		QTRY_COMPARE(proxy_->clientCount(), 1);
+		// change made on the receiver itself
+		receiver_->send("PWSTANDBY\r");
+		QTRY_COMPARE(client.received, QByteArray("PWSTANDBY\r"));
+	}
+};
+
+QTEST_MAIN(TestProxy)
+#include "test_proxy.moc"
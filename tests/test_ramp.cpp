@@ -0,0 +1,145 @@
+#include <QSignalSpy>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+
+#include <cstdlib>
+
+using namespace eu::tgcm::avrremote;
+
+class TestRamp : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+		device.refreshVolume();
+		QTRY_VERIFY(device.volume().state() == RemoteProperty::UpToDate);
+		receiver.received.clear();
+	}
+
+  private slots:
+	void testRamp_data()
+	{
+		QTest::addColumn<int>("curve");
+		QTest::addColumn<int>("target");
+		QTest::newRow("linear") << int(AvrDevice::Linear) << 400;
+		QTest::newRow("easeIn") << int(AvrDevice::EaseIn) << 400;
+		QTest::newRow("easeOut") << int(AvrDevice::EaseOut) << 400;
+		QTest::newRow("easeInOut") << int(AvrDevice::EaseInOut) << 400;
+		// down to silence, through the three digit volumes below 10 dB
+		QTest::newRow("fadeOut") << int(AvrDevice::Linear) << 0;
+	}
+
+	void testRamp()
+	{
+		QFETCH(int, curve);
+		QFETCH(int, target);
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		QCOMPARE(device.volume().value(), 300);
+
+		QSignalSpy finished(&device, &AvrDevice::volumeRampFinished);
+		device.rampVolume(target, 300, curve);
+		QVERIFY(device.rampingVolume());
+		QTRY_COMPARE(finished.count(), 1);
+		QVERIFY(finished[0][0].toBool());
+		QVERIFY(!device.rampingVolume());
+		QCOMPARE(device.volume().value(), target);
+
+		// half dB steps toward the target, at most one per half dB
+		int const direction = target > 300 ? 1 : -1;
+		QVERIFY(!receiver.received.isEmpty());
+		QVERIFY(receiver.received.size() <= std::abs(target - 300) / 5);
+		QCOMPARE(receiver.received.last(), target == 0 ? QByteArray("MV00") : QByteArray("MV40"));
+		int previous = 300;
+		for (auto const& command : receiver.received)
+		{
+			int v = command.mid(2).toInt();
+			if (command.size() == 4)
+				v *= 10;
+			QVERIFY((v - previous) * direction > 0);
+			QCOMPARE(v % 5, 0);
+			previous = v;
+		}
+	}
+
+	void testUnalignedTarget()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		// MV40 is all that can be sent for 407, and its echo must complete the ramp
+		QSignalSpy finished(&device, &AvrDevice::volumeRampFinished);
+		device.rampVolume(407, 300);
+		QTRY_COMPARE(finished.count(), 1);
+		QVERIFY(finished[0][0].toBool());
+		QCOMPARE(device.volume().value(), 400);
+		QCOMPARE(receiver.received.last(), QByteArray("MV40"));
+	}
+
+	void testUnknownVolume()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+		QCOMPARE(device.volume().state(), RemoteProperty::Unknown);
+		receiver.received.clear();
+
+		QSignalSpy finished(&device, &AvrDevice::volumeRampFinished);
+		device.rampVolume(400, 300);
+		QCOMPARE(finished.count(), 1);
+		QVERIFY(!finished[0][0].toBool());
+		QVERIFY(!device.rampingVolume());
+		QTest::qWait(50);
+		QVERIFY(receiver.received.isEmpty());
+	}
+
+	void testUserIntervention()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		QSignalSpy finished(&device, &AvrDevice::volumeRampFinished);
+		device.rampVolume(600, 5000);
+		QTRY_VERIFY(!receiver.received.isEmpty());
+		receiver.volume = 200;
+		receiver.send("MV20\r");
+		QTRY_COMPARE(finished.count(), 1);
+		QVERIFY(!finished[0][0].toBool());
+		QVERIFY(!device.rampingVolume());
+	}
+
+	void testCancelledByCommand()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		QSignalSpy finished(&device, &AvrDevice::volumeRampFinished);
+		device.rampVolume(600, 5000);
+		device.setVolume(350);
+		QCOMPARE(finished.count(), 1);
+		QVERIFY(!finished[0][0].toBool());
+		QTRY_COMPARE(device.volume().value(), 350);
+	}
+};
+
+QTEST_MAIN(TestRamp)
+#include "test_ramp.moc"
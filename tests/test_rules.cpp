@@ -0,0 +1,193 @@
+#include <QSignalSpy>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+#include "RulesEngine.hpp"
+#include "marantzuart.hpp"
+
+#include <cstring>
+#include <memory>
+
+using namespace eu::tgcm::avrremote;
+using eu::tgcm::avrcommand::Source;
+
+class TestRules : public QObject
+{
+	Q_OBJECT
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+		receiver.received.clear();
+	}
+
+	static void process(AvrDevice& device, char const* data)
+	{
+		device.processResponse(data, static_cast<int>(std::strlen(data)));
+	}
+
+  private slots:
+	void testFromVariantMap()
+	{
+		AvrDevice device;
+		QVariantMap map{{"when", QVariantMap{{"source", 4}, {"standby", false}, {"volume", QVariantMap{{">", 600}}}}},
+		                {"then", QVariantList{QVariantMap{{"volume", 350}}, QVariantMap{{"zone2On", true}}}}};
+		RulesEngine::Rule rule;
+		QString error;
+		QVERIFY(RulesEngine::fromVariantMap(map, &device, nullptr, rule, &error));
+		QVERIFY(error.isEmpty());
+		QCOMPARE(rule.device, &device);
+		QVERIFY(rule.target == nullptr);
+		QCOMPARE(rule.conditions.size(), std::size_t{3});
+		// ordered by name
+		QVERIFY(rule.conditions[0].property == DeviceProperty::Source);
+		QVERIFY(rule.conditions[0].comparison == RulesEngine::Comparison::Equal);
+		QCOMPARE(rule.conditions[0].value, 4);
+		QVERIFY(rule.conditions[1].property == DeviceProperty::Standby);
+		QCOMPARE(rule.conditions[1].value, 0);
+		QVERIFY(rule.conditions[2].property == DeviceProperty::Volume);
+		QVERIFY(rule.conditions[2].comparison == RulesEngine::Comparison::Greater);
+		QCOMPARE(rule.conditions[2].value, 600);
+		QCOMPARE(rule.scene.targets().size(), std::size_t{2});
+
+		// a condition that does not parse rejects the whole rule, which is left unchanged
+		auto const invalid = QList<QVariantMap>{
+		    QVariantMap{{"when", QVariantMap{{"source", 4}, {"unknown", 1}}}},
+		    QVariantMap{{"when", QVariantMap{{"volume", QVariantMap{{">=", 600}}}}}},
+		    QVariantMap{{"when", QVariantMap{{"volume", QVariantMap{{">", 600}, {"<", 700}}}}}},
+		    QVariantMap{{"when", QVariantMap{{"volume", "loud"}}}},
+		    QVariantMap{{"when", QVariantMap{{"volume", QVariantMap{{">", "loud"}}}}}},
+		    QVariantMap{{"when", QVariantMap{}}},
+		    QVariantMap{{"when", QVariantMap{{"source", 4}}}, {"then", QVariantList{QVariantMap{{"loudness", 1}}}}}};
+		for (auto const& m : invalid)
+		{
+			error.clear();
+			QVERIFY(!RulesEngine::fromVariantMap(m, &device, nullptr, rule, &error));
+			QVERIFY(!error.isEmpty());
+			QCOMPARE(rule.conditions.size(), std::size_t{3});
+		}
+	}
+
+	void testEdges()
+	{
+		AvrDevice device;
+		RulesEngine engine;
+		RulesEngine::Rule rule;
+		rule.device = &device;
+		rule.conditions = {{DeviceProperty::Source, RulesEngine::Comparison::Equal, static_cast<int>(Source::TV)},
+		                   {DeviceProperty::Volume, RulesEngine::Comparison::Less, 500}};
+		rule.scene.setZone2On(true);
+		QCOMPARE(engine.addRule(RulesEngine::Rule{}), -1);
+		int id = engine.addRule(rule);
+		QVERIFY(id > 0);
+		QCOMPARE(device.rulesEngine(), &engine);
+		QSignalSpy fired(&engine, &RulesEngine::ruleFired);
+
+		process(device, "MV45\rSITV\r");
+		QCOMPARE(fired.count(), 1);
+		QCOMPARE(fired[0][0].toInt(), id);
+		// still true, does not fire again
+		process(device, "SITV\rMV40\r");
+		QCOMPARE(fired.count(), 1);
+		// false, then true again
+		process(device, "MV60\rMV40\r");
+		QCOMPARE(fired.count(), 2);
+		process(device, "SICD\rSITV\r");
+		QCOMPARE(fired.count(), 3);
+
+		// only the rules depending on the property changed are evaluated
+		auto evaluations = engine.evaluations();
+		process(device, "MUON\rPWON\rZ2ON\r");
+		QCOMPARE(engine.evaluations(), evaluations);
+
+		engine.removeRule(id);
+		QCOMPARE(engine.ruleCount(), 0);
+		QVERIFY(device.rulesEngine() == nullptr);
+		process(device, "SICD\rSITV\r");
+		QCOMPARE(fired.count(), 3);
+	}
+
+	void testManyRules()
+	{
+		std::vector<std::unique_ptr<AvrDevice>> devices;
+		RulesEngine engine;
+		for (int i = 0; i < 100; ++i)
+		{
+			devices.emplace_back(new AvrDevice);
+			for (int v = 0; v < 20; ++v)
+			{
+				RulesEngine::Rule rule;
+				rule.device = devices.back().get();
+				rule.conditions = {{DeviceProperty::Volume, RulesEngine::Comparison::Equal, v * 10}};
+				rule.scene.setMuted(true);
+				engine.addRule(rule);
+			}
+			RulesEngine::Rule rule;
+			rule.device = devices.back().get();
+			rule.conditions = {{DeviceProperty::Source, RulesEngine::Comparison::Equal, 0}};
+			engine.addRule(rule);
+		}
+		QCOMPARE(engine.ruleCount(), 2100);
+		QSignalSpy fired(&engine, &RulesEngine::ruleFired);
+		process(*devices[42], "MV10\r");
+		QCOMPARE(engine.evaluations(), std::uint64_t{20});
+		QCOMPARE(fired.count(), 1);
+
+		// the rules of a deleted device are removed
+		devices.erase(devices.begin() + 42);
+		QCOMPARE(engine.ruleCount(), 2079);
+		process(*devices[42], "SIPHONO\r");
+		QCOMPARE(engine.evaluations(), std::uint64_t{21});
+		QCOMPARE(fired.count(), 2);
+	}
+
+	void testBatch()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		AvrDevice other;
+
+		RulesEngine engine;
+		RulesEngine::Rule tv;
+		tv.device = &device;
+		tv.conditions = {{DeviceProperty::Source, RulesEngine::Comparison::Equal, static_cast<int>(Source::TV)}};
+		tv.scene.setVolume(350).setZone2On(true);
+		engine.addRule(tv);
+		RulesEngine::Rule loud;
+		loud.device = &device;
+		loud.conditions = {{DeviceProperty::Volume, RulesEngine::Comparison::Greater, 600}};
+		loud.scene.setVolume(400).setMuted(false);
+		engine.addRule(loud);
+		// rules of another device may target this one
+		RulesEngine::Rule remote;
+		remote.device = &other;
+		remote.target = &device;
+		remote.conditions = {{DeviceProperty::Muted, RulesEngine::Comparison::Equal, 1}};
+		remote.scene.setMuted(true);
+		engine.addRule(remote);
+
+		QSignalSpy fired(&engine, &RulesEngine::ruleFired);
+		receiver.send("MV70\rSITV\r");
+		QTRY_COMPARE(fired.count(), 2);
+		// a single write, the latest rule setting the volume wins
+		QTRY_COMPARE(receiver.received, (QList<QByteArray>{"MV35", "MUOFF", "Z2ON"}));
+		QTRY_COMPARE(device.volume().value(), 350);
+		QTRY_VERIFY(device.zoneOn(1));
+		QVERIFY(!device.muted());
+
+		receiver.received.clear();
+		process(other, "MUON\r");
+		QCOMPARE(fired.count(), 3);
+		QTRY_COMPARE(receiver.received, (QList<QByteArray>{"MUON"}));
+		QTRY_VERIFY(device.muted());
+	}
+};
+
+QTEST_MAIN(TestRules)
+#include "test_rules.moc"
@@ -0,0 +1,69 @@
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "DeviceScanner.hpp"
+#include "FakeReceiver.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+/**
+ * The whole 127.0.0.0/8 range is routed to the loopback interface on Linux, so each emulated receiver
+ * gets its own address
+ */
+class TestScanner : public QObject
+{
+	Q_OBJECT
+  private slots:
+	void testInvalidRange()
+	{
+		DeviceScanner scanner;
+		QVERIFY(!scanner.start(QStringLiteral("not a range")));
+		QVERIFY(!scanner.start(QStringLiteral("::1/128")));
+		QVERIFY(!scanner.isRunning());
+	}
+
+	void testScan_data()
+	{
+		QTest::addColumn<int>("maxConcurrent");
+		QTest::newRow("sequential") << 1;
+		QTest::newRow("concurrent") << 256;
+	}
+
+	void testScan()
+	{
+		QFETCH(int, maxConcurrent);
+		FakeReceiver r2, r5, r9;
+		QVERIFY(r2.listen(QHostAddress(QStringLiteral("127.0.0.2"))));
+		auto port = r2.port();
+		QVERIFY(r5.listen(QHostAddress(QStringLiteral("127.0.0.5")), port));
+		QVERIFY(r9.listen(QHostAddress(QStringLiteral("127.0.0.9")), port));
+		// accepts connections, but does not speak the protocol
+		QTcpServer silent;
+		QVERIFY(silent.listen(QHostAddress(QStringLiteral("127.0.0.7")), port));
+
+		DeviceScanner scanner;
+		scanner.setPort(port);
+		scanner.setTimeoutMs(300);
+		scanner.setMaxConcurrent(maxConcurrent);
+		QSignalSpy finished(&scanner, &DeviceScanner::finished);
+		QVERIFY(scanner.start(QStringLiteral("127.0.0.0/28")));
+		QVERIFY(scanner.isRunning());
+		QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 10000);
+		QVERIFY(!scanner.isRunning());
+
+		auto found = scanner.foundAddresses();
+		found.sort();
+		QCOMPARE(found, (QStringList{"127.0.0.2", "127.0.0.5", "127.0.0.9"}));
+		QCOMPARE(r2.received, QList<QByteArray>{"PW?"});
+
+		auto devices = scanner.createDevices(this);
+		QCOMPARE(devices.size(), 3);
+		QCOMPARE(devices[0]->port(), int(port));
+		qDeleteAll(devices);
+	}
+};
+
+QTEST_MAIN(TestScanner)
+#include "test_scanner.moc"
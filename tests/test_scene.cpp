@@ -0,0 +1,170 @@
+#include <QTest>
+
+#include "AvrDevice.hpp"
+#include "FakeReceiver.hpp"
+#include "Scene.hpp"
+#include "marantzuart.hpp"
+
+using namespace eu::tgcm::avrremote;
+using eu::tgcm::avrcommand::Source;
+
+class TestScene : public QObject
+{
+	Q_OBJECT
+
+	struct Result
+	{
+		bool finished = false;
+		bool success = false;
+		int commandsSent = 0;
+		QStringList failed;
+	};
+
+	static void watch(SceneOperation* op, Result& result)
+	{
+		connect(op, &SceneOperation::finished, [op, &result](bool success) {
+			result.finished = true;
+			result.success = success;
+			result.commandsSent = op->commandsSent();
+			result.failed = op->failedProperties();
+		});
+	}
+
+	static void connectTo(AvrDevice& device, FakeReceiver& receiver)
+	{
+		device.setAddress(QStringLiteral("127.0.0.1"));
+		device.setPort(receiver.port());
+		device.connectToDevice();
+		// the device queries the power status once connected
+		QTRY_VERIFY(device.snapshot().standby.state() == RemoteProperty::UpToDate);
+	}
+
+  private slots:
+	void testFromVariantList()
+	{
+		QVariantList list{QVariantMap{{"standby", false}}, QVariantMap{{"source", 3}},
+		                  QVariantMap{{"volume", 450}}};
+		Scene scene;
+		QVERIFY(Scene::fromVariantList(list, scene));
+		QCOMPARE(scene.targets().size(), std::size_t(3));
+		QVERIFY(scene.targets()[0].property == DeviceProperty::Standby);
+		QCOMPARE(scene.targets()[0].value, 0);
+		QVERIFY(scene.targets()[1].property == DeviceProperty::Source);
+		QCOMPARE(scene.targets()[1].value, 3);
+		QVERIFY(scene.targets()[2].property == DeviceProperty::Volume);
+		QCOMPARE(scene.targets()[2].value, 450);
+
+		// rejected as a whole, the scene being left unchanged
+		QString error;
+		QVERIFY(!Scene::fromVariantList(list + QVariantList{QVariantMap{{"unknown", 1}}}, scene, &error));
+		QVERIFY(!error.isEmpty());
+		QCOMPARE(scene.targets().size(), std::size_t(3));
+		QVERIFY(!Scene::fromVariantList(QVariantList{QVariantMap{{"volume", 450}, {"standby", false}}}, scene));
+		QVERIFY(!Scene::fromVariantList(QVariantList{QVariantMap{{"volume", "loud"}}}, scene));
+		QVERIFY(!Scene::fromVariantList(QVariantList{QVariantMap{{"maxVolume", 600}}}, scene));
+		QVERIFY(!Scene::fromVariantList(QVariantList{450}, scene));
+		QVERIFY(Scene::fromVariantList(QVariantList{QVariantMap{{"muted", true}}}, scene));
+		QCOMPARE(scene.targets().size(), std::size_t(1));
+		QCOMPARE(scene.targets()[0].value, 1);
+	}
+
+	void testSkipsMatchingTargets()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+
+		Scene scene;
+		scene.setStandby(false).setSource(Source::Bluray).setVolume(450).setMuted(false);
+		Result result;
+		watch(SceneOperation::apply(scene, {&device}, 5000), result);
+		QTRY_VERIFY(result.finished);
+		QVERIFY(result.success);
+		QCOMPARE(result.commandsSent, 3);
+		QCOMPARE(receiver.received, (QList<QByteArray>{"PW?", "SIBD", "MV45", "MUOFF"}));
+		QVERIFY(device.currentSource().source() == Source::Bluray);
+		QCOMPARE(device.volume().value(), 450);
+
+		// applying it again does nothing
+		receiver.received.clear();
+		Result again;
+		watch(SceneOperation::apply(scene, {&device}, 5000), again);
+		QTRY_VERIFY(again.finished);
+		QVERIFY(again.success);
+		QCOMPARE(again.commandsSent, 0);
+		QVERIFY(receiver.received.isEmpty());
+	}
+
+	void testMultipleDevices()
+	{
+		FakeReceiver r1, r2;
+		QVERIFY(r1.listen());
+		QVERIFY(r2.listen());
+		r2.power = false;
+		AvrDevice d1, d2;
+		connectTo(d1, r1);
+		connectTo(d2, r2);
+
+		Scene scene;
+		scene.setStandby(false).setVolume(455);
+		Result result;
+		watch(SceneOperation::apply(scene, {&d1, &d2}, 5000), result);
+		QTRY_VERIFY(result.finished);
+		QVERIFY(result.success);
+		QCOMPARE(result.commandsSent, 3);
+		QCOMPARE(r1.received, (QList<QByteArray>{"PW?", "MV455"}));
+		QCOMPARE(r2.received, (QList<QByteArray>{"PW?", "PWON", "MV455"}));
+	}
+
+	void testTimeout()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		receiver.echo = false;
+
+		Scene scene;
+		scene.setVolume(450).setStandby(false);
+		Result result;
+		watch(SceneOperation::apply(scene, {&device}, 200), result);
+		QTRY_VERIFY(result.finished);
+		QVERIFY(!result.success);
+		QCOMPARE(result.failed, QStringList{"volume"});
+	}
+
+	void testDisconnected()
+	{
+		FakeReceiver receiver;
+		QVERIFY(receiver.listen());
+		AvrDevice device;
+		connectTo(device, receiver);
+		receiver.echo = false;
+
+		Scene scene;
+		scene.setMuted(true);
+		Result result;
+		watch(SceneOperation::apply(scene, {&device}, 60000), result);
+		QTRY_VERIFY(receiver.received.size() == 2);
+		receiver.disconnectClients();
+		QTRY_VERIFY(result.finished);
+		QVERIFY(!result.success);
+		QCOMPARE(result.failed, QStringList{"muted"});
+	}
+
+	void testNotConnected()
+	{
+		AvrDevice device;
+		Result result;
+		watch(device.applyScene(QVariantList{QVariantMap{{"muted", true}}}), result);
+		QVERIFY(!result.finished); // always asynchronous
+		QTRY_VERIFY(result.finished);
+		QVERIFY(!result.success);
+		QCOMPARE(result.failed, QStringList{"muted"});
+		QVERIFY(device.applyScene(QVariantList{QVariantMap{{"volum", 450}}}) == nullptr);
+	}
+};
+
+QTEST_MAIN(TestScene)
+#include "test_scene.moc"
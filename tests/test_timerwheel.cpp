@@ -0,0 +1,93 @@
+#include <QElapsedTimer>
+#include <QTest>
+
+#include "TimerWheel.hpp"
+
+#include <functional>
+#include <vector>
+
+using namespace eu::tgcm::avrremote;
+
+class TestTimerWheel : public QObject
+{
+	Q_OBJECT
+
+  private slots:
+	void testFire()
+	{
+		TimerWheel wheel(10, 64);
+		QElapsedTimer elapsed;
+		elapsed.start();
+		std::vector<std::pair<int, qint64>> fired;
+		auto record = [&fired, &elapsed](int id) {
+			return [&fired, &elapsed, id] { fired.emplace_back(id, elapsed.elapsed()); };
+		};
+		auto late = wheel.start(50, record(1));
+		wheel.start(20, record(2));
+		// longer than a turn of the wheel (640 ms)
+		wheel.start(700, record(3));
+		QVERIFY(wheel.isActive(late));
+		QCOMPARE(wheel.activeTimers(), std::size_t{3});
+		QTRY_COMPARE(fired.size(), std::size_t{3});
+		QCOMPARE(fired[0].first, 2);
+		QCOMPARE(fired[1].first, 1);
+		QCOMPARE(fired[2].first, 3);
+		// never early
+		QVERIFY(fired[0].second >= 20);
+		QVERIFY(fired[1].second >= 50);
+		QVERIFY(fired[2].second >= 700);
+		QVERIFY(!wheel.isActive(late));
+		QCOMPARE(wheel.activeTimers(), std::size_t{0});
+	}
+
+	void testCancel()
+	{
+		TimerWheel wheel(10, 64);
+		std::vector<int> fired;
+		auto cancelled = wheel.start(20, [&fired] { fired.push_back(1); });
+		TimerWheel::TimerId second = 0;
+		// expires during the same tick as second, which it cancels
+		wheel.start(40, [&fired, &wheel, &second] {
+			fired.push_back(2);
+			QVERIFY(wheel.cancel(second));
+		});
+		second = wheel.start(40, [&fired] { fired.push_back(3); });
+		QVERIFY(wheel.cancel(cancelled));
+		QVERIFY(!wheel.cancel(cancelled));
+		QVERIFY(!wheel.isActive(cancelled));
+		QTest::qWait(100);
+		QCOMPARE(fired, std::vector<int>{2});
+		QCOMPARE(wheel.activeTimers(), std::size_t{0});
+	}
+
+	void testRestart()
+	{
+		TimerWheel wheel(10, 64);
+		int count = 0;
+		std::function<void()> heartbeat = [&] {
+			if (++count < 5)
+				wheel.start(15, heartbeat);
+		};
+		wheel.start(15, heartbeat);
+		QTRY_COMPARE(count, 5);
+		QCOMPARE(wheel.activeTimers(), std::size_t{0});
+	}
+
+	void testCoalescing()
+	{
+		TimerWheel wheel(100, 64);
+		int count = 0;
+		for (int i = 0; i < 1000; ++i)
+			wheel.start(i % 300, [&count] { count += 1; });
+		QTRY_COMPARE(count, 1000);
+	}
+
+	void testForCurrentThread()
+	{
+		QVERIFY(TimerWheel::forCurrentThread() != nullptr);
+		QCOMPARE(TimerWheel::forCurrentThread(), TimerWheel::forCurrentThread());
+	}
+};
+
+QTEST_MAIN(TestTimerWheel)
+#include "test_timerwheel.moc"
@@ -0,0 +1,39 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+
+#define AVRCONTROL_ENABLE_TRACING
+#include "Trace.hpp"
+
+using namespace eu::tgcm::avrremote;
+
+class TestTrace : public QObject
+{
+	Q_OBJECT
+  private slots:
+	void testExport()
+	{
+		trace::clear();
+		{
+			AVR_TRACE_SPAN("outer");
+			AVR_TRACE_SPAN("inner \"quoted\"");
+		}
+		auto text = trace::exportChromeTrace();
+		QJsonParseError error;
+		auto doc = QJsonDocument::fromJson(QByteArray::fromStdString(text), &error);
+		QVERIFY(error.error == QJsonParseError::NoError);
+		auto events = doc.object().value(QStringLiteral("traceEvents")).toArray();
+		QVERIFY(events.size() == 2);
+		// spans are recorded when they end
+		QVERIFY(events[0].toObject().value(QStringLiteral("name")).toString() == QStringLiteral("inner \"quoted\""));
+		auto outer = events[1].toObject();
+		QVERIFY(outer.value(QStringLiteral("name")).toString() == QStringLiteral("outer"));
+		QVERIFY(outer.value(QStringLiteral("ph")).toString() == QStringLiteral("X"));
+		auto innerDuration = events[0].toObject().value(QStringLiteral("dur")).toDouble();
+		QVERIFY(outer.value(QStringLiteral("dur")).toDouble() >= innerDuration);
+	}
+};
+
+QTEST_MAIN(TestTrace)
+#include "test_trace.moc"
@@ -0,0 +1,69 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+
+#include "AvrDevice.hpp"
+#include "DeviceProxy.hpp"
+
+#include <cstdio>
+
+using eu::tgcm::avrremote::AvrDevice;
+using eu::tgcm::avrremote::DeviceProxy;
+
+/**
+ * Holds the only control connection to a receiver, and lets any number of local clients share it (see
+ * DeviceProxy)
+ */
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName(QStringLiteral("avrproxy"));
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QStringLiteral("Shares the control connection of a receiver"));
+	parser.addHelpOption();
+	parser.addPositionalArgument(QStringLiteral("address"), QStringLiteral("Address of the receiver"));
+	QCommandLineOption portOption(QStringLiteral("port"), QStringLiteral("Control port of the receiver"),
+	                              QStringLiteral("port"), QStringLiteral("23"));
+	QCommandLineOption listenOption(QStringLiteral("listen"), QStringLiteral("Port clients connect to"),
+	                                QStringLiteral("port"), QStringLiteral("2323"));
+	QCommandLineOption bindOption(QStringLiteral("bind"), QStringLiteral("Address clients connect to"),
+	                              QStringLiteral("address"), QStringLiteral("127.0.0.1"));
+	QCommandLineOption dialectOption(QStringLiteral("dialect"), QStringLiteral("Protocol dialect, marantz or denon"),
+	                                 QStringLiteral("dialect"), QStringLiteral("marantz"));
+	parser.addOptions({portOption, listenOption, bindOption, dialectOption});
+	parser.process(app);
+	if (parser.positionalArguments().size() != 1)
+		parser.showHelp(1);
+
+	AvrDevice device;
+	device.setName(parser.positionalArguments().front());
+	device.setAddress(parser.positionalArguments().front());
+	device.setPort(parser.value(portOption).toInt());
+	if (parser.value(dialectOption) == QLatin1String("denon"))
+		device.setDialect(AvrDevice::Denon);
+	else if (parser.value(dialectOption) != QLatin1String("marantz"))
+		parser.showHelp(1);
+
+	DeviceProxy proxy(&device);
+	if (!proxy.listen(static_cast<quint16>(parser.value(listenOption).toUInt()),
+	                  QHostAddress(parser.value(bindOption))))
+	{
+		std::fprintf(stderr, "Cannot listen on %s:%s\n", qPrintable(parser.value(bindOption)),
+		             qPrintable(parser.value(listenOption)));
+		return 1;
+	}
+
+	// reconnect after a while when the connection is lost or cannot be established
+	QTimer reconnect;
+	reconnect.setSingleShot(true);
+	reconnect.setInterval(2000);
+	QObject::connect(&reconnect, &QTimer::timeout, &device, &AvrDevice::connectToDevice);
+	QObject::connect(&device, &AvrDevice::connectionStatusChanged, [&device, &reconnect] {
+		if (device.connectionStatus() == AvrDevice::Unconnected)
+			reconnect.start();
+	});
+	device.connectToDevice();
+
+	return app.exec();
+}